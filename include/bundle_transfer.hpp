@@ -0,0 +1,449 @@
+#ifndef ICOMMANDS_BUNDLE_TRANSFER_HPP
+#define ICOMMANDS_BUNDLE_TRANSFER_HPP
+
+#include "rodsClient.h"
+#include "transfer_engine.hpp"
+#include "ustar.hpp"
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // which files go into bundles and how large a bundle grows before it
+    // is registered
+    struct bundle_options {
+        bundle_options() :
+            max_file_size( 1024 * 1024 ),
+            max_files( 512 ),
+            max_bytes( 64 * 1024 * 1024 ) {
+        }
+
+        off_t  max_file_size;
+        size_t max_files;
+        size_t max_bytes;
+    };
+
+    // =-=-=-=-=-=-=-
+    // a name for a temporary bundle data object that no other client or
+    // worker will use: .<tool>_bundle_<host>_<pid>_<seq>.tar
+    inline std::string bundle_name( const std::string& _coll, const char* _tool ) {
+        static std::atomic< unsigned int > seq( 0 );
+        char host[ 64 ] = "";
+        gethostname( host, sizeof( host ) - 1 );
+        char name[ 160 ];
+        snprintf( name, sizeof( name ), ".%s_bundle_%s_%d_%u.tar",
+                  _tool, host, static_cast< int >( getpid() ), seq++ );
+        return _coll + "/" + name;
+    }
+
+    // =-=-=-=-=-=-=-
+    // remove a temporary bundle without keeping it in the trash
+    inline int remove_bundle( rcComm_t* _conn, const std::string& _path ) {
+        dataObjInp_t dataObjInp;
+        memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+        rstrcpy( dataObjInp.objPath, _path.c_str(), MAX_NAME_LEN );
+        addKeyVal( &dataObjInp.condInput, FORCE_FLAG_KW, "" );
+        int status = rcDataObjUnlink( _conn, &dataObjInp );
+        clearKeyVal( &dataObjInp.condInput );
+        return status;
+    }
+
+    // =-=-=-=-=-=-=-
+    // an upload_engine that packs small files into tar bundles instead of
+    // putting them one at a time.  each worker streams the files it takes
+    // into a bundle data object below the collection they belong in,
+    // writing as it goes, and once the bundle is full, or the files are
+    // for another collection, or the queue is empty, has the server
+    // extract it and register all of its files in one bulk
+    // rcStructFileExtAndReg, then removes it.  files larger than
+    // max_file_size, and files given on their own, are put as usual, as
+    // are the files of a bundle that could not be written or extracted.
+    class bundle_upload_engine : public upload_engine {
+    public:
+        bundle_upload_engine(
+            rodsEnv&              _env,
+            const upload_options& _opts,
+            const bundle_options& _bundle_opts ) :
+            upload_engine( _env, _opts ),
+            bundle_opts_( _bundle_opts ) {
+        }
+
+    protected:
+        int put_file( rcComm_t* _conn, const upload_item& _item ) {
+            if ( _item.base.empty() || _item.size > bundle_opts_.max_file_size ) {
+                return upload_engine::put_file( _conn, _item );
+            }
+
+            // small files are read whole, so the header records what was
+            // actually read even if the file changed after it was found
+            std::string contents;
+            int status = read_file( _item.local, contents );
+            if ( status < 0 ) {
+                return status;
+            }
+
+            bundle& b = bundle_for( _conn );
+            if ( b.fd >= 0 && b.base != _item.base ) {
+                close_bundle( _conn, b );
+            }
+            std::string header;
+            if ( !ustar::write_header( _item.relative, contents.size(), _item.mode,
+                                       _item.mtime, ustar::REGULAR, header ) ) {
+                // the name does not fit a ustar header
+                return upload_engine::put_file( _conn, _item );
+            }
+            if ( b.fd < 0 ) {
+                status = open_bundle( _conn, b, _item.base );
+                if ( status < 0 ) {
+                    return status;
+                }
+            }
+
+            b.buf += header;
+            b.buf += contents;
+            b.buf.append( ustar::padding( contents.size() ), '\0' );
+            b.files.push_back( _item );
+            b.bytes += contents.size();
+
+            if ( b.buf.size() >= WRITE_SIZE ) {
+                status = write_buffer( _conn, b );
+                if ( status < 0 ) {
+                    abort_bundle( _conn, b, status );
+                    return DEFERRED;
+                }
+            }
+            if ( b.files.size() >= bundle_opts_.max_files || b.bytes >= bundle_opts_.max_bytes ) {
+                close_bundle( _conn, b );
+            }
+            return DEFERRED;
+        }
+
+        void finish( rcComm_t* _conn ) {
+            bundle& b = bundle_for( _conn );
+            if ( b.fd >= 0 ) {
+                close_bundle( _conn, b );
+            }
+        }
+
+    private:
+        static const size_t WRITE_SIZE = 4 * 1024 * 1024;
+
+        struct bundle {
+            bundle() :
+                fd( -1 ),
+                bytes( 0 ) {
+            }
+
+            int                        fd;
+            std::string                path;
+            std::string                base;
+            std::string                buf;
+            std::vector< upload_item > files;
+            size_t                     bytes;
+        };
+
+        bundle& bundle_for( rcComm_t* _conn ) {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            return bundles_[ _conn ];
+        }
+
+        static int read_file( const std::string& _path, std::string& _contents ) {
+            int fd = open( _path.c_str(), O_RDONLY );
+            if ( fd < 0 ) {
+                return UNIX_FILE_OPEN_ERR - errno;
+            }
+            char buf[ 65536 ];
+            ssize_t n;
+            while ( ( n = read( fd, buf, sizeof( buf ) ) ) > 0 ) {
+                _contents.append( buf, n );
+            }
+            int status = n < 0 ? UNIX_FILE_READ_ERR - errno : 0;
+            close( fd );
+            return status;
+        }
+
+        int open_bundle( rcComm_t* _conn, bundle& _b, const std::string& _base ) {
+            _b.path = bundle_name( _base, "iput" );
+            _b.base = _base;
+
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _b.path.c_str(), MAX_NAME_LEN );
+            dataObjInp.createMode = 0600;
+            dataObjInp.openFlags  = O_WRONLY;
+            dataObjInp.dataSize   = -1;
+            addKeyVal( &dataObjInp.condInput, DATA_TYPE_KW, "tar file" );
+            if ( !opts_.resource.empty() ) {
+                addKeyVal( &dataObjInp.condInput, DEST_RESC_NAME_KW, opts_.resource.c_str() );
+            }
+            int status = rcDataObjCreate( _conn, &dataObjInp );
+            clearKeyVal( &dataObjInp.condInput );
+            if ( status < 0 ) {
+                return status;
+            }
+            _b.fd = status;
+            return 0;
+        }
+
+        int write_buffer( rcComm_t* _conn, bundle& _b ) {
+            openedDataObjInp_t writeInp;
+            memset( &writeInp, 0, sizeof( writeInp ) );
+            writeInp.l1descInx = _b.fd;
+            writeInp.len       = static_cast< int >( _b.buf.size() );
+
+            bytesBuf_t writeBuf;
+            writeBuf.len = writeInp.len;
+            writeBuf.buf = &_b.buf[ 0 ];
+            int status = rcDataObjWrite( _conn, &writeInp, &writeBuf );
+            if ( status >= 0 && status != writeInp.len ) {
+                status = SYS_COPY_LEN_ERR;
+            }
+            _b.buf.clear();
+            return status < 0 ? status : 0;
+        }
+
+        int close_data_object( rcComm_t* _conn, bundle& _b ) {
+            openedDataObjInp_t closeInp;
+            memset( &closeInp, 0, sizeof( closeInp ) );
+            closeInp.l1descInx = _b.fd;
+            _b.fd = -1;
+            return rcDataObjClose( _conn, &closeInp );
+        }
+
+        // give up on a bundle and put its files one at a time instead,
+        // so that each one that still fails is reported by its own path
+        void abort_bundle( rcComm_t* _conn, bundle& _b, int _status ) {
+            rodsLogError( LOG_ERROR, _status, "bundle %s of %d files failed, putting them one at a time",
+                          _b.path.c_str(), static_cast< int >( _b.files.size() ) );
+            if ( _b.fd >= 0 ) {
+                close_data_object( _conn, _b );
+            }
+            remove_bundle( _conn, _b.path );
+            _b.buf.clear();
+            _b.bytes = 0;
+
+            std::vector< upload_item > files;
+            files.swap( _b.files );
+            for ( size_t i = 0; i < files.size(); ++i ) {
+                int status = upload_engine::put_file( _conn, files[ i ] );
+                if ( status < 0 ) {
+                    failed( files[ i ].local, status );
+                    continue;
+                }
+                stats_.add( files[ i ].size );
+                if ( opts_.verbose ) {
+                    printf( "   %s  %lld bytes\n", files[ i ].local.c_str(),
+                            static_cast< long long >( files[ i ].size ) );
+                }
+            }
+        }
+
+        void close_bundle( rcComm_t* _conn, bundle& _b ) {
+            ustar::write_end( _b.buf );
+            int status = write_buffer( _conn, _b );
+            if ( status < 0 ) {
+                abort_bundle( _conn, _b, status );
+                return;
+            }
+            status = close_data_object( _conn, _b );
+            if ( status < 0 ) {
+                abort_bundle( _conn, _b, status );
+                return;
+            }
+
+            structFileExtAndRegInp_t extInp;
+            memset( &extInp, 0, sizeof( extInp ) );
+            rstrcpy( extInp.objPath, _b.path.c_str(), MAX_NAME_LEN );
+            rstrcpy( extInp.collection, _b.base.c_str(), MAX_NAME_LEN );
+            addKeyVal( &extInp.condInput, BULK_OPR_KW, "" );
+            addKeyVal( &extInp.condInput, DATA_TYPE_KW, "tar file" );
+            if ( opts_.force ) {
+                addKeyVal( &extInp.condInput, FORCE_FLAG_KW, "" );
+            }
+            if ( !opts_.resource.empty() ) {
+                addKeyVal( &extInp.condInput, DEST_RESC_NAME_KW, opts_.resource.c_str() );
+            }
+            status = rcStructFileExtAndReg( _conn, &extInp );
+            clearKeyVal( &extInp.condInput );
+            if ( status < 0 ) {
+                abort_bundle( _conn, _b, status );
+                return;
+            }
+
+            stats_.add( _b.bytes, _b.files.size() );
+            if ( opts_.verbose ) {
+                for ( size_t i = 0; i < _b.files.size(); ++i ) {
+                    printf( "   %s  (bundled)\n", _b.files[ i ].local.c_str() );
+                }
+            }
+            status = remove_bundle( _conn, _b.path );
+            if ( status < 0 ) {
+                rodsLogError( LOG_ERROR, status, "could not remove bundle %s", _b.path.c_str() );
+            }
+            _b.files.clear();
+            _b.bytes = 0;
+        }
+
+        const bundle_options            bundle_opts_;
+        std::mutex                      mutex_;
+        std::map< rcComm_t*, bundle >   bundles_;
+
+    }; // class bundle_upload_engine
+
+    // =-=-=-=-=-=-=-
+    // download the collection _coll into the local directory _dir by
+    // having the server bundle it into a temporary tar data object with
+    // rcStructFileBundle, which is then read as one stream and unpacked
+    // as it arrives.  the bundle is made in _work_coll, which must be
+    // writable, and removed afterwards.  local files are only replaced
+    // if _force is set.
+    inline int bundle_download(
+        rcComm_t*          _conn,
+        const std::string& _coll,
+        const std::string& _dir,
+        const std::string& _work_coll,
+        const std::string& _resource,
+        bool               _force,
+        bool               _verbose,
+        transfer_stats&    _stats ) {
+        std::string path = bundle_name( _work_coll, "iget" );
+
+        structFileExtAndRegInp_t bunInp;
+        memset( &bunInp, 0, sizeof( bunInp ) );
+        rstrcpy( bunInp.objPath, path.c_str(), MAX_NAME_LEN );
+        rstrcpy( bunInp.collection, _coll.c_str(), MAX_NAME_LEN );
+        addKeyVal( &bunInp.condInput, DATA_TYPE_KW, "tar file" );
+        if ( !_resource.empty() ) {
+            addKeyVal( &bunInp.condInput, DEST_RESC_NAME_KW, _resource.c_str() );
+        }
+        int status = rcStructFileBundle( _conn, &bunInp );
+        clearKeyVal( &bunInp.condInput );
+        if ( status < 0 ) {
+            rodsLogError( LOG_ERROR, status, "could not bundle %s", _coll.c_str() );
+            return status;
+        }
+
+        dataObjInp_t dataObjInp;
+        memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+        rstrcpy( dataObjInp.objPath, path.c_str(), MAX_NAME_LEN );
+        dataObjInp.openFlags = O_RDONLY;
+        int l1descInx = rcDataObjOpen( _conn, &dataObjInp );
+        if ( l1descInx < 0 ) {
+            rodsLogError( LOG_ERROR, l1descInx, "could not open bundle %s", path.c_str() );
+            remove_bundle( _conn, path );
+            return l1descInx;
+        }
+
+        if ( mkdir( _dir.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+            status = UNIX_FILE_MKDIR_ERR - errno;
+        }
+
+        // the member being written, and its size and times
+        int         out = -1;
+        std::string out_path;
+        ustar::entry current;
+        ustar::reader reader(
+            [&]( const ustar::entry& _entry ) {
+                // only relative names without .. may be unpacked
+                const std::string& name = _entry.name;
+                if ( name.empty() || name[ 0 ] == '/' || name == ".." ||
+                        name.compare( 0, 3, "../" ) == 0 ||
+                        name.find( "/../" ) != std::string::npos ||
+                        ( name.size() >= 3 && name.compare( name.size() - 3, 3, "/.." ) == 0 ) ) {
+                    return SYS_INVALID_FILE_PATH;
+                }
+                current = _entry;
+                out_path = _dir + "/" + name;
+                for ( size_t slash = out_path.find( '/', _dir.size() + 1 );
+                        slash != std::string::npos; slash = out_path.find( '/', slash + 1 ) ) {
+                    mkdir( out_path.substr( 0, slash ).c_str(), 0755 );
+                }
+                if ( _entry.type == ustar::DIRECTORY ) {
+                    if ( mkdir( out_path.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+                        return UNIX_FILE_MKDIR_ERR - errno;
+                    }
+                    return 0;
+                }
+                int flags = O_WRONLY | O_CREAT | O_TRUNC | ( _force ? 0 : O_EXCL );
+                out = open( out_path.c_str(), flags, _entry.mode & 0777 ? _entry.mode & 0777 : 0644 );
+                if ( out < 0 ) {
+                    return errno == EEXIST ? OVERWRITE_WITHOUT_FORCE_FLAG : UNIX_FILE_OPEN_ERR - errno;
+                }
+                return 0;
+            },
+            [&]( const char* _buf, size_t _len ) {
+                while ( _len > 0 ) {
+                    ssize_t n = write( out, _buf, _len );
+                    if ( n < 0 ) {
+                        return UNIX_FILE_WRITE_ERR - errno;
+                    }
+                    _buf += n;
+                    _len -= n;
+                }
+                return 0;
+            },
+            [&]() {
+                close( out );
+                out = -1;
+                struct timeval times[ 2 ];
+                times[ 0 ].tv_sec = times[ 1 ].tv_sec = current.mtime;
+                times[ 0 ].tv_usec = times[ 1 ].tv_usec = 0;
+                utimes( out_path.c_str(), times );
+                _stats.add( current.size );
+                if ( _verbose ) {
+                    printf( "   %s  %lld bytes\n", out_path.c_str(),
+                            static_cast< long long >( current.size ) );
+                }
+                return 0;
+            } );
+
+        std::vector< char > buf( 4 * 1024 * 1024 );
+        while ( status >= 0 && !reader.done() ) {
+            openedDataObjInp_t readInp;
+            memset( &readInp, 0, sizeof( readInp ) );
+            readInp.l1descInx = l1descInx;
+            readInp.len       = static_cast< int >( buf.size() );
+            bytesBuf_t readBuf;
+            readBuf.len = readInp.len;
+            readBuf.buf = &buf[ 0 ];
+            int n = rcDataObjRead( _conn, &readInp, &readBuf );
+            if ( n <= 0 ) {
+                status = n < 0 ? n : reader.done() ? 0 : SYS_COPY_LEN_ERR;
+                break;
+            }
+            status = reader.feed( &buf[ 0 ], n );
+        }
+        if ( out >= 0 ) {
+            close( out );
+            unlink( out_path.c_str() );
+        }
+        if ( status < 0 ) {
+            rodsLogError( LOG_ERROR, status, "could not unpack %s into %s",
+                          _coll.c_str(), _dir.c_str() );
+        }
+
+        openedDataObjInp_t closeInp;
+        memset( &closeInp, 0, sizeof( closeInp ) );
+        closeInp.l1descInx = l1descInx;
+        rcDataObjClose( _conn, &closeInp );
+        int remove_status = remove_bundle( _conn, path );
+        if ( remove_status < 0 ) {
+            rodsLogError( LOG_ERROR, remove_status, "could not remove bundle %s", path.c_str() );
+        }
+        return status;
+
+    } // bundle_download
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_BUNDLE_TRANSFER_HPP
@@ -0,0 +1,344 @@
+#ifndef ICOMMANDS_CATALOG_SYNC_HPP
+#define ICOMMANDS_CATALOG_SYNC_HPP
+
+#include "rodsClient.h"
+#include "genquery_pager.hpp"
+#include "transfer_engine.hpp"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // what the catalog records for a good replica of a data object
+    struct catalog_entry {
+        off_t       size;
+        time_t      modify_time;
+        std::string checksum;
+    };
+
+    // =-=-=-=-=-=-=-
+    // the data objects and collections under some collections, fetched
+    // with one paged general query per tree rather than a stat per
+    // object, and held in hash tables by full path.  only good replicas
+    // are listed; where a data object has several, the first is kept.
+    class catalog_index {
+    public:
+        // add the data objects and collections in _coll and below it
+        int add_tree( rcComm_t* _conn, const std::string& _coll ) {
+            char cond[ MAX_NAME_LEN * 2 + 32 ];
+            snprintf( cond, sizeof( cond ), " = '%s' || like '%s/%%' ", _coll.c_str(), _coll.c_str() );
+            int status = query_collections( _conn, cond );
+            if ( status < 0 ) {
+                return status;
+            }
+            return query_objects( _conn, cond, NULL );
+        }
+
+        // add the one data object _path, if there is one
+        int add_object( rcComm_t* _conn, const std::string& _path ) {
+            size_t slash = _path.rfind( '/' );
+            if ( slash == std::string::npos ) {
+                return USER_INPUT_PATH_ERR;
+            }
+            char coll_cond[ MAX_NAME_LEN + 8 ];
+            char name_cond[ MAX_NAME_LEN + 8 ];
+            snprintf( coll_cond, sizeof( coll_cond ), "= '%s'",
+                      slash == 0 ? "/" : _path.substr( 0, slash ).c_str() );
+            snprintf( name_cond, sizeof( name_cond ), "= '%s'", _path.c_str() + slash + 1 );
+            return query_objects( _conn, coll_cond, name_cond );
+        }
+
+        const catalog_entry* find( const std::string& _path ) const {
+            std::unordered_map< std::string, catalog_entry >::const_iterator it = objects_.find( _path );
+            return it == objects_.end() ? NULL : &it->second;
+        }
+
+        bool has_collection( const std::string& _coll ) const {
+            return collections_.count( _coll ) > 0;
+        }
+
+        const std::unordered_set< std::string >& collections() const {
+            return collections_;
+        }
+
+        size_t objects() const {
+            return objects_.size();
+        }
+
+        // add the rows of one page of the data object query, which
+        // selects the collection, name, size, modify time and checksum
+        int add_rows( genQueryOut_t* _out ) {
+            sqlResult_t* colls     = getSqlResultByInx( _out, COL_COLL_NAME );
+            sqlResult_t* names     = getSqlResultByInx( _out, COL_DATA_NAME );
+            sqlResult_t* sizes     = getSqlResultByInx( _out, COL_DATA_SIZE );
+            sqlResult_t* times     = getSqlResultByInx( _out, COL_D_MODIFY_TIME );
+            sqlResult_t* checksums = getSqlResultByInx( _out, COL_D_DATA_CHECKSUM );
+            if ( colls == NULL || names == NULL || sizes == NULL || times == NULL || checksums == NULL ) {
+                return UNMATCHED_KEY_OR_INDEX;
+            }
+            std::string path;
+            for ( int i = 0; i < _out->rowCnt; ++i ) {
+                const char* coll = colls->value + i * colls->len;
+                path = coll;
+                if ( path != "/" ) {
+                    path += "/";
+                }
+                path += names->value + i * names->len;
+
+                catalog_entry entry;
+                entry.size        = strtoll( sizes->value + i * sizes->len, NULL, 10 );
+                entry.modify_time = strtoll( times->value + i * times->len, NULL, 10 );
+                entry.checksum    = checksums->value + i * checksums->len;
+                objects_.insert( std::make_pair( path, entry ) );
+            }
+            return 0;
+        }
+
+    private:
+        int query_collections( rcComm_t* _conn, const char* _coll_cond ) {
+            genQueryInp_t genQueryInp;
+            memset( &genQueryInp, 0, sizeof( genQueryInp ) );
+            addInxIval( &genQueryInp.selectInp, COL_COLL_NAME, 0 );
+            addInxVal( &genQueryInp.sqlCondInp, COL_COLL_NAME, _coll_cond );
+
+            genQueryOut_t* genQueryOut = NULL;
+            int status;
+            {
+                prefetch_pager pager( _conn, &genQueryInp, &genQueryOut );
+                status = pager.first();
+                while ( status == 0 ) {
+                    sqlResult_t* colls = getSqlResultByInx( genQueryOut, COL_COLL_NAME );
+                    if ( colls == NULL ) {
+                        status = UNMATCHED_KEY_OR_INDEX;
+                        break;
+                    }
+                    for ( int i = 0; i < genQueryOut->rowCnt; ++i ) {
+                        collections_.insert( colls->value + i * colls->len );
+                    }
+                    if ( !pager.more() ) {
+                        break;
+                    }
+                    status = pager.next();
+                }
+            }
+            clearGenQueryInp( &genQueryInp );
+            return status == CAT_NO_ROWS_FOUND ? 0 : status;
+        }
+
+        int query_objects( rcComm_t* _conn, const char* _coll_cond, const char* _name_cond ) {
+            genQueryInp_t genQueryInp;
+            memset( &genQueryInp, 0, sizeof( genQueryInp ) );
+            addInxIval( &genQueryInp.selectInp, COL_COLL_NAME, 0 );
+            addInxIval( &genQueryInp.selectInp, COL_DATA_NAME, 0 );
+            addInxIval( &genQueryInp.selectInp, COL_DATA_SIZE, 0 );
+            addInxIval( &genQueryInp.selectInp, COL_D_MODIFY_TIME, 0 );
+            addInxIval( &genQueryInp.selectInp, COL_D_DATA_CHECKSUM, 0 );
+            addInxVal( &genQueryInp.sqlCondInp, COL_COLL_NAME, _coll_cond );
+            if ( _name_cond != NULL ) {
+                addInxVal( &genQueryInp.sqlCondInp, COL_DATA_NAME, _name_cond );
+            }
+            addInxVal( &genQueryInp.sqlCondInp, COL_D_REPL_STATUS, "= '1'" );
+
+            genQueryOut_t* genQueryOut = NULL;
+            int status;
+            {
+                prefetch_pager pager( _conn, &genQueryInp, &genQueryOut );
+                status = pager.first();
+                while ( status == 0 ) {
+                    status = add_rows( genQueryOut );
+                    if ( status < 0 || !pager.more() ) {
+                        break;
+                    }
+                    status = pager.next();
+                }
+            }
+            clearGenQueryInp( &genQueryInp );
+            return status == CAT_NO_ROWS_FOUND ? 0 : status;
+        }
+
+        std::unordered_map< std::string, catalog_entry > objects_;
+        std::unordered_set< std::string >                collections_;
+
+    }; // class catalog_index
+
+    // =-=-=-=-=-=-=-
+    // settings for sync_upload_engine.  max_age is in seconds, and 0
+    // means files of any age are synchronized.
+    struct sync_options {
+        sync_options() :
+            size_only( false ),
+            list_only( false ),
+            max_age( 0 ) {
+        }
+
+        bool   size_only;
+        bool   list_only;
+        time_t max_age;
+    };
+
+    // =-=-=-=-=-=-=-
+    // an upload_engine that sends only the files that differ from what
+    // the catalog holds.  the listing of every target collection is
+    // fetched into a catalog_index before the local trees are walked,
+    // and each file is then compared against it by the scanner that
+    // finds it, so that the workers start on the first file that
+    // differs while the scan goes on.
+    //
+    // as with irsync, a file is sent if there is no data object for it
+    // or the sizes differ, and otherwise, unless only sizes are
+    // compared, if its checksum differs.  the scanner checksums the file
+    // with chksumLocFile in the scheme of the checksum in the catalog.
+    // only a data object without a checksum costs a round trip: a
+    // worker has the server compute and register one before comparing.
+    class sync_upload_engine : public upload_engine {
+    public:
+        sync_upload_engine( rodsEnv& _env, const upload_options& _opts, const sync_options& _sync ) :
+            upload_engine( _env, with_sync( _opts ) ),
+            sync_( _sync ),
+            now_( time( NULL ) ),
+            listed_( 0 ) {
+        }
+
+        // index the targets of _sources, then upload what differs
+        int run(
+            rcComm_t*                         _conn,
+            const std::vector< std::string >& _sources,
+            const std::vector< std::string >& _targets ) {
+            for ( size_t i = 0; i < _sources.size(); ++i ) {
+                struct stat st;
+                if ( stat( _sources[ i ].c_str(), &st ) != 0 ) {
+                    continue; // reported by upload_engine::run
+                }
+                int status = S_ISDIR( st.st_mode ) ?
+                             index_.add_tree( _conn, _targets[ i ] ) :
+                             index_.add_object( _conn, _targets[ i ] );
+                if ( status < 0 ) {
+                    rodsLogError( LOG_ERROR, status, "listing %s failed", _targets[ i ].c_str() );
+                    return status;
+                }
+            }
+            const std::unordered_set< std::string >& colls = index_.collections();
+            for ( std::unordered_set< std::string >::const_iterator it = colls.begin(); it != colls.end(); ++it ) {
+                collection_exists( *it );
+            }
+            return upload_engine::run( _conn, _sources, _targets );
+        }
+
+        const catalog_index& index() const {
+            return index_;
+        }
+
+        // the files -l listed as needing synchronization
+        size_t listed() const {
+            return listed_;
+        }
+
+    protected:
+        bool wanted( const upload_item& _item ) {
+            if ( _item.collection ) {
+                return !sync_.list_only && !index_.has_collection( _item.remote );
+            }
+            if ( sync_.max_age > 0 && now_ - _item.mtime > sync_.max_age ) {
+                return false;
+            }
+            int status = compare( _item );
+            if ( status < 0 ) {
+                failed( _item.local, status );
+                return false;
+            }
+            if ( status == SAME ) {
+                stats_.skip();
+                return false;
+            }
+            if ( status == DIFFERENT && sync_.list_only ) {
+                list( _item );
+                return false;
+            }
+            return true;
+        }
+
+        // settle a file the catalog has no checksum for, then upload it
+        // if it differs
+        int put_file( rcComm_t* _conn, const upload_item& _item ) {
+            const catalog_entry* entry = index_.find( _item.remote );
+            if ( entry != NULL && entry->size == _item.size && entry->checksum.empty() ) {
+                std::string remote;
+                int status = object_checksum( _conn, _item.remote, remote );
+                if ( status < 0 ) {
+                    return status;
+                }
+                std::string local;
+                status = local_checksum( _item.local, remote, local );
+                if ( status < 0 ) {
+                    return status;
+                }
+                if ( local == remote ) {
+                    return SKIPPED;
+                }
+            }
+            if ( sync_.list_only ) {
+                list( _item );
+                return SKIPPED;
+            }
+            return upload_engine::put_file( _conn, _item );
+        }
+
+    private:
+        // what compare found
+        static const int SAME      = 0;
+        static const int DIFFERENT = 1;
+        static const int UNKNOWN   = 2;
+
+        static upload_options with_sync( upload_options _opts ) {
+            _opts.force    = true;
+            _opts.checksum = true;
+            return _opts;
+        }
+
+        int compare( const upload_item& _item ) const {
+            const catalog_entry* entry = index_.find( _item.remote );
+            if ( entry == NULL || entry->size != _item.size ) {
+                return DIFFERENT;
+            }
+            if ( sync_.size_only ) {
+                return SAME;
+            }
+            if ( entry->checksum.empty() ) {
+                return UNKNOWN;
+            }
+            std::string local;
+            int status = local_checksum( _item.local, entry->checksum, local );
+            if ( status < 0 ) {
+                return status;
+            }
+            return local == entry->checksum ? SAME : DIFFERENT;
+        }
+
+        void list( const upload_item& _item ) {
+            ++listed_;
+            printf( "   %-60s %12lld   N\n", _item.local.c_str(), static_cast< long long >( _item.size ) );
+        }
+
+        const sync_options    sync_;
+        const time_t          now_;
+        catalog_index         index_;
+        std::atomic< size_t > listed_;
+
+    }; // class sync_upload_engine
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_CATALOG_SYNC_HPP
@@ -0,0 +1,388 @@
+#ifndef ICOMMANDS_CONNECTION_BROKER_HPP
+#define ICOMMANDS_CONNECTION_BROKER_HPP
+
+#include "rodsClient.h"
+#include "packStruct.h"
+#include "rodsPackTable.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // the wire protocol between the icommands and iagent, the local agent
+    // that keeps logged in connections open.  a client opens a session
+    // on the agent's Unix domain socket, introduces itself with HELLO and
+    // is then lent one of the agent's server connections for as long as
+    // the session lasts, so continued queries work as on a direct
+    // connection.  the agent refuses a HELLO when all its connections
+    // are lent, rather than keep the client waiting for one.  each
+    // message is a native endian u32 type and u32 body length followed
+    // by the body; each reply is an i32 status and a u8 flag saying what
+    // follows: nothing, the output, or the server's error stack for a
+    // failed request.  queries and outputs are packed with packStruct in
+    // NATIVE_PROT.
+    namespace broker {
+
+        enum message_t {
+            HELLO = 1,      // body: identity(); reply: status
+            GEN_QUERY,      // body: packed genQueryInp_t; output: genQueryOut_t
+            SPECIFIC_QUERY, // body: packed specificQueryInp_t; output: genQueryOut_t
+            QUERY2,         // body: query NUL header NUL; output: the reply
+            STATUS,         // output: a line of text describing the agent
+            STOP,           // the agent stops accepting sessions and exits
+            CONTROL         // as HELLO, for a session that only sends STATUS
+                            // and STOP, and so is never refused for want of
+                            // a connection
+        };
+
+        enum reply_t {
+            NO_OUTPUT = 0,
+            OUTPUT,         // the output follows
+            ERROR_STACK     // each message: i32 status, text, NUL
+        };
+
+        static const uint32_t MAX_MESSAGE = 1024 * 1024 * 1024;
+
+        // the agent's socket: $IRODS_AGENT_SOCKET, or agent.sock next to
+        // the other client files in ~/.irods
+        inline std::string socket_path() {
+            const char* path = getenv( "IRODS_AGENT_SOCKET" );
+            if ( path != NULL && *path != '\0' ) {
+                return path;
+            }
+            const char* home = getenv( "HOME" );
+            return std::string( home != NULL ? home : "" ) + "/.irods/agent.sock";
+        }
+
+        // the server and user that a session's connections are for; the
+        // agent only lends connections to clients with the same identity
+        inline std::string identity( const rodsEnv& _env ) {
+            char port[ 16 ];
+            snprintf( port, sizeof( port ), "%d", _env.rodsPort );
+            return std::string( _env.rodsHost ) + ":" + port + "/" +
+                   _env.rodsUserName + "#" + _env.rodsZone;
+        }
+
+        inline bool write_all( int _fd, const char* _buf, size_t _len ) {
+            while ( _len > 0 ) {
+                ssize_t n = send( _fd, _buf, _len, MSG_NOSIGNAL );
+                if ( n < 0 && errno == EINTR ) {
+                    continue;
+                }
+                if ( n <= 0 ) {
+                    return false;
+                }
+                _buf += n;
+                _len -= n;
+            }
+            return true;
+        }
+
+        inline bool read_all( int _fd, char* _buf, size_t _len ) {
+            while ( _len > 0 ) {
+                ssize_t n = recv( _fd, _buf, _len, 0 );
+                if ( n < 0 && errno == EINTR ) {
+                    continue;
+                }
+                if ( n <= 0 ) {
+                    return false;
+                }
+                _buf += n;
+                _len -= n;
+            }
+            return true;
+        }
+
+        inline bool send_message( int _fd, uint32_t _type, const std::string& _body ) {
+            uint32_t header[ 2 ] = { _type, static_cast< uint32_t >( _body.size() ) };
+            return write_all( _fd, reinterpret_cast< const char* >( header ), sizeof( header ) ) &&
+                   write_all( _fd, _body.data(), _body.size() );
+        }
+
+        inline bool recv_message( int _fd, uint32_t& _type, std::string& _body ) {
+            uint32_t header[ 2 ];
+            if ( !read_all( _fd, reinterpret_cast< char* >( header ), sizeof( header ) ) ||
+                    header[ 1 ] > MAX_MESSAGE ) {
+                return false;
+            }
+            _type = header[ 0 ];
+            _body.resize( header[ 1 ] );
+            return header[ 1 ] == 0 || read_all( _fd, &_body[ 0 ], header[ 1 ] );
+        }
+
+        inline std::string make_reply( int _status, const char* _out = NULL, size_t _len = 0 ) {
+            std::string reply( reinterpret_cast< const char* >( &_status ), sizeof( _status ) );
+            reply += static_cast< char >( _out != NULL ? OUTPUT : NO_OUTPUT );
+            if ( _out != NULL ) {
+                reply.append( _out, _len );
+            }
+            return reply;
+        }
+
+        // the reply to a failed request, carrying the messages the server
+        // left on the connection's error stack
+        inline std::string make_error_reply( int _status, const rError_t* _err ) {
+            std::string reply( reinterpret_cast< const char* >( &_status ), sizeof( _status ) );
+            reply += static_cast< char >( ERROR_STACK );
+            for ( int i = 0; i < _err->len; ++i ) {
+                const rErrMsg_t* msg = _err->errMsg[ i ];
+                reply.append( reinterpret_cast< const char* >( &msg->status ), sizeof( msg->status ) );
+                reply.append( msg->msg, strnlen( msg->msg, ERR_MSG_LEN ) );
+                reply += '\0';
+            }
+            return reply;
+        }
+
+        inline void add_errors( const std::string& _stack, rError_t* _err ) {
+            size_t pos = 0;
+            while ( pos + sizeof( int ) < _stack.size() ) {
+                int status = 0;
+                memcpy( &status, _stack.data() + pos, sizeof( status ) );
+                pos += sizeof( status );
+                size_t end = _stack.find( '\0', pos );
+                if ( end == std::string::npos ) {
+                    end = _stack.size();
+                }
+                addRErrorMsg( _err, status, _stack.substr( pos, end - pos ).c_str() );
+                pos = end + 1;
+            }
+        }
+
+        inline int pack( void* _in, const char* _instruction, std::string& _packed ) {
+            bytesBuf_t* packed = NULL;
+            int status = packStruct( _in, &packed, _instruction, RodsPackTable, 0, NATIVE_PROT );
+            if ( status < 0 ) {
+                return status;
+            }
+            _packed.assign( static_cast< const char* >( packed->buf ), packed->len );
+            freeBBuf( packed );
+            return 0;
+        }
+
+        inline int unpack( const std::string& _packed, const char* _instruction, void** _out ) {
+            return unpackStruct( _packed.data(), _out, _instruction, RodsPackTable, NATIVE_PROT );
+        }
+
+        // the socket of each connection that is a session with the agent
+        class session_table {
+        public:
+            void add( rcComm_t* _conn, int _fd ) {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                fds_[ _conn ] = _fd;
+            }
+
+            // the session's socket, or -1 for a direct connection
+            int find( rcComm_t* _conn ) {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                std::map< rcComm_t*, int >::const_iterator it = fds_.find( _conn );
+                return it == fds_.end() ? -1 : it->second;
+            }
+
+            int remove( rcComm_t* _conn ) {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                std::map< rcComm_t*, int >::iterator it = fds_.find( _conn );
+                if ( it == fds_.end() ) {
+                    return -1;
+                }
+                int fd = it->second;
+                fds_.erase( it );
+                return fd;
+            }
+
+        private:
+            std::mutex                 mutex_;
+            std::map< rcComm_t*, int > fds_;
+
+        }; // class session_table
+
+        inline session_table& sessions() {
+            static session_table table;
+            return table;
+        }
+
+        // send a request on a session and wait for the reply.  returns the
+        // status of the request on the server, with _has_out telling
+        // whether _out holds an output, or SYS_SOCK_READ_ERR if the
+        // session failed.  the server's messages for a failed request
+        // are added to _err when it is given.
+        inline int call(
+            int                _fd,
+            uint32_t           _type,
+            const std::string& _request,
+            std::string&       _out,
+            bool&              _has_out,
+            rError_t*          _err = NULL ) {
+            uint32_t    type = 0;
+            std::string reply;
+            _has_out = false;
+            if ( !send_message( _fd, _type, _request ) ||
+                    !recv_message( _fd, type, reply ) ||
+                    reply.size() < sizeof( int ) + 1 ) {
+                return SYS_SOCK_READ_ERR;
+            }
+            int status = 0;
+            memcpy( &status, reply.data(), sizeof( status ) );
+            char flag = reply[ sizeof( int ) ];
+            _out.assign( reply, sizeof( int ) + 1, std::string::npos );
+            _has_out = flag == OUTPUT;
+            if ( flag == ERROR_STACK ) {
+                if ( _err != NULL ) {
+                    add_errors( _out, _err );
+                }
+                _out.clear();
+            }
+            return status;
+        }
+
+        // connect to the agent and open a session for _identity with a
+        // HELLO or CONTROL message, returning the socket,
+        // USER_SOCK_CONNECT_ERR if no agent is listening, or the error the
+        // agent refused the session with: CAT_INVALID_USER when it serves
+        // someone else, SYS_MAX_CONNECT_COUNT_EXCEEDED when it has no
+        // connection to lend
+        inline int open_session( const std::string& _identity, uint32_t _hello = HELLO ) {
+            std::string path = socket_path();
+            struct sockaddr_un addr;
+            memset( &addr, 0, sizeof( addr ) );
+            if ( path.size() >= sizeof( addr.sun_path ) ) {
+                return USER_SOCK_CONNECT_ERR;
+            }
+            addr.sun_family = AF_UNIX;
+            strncpy( addr.sun_path, path.c_str(), sizeof( addr.sun_path ) - 1 );
+
+            int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+            if ( fd < 0 ) {
+                return USER_SOCK_CONNECT_ERR;
+            }
+            if ( connect( fd, reinterpret_cast< struct sockaddr* >( &addr ), sizeof( addr ) ) != 0 ) {
+                close( fd );
+                return USER_SOCK_CONNECT_ERR;
+            }
+
+            std::string out;
+            bool        has_out = false;
+            int status = call( fd, _hello, _identity, out, has_out );
+            if ( status != 0 ) {
+                close( fd );
+                return status < 0 ? status : SYS_SOCK_READ_ERR;
+            }
+            return fd;
+        }
+
+    }; // namespace broker
+
+    // =-=-=-=-=-=-=-
+    // the client shim.  broker_connect borrows a connection from the
+    // agent when one is running for the same server and user, and
+    // otherwise connects directly as rcConnect does, as it also does
+    // when the agent has no connection to spare.  a borrowed connection
+    // is a placeholder rcComm_t that only the functions below accept; it
+    // is already logged in, so broker_login does nothing for it, and it
+    // must be released with broker_disconnect.  its rError holds the
+    // messages the server sent for relayed requests that failed, so
+    // printErrorStack works on it as on a direct connection.
+    inline rcComm_t* broker_connect( const rodsEnv& _env, rErrMsg_t* _err ) {
+        int fd = broker::open_session( broker::identity( _env ) );
+        if ( fd < 0 ) {
+            return rcConnect( _env.rodsHost, _env.rodsPort, _env.rodsUserName,
+                              _env.rodsZone, 0, _err );
+        }
+
+        rcComm_t* conn = static_cast< rcComm_t* >( calloc( 1, sizeof( rcComm_t ) ) );
+        conn->rError = static_cast< rError_t* >( calloc( 1, sizeof( rError_t ) ) );
+        conn->sock = -1;
+        conn->portNum = _env.rodsPort;
+        rstrcpy( conn->host, _env.rodsHost, NAME_LEN );
+        rstrcpy( conn->proxyUser.userName, _env.rodsUserName, NAME_LEN );
+        rstrcpy( conn->proxyUser.rodsZone, _env.rodsZone, NAME_LEN );
+        rstrcpy( conn->clientUser.userName, _env.rodsUserName, NAME_LEN );
+        rstrcpy( conn->clientUser.rodsZone, _env.rodsZone, NAME_LEN );
+        broker::sessions().add( conn, fd );
+        return conn;
+    }
+
+    inline int broker_login( rcComm_t* _conn ) {
+        if ( broker::sessions().find( _conn ) >= 0 ) {
+            return 0;
+        }
+        return clientLogin( _conn );
+    }
+
+    inline int broker_disconnect( rcComm_t* _conn ) {
+        int fd = broker::sessions().remove( _conn );
+        if ( fd < 0 ) {
+            return rcDisconnect( _conn );
+        }
+        close( fd );
+        freeRError( _conn->rError );
+        free( _conn );
+        return 0;
+    }
+
+    // =-=-=-=-=-=-=-
+    // rcGenQuery, relayed through the agent for a borrowed connection
+    inline int gen_query( rcComm_t* _conn, genQueryInp_t* _inp, genQueryOut_t** _out ) {
+        int fd = broker::sessions().find( _conn );
+        if ( fd < 0 ) {
+            return rcGenQuery( _conn, _inp, _out );
+        }
+
+        *_out = NULL;
+        std::string request;
+        int status = broker::pack( _inp, "GenQueryInp_PI", request );
+        if ( status < 0 ) {
+            return status;
+        }
+        std::string out;
+        bool        has_out = false;
+        status = broker::call( fd, broker::GEN_QUERY, request, out, has_out, _conn->rError );
+        if ( has_out ) {
+            int unpack_status = broker::unpack( out, "GenQueryOut_PI", reinterpret_cast< void** >( _out ) );
+            if ( unpack_status < 0 ) {
+                return unpack_status;
+            }
+        }
+        return status;
+    }
+
+    // =-=-=-=-=-=-=-
+    // rcSpecificQuery, relayed through the agent for a borrowed connection
+    inline int specific_query( rcComm_t* _conn, specificQueryInp_t* _inp, genQueryOut_t** _out ) {
+        int fd = broker::sessions().find( _conn );
+        if ( fd < 0 ) {
+            return rcSpecificQuery( _conn, _inp, _out );
+        }
+
+        *_out = NULL;
+        std::string request;
+        int status = broker::pack( _inp, "specificQueryInp_PI", request );
+        if ( status < 0 ) {
+            return status;
+        }
+        std::string out;
+        bool        has_out = false;
+        status = broker::call( fd, broker::SPECIFIC_QUERY, request, out, has_out, _conn->rError );
+        if ( has_out ) {
+            int unpack_status = broker::unpack( out, "GenQueryOut_PI", reinterpret_cast< void** >( _out ) );
+            if ( unpack_status < 0 ) {
+                return unpack_status;
+            }
+        }
+        return status;
+    }
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_CONNECTION_BROKER_HPP
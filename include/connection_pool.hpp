@@ -0,0 +1,125 @@
+#ifndef ICOMMANDS_CONNECTION_POOL_HPP
+#define ICOMMANDS_CONNECTION_POOL_HPP
+
+#include "rodsClient.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // a small set of logged in connections to the server in the client's
+    // environment, for running independent requests side by side.  an
+    // existing connection may be adopted as the first one; the pool only
+    // disconnects the connections it opened itself.
+    class connection_pool {
+    public:
+        explicit connection_pool( rodsEnv& _env, rcComm_t* _first = NULL ) :
+            env_( _env ),
+            owned_from_( 0 ) {
+            if ( _first != NULL ) {
+                conns_.push_back( _first );
+                owned_from_ = 1;
+            }
+        }
+
+        ~connection_pool() {
+            for ( size_t i = owned_from_; i < conns_.size(); ++i ) {
+                rcDisconnect( conns_[ i ] );
+            }
+        }
+
+        // grow the pool to _count connections.  returns the number of
+        // connections in the pool, or the error of the first failed
+        // connection attempt if there are none.
+        int open( size_t _count ) {
+            int status = 0;
+            while ( conns_.size() < _count ) {
+                rErrMsg_t err_msg;
+                rcComm_t* conn = rcConnect(
+                                     env_.rodsHost, env_.rodsPort,
+                                     env_.rodsUserName, env_.rodsZone,
+                                     0, &err_msg );
+                if ( conn == NULL ) {
+                    status = err_msg.status < 0 ? err_msg.status : USER_SOCK_CONNECT_ERR;
+                    break;
+                }
+                status = clientLogin( conn );
+                if ( status != 0 ) {
+                    rcDisconnect( conn );
+                    break;
+                }
+                conns_.push_back( conn );
+            }
+            if ( conns_.empty() ) {
+                return status < 0 ? status : USER_SOCK_CONNECT_ERR;
+            }
+            return static_cast< int >( conns_.size() );
+        }
+
+        size_t size() const {
+            return conns_.size();
+        }
+
+        rcComm_t* at( size_t _idx ) const {
+            return conns_[ _idx ];
+        }
+
+        const std::vector< rcComm_t* >& connections() const {
+            return conns_;
+        }
+
+    private:
+        connection_pool( const connection_pool& );
+        connection_pool& operator=( const connection_pool& );
+
+        rodsEnv&                 env_;
+        std::vector< rcComm_t* > conns_;
+        size_t                   owned_from_;
+
+    }; // class connection_pool
+
+    // =-=-=-=-=-=-=-
+    // run tasks 0 to _count - 1, each on one of _conns, with one thread
+    // per connection taking the next task as it finishes its last.  a
+    // connection is only ever used by one task at a time.
+    inline void run_on_connections(
+        const std::vector< rcComm_t* >&                   _conns,
+        size_t                                            _count,
+        const std::function< void( rcComm_t*, size_t ) >& _task ) {
+        std::atomic< size_t > next( 0 );
+        auto run = [&]( rcComm_t* _conn ) {
+            for ( size_t task = next++; task < _count; task = next++ ) {
+                _task( _conn, task );
+            }
+        };
+
+        std::vector< std::thread > threads;
+        for ( size_t i = 1; i < _conns.size() && i < _count; ++i ) {
+            threads.push_back( std::thread( run, _conns[ i ] ) );
+        }
+        if ( !_conns.empty() ) {
+            run( _conns[ 0 ] );
+        }
+        for ( size_t i = 0; i < threads.size(); ++i ) {
+            threads[ i ].join();
+        }
+
+    } // run_on_connections
+
+    // =-=-=-=-=-=-=-
+    // run tasks 0 to _count - 1 on the pool's connections
+    inline void run_on_pool(
+        const connection_pool&                            _pool,
+        size_t                                            _count,
+        const std::function< void( rcComm_t*, size_t ) >& _task ) {
+        run_on_connections( _pool.connections(), _count, _task );
+
+    } // run_on_pool
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_CONNECTION_POOL_HPP
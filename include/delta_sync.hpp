@@ -0,0 +1,539 @@
+#ifndef ICOMMANDS_DELTA_SYNC_HPP
+#define ICOMMANDS_DELTA_SYNC_HPP
+
+#include "rodsClient.h"
+#include "resumable_transfer.hpp"
+#include "transfer_engine.hpp"
+#include "irods_hasher_factory.hpp"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // what was last uploaded to a data object: the MD5 digest of each of
+    // its blocks in hex, the local file's size and time it came from, and the
+    // data object's size, modify time and checksum once it was written
+    struct delta_signature {
+        uint32_t                   block_size;
+        uint64_t                   local_size;
+        int64_t                    local_mtime;
+        uint64_t                   size;
+        std::string                modify_time;
+        std::string                checksum;
+        std::vector< std::string > blocks;
+    };
+
+    // the length of a block digest in a signature
+    static const size_t DELTA_DIGEST_SIZE = 32;
+
+    // the block size for a file of _size bytes: 64 KB, doubled until the
+    // file has no more than 65536 blocks
+    inline uint32_t delta_block_size( uint64_t _size ) {
+        uint32_t block_size = 64 * 1024;
+        while ( _size / block_size > 65536 && block_size < ( 1U << 30 ) ) {
+            block_size *= 2;
+        }
+        return block_size;
+    }
+
+    // the hex MD5 digest of a block, as the server's md5 scheme writes it
+    inline int delta_block_digest( const char* _buf, size_t _len, std::string& _digest ) {
+        irods::Hasher hasher;
+        irods::error ret = irods::getHasher( irods::MD5_NAME, hasher );
+        if ( ret.ok() ) {
+            ret = hasher.update( std::string( _buf, _len ) );
+        }
+        if ( ret.ok() ) {
+            ret = hasher.digest( _digest );
+        }
+        if ( !ret.ok() ) {
+            return ret.code();
+        }
+        return _digest.size() == DELTA_DIGEST_SIZE ? 0 : SYS_INTERNAL_ERR;
+    }
+
+    // =-=-=-=-=-=-=-
+    // signatures kept on disk under ~/.irods/delta_signatures, one file
+    // per data object, keyed by the server, zone, user and path
+    class signature_store {
+    public:
+        explicit signature_store( const rodsEnv& _env ) :
+            env_( _env ) {
+            const char* home = getenv( "HOME" );
+            if ( home != NULL ) {
+                dir_ = std::string( home ) + "/.irods/delta_signatures";
+            }
+        }
+
+        bool load( const std::string& _path, delta_signature& _sig ) const {
+            if ( dir_.empty() ) {
+                return false;
+            }
+            std::string key = key_of( _path );
+            int fd = open( file_of( key ).c_str(), O_RDONLY );
+            if ( fd < 0 ) {
+                return false;
+            }
+            std::string data;
+            char buf[ 65536 ];
+            ssize_t n;
+            while ( ( n = read( fd, buf, sizeof( buf ) ) ) > 0 ) {
+                data.append( buf, n );
+            }
+            close( fd );
+
+            size_t pos = 0;
+            uint64_t magic = 0;
+            std::string stored_key;
+            uint64_t count = 0;
+            if ( !take( data, pos, magic ) || magic != DELTA_SIGNATURE_MAGIC ||
+                    !take( data, pos, stored_key ) || stored_key != key ||
+                    !take( data, pos, _sig.block_size ) || _sig.block_size == 0 ||
+                    !take( data, pos, _sig.local_size ) ||
+                    !take( data, pos, _sig.local_mtime ) ||
+                    !take( data, pos, _sig.size ) ||
+                    !take( data, pos, _sig.modify_time ) ||
+                    !take( data, pos, _sig.checksum ) ||
+                    !take( data, pos, count ) ||
+                    data.size() - pos != count * DELTA_DIGEST_SIZE ) {
+                return false;
+            }
+            _sig.blocks.clear();
+            for ( uint64_t i = 0; i < count; ++i, pos += DELTA_DIGEST_SIZE ) {
+                _sig.blocks.push_back( data.substr( pos, DELTA_DIGEST_SIZE ) );
+            }
+            return true;
+        }
+
+        // write a signature through a temporary file, so that a reader
+        // never sees part of one
+        void store( const std::string& _path, const delta_signature& _sig ) const {
+            if ( dir_.empty() ) {
+                return;
+            }
+            std::string key = key_of( _path );
+            std::string data;
+            append( data, DELTA_SIGNATURE_MAGIC );
+            append( data, key );
+            append( data, _sig.block_size );
+            append( data, _sig.local_size );
+            append( data, _sig.local_mtime );
+            append( data, _sig.size );
+            append( data, _sig.modify_time );
+            append( data, _sig.checksum );
+            append( data, static_cast< uint64_t >( _sig.blocks.size() ) );
+            for ( size_t i = 0; i < _sig.blocks.size(); ++i ) {
+                data += _sig.blocks[ i ];
+            }
+
+            mkdir( dir_.substr( 0, dir_.rfind( '/' ) ).c_str(), 0700 );
+            mkdir( dir_.c_str(), 0700 );
+            std::string final_path = file_of( key );
+            char suffix[ 32 ];
+            snprintf( suffix, sizeof( suffix ), ".%d", static_cast< int >( getpid() ) );
+            std::string tmp_path = final_path + suffix;
+            int fd = open( tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+            if ( fd < 0 ) {
+                return;
+            }
+            bool ok = ::write( fd, data.data(), data.size() ) == static_cast< ssize_t >( data.size() );
+            ok = close( fd ) == 0 && ok;
+            if ( !ok || rename( tmp_path.c_str(), final_path.c_str() ) != 0 ) {
+                unlink( tmp_path.c_str() );
+            }
+        }
+
+    private:
+        static const uint64_t DELTA_SIGNATURE_MAGIC = 0x3230474953444349ULL; // "ICDSIG02"
+
+        template < typename T >
+        static void append( std::string& _data, T _value ) {
+            _data.append( reinterpret_cast< const char* >( &_value ), sizeof( _value ) );
+        }
+
+        static void append( std::string& _data, const std::string& _value ) {
+            append( _data, static_cast< uint32_t >( _value.size() ) );
+            _data += _value;
+        }
+
+        template < typename T >
+        static bool take( const std::string& _data, size_t& _pos, T& _value ) {
+            if ( _data.size() - _pos < sizeof( _value ) ) {
+                return false;
+            }
+            memcpy( &_value, _data.data() + _pos, sizeof( _value ) );
+            _pos += sizeof( _value );
+            return true;
+        }
+
+        static bool take( const std::string& _data, size_t& _pos, std::string& _value ) {
+            uint32_t len = 0;
+            if ( !take( _data, _pos, len ) || _data.size() - _pos < len ) {
+                return false;
+            }
+            _value = _data.substr( _pos, len );
+            _pos += len;
+            return true;
+        }
+
+        std::string key_of( const std::string& _path ) const {
+            char port[ 16 ];
+            snprintf( port, sizeof( port ), "%d", env_.rodsPort );
+            return std::string( "delta\n" ) + env_.rodsHost + ":" + port + "\n" +
+                   env_.rodsUserName + "#" + env_.rodsZone + "\n" + _path;
+        }
+
+        // the file for a key is named by the key's hash; the key is stored
+        // in the file as well to tell collisions apart
+        std::string file_of( const std::string& _key ) const {
+            char name[ 17 ];
+            snprintf( name, sizeof( name ), "%016llx",
+                      static_cast< unsigned long long >( journal_hash( _key ) ) );
+            return dir_ + "/" + name;
+        }
+
+        const rodsEnv& env_;
+        std::string    dir_;
+
+    }; // class signature_store
+
+    // =-=-=-=-=-=-=-
+    // an upload_engine that sends only the blocks of a file that changed
+    // since it was last uploaded this way.  the signature kept for a data
+    // object is only trusted while the data object's size, modify time
+    // and checksum are still the ones recorded after that upload.  a file
+    // without a trusted signature is first compared as irsync does, by
+    // size and then checksum in the data object's scheme, and if it
+    // differs is sent whole with rcDataObjPut, as by upload_engine;
+    // either way its signature is made from the local file.  a file
+    // whose size and time match its signature is not read at all.
+    //
+    // the server cannot compute signatures or build a data object from
+    // pieces of its old contents, so a block is only reused where it
+    // still lies at the same offset, as it does in disk images and HDF5
+    // files changed in place; data shifted by an insertion is resent
+    // from that point on.  changed blocks are written into the data
+    // object in place, and it is truncated if the file shrank.
+    class delta_upload_engine : public upload_engine {
+    public:
+        delta_upload_engine( rodsEnv& _env, const upload_options& _opts ) :
+            upload_engine( _env, with_delta( _opts ) ),
+            signatures_( _env ),
+            scanned_( 0 ) {
+        }
+
+        // the bytes of the files that were compared, sent or not
+        unsigned long long scanned() const {
+            return scanned_;
+        }
+
+    protected:
+        int put_file( rcComm_t* _conn, const upload_item& _item ) {
+            scanned_ += _item.size;
+
+            rodsObjStat_t* objStat = NULL;
+            int status = stat_object( _conn, _item.remote, objStat );
+            if ( status < 0 && status != USER_FILE_DOES_NOT_EXIST ) {
+                return status;
+            }
+            bool exists = status >= 0;
+            delta_signature next;
+            if ( exists ) {
+                next.size        = objStat->objSize;
+                next.modify_time = objStat->modifyTime;
+                next.checksum    = objStat->chksum;
+                freeRodsObjStat( objStat );
+            }
+            delta_signature sig;
+            bool trusted = exists && signatures_.load( _item.remote, sig ) &&
+                           sig.size == next.size &&
+                           sig.modify_time == next.modify_time &&
+                           sig.checksum == next.checksum;
+            if ( trusted && sig.local_size == static_cast< uint64_t >( _item.size ) &&
+                    sig.local_mtime == _item.mtime ) {
+                return SKIPPED;
+            }
+            bool same = false;
+            if ( exists && !trusted && next.size == static_cast< uint64_t >( _item.size ) ) {
+                status = same_contents( _conn, _item, next );
+                if ( status < 0 ) {
+                    return status;
+                }
+                same = status > 0;
+            }
+
+            int fd = open( _item.local.c_str(), O_RDONLY );
+            if ( fd < 0 ) {
+                return UNIX_FILE_OPEN_ERR - errno;
+            }
+            next.block_size  = trusted ? sig.block_size : delta_block_size( _item.size );
+            next.local_size  = _item.size;
+            next.local_mtime = _item.mtime;
+
+            // the data object already holds the file; sign it for next time
+            std::vector< bool > changed;
+            if ( same ) {
+                status = compare_blocks( fd, _item.size, delta_signature(), next, changed );
+                close( fd );
+                if ( status >= 0 && next.checksum.empty() ) {
+                    // record the checksum if the server registered one
+                    status = stat_object( _conn, _item.remote, objStat );
+                    if ( status >= 0 ) {
+                        next.modify_time = objStat->modifyTime;
+                        next.checksum    = objStat->chksum;
+                        freeRodsObjStat( objStat );
+                    }
+                }
+                if ( status < 0 ) {
+                    return status;
+                }
+                signatures_.store( _item.remote, next );
+                return SKIPPED;
+            }
+
+            // with nothing to go by, the file is sent whole
+            if ( !trusted ) {
+                status = compare_blocks( fd, _item.size, delta_signature(), next, changed );
+                close( fd );
+                if ( status >= 0 ) {
+                    status = upload_engine::put_file( _conn, _item );
+                }
+                if ( status >= 0 ) {
+                    status = record_object( _conn, _item, next );
+                }
+                return status < 0 ? status : 0;
+            }
+
+            // find the blocks that changed
+            status = compare_blocks( fd, _item.size, sig, next, changed );
+            if ( status < 0 ) {
+                close( fd );
+                return status;
+            }
+
+            bool any = sig.size != static_cast< uint64_t >( _item.size );
+            for ( size_t i = 0; i < changed.size() && !any; ++i ) {
+                any = changed[ i ];
+            }
+            if ( !any ) {
+                // only the file's time changed; remember it, so the file
+                // is not read again next time
+                close( fd );
+                signatures_.store( _item.remote, next );
+                return SKIPPED;
+            }
+
+            uint64_t sent = 0;
+            status = write_blocks( _conn, _item, fd, !next.checksum.empty(), changed, next, sent );
+            close( fd );
+            if ( status >= 0 && sig.size > static_cast< uint64_t >( _item.size ) ) {
+                status = truncate_object( _conn, _item.remote, _item.size );
+            }
+            if ( status >= 0 ) {
+                status = record_object( _conn, _item, next );
+            }
+            if ( status < 0 ) {
+                return status;
+            }
+
+            stats_.add( 0 );
+            if ( opts_.verbose ) {
+                printf( "   %s  %lld of %lld bytes sent\n", _item.local.c_str(),
+                        static_cast< long long >( sent ), static_cast< long long >( _item.size ) );
+            }
+            return COUNTED;
+
+        } // put_file
+
+    private:
+        // a whole file replaces the data object it differs from
+        static upload_options with_delta( upload_options _opts ) {
+            _opts.force = true;
+            return _opts;
+        }
+
+        // store _next as the signature of the data object as it now is
+        int record_object( rcComm_t* _conn, const upload_item& _item, delta_signature& _next ) {
+            rodsObjStat_t* objStat = NULL;
+            int status = stat_object( _conn, _item.remote, objStat );
+            if ( status < 0 ) {
+                return status;
+            }
+            _next.size        = objStat->objSize;
+            _next.modify_time = objStat->modifyTime;
+            _next.checksum    = objStat->chksum;
+            freeRodsObjStat( objStat );
+            signatures_.store( _item.remote, _next );
+            return 0;
+        }
+
+        static int stat_object( rcComm_t* _conn, const std::string& _path, rodsObjStat_t*& _stat ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _path.c_str(), MAX_NAME_LEN );
+            _stat = NULL;
+            int status = rcObjStat( _conn, &dataObjInp, &_stat );
+            if ( status >= 0 && _stat->objType != DATA_OBJ_T ) {
+                freeRodsObjStat( _stat );
+                return USER_INPUT_PATH_ERR;
+            }
+            return status;
+        }
+
+        // whether the file matches the data object by irsync's check: its
+        // checksum in the scheme of the data object's, which the server
+        // computes and registers if there is none yet
+        static int same_contents( rcComm_t* _conn, const upload_item& _item, const delta_signature& _next ) {
+            std::string remote = _next.checksum;
+            if ( remote.empty() ) {
+                int status = object_checksum( _conn, _item.remote, remote );
+                if ( status < 0 ) {
+                    return status;
+                }
+            }
+            std::string local;
+            int status = local_checksum( _item.local, remote, local );
+            if ( status < 0 ) {
+                return status;
+            }
+            return local == remote ? 1 : 0;
+        }
+
+        static int truncate_object( rcComm_t* _conn, const std::string& _path, uint64_t _size ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _path.c_str(), MAX_NAME_LEN );
+            dataObjInp.dataSize = _size;
+            return rcDataObjTruncate( _conn, &dataObjInp );
+        }
+
+        // digest each block of the file, marking those that differ from
+        // the same block in _old
+        int compare_blocks(
+            int                    _fd,
+            uint64_t               _size,
+            const delta_signature& _old,
+            delta_signature&       _next,
+            std::vector< bool >&   _changed ) {
+            std::vector< char > buf( _next.block_size );
+            std::string block;
+            for ( uint64_t offset = 0; offset < _size; offset += _next.block_size ) {
+                size_t len = static_cast< size_t >( std::min< uint64_t >( _next.block_size, _size - offset ) );
+                ssize_t n = pread( _fd, &buf[ 0 ], len, offset );
+                if ( n != static_cast< ssize_t >( len ) ) {
+                    return n < 0 ? UNIX_FILE_READ_ERR - errno : SYS_COPY_LEN_ERR;
+                }
+                int status = delta_block_digest( &buf[ 0 ], len, block );
+                if ( status < 0 ) {
+                    return status;
+                }
+                size_t i = _next.blocks.size();
+
+                // a last block that was shorter or longer before differs
+                // even if its digest happens to match
+                uint64_t old_len = offset < _old.size ?
+                                   std::min< uint64_t >( _next.block_size, _old.size - offset ) : 0;
+                _changed.push_back( i >= _old.blocks.size() || old_len != len || _old.blocks[ i ] != block );
+                _next.blocks.push_back( block );
+            }
+            return 0;
+        }
+
+        // write the changed blocks into the data object in place,
+        // recording the digests of what was actually sent
+        int write_blocks(
+            rcComm_t*                  _conn,
+            const upload_item&         _item,
+            int                        _fd,
+            bool                       _checksum,
+            const std::vector< bool >& _changed,
+            delta_signature&           _next,
+            uint64_t&                  _sent ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _item.remote.c_str(), MAX_NAME_LEN );
+            dataObjInp.dataSize   = _item.size;
+            dataObjInp.createMode = _item.mode;
+            dataObjInp.openFlags  = O_WRONLY;
+            dataObjInp.oprType    = PUT_OPR;
+            if ( !opts_.resource.empty() ) {
+                addKeyVal( &dataObjInp.condInput, DEST_RESC_NAME_KW, opts_.resource.c_str() );
+            }
+            // keep a registered checksum up to date
+            if ( _checksum ) {
+                addKeyVal( &dataObjInp.condInput, REG_CHKSUM_KW, "" );
+            }
+            int l1descInx = rcDataObjOpen( _conn, &dataObjInp );
+            clearKeyVal( &dataObjInp.condInput );
+            if ( l1descInx < 0 ) {
+                return l1descInx;
+            }
+
+            uint64_t size = _item.size;
+            std::vector< char > buf( _next.block_size );
+            int status = 0;
+            bool positioned = false;
+            for ( size_t i = 0; i < _changed.size() && status >= 0; ++i ) {
+                if ( !_changed[ i ] ) {
+                    positioned = false;
+                    continue;
+                }
+                uint64_t offset = static_cast< uint64_t >( i ) * _next.block_size;
+                size_t len = static_cast< size_t >( std::min< uint64_t >( _next.block_size, size - offset ) );
+                ssize_t n = pread( _fd, &buf[ 0 ], len, offset );
+                if ( n != static_cast< ssize_t >( len ) ) {
+                    status = n < 0 ? UNIX_FILE_READ_ERR - errno : SYS_COPY_LEN_ERR;
+                    break;
+                }
+                status = delta_block_digest( &buf[ 0 ], len, _next.blocks[ i ] );
+                if ( status < 0 ) {
+                    break;
+                }
+
+                if ( !positioned ) {
+                    status = seek_data_object( _conn, l1descInx, offset );
+                    positioned = status >= 0;
+                }
+                for ( size_t done = 0; status >= 0 && done < len; ) {
+                    openedDataObjInp_t writeInp;
+                    memset( &writeInp, 0, sizeof( writeInp ) );
+                    writeInp.l1descInx = l1descInx;
+                    writeInp.len       = static_cast< int >( std::min( len - done, RESUME_IO_SIZE ) );
+                    bytesBuf_t writeBuf;
+                    writeBuf.len = writeInp.len;
+                    writeBuf.buf = &buf[ done ];
+                    status = rcDataObjWrite( _conn, &writeInp, &writeBuf );
+                    if ( status >= 0 && status != writeInp.len ) {
+                        status = SYS_COPY_LEN_ERR;
+                    }
+                    if ( status >= 0 ) {
+                        done += writeInp.len;
+                        _sent += writeInp.len;
+                        stats_.add( writeInp.len, 0 );
+                    }
+                }
+            }
+
+            int close_status = close_data_object( _conn, l1descInx );
+            return status < 0 ? status : close_status;
+
+        } // write_blocks
+
+        signature_store                     signatures_;
+        std::atomic< unsigned long long >   scanned_;
+
+    }; // class delta_upload_engine
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_DELTA_SYNC_HPP
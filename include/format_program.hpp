@@ -0,0 +1,276 @@
+#ifndef ICOMMANDS_FORMAT_PROGRAM_HPP
+#define ICOMMANDS_FORMAT_PROGRAM_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // a printf style format string, as accepted by boost::format for
+    // string arguments, compiled once into literal and field segments so
+    // that each row is rendered without parsing the format again.
+    // fields are %[N$][flags][width][.precision]type, %|spec| or %N%, and
+    // every argument is a string: the precision truncates it and the width
+    // pads it, on the left unless the - flag is given.
+    class format_program {
+    public:
+        format_program() :
+            arg_count_( 0 ),
+            compiled_( false ) {
+        }
+
+        // returns false, with error() describing the problem, if _format
+        // is not a valid format string
+        bool compile( const char* _format ) {
+            segments_.clear();
+            arg_count_ = 0;
+            error_.clear();
+            compiled_ = false;
+
+            std::string literal;
+            size_t      next_arg = 0;
+            const char* p = _format;
+            while ( *p != '\0' ) {
+                if ( *p != '%' ) {
+                    literal += *p++;
+                    continue;
+                }
+                if ( p[1] == '%' ) {
+                    literal += '%';
+                    p += 2;
+                    continue;
+                }
+
+                segment field;
+                const char* end = parse_field( p + 1, field );
+                if ( end == NULL ) {
+                    error_ = "boost::bad_format_string: format-string is ill-formed";
+                    return false;
+                }
+                p = end;
+
+                if ( !literal.empty() ) {
+                    segments_.push_back( segment( literal ) );
+                    literal.clear();
+                }
+                if ( field.arg == NO_ARG ) {
+                    field.arg = next_arg++;
+                }
+                if ( field.arg + 1 > arg_count_ ) {
+                    arg_count_ = field.arg + 1;
+                }
+                segments_.push_back( field );
+            }
+            if ( !literal.empty() ) {
+                segments_.push_back( segment( literal ) );
+            }
+            compiled_ = true;
+            return true;
+        }
+
+        bool compiled() const {
+            return compiled_;
+        }
+
+        const std::string& error() const {
+            return error_;
+        }
+
+        // append the format applied to _args to _out.  returns false, with
+        // the message appended instead, if the argument count is wrong.
+        // the arguments are C strings, or views with data() and size().
+        template< typename T >
+        bool render( const T* _args, size_t _nargs, std::string& _out ) const {
+            if ( _nargs < arg_count_ ) {
+                _out += "boost::too_few_args: format-string referred to more arguments than were passed\n";
+                return false;
+            }
+            if ( _nargs > arg_count_ ) {
+                _out += "boost::too_many_args: format-string referred to fewer arguments than were passed\n";
+                return false;
+            }
+
+            for ( size_t i = 0; i < segments_.size(); ++i ) {
+                const segment& seg = segments_[ i ];
+                if ( seg.arg == NO_ARG ) {
+                    _out += seg.literal;
+                    continue;
+                }
+
+                const char* value = data( _args[ seg.arg ] );
+                size_t len = size( _args[ seg.arg ] );
+                if ( seg.precision >= 0 && len > static_cast< size_t >( seg.precision ) ) {
+                    len = seg.precision;
+                }
+                size_t pad = seg.width > len ? seg.width - len : 0;
+                if ( !seg.left ) {
+                    _out.append( pad, seg.zero ? '0' : ' ' );
+                }
+                _out.append( value, len );
+                if ( seg.left ) {
+                    _out.append( pad, ' ' );
+                }
+            }
+            return true;
+        }
+
+    private:
+        static const size_t NO_ARG = static_cast< size_t >( -1 );
+
+        static const char* data( const char* _arg ) {
+            return _arg;
+        }
+
+        static size_t size( const char* _arg ) {
+            return strlen( _arg );
+        }
+
+        template< typename T >
+        static const char* data( const T& _arg ) {
+            return _arg.data();
+        }
+
+        template< typename T >
+        static size_t size( const T& _arg ) {
+            return _arg.size();
+        }
+
+        struct segment {
+            segment() :
+                arg( NO_ARG ),
+                width( 0 ),
+                precision( -1 ),
+                left( false ),
+                zero( false ) {
+            }
+
+            explicit segment( const std::string& _literal ) :
+                literal( _literal ),
+                arg( NO_ARG ),
+                width( 0 ),
+                precision( -1 ),
+                left( false ),
+                zero( false ) {
+            }
+
+            std::string literal;
+            size_t      arg;
+            size_t      width;
+            int         precision;
+            bool        left;
+            bool        zero;
+        };
+
+        // parse the field that follows a %, returning the position after
+        // it or NULL if it is malformed
+        static const char* parse_field( const char* _p, segment& _field ) {
+            bool piped = false;
+            if ( *_p == '|' ) {
+                piped = true;
+                ++_p;
+            }
+
+            // %N% or %N$...
+            if ( *_p >= '1' && *_p <= '9' && !piped ) {
+                char* end = NULL;
+                long n = strtol( _p, &end, 10 );
+                if ( *end == '%' ) {
+                    _field.arg = n - 1;
+                    return end + 1;
+                }
+                if ( *end == '$' ) {
+                    _field.arg = n - 1;
+                    _p = end + 1;
+                }
+            }
+
+            for ( ; *_p != '\0' && strchr( "-+ #0'", *_p ) != NULL; ++_p ) {
+                if ( *_p == '-' ) {
+                    _field.left = true;
+                }
+                else if ( *_p == '0' ) {
+                    _field.zero = true;
+                }
+            }
+            while ( *_p >= '0' && *_p <= '9' ) {
+                _field.width = _field.width * 10 + ( *_p++ - '0' );
+            }
+            if ( *_p == '.' ) {
+                _field.precision = 0;
+                ++_p;
+                while ( *_p >= '0' && *_p <= '9' ) {
+                    _field.precision = _field.precision * 10 + ( *_p++ - '0' );
+                }
+            }
+            while ( *_p != '\0' && strchr( "hlLqjzt", *_p ) != NULL ) {
+                ++_p;
+            }
+
+            if ( *_p == '\0' ) {
+                return NULL;
+            }
+            if ( piped ) {
+                // the conversion letter is optional inside %|...|
+                if ( *_p != '|' ) {
+                    ++_p;
+                }
+                return *_p == '|' ? _p + 1 : NULL;
+            }
+            return strchr( "sSdiuoxXeEfFgGaAcCp", *_p ) != NULL ? _p + 1 : NULL;
+        }
+
+        std::vector< segment > segments_;
+        size_t                 arg_count_;
+        bool                   compiled_;
+        std::string            error_;
+
+    }; // class format_program
+
+    // =-=-=-=-=-=-=-
+    // output collected in one large buffer and written in blocks
+    class output_buffer {
+    public:
+        explicit output_buffer( FILE* _out ) :
+            out_( _out ) {
+            buf_.reserve( BUFFER_SIZE );
+        }
+
+        ~output_buffer() {
+            flush();
+        }
+
+        std::string& str() {
+            return buf_;
+        }
+
+        // write the buffer out once it has grown past its block size
+        void commit() {
+            if ( buf_.size() >= BUFFER_SIZE ) {
+                fwrite( buf_.data(), 1, buf_.size(), out_ );
+                buf_.clear();
+            }
+        }
+
+        void flush() {
+            if ( !buf_.empty() ) {
+                fwrite( buf_.data(), 1, buf_.size(), out_ );
+                buf_.clear();
+            }
+            fflush( out_ );
+        }
+
+    private:
+        static const size_t BUFFER_SIZE = 1024 * 1024;
+
+        FILE*       out_;
+        std::string buf_;
+
+    }; // class output_buffer
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_FORMAT_PROGRAM_HPP
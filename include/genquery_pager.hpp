@@ -0,0 +1,183 @@
+#ifndef ICOMMANDS_GENQUERY_PAGER_HPP
+#define ICOMMANDS_GENQUERY_PAGER_HPP
+
+#include "rodsClient.h"
+#include "connection_broker.hpp"
+
+#include <cstring>
+#include <future>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // runs a general query a page at a time.  the first page is small so
+    // that output starts quickly; every later page asks for MAX_SQL_ROWS,
+    // the most the server returns, since fewer rows only add round trips.
+    // only rows so wide that such a page would pass a byte budget get
+    // smaller pages.
+    //
+    //     icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    //     status = pager.first();
+    //     while ( status == 0 && pager.more() ) {
+    //         status = pager.next();
+    //     }
+    //
+    // each call frees the previous page, so *_out is only valid until the
+    // next call.
+    class genquery_pager {
+    public:
+        static const int INITIAL_ROWS = 16;
+        static const size_t PAGE_BYTES = 1024 * 1024;
+
+        genquery_pager(
+            rcComm_t*       _conn,
+            genQueryInp_t*  _inp,
+            genQueryOut_t** _out,
+            int             _initial_rows = INITIAL_ROWS ) :
+            conn_( _conn ),
+            inp_( _inp ),
+            out_( _out ),
+            initial_rows_( _initial_rows ) {
+            *out_ = NULL;
+        }
+
+        ~genquery_pager() {
+            freeGenQueryOut( out_ );
+        }
+
+        // run the query from the start, as it is now set up in the input
+        int first() {
+            freeGenQueryOut( out_ );
+            inp_->continueInx = 0;
+            inp_->maxRows = initial_rows_;
+            return fetch();
+        }
+
+        bool more() const {
+            return *out_ != NULL && ( *out_ )->continueInx > 0;
+        }
+
+        // fetch the page after the current one
+        int next() {
+            return fetch_page( ( *out_ )->continueInx );
+        }
+
+        // fetch the page that a previous page's continueInx points to
+        int fetch_page( int _continue_inx ) {
+            inp_->continueInx = _continue_inx;
+            freeGenQueryOut( out_ );
+            return fetch();
+        }
+
+        int page_size() const {
+            return inp_->maxRows;
+        }
+
+    private:
+        int fetch() {
+            int status = gen_query( conn_, inp_, out_ );
+            if ( status == 0 && *out_ != NULL && ( *out_ )->rowCnt > 0 ) {
+                adapt();
+            }
+            return status;
+        }
+
+        // choose maxRows for the next page from the width of this one's rows
+        void adapt() {
+            const genQueryOut_t* out = *out_;
+
+            size_t bytes = 0;
+            for ( int j = 0; j < out->attriCnt; ++j ) {
+                const char* value = out->sqlResult[ j ].value;
+                for ( int i = 0; i < out->rowCnt; ++i ) {
+                    bytes += strlen( value + i * out->sqlResult[ j ].len ) + 1;
+                }
+            }
+            size_t width = bytes / out->rowCnt + 1;
+
+            int limit = MAX_SQL_ROWS;
+            if ( PAGE_BYTES / width < static_cast< size_t >( limit ) ) {
+                limit = static_cast< int >( PAGE_BYTES / width );
+            }
+
+            inp_->maxRows = limit > 0 ? limit : 1;
+        }
+
+        rcComm_t*       conn_;
+        genQueryInp_t*  inp_;
+        genQueryOut_t** out_;
+        int             initial_rows_;
+
+    }; // class genquery_pager
+
+    // =-=-=-=-=-=-=-
+    // a genquery_pager that requests the next page on a background thread
+    // as soon as the current one arrives, so that the round trip overlaps
+    // with printing or parsing the current page.  used the same way as
+    // genquery_pager.  the connection is in use by the background thread
+    // between calls, so the caller must not use it for anything else until
+    // the pager is destroyed, which waits for any outstanding request.
+    class prefetch_pager {
+    public:
+        prefetch_pager(
+            rcComm_t*       _conn,
+            genQueryInp_t*  _inp,
+            genQueryOut_t** _out,
+            int             _initial_rows = genquery_pager::INITIAL_ROWS ) :
+            pending_( NULL ),
+            pager_( _conn, _inp, &pending_, _initial_rows ),
+            out_( _out ) {
+            *out_ = NULL;
+        }
+
+        ~prefetch_pager() {
+            if ( prefetch_.valid() ) {
+                prefetch_.wait();
+            }
+            freeGenQueryOut( out_ );
+        }
+
+        int first() {
+            if ( prefetch_.valid() ) {
+                prefetch_.wait();
+            }
+            int status = pager_.first();
+            return take( status );
+        }
+
+        bool more() const {
+            return *out_ != NULL && ( *out_ )->continueInx > 0;
+        }
+
+        int next() {
+            if ( !prefetch_.valid() ) {
+                return take( pager_.fetch_page( ( *out_ )->continueInx ) );
+            }
+            return take( prefetch_.get() );
+        }
+
+    private:
+        // hand the fetched page to the caller and start on the next one
+        int take( int _status ) {
+            freeGenQueryOut( out_ );
+            *out_ = pending_;
+            pending_ = NULL;
+            if ( _status == 0 && more() ) {
+                int inx = ( *out_ )->continueInx;
+                prefetch_ = std::async( std::launch::async, [this, inx]() {
+                    return pager_.fetch_page( inx );
+                } );
+            }
+            return _status;
+        }
+
+        genQueryOut_t*     pending_;
+        genquery_pager     pager_;
+        genQueryOut_t**    out_;
+        std::future< int > prefetch_;
+
+    }; // class prefetch_pager
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_GENQUERY_PAGER_HPP
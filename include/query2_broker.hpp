@@ -0,0 +1,48 @@
+#ifndef QUERY2_BROKER_HPP
+#define QUERY2_BROKER_HPP
+
+#include "rodsClient.h"
+#include "query2.hpp"
+#include "connection_broker.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // run a query2 query as ::query does, relaying it through the agent
+    // when _conn was borrowed with icommands::broker_connect.  the reply
+    // is allocated with malloc either way.
+    inline int send_query(
+        rcComm_t*   _conn,
+        const char* _qu,
+        const char* _hdr,
+        char**      _res ) {
+        int fd = icommands::broker::sessions().find( _conn );
+        if ( fd < 0 ) {
+            return ::query( _conn, _qu, _hdr, _res );
+        }
+
+        *_res = NULL;
+        std::string request( _qu );
+        request += '\0';
+        request += _hdr;
+        request += '\0';
+        std::string out;
+        bool        has_out = false;
+        int status = icommands::broker::call( fd, icommands::broker::QUERY2, request, out, has_out,
+                                                      _conn->rError );
+        if ( has_out ) {
+            *_res = static_cast< char* >( malloc( out.size() + 1 ) );
+            memcpy( *_res, out.data(), out.size() );
+            ( *_res )[ out.size() ] = '\0';
+        }
+        return status;
+
+    } // send_query
+
+}; // namespace query2
+
+#endif // QUERY2_BROKER_HPP
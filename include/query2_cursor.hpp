@@ -0,0 +1,305 @@
+#ifndef QUERY2_CURSOR_HPP
+#define QUERY2_CURSOR_HPP
+
+#include "rodsClient.h"
+#include "query2.hpp"
+#include "query2_broker.hpp"
+
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+namespace query2 {
+
+    typedef boost::string_ref cell_t;
+    typedef std::vector< cell_t > row_t;
+
+    // =-=-=-=-=-=-=-
+    // incremental reader over a query2 result document of the form
+    // [ [ "v", ... ], ... ].  rows are handed out one at a time as
+    // views into the caller's buffer; string cells are unescaped in
+    // place, so the buffer must be writable and must outlive the rows.
+    class cursor {
+    public:
+        explicit cursor( char* _json ) :
+            pos_( _json ),
+            status_( 0 ),
+            started_( false ),
+            done_( _json == NULL ) {
+        }
+
+        // returns 1 when _row holds the next row, 0 at the end of the
+        // result and a negative error code on malformed input
+        int next( row_t& _row ) {
+            _row.clear();
+            if ( done_ || status_ < 0 ) {
+                return status_;
+            }
+            if ( !started_ ) {
+                started_ = true;
+                skip_ws();
+                if ( *pos_ == '\0' ) {
+                    done_ = true;
+                    return 0;
+                }
+                if ( *pos_ != '[' ) {
+                    return fail();
+                }
+                ++pos_;
+            }
+            else {
+                skip_ws();
+                if ( *pos_ == ',' ) {
+                    ++pos_;
+                }
+            }
+
+            skip_ws();
+            if ( *pos_ == ']' ) {
+                ++pos_;
+                done_ = true;
+                return 0;
+            }
+
+            char close = 0;
+            if ( *pos_ == '[' ) {
+                close = ']';
+            }
+            else if ( *pos_ == '{' ) {
+                close = '}';
+            }
+            else {
+                return fail();
+            }
+            ++pos_;
+
+            for ( ;; ) {
+                skip_ws();
+                if ( *pos_ == close ) {
+                    ++pos_;
+                    return 1;
+                }
+                if ( !_row.empty() ) {
+                    if ( *pos_ != ',' ) {
+                        return fail();
+                    }
+                    ++pos_;
+                    skip_ws();
+                }
+
+                cell_t cell;
+                if ( read_value( cell ) < 0 ) {
+                    return status_;
+                }
+
+                // objects keep their values in key order, keys are dropped
+                if ( close == '}' ) {
+                    skip_ws();
+                    if ( *pos_ != ':' ) {
+                        return fail();
+                    }
+                    ++pos_;
+                    skip_ws();
+                    if ( read_value( cell ) < 0 ) {
+                        return status_;
+                    }
+                }
+                _row.push_back( cell );
+            }
+        }
+
+        int status() const {
+            return status_;
+        }
+
+    private:
+        int fail() {
+            status_ = SYS_INVALID_INPUT_PARAM;
+            return status_;
+        }
+
+        void skip_ws() {
+            while ( *pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t' ) {
+                ++pos_;
+            }
+        }
+
+        int read_value( cell_t& _cell ) {
+            if ( *pos_ == '"' ) {
+                return read_string( _cell );
+            }
+
+            // numbers and literals are passed through as written, null is empty
+            char* start = pos_;
+            while ( *pos_ != '\0' && *pos_ != ',' && *pos_ != ']' && *pos_ != '}' &&
+                    *pos_ != ' ' && *pos_ != '\n' && *pos_ != '\r' && *pos_ != '\t' ) {
+                ++pos_;
+            }
+            if ( pos_ == start ) {
+                return fail();
+            }
+            size_t len = pos_ - start;
+            if ( len == 4 && strncmp( start, "null", 4 ) == 0 ) {
+                len = 0;
+            }
+            _cell = cell_t( start, len );
+            return 0;
+        }
+
+        int read_string( cell_t& _cell ) {
+            char* start = ++pos_;
+            char* out = start;
+            for ( ;; ) {
+                char c = *pos_;
+                if ( c == '\0' ) {
+                    return fail();
+                }
+                if ( c == '"' ) {
+                    ++pos_;
+                    break;
+                }
+                if ( c != '\\' ) {
+                    *out++ = c;
+                    ++pos_;
+                    continue;
+                }
+
+                ++pos_;
+                switch ( *pos_ ) {
+                case '"':  *out++ = '"';  break;
+                case '\\': *out++ = '\\'; break;
+                case '/':  *out++ = '/';  break;
+                case 'b':  *out++ = '\b'; break;
+                case 'f':  *out++ = '\f'; break;
+                case 'n':  *out++ = '\n'; break;
+                case 'r':  *out++ = '\r'; break;
+                case 't':  *out++ = '\t'; break;
+                case 'u': {
+                    unsigned long cp = 0;
+                    if ( read_hex4( pos_ + 1, cp ) < 0 ) {
+                        return fail();
+                    }
+                    pos_ += 4;
+                    if ( cp >= 0xD800 && cp <= 0xDBFF && pos_[1] == '\\' && pos_[2] == 'u' ) {
+                        unsigned long lo = 0;
+                        if ( read_hex4( pos_ + 3, lo ) == 0 && lo >= 0xDC00 && lo <= 0xDFFF ) {
+                            cp = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( lo - 0xDC00 );
+                            pos_ += 6;
+                        }
+                    }
+                    out = put_utf8( out, cp );
+                    break;
+                }
+                default:
+                    return fail();
+                }
+                ++pos_;
+            }
+
+            // the unescaped text is never longer than the escaped text,
+            // so it always fits in the space the string used to occupy
+            _cell = cell_t( start, out - start );
+            return 0;
+        }
+
+        static int read_hex4( const char* _p, unsigned long& _value ) {
+            _value = 0;
+            for ( int i = 0; i < 4; ++i ) {
+                char c = _p[i];
+                _value <<= 4;
+                if ( c >= '0' && c <= '9' ) {
+                    _value |= c - '0';
+                }
+                else if ( c >= 'a' && c <= 'f' ) {
+                    _value |= c - 'a' + 10;
+                }
+                else if ( c >= 'A' && c <= 'F' ) {
+                    _value |= c - 'A' + 10;
+                }
+                else {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+
+        static char* put_utf8( char* _out, unsigned long _cp ) {
+            if ( _cp < 0x80 ) {
+                *_out++ = static_cast< char >( _cp );
+            }
+            else if ( _cp < 0x800 ) {
+                *_out++ = static_cast< char >( 0xC0 | ( _cp >> 6 ) );
+                *_out++ = static_cast< char >( 0x80 | ( _cp & 0x3F ) );
+            }
+            else if ( _cp < 0x10000 ) {
+                *_out++ = static_cast< char >( 0xE0 | ( _cp >> 12 ) );
+                *_out++ = static_cast< char >( 0x80 | ( ( _cp >> 6 ) & 0x3F ) );
+                *_out++ = static_cast< char >( 0x80 | ( _cp & 0x3F ) );
+            }
+            else {
+                *_out++ = static_cast< char >( 0xF0 | ( _cp >> 18 ) );
+                *_out++ = static_cast< char >( 0x80 | ( ( _cp >> 12 ) & 0x3F ) );
+                *_out++ = static_cast< char >( 0x80 | ( ( _cp >> 6 ) & 0x3F ) );
+                *_out++ = static_cast< char >( 0x80 | ( _cp & 0x3F ) );
+            }
+            return _out;
+        }
+
+        char* pos_;
+        int   status_;
+        bool  started_;
+        bool  done_;
+
+    }; // class cursor
+
+    // =-=-=-=-=-=-=-
+    // row callback.  returning 0 continues, STOP_ITERATION ends the
+    // iteration early without error and a negative value stops the
+    // iteration and is handed back to the caller of for_each_row
+    typedef std::function< int( const row_t& ) > row_callback_t;
+
+    static const int STOP_ITERATION = 1;
+
+    // =-=-=-=-=-=-=-
+    // run a query2 query and hand each row to _cb as soon as it has been
+    // read from the reply, without materializing the full result set.
+    // the reply buffer is released before returning.
+    inline int for_each_row(
+        rcComm_t*             _conn,
+        const char*           _qu,
+        const char*           _hdr,
+        const row_callback_t& _cb ) {
+        char* res = NULL;
+        int status = send_query( _conn, _qu, _hdr, &res );
+        if ( status < 0 ) {
+            free( res );
+            return status;
+        }
+
+        cursor cur( res );
+        row_t  row;
+        int    rows = 0;
+        while ( ( status = cur.next( row ) ) > 0 ) {
+            ++rows;
+            status = _cb( row );
+            if ( status != 0 ) {
+                break;
+            }
+        }
+        free( res );
+
+        if ( status == STOP_ITERATION ) {
+            return 0;
+        }
+        if ( status < 0 ) {
+            return status;
+        }
+        return rows > 0 ? 0 : CAT_NO_ROWS_FOUND;
+
+    } // for_each_row
+
+}; // namespace query2
+
+#endif // QUERY2_CURSOR_HPP
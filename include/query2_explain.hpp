@@ -0,0 +1,158 @@
+#ifndef QUERY2_EXPLAIN_HPP
+#define QUERY2_EXPLAIN_HPP
+
+#include <cctype>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // one predicate of a query, e.g. META_2(oid, a, "size", u), with its
+    // text as written and its arguments.  an argument is a variable when
+    // it is a bare name and a literal otherwise.
+    struct predicate {
+        std::string                name;
+        std::string                text;
+        std::vector< std::string > args;
+        std::vector< bool >        literal;
+    };
+
+    // =-=-=-=-=-=-=-
+    // split a query into its predicates.  returns false with _error
+    // saying where the text stopped making sense if it is not a sequence
+    // of NAME(arg, ...) predicates.
+    inline bool parse_predicates(
+        const std::string&         _qu,
+        std::vector< predicate >&  _preds,
+        std::string&               _error ) {
+        size_t i = 0;
+        auto skip_space = [&]() {
+            while ( i < _qu.size() && isspace( static_cast< unsigned char >( _qu[ i ] ) ) ) {
+                ++i;
+            }
+        };
+        auto fail = [&]( const char* _what ) {
+            _error = std::string( _what ) + " at offset " + std::to_string( i );
+            return false;
+        };
+
+        for ( skip_space(); i < _qu.size(); skip_space() ) {
+            predicate pred;
+            size_t start = i;
+            while ( i < _qu.size() && ( isalnum( static_cast< unsigned char >( _qu[ i ] ) ) || _qu[ i ] == '_' ) ) {
+                pred.name += _qu[ i++ ];
+            }
+            if ( pred.name.empty() ) {
+                return fail( "expected a predicate name" );
+            }
+            skip_space();
+            if ( i >= _qu.size() || _qu[ i ] != '(' ) {
+                return fail( "expected (" );
+            }
+            ++i;
+
+            for ( ;; ) {
+                skip_space();
+                std::string arg;
+                bool quoted = i < _qu.size() && _qu[ i ] == '"';
+                if ( quoted ) {
+                    arg += _qu[ i++ ];
+                    while ( i < _qu.size() && _qu[ i ] != '"' ) {
+                        if ( _qu[ i ] == '\\' && i + 1 < _qu.size() ) {
+                            arg += _qu[ i++ ];
+                        }
+                        arg += _qu[ i++ ];
+                    }
+                    if ( i >= _qu.size() ) {
+                        return fail( "unterminated string" );
+                    }
+                    arg += _qu[ i++ ];
+                }
+                else {
+                    while ( i < _qu.size() && _qu[ i ] != ',' && _qu[ i ] != ')' &&
+                            !isspace( static_cast< unsigned char >( _qu[ i ] ) ) ) {
+                        arg += _qu[ i++ ];
+                    }
+                }
+                if ( arg.empty() ) {
+                    return fail( "expected an argument" );
+                }
+                bool variable = !quoted &&
+                                ( isalpha( static_cast< unsigned char >( arg[ 0 ] ) ) || arg[ 0 ] == '_' );
+                pred.args.push_back( arg );
+                pred.literal.push_back( !variable );
+
+                skip_space();
+                if ( i < _qu.size() && _qu[ i ] == ',' ) {
+                    ++i;
+                    continue;
+                }
+                if ( i < _qu.size() && _qu[ i ] == ')' ) {
+                    ++i;
+                    break;
+                }
+                return fail( "expected , or )" );
+            }
+
+            pred.text = _qu.substr( start, i - start );
+            _preds.push_back( pred );
+        }
+
+        if ( _preds.empty() ) {
+            _error = "the query has no predicates";
+            return false;
+        }
+        return true;
+
+    } // parse_predicates
+
+    // =-=-=-=-=-=-=-
+    // how a predicate joins the ones before it in query order: the
+    // variables it shares with them, the variables it introduces and the
+    // literals it filters on.  a predicate after the first that shares
+    // no variable is a cross product with everything before it.
+    struct predicate_plan {
+        std::vector< std::string > joins;
+        std::vector< std::string > binds;
+        std::vector< std::string > filters;
+        bool                       cross;
+    };
+
+    inline void plan_predicates(
+        const std::vector< predicate >&                      _preds,
+        std::vector< predicate_plan >&                       _plans,
+        std::map< std::string, std::vector< size_t > >&      _uses ) {
+        std::set< std::string > bound;
+        for ( size_t p = 0; p < _preds.size(); ++p ) {
+            predicate_plan plan;
+            std::set< std::string > seen;
+            for ( size_t a = 0; a < _preds[ p ].args.size(); ++a ) {
+                const std::string& arg = _preds[ p ].args[ a ];
+                if ( _preds[ p ].literal[ a ] ) {
+                    plan.filters.push_back( arg );
+                    continue;
+                }
+                if ( !seen.insert( arg ).second ) {
+                    continue;
+                }
+                _uses[ arg ].push_back( p );
+                if ( bound.count( arg ) ) {
+                    plan.joins.push_back( arg );
+                }
+                else {
+                    plan.binds.push_back( arg );
+                }
+            }
+            plan.cross = p > 0 && plan.joins.empty();
+            bound.insert( plan.binds.begin(), plan.binds.end() );
+            _plans.push_back( plan );
+        }
+
+    } // plan_predicates
+
+}; // namespace query2
+
+#endif // QUERY2_EXPLAIN_HPP
@@ -0,0 +1,650 @@
+#ifndef QUERY2_FORMATTER_HPP
+#define QUERY2_FORMATTER_HPP
+
+#include "format_program.hpp"
+#include "query2_cursor.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // base class for the output formats of query2 rows.  output is
+    // collected in a large buffer and written to the stream in blocks.
+    class formatter {
+    public:
+        formatter( FILE* _out, const std::vector< std::string >& _names ) :
+            out_( _out ),
+            names_( _names ) {
+            buf_.reserve( BUFFER_SIZE );
+        }
+
+        virtual ~formatter() {
+            flush();
+        }
+
+        virtual void begin() {}
+        virtual void row( const row_t& _row ) = 0;
+        virtual void end() {
+            flush();
+        }
+
+        // true for the human oriented format, which may be interleaved
+        // with prompts
+        virtual bool interactive() const {
+            return false;
+        }
+
+        void flush() {
+            if ( !buf_.empty() ) {
+                fwrite( buf_.data(), 1, buf_.size(), out_ );
+                buf_.clear();
+            }
+            fflush( out_ );
+        }
+
+    protected:
+        static const size_t BUFFER_SIZE = 1024 * 1024;
+
+        void write( const char* _data, size_t _len ) {
+            if ( buf_.size() + _len > BUFFER_SIZE ) {
+                fwrite( buf_.data(), 1, buf_.size(), out_ );
+                buf_.clear();
+                if ( _len > BUFFER_SIZE ) {
+                    fwrite( _data, 1, _len, out_ );
+                    return;
+                }
+            }
+            buf_.append( _data, _len );
+        }
+
+        void write( const cell_t& _cell ) {
+            write( _cell.data(), _cell.size() );
+        }
+
+        void write( const std::string& _str ) {
+            write( _str.data(), _str.size() );
+        }
+
+        void write( char _c ) {
+            if ( buf_.size() + 1 > BUFFER_SIZE ) {
+                fwrite( buf_.data(), 1, buf_.size(), out_ );
+                buf_.clear();
+            }
+            buf_ += _c;
+        }
+
+        // the name of column _col, from the header or made up
+        std::string name( size_t _col ) const {
+            if ( _col < names_.size() ) {
+                return names_[ _col ];
+            }
+            return "col" + std::to_string( _col + 1 );
+        }
+
+        FILE*                      out_;
+        std::vector< std::string > names_;
+        std::string                buf_;
+
+    }; // class formatter
+
+    // =-=-=-=-=-=-=-
+    // 'name = value' lines, rows separated by ----
+    class text_formatter : public formatter {
+    public:
+        text_formatter( FILE* _out, const std::vector< std::string >& _names ) :
+            formatter( _out, _names ),
+            rows_( 0 ) {
+        }
+
+        void row( const row_t& _row ) {
+            if ( rows_++ > 0 ) {
+                write( "----\n", 5 );
+            }
+            for ( size_t j = 0; j < _row.size(); ++j ) {
+                if ( j < names_.size() ) {
+                    write( names_[ j ] );
+                    write( " = ", 3 );
+                }
+                write( _row[ j ] );
+                write( '\n' );
+            }
+        }
+
+        bool interactive() const {
+            return true;
+        }
+
+    private:
+        size_t rows_;
+
+    }; // class text_formatter
+
+    // =-=-=-=-=-=-=-
+    // CSV (RFC 4180) with a header line, or TSV with tab, newline,
+    // carriage return and backslash escaped as in the PostgreSQL text format
+    class delimited_formatter : public formatter {
+    public:
+        delimited_formatter(
+            FILE*                             _out,
+            const std::vector< std::string >& _names,
+            char                              _delim ) :
+            formatter( _out, _names ),
+            delim_( _delim ) {
+        }
+
+        void begin() {
+            if ( !names_.empty() ) {
+                std::vector< cell_t > header( names_.begin(), names_.end() );
+                row( header );
+            }
+        }
+
+        void row( const row_t& _row ) {
+            for ( size_t j = 0; j < _row.size(); ++j ) {
+                if ( j > 0 ) {
+                    write( delim_ );
+                }
+                if ( delim_ == '\t' ) {
+                    write_tsv( _row[ j ] );
+                }
+                else {
+                    write_csv( _row[ j ] );
+                }
+            }
+            write( '\n' );
+        }
+
+    private:
+        void write_csv( const cell_t& _cell ) {
+            if ( _cell.find_first_of( ",\"\r\n" ) == cell_t::npos ) {
+                write( _cell );
+                return;
+            }
+            write( '"' );
+            for ( size_t i = 0; i < _cell.size(); ++i ) {
+                if ( _cell[ i ] == '"' ) {
+                    write( '"' );
+                }
+                write( _cell[ i ] );
+            }
+            write( '"' );
+        }
+
+        void write_tsv( const cell_t& _cell ) {
+            for ( size_t i = 0; i < _cell.size(); ++i ) {
+                switch ( _cell[ i ] ) {
+                case '\t': write( "\\t", 2 );  break;
+                case '\n': write( "\\n", 2 );  break;
+                case '\r': write( "\\r", 2 );  break;
+                case '\\': write( "\\\\", 2 ); break;
+                default:   write( _cell[ i ] ); break;
+                }
+            }
+        }
+
+        char delim_;
+
+    }; // class delimited_formatter
+
+    // =-=-=-=-=-=-=-
+    // one JSON object per line, keyed by the header names
+    class ndjson_formatter : public formatter {
+    public:
+        ndjson_formatter( FILE* _out, const std::vector< std::string >& _names ) :
+            formatter( _out, _names ) {
+        }
+
+        void row( const row_t& _row ) {
+            write( '{' );
+            for ( size_t j = 0; j < _row.size(); ++j ) {
+                if ( j > 0 ) {
+                    write( ',' );
+                }
+                write_json_string( name( j ) );
+                write( ':' );
+                write_json_string( _row[ j ] );
+            }
+            write( "}\n", 2 );
+        }
+
+    private:
+        void write_json_string( const cell_t& _str ) {
+            static const char hex[] = "0123456789abcdef";
+            write( '"' );
+            for ( size_t i = 0; i < _str.size(); ++i ) {
+                unsigned char c = _str[ i ];
+                switch ( c ) {
+                case '"':  write( "\\\"", 2 ); break;
+                case '\\': write( "\\\\", 2 ); break;
+                case '\n': write( "\\n", 2 );  break;
+                case '\r': write( "\\r", 2 );  break;
+                case '\t': write( "\\t", 2 );  break;
+                default:
+                    if ( c < 0x20 ) {
+                        char esc[] = { '\\', 'u', '0', '0', hex[ c >> 4 ], hex[ c & 0xF ] };
+                        write( esc, sizeof( esc ) );
+                    }
+                    else {
+                        write( static_cast< char >( c ) );
+                    }
+                }
+            }
+            write( '"' );
+        }
+
+    }; // class ndjson_formatter
+
+    // =-=-=-=-=-=-=-
+    // minimal flatbuffers builder for the Arrow IPC message headers.  like
+    // the reference builder it fills the buffer from the back, so offsets
+    // are measured from the end of the buffer while building.
+    class flatbuffer_builder {
+    public:
+        flatbuffer_builder() :
+            table_start_( 0 ) {
+        }
+
+        uint32_t size() const {
+            return static_cast< uint32_t >( buf_.size() );
+        }
+
+        // pad so that the buffer is aligned to _align after _extra more bytes
+        void align( size_t _align, size_t _extra = 0 ) {
+            while ( ( buf_.size() + _extra ) % _align != 0 ) {
+                buf_.insert( buf_.begin(), '\0' );
+            }
+        }
+
+        template< typename T >
+        uint32_t scalar( T _value ) {
+            align( sizeof( T ) );
+            prepend_le( static_cast< uint64_t >( _value ), sizeof( T ) );
+            return size();
+        }
+
+        uint32_t offset( uint32_t _ref ) {
+            align( 4 );
+            prepend_le( size() + 4 - _ref, 4 );
+            return size();
+        }
+
+        uint32_t string( const std::string& _str ) {
+            align( 4, _str.size() + 1 );
+            buf_.insert( buf_.begin(), '\0' );
+            buf_.insert( buf_.begin(), _str.begin(), _str.end() );
+            prepend_le( _str.size(), 4 );
+            return size();
+        }
+
+        uint32_t offset_vector( const std::vector< uint32_t >& _refs ) {
+            align( 4, _refs.size() * 4 );
+            for ( size_t i = _refs.size(); i > 0; --i ) {
+                offset( _refs[ i - 1 ] );
+            }
+            prepend_le( _refs.size(), 4 );
+            return size();
+        }
+
+        // a vector of structs made of 64 bit fields, given as raw words
+        uint32_t struct_vector( const std::vector< int64_t >& _words, size_t _words_per_struct ) {
+            align( 8, _words.size() * 8 );
+            for ( size_t i = _words.size(); i > 0; --i ) {
+                prepend_le( static_cast< uint64_t >( _words[ i - 1 ] ), 8 );
+            }
+            prepend_le( _words.size() / _words_per_struct, 4 );
+            return size();
+        }
+
+        void start_table() {
+            fields_.clear();
+            table_start_ = size();
+        }
+
+        template< typename T >
+        void add_scalar( uint16_t _id, T _value ) {
+            fields_.push_back( std::make_pair( _id, scalar( _value ) ) );
+        }
+
+        void add_offset( uint16_t _id, uint32_t _ref ) {
+            fields_.push_back( std::make_pair( _id, offset( _ref ) ) );
+        }
+
+        uint32_t end_table() {
+            scalar< int32_t >( 0 );
+            uint32_t table = size();
+
+            uint16_t max_id = 0;
+            for ( size_t i = 0; i < fields_.size(); ++i ) {
+                if ( fields_[ i ].first + 1 > max_id ) {
+                    max_id = fields_[ i ].first + 1;
+                }
+            }
+            std::vector< uint16_t > vtable( 2 + max_id, 0 );
+            vtable[ 0 ] = static_cast< uint16_t >( vtable.size() * 2 );
+            vtable[ 1 ] = static_cast< uint16_t >( table - table_start_ );
+            for ( size_t i = 0; i < fields_.size(); ++i ) {
+                vtable[ 2 + fields_[ i ].first ] = static_cast< uint16_t >( table - fields_[ i ].second );
+            }
+            for ( size_t i = vtable.size(); i > 0; --i ) {
+                prepend_le( vtable[ i - 1 ], 2 );
+            }
+
+            // the table's first word is the distance back to its vtable
+            uint32_t vt = size();
+            int32_t soffset = static_cast< int32_t >( vt - table );
+            size_t pos = buf_.size() - table;
+            for ( size_t i = 0; i < 4; ++i ) {
+                buf_[ pos + i ] = static_cast< char >( ( static_cast< uint32_t >( soffset ) >> ( 8 * i ) ) & 0xFF );
+            }
+            return table;
+        }
+
+        const std::string& finish( uint32_t _root ) {
+            align( 8, 4 );
+            offset( _root );
+            return buf_;
+        }
+
+    private:
+        void prepend_le( uint64_t _value, size_t _bytes ) {
+            char bytes[ 8 ];
+            for ( size_t i = 0; i < _bytes; ++i ) {
+                bytes[ i ] = static_cast< char >( ( _value >> ( 8 * i ) ) & 0xFF );
+            }
+            buf_.insert( buf_.begin(), bytes, bytes + _bytes );
+        }
+
+        std::string                                    buf_;
+        std::vector< std::pair< uint16_t, uint32_t > > fields_;
+        uint32_t                                       table_start_;
+
+    }; // class flatbuffer_builder
+
+    // =-=-=-=-=-=-=-
+    // Arrow IPC stream with every column as a non-null utf8 field.  rows
+    // are collected into record batches of BATCH_ROWS rows.
+    class arrow_formatter : public formatter {
+    public:
+        arrow_formatter( FILE* _out, const std::vector< std::string >& _names ) :
+            formatter( _out, _names ),
+            columns_( 0 ),
+            schema_written_( false ),
+            rows_( 0 ) {
+        }
+
+        void begin() {
+            if ( !names_.empty() ) {
+                start( names_.size() );
+            }
+        }
+
+        void row( const row_t& _row ) {
+            if ( !schema_written_ ) {
+                start( _row.size() );
+            }
+            for ( size_t j = 0; j < columns_; ++j ) {
+                if ( j < _row.size() ) {
+                    data_[ j ].append( _row[ j ].data(), _row[ j ].size() );
+                }
+                offsets_[ j ].push_back( static_cast< int32_t >( data_[ j ].size() ) );
+            }
+            if ( ++rows_ >= static_cast< int64_t >( BATCH_ROWS ) ) {
+                write_batch();
+            }
+        }
+
+        void end() {
+            if ( !schema_written_ ) {
+                start( names_.size() );
+            }
+            if ( rows_ > 0 ) {
+                write_batch();
+            }
+            write_u32( 0xFFFFFFFF );
+            write_u32( 0 );
+            flush();
+        }
+
+    private:
+        static const size_t  BATCH_ROWS = 65536;
+        static const int16_t METADATA_V5 = 4;
+        static const uint8_t HEADER_SCHEMA = 1;
+        static const uint8_t HEADER_RECORD_BATCH = 3;
+        static const uint8_t TYPE_UTF8 = 5;
+
+        void start( size_t _columns ) {
+            columns_ = _columns;
+            data_.assign( columns_, std::string() );
+            offsets_.assign( columns_, std::vector< int32_t >( 1, 0 ) );
+
+            flatbuffer_builder fb;
+            std::vector< uint32_t > fields;
+            for ( size_t j = 0; j < columns_; ++j ) {
+                uint32_t field_name = fb.string( name( j ) );
+                fb.start_table();
+                uint32_t utf8 = fb.end_table();
+                uint32_t children = fb.offset_vector( std::vector< uint32_t >() );
+                fb.start_table();
+                fb.add_offset( 0, field_name );
+                fb.add_offset( 5, children );
+                fb.add_offset( 3, utf8 );
+                fb.add_scalar< uint8_t >( 1, 0 );
+                fb.add_scalar< uint8_t >( 2, TYPE_UTF8 );
+                fields.push_back( fb.end_table() );
+            }
+            uint32_t field_vector = fb.offset_vector( fields );
+            fb.start_table();
+            fb.add_offset( 1, field_vector );
+            fb.add_scalar< int16_t >( 0, 0 );
+            uint32_t schema = fb.end_table();
+
+            write_message( fb, HEADER_SCHEMA, schema, 0 );
+            schema_written_ = true;
+        }
+
+        void write_batch() {
+            std::vector< int64_t > nodes;
+            std::vector< int64_t > buffers;
+            int64_t body = 0;
+            for ( size_t j = 0; j < columns_; ++j ) {
+                nodes.push_back( rows_ );
+                nodes.push_back( 0 );
+                int64_t offsets_len = offsets_[ j ].size() * 4;
+                int64_t data_len = data_[ j ].size();
+                buffers.push_back( body );
+                buffers.push_back( 0 );
+                buffers.push_back( body );
+                buffers.push_back( offsets_len );
+                body += pad8( offsets_len );
+                buffers.push_back( body );
+                buffers.push_back( data_len );
+                body += pad8( data_len );
+            }
+
+            flatbuffer_builder fb;
+            uint32_t buffer_vector = fb.struct_vector( buffers, 2 );
+            uint32_t node_vector = fb.struct_vector( nodes, 2 );
+            fb.start_table();
+            fb.add_scalar< int64_t >( 0, rows_ );
+            fb.add_offset( 1, node_vector );
+            fb.add_offset( 2, buffer_vector );
+            uint32_t batch = fb.end_table();
+
+            write_message( fb, HEADER_RECORD_BATCH, batch, body );
+            for ( size_t j = 0; j < columns_; ++j ) {
+                for ( size_t i = 0; i < offsets_[ j ].size(); ++i ) {
+                    write_u32( static_cast< uint32_t >( offsets_[ j ][ i ] ) );
+                }
+                write_padding( offsets_[ j ].size() * 4 );
+                write( data_[ j ] );
+                write_padding( data_[ j ].size() );
+
+                data_[ j ].clear();
+                offsets_[ j ].assign( 1, 0 );
+            }
+            rows_ = 0;
+        }
+
+        void write_message(
+            flatbuffer_builder& _fb,
+            uint8_t             _header_type,
+            uint32_t            _header,
+            int64_t             _body_length ) {
+            _fb.start_table();
+            _fb.add_scalar< int64_t >( 3, _body_length );
+            _fb.add_offset( 2, _header );
+            _fb.add_scalar< int16_t >( 0, METADATA_V5 );
+            _fb.add_scalar< uint8_t >( 1, _header_type );
+            const std::string& meta = _fb.finish( _fb.end_table() );
+
+            write_u32( 0xFFFFFFFF );
+            write_u32( static_cast< uint32_t >( pad8( meta.size() ) ) );
+            write( meta );
+            write_padding( meta.size() );
+        }
+
+        void write_u32( uint32_t _value ) {
+            char bytes[ 4 ];
+            for ( size_t i = 0; i < 4; ++i ) {
+                bytes[ i ] = static_cast< char >( ( _value >> ( 8 * i ) ) & 0xFF );
+            }
+            write( bytes, 4 );
+        }
+
+        void write_padding( size_t _len ) {
+            static const char zeros[ 8 ] = { 0 };
+            write( zeros, pad8( _len ) - _len );
+        }
+
+        static int64_t pad8( int64_t _len ) {
+            return ( _len + 7 ) & ~static_cast< int64_t >( 7 );
+        }
+
+        size_t                                columns_;
+        bool                                  schema_written_;
+        int64_t                               rows_;
+        std::vector< std::string >            data_;
+        std::vector< std::vector< int32_t > > offsets_;
+
+    }; // class arrow_formatter
+
+    // =-=-=-=-=-=-=-
+    // rows rendered through a printf style format, as with iquest's
+    // format argument: each field takes the next column, and a newline
+    // ends every row.  the format is compiled once.
+    class program_formatter : public formatter {
+    public:
+        program_formatter( FILE* _out, const std::vector< std::string >& _names ) :
+            formatter( _out, _names ) {
+        }
+
+        bool compile( const std::string& _format ) {
+            return program_.compile( ( _format + "\n" ).c_str() );
+        }
+
+        void row( const row_t& _row ) {
+            program_.render( _row.data(), _row.size(), buf_ );
+            if ( buf_.size() >= BUFFER_SIZE ) {
+                fwrite( buf_.data(), 1, buf_.size(), out_ );
+                buf_.clear();
+            }
+        }
+
+        bool interactive() const {
+            return true;
+        }
+
+    private:
+        icommands::format_program program_;
+
+    }; // class program_formatter
+
+    // =-=-=-=-=-=-=-
+    // create the formatter named _format (text, csv, tsv, ndjson or
+    // arrow), or a program_formatter if _format contains a %.  returns
+    // a null pointer for an unknown name or a malformed format.
+    inline std::unique_ptr< formatter > make_formatter(
+        const std::string&                _format,
+        FILE*                             _out,
+        const std::vector< std::string >& _names ) {
+        std::unique_ptr< formatter > fmt;
+        if ( _format == "text" ) {
+            fmt.reset( new text_formatter( _out, _names ) );
+        }
+        else if ( _format == "csv" ) {
+            fmt.reset( new delimited_formatter( _out, _names, ',' ) );
+        }
+        else if ( _format == "tsv" ) {
+            fmt.reset( new delimited_formatter( _out, _names, '\t' ) );
+        }
+        else if ( _format == "ndjson" ) {
+            fmt.reset( new ndjson_formatter( _out, _names ) );
+        }
+        else if ( _format == "arrow" ) {
+            fmt.reset( new arrow_formatter( _out, _names ) );
+        }
+        else if ( _format.find( '%' ) != std::string::npos ) {
+            std::unique_ptr< program_formatter > program( new program_formatter( _out, _names ) );
+            if ( program->compile( _format ) ) {
+                fmt.reset( program.release() );
+            }
+        }
+        return fmt;
+
+    } // make_formatter
+
+    // =-=-=-=-=-=-=-
+    // rows held back for later formatting, stored as one block of cell
+    // bytes plus cell boundaries rather than as a string per cell
+    class row_buffer {
+    public:
+        void append( const row_t& _row ) {
+            row_ends_.push_back( cell_ends_.size() + _row.size() );
+            for ( size_t j = 0; j < _row.size(); ++j ) {
+                data_.append( _row[ j ].data(), _row[ j ].size() );
+                cell_ends_.push_back( data_.size() );
+            }
+        }
+
+        size_t rows() const {
+            return row_ends_.size();
+        }
+
+        // replay up to _max rows (all if 0) into _fmt
+        size_t replay( formatter& _fmt, size_t _max ) const {
+            row_t  row;
+            size_t cell = 0;
+            size_t start = 0;
+            size_t count = 0;
+            for ( ; count < row_ends_.size() && ( _max == 0 || count < _max ); ++count ) {
+                row.clear();
+                for ( ; cell < row_ends_[ count ]; ++cell ) {
+                    row.push_back( cell_t( data_.data() + start, cell_ends_[ cell ] - start ) );
+                    start = cell_ends_[ cell ];
+                }
+                _fmt.row( row );
+            }
+            return count;
+        }
+
+        void clear() {
+            std::string().swap( data_ );
+            std::vector< size_t >().swap( cell_ends_ );
+            std::vector< size_t >().swap( row_ends_ );
+        }
+
+    private:
+        std::string           data_;
+        std::vector< size_t > cell_ends_;
+        std::vector< size_t > row_ends_;
+
+    }; // class row_buffer
+
+}; // namespace query2
+
+#endif // QUERY2_FORMATTER_HPP
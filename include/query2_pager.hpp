@@ -0,0 +1,68 @@
+#ifndef QUERY2_PAGER_HPP
+#define QUERY2_PAGER_HPP
+
+#include "query2_cursor.hpp"
+
+#include <functional>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // paging controls for a query2 result.  a page_size of 0 (the
+    // default) delivers the result as one page, a limit of 0 does not
+    // cap the row count.
+    struct page_options {
+        page_options() :
+            page_size( 0 ),
+            limit( 0 ) {
+        }
+
+        size_t page_size;
+        size_t limit;
+    };
+
+    // =-=-=-=-=-=-=-
+    // called before the first row of every page after the first with the
+    // number of rows delivered so far.  returning false ends the query
+    // early.
+    typedef std::function< bool( size_t ) > page_callback_t;
+
+    // =-=-=-=-=-=-=-
+    // run a query2 query, delivering rows to _row_cb in pages of
+    // _opts.page_size rows and stopping after _opts.limit rows.
+    //
+    // the query2 API returns the whole result in one reply and has no
+    // continuation token, so the pages are cut on the client from that
+    // reply: they pace the rows delivered, and the limit stops the
+    // parsing, but neither makes the server or the reply any smaller.
+    inline int for_each_page_row(
+        rcComm_t*              _conn,
+        const char*            _qu,
+        const char*            _hdr,
+        const page_options&    _opts,
+        const row_callback_t&  _row_cb,
+        const page_callback_t& _page_cb ) {
+        size_t rows = 0;
+        return for_each_row( _conn, _qu, _hdr,
+            [&]( const row_t& _row ) {
+                if ( _opts.limit > 0 && rows >= _opts.limit ) {
+                    return STOP_ITERATION;
+                }
+                if ( _opts.page_size > 0 && rows > 0 &&
+                        rows % _opts.page_size == 0 &&
+                        _page_cb && !_page_cb( rows ) ) {
+                    return STOP_ITERATION;
+                }
+                int status = _row_cb( _row );
+                if ( status != 0 ) {
+                    return status;
+                }
+                ++rows;
+                return 0;
+            } );
+
+    } // for_each_page_row
+
+}; // namespace query2
+
+#endif // QUERY2_PAGER_HPP
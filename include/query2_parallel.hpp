@@ -0,0 +1,93 @@
+#ifndef QUERY2_PARALLEL_HPP
+#define QUERY2_PARALLEL_HPP
+
+#include "query2_cursor.hpp"
+#include "query2_statement.hpp"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // the arguments bound to a statement for one part of a partitioned query
+    typedef std::vector< std::string > partition_t;
+
+    // =-=-=-=-=-=-=-
+    // row callback for a partitioned query, called with the index of the
+    // partition the row belongs to.  rows of one partition are delivered
+    // in order from a single thread; different partitions run concurrently.
+    typedef std::function< int( size_t, const row_t& ) > partition_row_callback_t;
+
+    // =-=-=-=-=-=-=-
+    // called once per partition, from the thread that ran it, with the
+    // status of the partition's query
+    typedef std::function< void( size_t, int ) > partition_done_callback_t;
+
+    // =-=-=-=-=-=-=-
+    // run _stmt once per partition, with the partition's arguments bound,
+    // spreading the partitions over the connections in _conns with one
+    // thread per connection.  returns the first error, CAT_NO_ROWS_FOUND
+    // if no partition matched anything, or 0.
+    inline int for_each_partition_row(
+        const std::vector< rcComm_t* >&  _conns,
+        const statement&                 _stmt,
+        const std::vector< partition_t >& _parts,
+        const char*                      _hdr,
+        const partition_row_callback_t&  _row_cb,
+        const partition_done_callback_t& _done_cb ) {
+        if ( _conns.empty() ) {
+            return SYS_INVALID_INPUT_PARAM;
+        }
+
+        std::atomic< size_t > next( 0 );
+        std::mutex            mutex;
+        int                   error = 0;
+        bool                  found = false;
+
+        auto run = [&]( rcComm_t* _conn ) {
+            for ( size_t part = next++; part < _parts.size(); part = next++ ) {
+                std::string qu;
+                int status = _stmt.bind( _parts[ part ], qu );
+                if ( status >= 0 ) {
+                    status = for_each_row( _conn, qu.c_str(), _hdr,
+                        [&]( const row_t& _row ) {
+                            return _row_cb( part, _row );
+                        } );
+                }
+                {
+                    std::lock_guard< std::mutex > lock( mutex );
+                    if ( status == 0 ) {
+                        found = true;
+                    }
+                    else if ( status != CAT_NO_ROWS_FOUND && error == 0 ) {
+                        error = status;
+                    }
+                }
+                _done_cb( part, status );
+            }
+        };
+
+        std::vector< std::thread > threads;
+        for ( size_t i = 1; i < _conns.size(); ++i ) {
+            threads.push_back( std::thread( run, _conns[ i ] ) );
+        }
+        run( _conns[ 0 ] );
+        for ( size_t i = 0; i < threads.size(); ++i ) {
+            threads[ i ].join();
+        }
+
+        if ( error < 0 ) {
+            return error;
+        }
+        return found ? 0 : CAT_NO_ROWS_FOUND;
+
+    } // for_each_partition_row
+
+}; // namespace query2
+
+#endif // QUERY2_PARALLEL_HPP
@@ -0,0 +1,109 @@
+#ifndef QUERY2_RESULT_VIEW_HPP
+#define QUERY2_RESULT_VIEW_HPP
+
+#include "query2_cursor.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // column-major view over a complete query2 result.  the view owns
+    // the reply buffer and every cell is a view into it, so building and
+    // reading the result does not allocate per cell.  short rows are
+    // padded with empty cells so that every column has rows() entries.
+    class result_view {
+    public:
+        result_view() :
+            buf_( NULL ),
+            rows_( 0 ) {
+        }
+
+        ~result_view() {
+            free( buf_ );
+        }
+
+        // takes ownership of _json, which must have been allocated with malloc
+        int assign( char* _json ) {
+            clear();
+            buf_ = _json;
+
+            cursor cur( buf_ );
+            row_t  row;
+            int    status = 0;
+            while ( ( status = cur.next( row ) ) > 0 ) {
+                if ( row.size() > columns_.size() ) {
+                    columns_.resize( row.size() );
+                    for ( size_t j = 0; j < columns_.size(); ++j ) {
+                        columns_[ j ].resize( rows_ );
+                    }
+                }
+                for ( size_t j = 0; j < columns_.size(); ++j ) {
+                    columns_[ j ].push_back( j < row.size() ? row[ j ] : cell_t() );
+                }
+                ++rows_;
+            }
+            return status;
+        }
+
+        void clear() {
+            free( buf_ );
+            buf_ = NULL;
+            rows_ = 0;
+            columns_.clear();
+        }
+
+        size_t rows() const {
+            return rows_;
+        }
+
+        size_t columns() const {
+            return columns_.size();
+        }
+
+        const std::vector< cell_t >& column( size_t _col ) const {
+            return columns_[ _col ];
+        }
+
+        cell_t at( size_t _row, size_t _col ) const {
+            return columns_[ _col ][ _row ];
+        }
+
+    private:
+        result_view( const result_view& );
+        result_view& operator=( const result_view& );
+
+        char*                                buf_;
+        size_t                               rows_;
+        std::vector< std::vector< cell_t > > columns_;
+
+    }; // class result_view
+
+    // =-=-=-=-=-=-=-
+    // run a query2 query and collect the reply into _view.  returns
+    // CAT_NO_ROWS_FOUND when the query matched nothing.
+    inline int query(
+        rcComm_t*    _conn,
+        const char*  _qu,
+        const char*  _hdr,
+        result_view& _view ) {
+        char* res = NULL;
+        int status = send_query( _conn, _qu, _hdr, &res );
+        if ( status < 0 ) {
+            free( res );
+            _view.clear();
+            return status;
+        }
+
+        status = _view.assign( res );
+        if ( status < 0 ) {
+            return status;
+        }
+        return _view.rows() > 0 ? 0 : CAT_NO_ROWS_FOUND;
+
+    } // query
+
+}; // namespace query2
+
+#endif // QUERY2_RESULT_VIEW_HPP
@@ -0,0 +1,135 @@
+#ifndef QUERY2_SCRIPT_HPP
+#define QUERY2_SCRIPT_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // one statement of a query2 script, with the line it starts on.  an
+    // empty format means the one given on the command line, and an
+    // output of "-" means standard output.
+    struct script_statement {
+        script_statement() :
+            line( 0 ),
+            output( "-" ) {
+        }
+
+        int         line;
+        std::string query;
+        std::string header;
+        std::string format;
+        std::string output;
+    };
+
+    // =-=-=-=-=-=-=-
+    // read a script of statements, each a group of "key: value" lines:
+    //
+    //   # the AVUs on the home collection
+    //   query:  COLL_NAME(cid, "/tempZone/home/rods")
+    //           META_2(cid, a, v, u)
+    //   header: a v u
+    //   format: csv
+    //   output: avus.csv
+    //
+    // query is required and header, format and output are optional.  a
+    // statement ends at a blank line or at the next query line, lines
+    // starting with # are comments, and an indented line continues the
+    // value of the line before it.  returns false with _error describing
+    // the first problem if the script is not well formed.
+    inline bool parse_script(
+        std::istream&                    _in,
+        std::vector< script_statement >& _stmts,
+        std::string&                     _error ) {
+        script_statement stmt;
+        std::string*     last = NULL;
+        std::string      line;
+        int              line_no = 0;
+
+        auto finish = [&]() {
+            if ( stmt.line == 0 ) {
+                return true;
+            }
+            if ( stmt.query.empty() ) {
+                _error = "line " + std::to_string( stmt.line ) + ": statement has no query";
+                return false;
+            }
+            _stmts.push_back( stmt );
+            stmt = script_statement();
+            return true;
+        };
+
+        while ( std::getline( _in, line ) ) {
+            ++line_no;
+            if ( !line.empty() && line[ line.size() - 1 ] == '\r' ) {
+                line.erase( line.size() - 1 );
+            }
+            size_t start = line.find_first_not_of( " \t" );
+            if ( start == std::string::npos ) {
+                if ( !finish() ) {
+                    return false;
+                }
+                last = NULL;
+                continue;
+            }
+            if ( line[ start ] == '#' ) {
+                continue;
+            }
+
+            if ( start > 0 ) {
+                if ( last == NULL ) {
+                    _error = "line " + std::to_string( line_no ) + ": continuation line with nothing to continue";
+                    return false;
+                }
+                *last += ' ';
+                *last += line.substr( start );
+                continue;
+            }
+
+            size_t colon = line.find( ':' );
+            if ( colon == std::string::npos ) {
+                _error = "line " + std::to_string( line_no ) + ": expected key: value";
+                return false;
+            }
+            std::string key = line.substr( 0, colon );
+            size_t value_start = line.find_first_not_of( " \t", colon + 1 );
+            std::string value = value_start == std::string::npos ? "" : line.substr( value_start );
+
+            if ( key == "query" ) {
+                if ( !finish() ) {
+                    return false;
+                }
+                stmt.line = line_no;
+                stmt.query = value;
+                last = &stmt.query;
+                continue;
+            }
+            if ( stmt.line == 0 ) {
+                stmt.line = line_no;
+            }
+            if ( key == "header" ) {
+                stmt.header = value;
+                last = &stmt.header;
+            }
+            else if ( key == "format" ) {
+                stmt.format = value;
+                last = &stmt.format;
+            }
+            else if ( key == "output" ) {
+                stmt.output = value.empty() ? "-" : value;
+                last = &stmt.output;
+            }
+            else {
+                _error = "line " + std::to_string( line_no ) + ": unknown key " + key;
+                return false;
+            }
+        }
+        return finish();
+
+    } // parse_script
+
+}; // namespace query2
+
+#endif // QUERY2_SCRIPT_HPP
@@ -0,0 +1,124 @@
+#ifndef QUERY2_STATEMENT_HPP
+#define QUERY2_STATEMENT_HPP
+
+#include "query2_result_view.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace query2 {
+
+    // =-=-=-=-=-=-=-
+    // a query2 query with ? placeholders, e.g.
+    //     COLL_NAME(cid, ?) META_2(cid, a, v, u)
+    // the text is split into literal segments once, and each bind
+    // renders the segments with the arguments as quoted string literals.
+    // a ? inside a quoted literal of the template is not a placeholder.
+    class statement {
+    public:
+        explicit statement( const std::string& _text ) :
+            text_size_( _text.size() ) {
+            std::string segment;
+            bool quoted = false;
+            for ( size_t i = 0; i < _text.size(); ++i ) {
+                char c = _text[ i ];
+                if ( quoted && c == '\\' && i + 1 < _text.size() ) {
+                    segment += c;
+                    segment += _text[ ++i ];
+                    continue;
+                }
+                if ( c == '"' ) {
+                    quoted = !quoted;
+                }
+                if ( c == '?' && !quoted ) {
+                    segments_.push_back( segment );
+                    segment.clear();
+                    continue;
+                }
+                segment += c;
+            }
+            segments_.push_back( segment );
+        }
+
+        size_t parameter_count() const {
+            return segments_.size() - 1;
+        }
+
+        // render the statement with _args bound to the placeholders
+        int bind(
+            const std::vector< std::string >& _args,
+            std::string&                      _out ) const {
+            if ( _args.size() != parameter_count() ) {
+                return SYS_INVALID_INPUT_PARAM;
+            }
+
+            size_t size = text_size_;
+            for ( size_t i = 0; i < _args.size(); ++i ) {
+                size += _args[ i ].size() + 2;
+            }
+            _out.clear();
+            _out.reserve( size );
+
+            _out += segments_[ 0 ];
+            for ( size_t i = 0; i < _args.size(); ++i ) {
+                _out += '"';
+                for ( size_t j = 0; j < _args[ i ].size(); ++j ) {
+                    char c = _args[ i ][ j ];
+                    if ( c == '"' || c == '\\' ) {
+                        _out += '\\';
+                    }
+                    _out += c;
+                }
+                _out += '"';
+                _out += segments_[ i + 1 ];
+            }
+            return 0;
+        }
+
+    private:
+        std::vector< std::string > segments_;
+        size_t                     text_size_;
+
+    }; // class statement
+
+    // =-=-=-=-=-=-=-
+    // bind _args to _stmt and collect the reply into _view
+    inline int query(
+        rcComm_t*                         _conn,
+        const statement&                  _stmt,
+        const std::vector< std::string >& _args,
+        const char*                       _hdr,
+        result_view&                      _view ) {
+        std::string qu;
+        int status = _stmt.bind( _args, qu );
+        if ( status < 0 ) {
+            _view.clear();
+            return status;
+        }
+        return query( _conn, qu.c_str(), _hdr, _view );
+
+    } // query
+
+    // =-=-=-=-=-=-=-
+    // bind _args to _stmt and run it for its effect, such as an insert or
+    // delete, discarding any reply
+    inline int execute(
+        rcComm_t*                         _conn,
+        const statement&                  _stmt,
+        const std::vector< std::string >& _args ) {
+        std::string qu;
+        int status = _stmt.bind( _args, qu );
+        if ( status < 0 ) {
+            return status;
+        }
+        char* res = NULL;
+        status = send_query( _conn, qu.c_str(), "", &res );
+        free( res );
+        return status;
+
+    } // execute
+
+}; // namespace query2
+
+#endif // QUERY2_STATEMENT_HPP
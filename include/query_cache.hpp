@@ -0,0 +1,492 @@
+#ifndef ICOMMANDS_QUERY_CACHE_HPP
+#define ICOMMANDS_QUERY_CACHE_HPP
+
+#include "rodsClient.h"
+#include "genquery_pager.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace icommands {
+
+    // first four bytes of a cache file, "IQC1"
+    const uint32_t QUERY_CACHE_MAGIC = 0x31435149;
+
+    // =-=-=-=-=-=-=-
+    // the complete result of a general query as kept in the cache: one
+    // block of fixed width values per column, laid out as they are in
+    // genQueryOut_t, so that a page is served with a copy per column.
+    // a result read from the cache is a view of the mapped file.
+    class cached_result {
+    public:
+        cached_result() :
+            status_( 0 ),
+            row_cnt_( 0 ),
+            map_( NULL ),
+            map_len_( 0 ) {
+        }
+
+        ~cached_result() {
+            unmap();
+        }
+
+        int status() const {
+            return status_;
+        }
+
+        int row_count() const {
+            return row_cnt_;
+        }
+
+        // map _path, returning false if it is missing, malformed, for
+        // another key or older than _ttl seconds
+        bool map( const std::string& _path, const std::string& _key, time_t _ttl ) {
+            unmap();
+            int fd = open( _path.c_str(), O_RDONLY );
+            if ( fd < 0 ) {
+                return false;
+            }
+            struct stat st;
+            if ( fstat( fd, &st ) != 0 || st.st_size == 0 ) {
+                close( fd );
+                return false;
+            }
+            void* map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            close( fd );
+            if ( map == MAP_FAILED ) {
+                return false;
+            }
+            map_ = static_cast< const char* >( map );
+            map_len_ = st.st_size;
+            if ( !parse( _key, _ttl ) ) {
+                unmap();
+                return false;
+            }
+            return true;
+        }
+
+        // a page of up to _count rows from _start, allocated as rcGenQuery
+        // allocates its output so that freeGenQueryOut releases it
+        genQueryOut_t* page( int _start, int _count ) const {
+            int n = std::min( _count, row_cnt_ - _start );
+            genQueryOut_t* out = static_cast< genQueryOut_t* >( calloc( 1, sizeof( genQueryOut_t ) ) );
+            out->rowCnt = n;
+            out->attriCnt = static_cast< int >( columns_.size() );
+            out->continueInx = _start + n < row_cnt_ ? _start + n : 0;
+            for ( size_t j = 0; j < columns_.size(); ++j ) {
+                const column& col = columns_[ j ];
+                out->sqlResult[ j ].attriInx = col.inx;
+                out->sqlResult[ j ].len = col.len;
+                out->sqlResult[ j ].value = static_cast< char* >( malloc( col.len * n + 1 ) );
+                memcpy( out->sqlResult[ j ].value, col.values + col.len * _start, col.len * n );
+            }
+            return out;
+        }
+
+    private:
+        struct column {
+            int         inx;
+            int         len;
+            const char* values;
+        };
+
+        bool read( size_t& _off, void* _to, size_t _len ) const {
+            if ( _off + _len > map_len_ ) {
+                return false;
+            }
+            memcpy( _to, map_ + _off, _len );
+            _off += _len;
+            return true;
+        }
+
+        bool parse( const std::string& _key, time_t _ttl ) {
+            size_t off = 0;
+            uint32_t magic = 0;
+            int64_t stored_at = 0;
+            uint32_t key_len = 0;
+            if ( !read( off, &magic, sizeof( magic ) ) || magic != QUERY_CACHE_MAGIC ||
+                    !read( off, &stored_at, sizeof( stored_at ) ) ||
+                    time( NULL ) - stored_at > _ttl ||
+                    !read( off, &key_len, sizeof( key_len ) ) ||
+                    key_len != _key.size() || off + key_len > map_len_ ||
+                    memcmp( map_ + off, _key.data(), key_len ) != 0 ) {
+                return false;
+            }
+            off += key_len;
+
+            int32_t status = 0;
+            int32_t attri_cnt = 0;
+            int32_t row_cnt = 0;
+            if ( !read( off, &status, sizeof( status ) ) ||
+                    !read( off, &attri_cnt, sizeof( attri_cnt ) ) ||
+                    !read( off, &row_cnt, sizeof( row_cnt ) ) ||
+                    attri_cnt < 0 || attri_cnt > MAX_SQL_ATTR || row_cnt < 0 ) {
+                return false;
+            }
+            status_ = status;
+            row_cnt_ = row_cnt;
+
+            columns_.resize( attri_cnt );
+            for ( int j = 0; j < attri_cnt; ++j ) {
+                int32_t inx = 0;
+                int32_t len = 0;
+                if ( !read( off, &inx, sizeof( inx ) ) || !read( off, &len, sizeof( len ) ) ||
+                        len <= 0 || off + static_cast< size_t >( len ) * row_cnt > map_len_ ) {
+                    return false;
+                }
+                columns_[ j ].inx = inx;
+                columns_[ j ].len = len;
+                columns_[ j ].values = map_ + off;
+                off += static_cast< size_t >( len ) * row_cnt;
+            }
+            return true;
+        }
+
+        void unmap() {
+            if ( map_ != NULL ) {
+                munmap( const_cast< char* >( map_ ), map_len_ );
+                map_ = NULL;
+                map_len_ = 0;
+            }
+            columns_.clear();
+        }
+
+        cached_result( const cached_result& );
+        cached_result& operator=( const cached_result& );
+
+        int                   status_;
+        int                   row_cnt_;
+        std::vector< column > columns_;
+        const char*           map_;
+        size_t                map_len_;
+
+    }; // class cached_result
+
+    // =-=-=-=-=-=-=-
+    // results of general queries kept on disk under ~/.irods/query_cache
+    // between invocations, keyed by the query and the zone and user it
+    // was run as.  the cache is opt in: it is only used when the
+    // IRODS_QUERY_CACHE_TTL environment variable gives the number of
+    // seconds that a result stays valid for.
+    class query_cache {
+    public:
+        query_cache( const rodsEnv& _env, bool _enabled ) :
+            env_( _env ),
+            ttl_( 0 ) {
+            const char* ttl = getenv( "IRODS_QUERY_CACHE_TTL" );
+            const char* home = getenv( "HOME" );
+            if ( _enabled && ttl != NULL && home != NULL ) {
+                ttl_ = atol( ttl );
+                dir_ = std::string( home ) + "/.irods/query_cache";
+            }
+        }
+
+        bool enabled() const {
+            return ttl_ > 0;
+        }
+
+        // the query with its conditions in a canonical order and its
+        // condition values with redundant white space removed, and the
+        // server, zone and user it is run as.  the page size and position
+        // are not part of the key.
+        std::string key( const genQueryInp_t& _inp ) const {
+            std::ostringstream key;
+            key << "genquery\n" << env_.rodsHost << ":" << env_.rodsPort << "\n"
+                << env_.rodsUserName << "#" << env_.rodsZone << "\n";
+
+            key << "select";
+            for ( int i = 0; i < _inp.selectInp.len; ++i ) {
+                key << " " << _inp.selectInp.inx[ i ] << ":" << _inp.selectInp.value[ i ];
+            }
+            key << "\n";
+
+            std::vector< std::pair< int, std::string > > conds;
+            for ( int i = 0; i < _inp.sqlCondInp.len; ++i ) {
+                conds.push_back( std::make_pair( _inp.sqlCondInp.inx[ i ],
+                                                 normalize( _inp.sqlCondInp.value[ i ] ) ) );
+            }
+            std::sort( conds.begin(), conds.end() );
+            for ( size_t i = 0; i < conds.size(); ++i ) {
+                key << "where " << conds[ i ].first << " " << conds[ i ].second << "\n";
+            }
+
+            std::vector< std::pair< std::string, std::string > > kvps;
+            for ( int i = 0; i < _inp.condInput.len; ++i ) {
+                kvps.push_back( std::make_pair( _inp.condInput.keyWord[ i ],
+                                                _inp.condInput.value[ i ] ) );
+            }
+            std::sort( kvps.begin(), kvps.end() );
+            for ( size_t i = 0; i < kvps.size(); ++i ) {
+                key << "kw " << kvps[ i ].first << "=" << kvps[ i ].second << "\n";
+            }
+
+            key << "options " << _inp.options << "\n";
+            return key.str();
+        }
+
+        bool load( const std::string& _key, cached_result& _result ) const {
+            return enabled() && _result.map( path( _key ), _key, ttl_ );
+        }
+
+        // write a complete result, given as the strings of each column,
+        // through a temporary file so that readers never see part of it
+        void store(
+            const std::string&                              _key,
+            int                                             _status,
+            const std::vector< int >&                       _inx,
+            const std::vector< std::vector< std::string > >& _columns ) const {
+            if ( !enabled() ) {
+                return;
+            }
+
+            int32_t row_cnt = _columns.empty() ? 0 : static_cast< int32_t >( _columns[ 0 ].size() );
+            std::string data;
+            append( data, QUERY_CACHE_MAGIC );
+            append( data, static_cast< int64_t >( time( NULL ) ) );
+            append( data, static_cast< uint32_t >( _key.size() ) );
+            data += _key;
+            append( data, static_cast< int32_t >( _status ) );
+            append( data, static_cast< int32_t >( _inx.size() ) );
+            append( data, row_cnt );
+            for ( size_t j = 0; j < _inx.size(); ++j ) {
+                int32_t len = 1;
+                for ( int32_t i = 0; i < row_cnt; ++i ) {
+                    len = std::max( len, static_cast< int32_t >( _columns[ j ][ i ].size() + 1 ) );
+                }
+                append( data, static_cast< int32_t >( _inx[ j ] ) );
+                append( data, len );
+                for ( int32_t i = 0; i < row_cnt; ++i ) {
+                    data += _columns[ j ][ i ];
+                    data.append( len - _columns[ j ][ i ].size(), '\0' );
+                }
+            }
+
+            mkdir( dir_.substr( 0, dir_.rfind( '/' ) ).c_str(), 0700 );
+            mkdir( dir_.c_str(), 0700 );
+            std::string final_path = path( _key );
+            char suffix[ 32 ];
+            snprintf( suffix, sizeof( suffix ), ".%d", static_cast< int >( getpid() ) );
+            std::string tmp_path = final_path + suffix;
+            int fd = open( tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+            if ( fd < 0 ) {
+                return;
+            }
+            bool ok = ::write( fd, data.data(), data.size() ) == static_cast< ssize_t >( data.size() );
+            ok = close( fd ) == 0 && ok;
+            if ( !ok || rename( tmp_path.c_str(), final_path.c_str() ) != 0 ) {
+                unlink( tmp_path.c_str() );
+            }
+        }
+
+    private:
+        template < typename T >
+        static void append( std::string& _data, T _value ) {
+            _data.append( reinterpret_cast< const char* >( &_value ), sizeof( _value ) );
+        }
+
+        // collapse runs of white space outside quotes, drop the white
+        // space between a comparison operator and its operand, so that
+        // = 'x' and ='x' give the same key, and trim the ends
+        static std::string normalize( const char* _value ) {
+            std::string out;
+            char quote = '\0';
+            bool space = false;
+            for ( const char* p = _value; *p != '\0'; ++p ) {
+                if ( quote == '\0' && isspace( static_cast< unsigned char >( *p ) ) ) {
+                    space = true;
+                    continue;
+                }
+                if ( space && !out.empty() &&
+                        is_operator( out[ out.size() - 1 ] ) == is_operator( *p ) ) {
+                    out += ' ';
+                }
+                space = false;
+                if ( quote == '\0' && ( *p == '\'' || *p == '"' ) ) {
+                    quote = *p;
+                }
+                else if ( *p == quote ) {
+                    quote = '\0';
+                }
+                out += *p;
+            }
+            return out;
+        }
+
+        static bool is_operator( char _c ) {
+            return _c == '=' || _c == '<' || _c == '>' || _c == '!';
+        }
+
+        // the file for a key is named by the key's FNV-1a hash; the key is
+        // stored in the file as well to tell collisions apart
+        std::string path( const std::string& _key ) const {
+            uint64_t hash = 14695981039346656037ULL;
+            for ( size_t i = 0; i < _key.size(); ++i ) {
+                hash ^= static_cast< unsigned char >( _key[ i ] );
+                hash *= 1099511628211ULL;
+            }
+            char name[ 17 ];
+            snprintf( name, sizeof( name ), "%016llx", static_cast< unsigned long long >( hash ) );
+            return dir_ + "/" + name;
+        }
+
+        const rodsEnv& env_;
+        time_t         ttl_;
+        std::string    dir_;
+
+    }; // class query_cache
+
+    // =-=-=-=-=-=-=-
+    // a pager that serves a query from the cache when it holds a current
+    // result for it, and otherwise runs the query on the server with
+    // _Pager and stores the result once it has been read to the end.
+    // the connection is only asked for when the query goes to the server,
+    // so an invocation answered entirely from the cache never connects.
+    template < typename _Pager = genquery_pager >
+    class cached_pager {
+    public:
+        cached_pager(
+            const query_cache&                  _cache,
+            const std::function< rcComm_t*() >& _connect,
+            genQueryInp_t*                      _inp,
+            genQueryOut_t**                     _out,
+            int                                 _initial_rows = genquery_pager::INITIAL_ROWS ) :
+            cache_( _cache ),
+            connect_( _connect ),
+            inp_( _inp ),
+            out_( _out ),
+            initial_rows_( _initial_rows ),
+            next_row_( 0 ),
+            from_cache_( false ),
+            recording_( false ) {
+            *out_ = NULL;
+        }
+
+        ~cached_pager() {
+            pager_.reset();
+            freeGenQueryOut( out_ );
+        }
+
+        int first() {
+            pager_.reset();
+            freeGenQueryOut( out_ );
+            key_ = cache_.enabled() ? cache_.key( *inp_ ) : std::string();
+
+            from_cache_ = cache_.enabled() && cache_.load( key_, result_ );
+            if ( from_cache_ ) {
+                next_row_ = 0;
+                if ( result_.status() != 0 ) {
+                    return result_.status();
+                }
+                if ( result_.row_count() == 0 ) {
+                    return CAT_NO_ROWS_FOUND;
+                }
+                return serve();
+            }
+
+            rcComm_t* conn = connect_();
+            if ( conn == NULL ) {
+                return USER_SOCK_CONNECT_ERR;
+            }
+            pager_.reset( new _Pager( conn, inp_, out_, initial_rows_ ) );
+            recording_ = cache_.enabled();
+            inx_.clear();
+            columns_.clear();
+            return record( pager_->first() );
+        }
+
+        bool more() const {
+            if ( from_cache_ ) {
+                return next_row_ < result_.row_count();
+            }
+            return pager_ && pager_->more();
+        }
+
+        int next() {
+            if ( from_cache_ ) {
+                return serve();
+            }
+            return record( pager_->next() );
+        }
+
+    private:
+        int serve() {
+            freeGenQueryOut( out_ );
+            *out_ = result_.page( next_row_, MAX_SQL_ROWS );
+            next_row_ += ( *out_ )->rowCnt;
+            return 0;
+        }
+
+        // keep the rows of each page, and store the result once the last
+        // page has been read.  errors are not cached.
+        int record( int _status ) {
+            if ( !recording_ ) {
+                return _status;
+            }
+            if ( _status == CAT_NO_ROWS_FOUND && columns_.empty() ) {
+                recording_ = false;
+                cache_.store( key_, _status, inx_, columns_ );
+                return _status;
+            }
+            if ( _status != 0 ) {
+                recording_ = false;
+                return _status;
+            }
+
+            const genQueryOut_t* out = *out_;
+            if ( columns_.empty() ) {
+                columns_.resize( out->attriCnt );
+                for ( int j = 0; j < out->attriCnt; ++j ) {
+                    inx_.push_back( out->sqlResult[ j ].attriInx );
+                }
+            }
+            for ( int j = 0; j < out->attriCnt; ++j ) {
+                for ( int i = 0; i < out->rowCnt; ++i ) {
+                    columns_[ j ].push_back( out->sqlResult[ j ].value + i * out->sqlResult[ j ].len );
+                }
+            }
+            if ( !pager_->more() ) {
+                recording_ = false;
+                cache_.store( key_, 0, inx_, columns_ );
+            }
+            return _status;
+        }
+
+        cached_pager( const cached_pager& );
+        cached_pager& operator=( const cached_pager& );
+
+        const query_cache&                        cache_;
+        std::function< rcComm_t*() >              connect_;
+        genQueryInp_t*                            inp_;
+        genQueryOut_t**                           out_;
+        int                                       initial_rows_;
+        std::unique_ptr< _Pager >                 pager_;
+        std::string                               key_;
+        cached_result                             result_;
+        int                                       next_row_;
+        bool                                      from_cache_;
+        bool                                      recording_;
+        std::vector< int >                        inx_;
+        std::vector< std::vector< std::string > > columns_;
+
+    }; // class cached_pager
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_QUERY_CACHE_HPP
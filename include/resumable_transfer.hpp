@@ -0,0 +1,592 @@
+#ifndef ICOMMANDS_RESUMABLE_TRANSFER_HPP
+#define ICOMMANDS_RESUMABLE_TRANSFER_HPP
+
+#include "rodsClient.h"
+#include "miscUtil.h"
+#include "transfer_engine.hpp"
+#include "transfer_journal.hpp"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace icommands {
+
+    // files at least this large are moved in chunks of this size, each
+    // recorded in the journal once stored, so that an interrupted
+    // transfer of one picks up at its first missing chunk
+    static const uint64_t RESUME_CHUNK_SIZE = 64 * 1024 * 1024;
+
+    // the most data sent or asked for in one request
+    static const size_t RESUME_IO_SIZE = 4 * 1024 * 1024;
+
+    // =-=-=-=-=-=-=-
+    // the journal key of a file moved from _from to _to
+    inline uint64_t journal_key(
+        const std::string& _from,
+        const std::string& _to,
+        uint64_t           _size,
+        time_t             _mtime ) {
+        int64_t mtime = _mtime;
+        uint64_t key = journal_hash( _from );
+        key = journal_hash( _to, key );
+        key = journal_hash( &_size, sizeof( _size ), key );
+        return journal_hash( &mtime, sizeof( mtime ), key );
+    }
+
+    // =-=-=-=-=-=-=-
+    // the journal identity of a whole transfer: the tool and each of its
+    // source and target paths, in order
+    inline uint64_t journal_job(
+        const char*                       _tool,
+        const std::vector< std::string >& _sources,
+        const std::vector< std::string >& _targets ) {
+        uint64_t job = journal_hash( std::string( _tool ) );
+        for ( size_t i = 0; i < _sources.size(); ++i ) {
+            job = journal_hash( _sources[ i ], job );
+            job = journal_hash( _targets[ i ], job );
+        }
+        return job;
+    }
+
+    inline int seek_data_object( rcComm_t* _conn, int _l1descInx, rodsLong_t _offset ) {
+        openedDataObjInp_t seekInp;
+        memset( &seekInp, 0, sizeof( seekInp ) );
+        seekInp.l1descInx = _l1descInx;
+        seekInp.offset    = _offset;
+        seekInp.whence    = SEEK_SET;
+        fileLseekOut_t* seekOut = NULL;
+        int status = rcDataObjLseek( _conn, &seekInp, &seekOut );
+        free( seekOut );
+        return status;
+    }
+
+    inline int close_data_object( rcComm_t* _conn, int _l1descInx ) {
+        openedDataObjInp_t closeInp;
+        memset( &closeInp, 0, sizeof( closeInp ) );
+        closeInp.l1descInx = _l1descInx;
+        return rcDataObjClose( _conn, &closeInp );
+    }
+
+    // =-=-=-=-=-=-=-
+    // an upload_engine that records its progress in a transfer_journal.
+    // files the journal has as done are skipped.  files smaller than the
+    // journal's chunk size are put whole; larger ones are created and
+    // written a chunk at a time with rcDataObjWrite, and when resumed are
+    // reopened and only their missing chunks written.  a target the
+    // journal shows this transfer started is overwritten without -f, as
+    // it may hold a partial upload.
+    class resumable_upload_engine : public upload_engine {
+    public:
+        resumable_upload_engine(
+            rodsEnv&              _env,
+            const upload_options& _opts,
+            transfer_journal&     _journal ) :
+            upload_engine( _env, _opts ),
+            journal_( _journal ) {
+        }
+
+    protected:
+        int put_file( rcComm_t* _conn, const upload_item& _item ) {
+            uint64_t key = journal_key( _item.local, _item.remote, _item.size, _item.mtime );
+            if ( journal_.done( key ) ) {
+                return SKIPPED;
+            }
+            bool started = journal_.started( key );
+            if ( !started ) {
+                int status = journal_.start( key );
+                if ( status < 0 ) {
+                    return status;
+                }
+            }
+
+            bool chunked = static_cast< uint64_t >( _item.size ) >= journal_.chunk_size();
+            int status = chunked ?
+                         put_chunks( _conn, _item, key, started ) :
+                         put_whole( _conn, _item, started );
+            if ( status == OVERWRITE_WITHOUT_FORCE_FLAG ) {
+                // the target was somebody else's and is left alone
+                journal_.abort( key );
+                return status;
+            }
+            if ( status < 0 ) {
+                return status;
+            }
+            status = journal_.finish( key );
+            if ( status < 0 || !chunked ) {
+                return status;
+            }
+
+            stats_.add( 0 );
+            if ( opts_.verbose ) {
+                printf( "   %s  %lld bytes\n", _item.local.c_str(),
+                        static_cast< long long >( _item.size ) );
+            }
+            return COUNTED;
+
+        } // put_file
+
+    private:
+        int put_whole( rcComm_t* _conn, const upload_item& _item, bool _started ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _item.remote.c_str(), MAX_NAME_LEN );
+            dataObjInp.dataSize   = _item.size;
+            dataObjInp.createMode = _item.mode;
+            dataObjInp.openFlags  = O_RDWR;
+            dataObjInp.oprType    = PUT_OPR;
+            dataObjInp.numThreads = opts_.num_threads;
+            add_keywords( dataObjInp.condInput );
+            if ( _started && !opts_.force ) {
+                addKeyVal( &dataObjInp.condInput, FORCE_FLAG_KW, "" );
+            }
+
+            int status = rcDataObjPut( _conn, &dataObjInp, const_cast< char* >( _item.local.c_str() ) );
+            clearKeyVal( &dataObjInp.condInput );
+            return status;
+        }
+
+        // write the chunks of _item the journal does not have, counting
+        // the bytes in stats_ as they are written
+        int put_chunks( rcComm_t* _conn, const upload_item& _item, uint64_t _key, bool _started ) {
+            int fd = open( _item.local.c_str(), O_RDONLY );
+            if ( fd < 0 ) {
+                return UNIX_FILE_OPEN_ERR - errno;
+            }
+
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _item.remote.c_str(), MAX_NAME_LEN );
+            dataObjInp.dataSize   = _item.size;
+            dataObjInp.createMode = _item.mode;
+            dataObjInp.openFlags  = O_WRONLY;
+            dataObjInp.oprType    = PUT_OPR;
+            add_keywords( dataObjInp.condInput );
+
+            // reopen a started upload without truncating it, or start
+            // again if its data object has gone
+            bool resumed = false;
+            int l1descInx = -1;
+            if ( _started ) {
+                l1descInx = rcDataObjOpen( _conn, &dataObjInp );
+                resumed = l1descInx >= 0;
+                if ( !resumed ) {
+                    rodsLogError( LOG_NOTICE, l1descInx, "cannot reopen %s, uploading it again",
+                                  _item.remote.c_str() );
+                    if ( !opts_.force ) {
+                        addKeyVal( &dataObjInp.condInput, FORCE_FLAG_KW, "" );
+                    }
+                }
+            }
+            if ( !resumed ) {
+                l1descInx = rcDataObjCreate( _conn, &dataObjInp );
+            }
+            clearKeyVal( &dataObjInp.condInput );
+            if ( l1descInx < 0 ) {
+                close( fd );
+                return l1descInx;
+            }
+
+            uint64_t size = _item.size;
+            uint64_t chunk_size = journal_.chunk_size();
+            uint32_t chunks = static_cast< uint32_t >( ( size + chunk_size - 1 ) / chunk_size );
+            std::vector< char > buf( RESUME_IO_SIZE );
+            int status = 0;
+            for ( uint32_t c = 0; c < chunks && status >= 0; ++c ) {
+                if ( resumed && journal_.chunk_done( _key, c ) ) {
+                    continue;
+                }
+                uint64_t offset = c * chunk_size;
+                uint64_t end = std::min( size, offset + chunk_size );
+                status = seek_data_object( _conn, l1descInx, offset );
+                while ( status >= 0 && offset < end ) {
+                    size_t len = static_cast< size_t >( std::min< uint64_t >( buf.size(), end - offset ) );
+                    ssize_t n = pread( fd, &buf[ 0 ], len, offset );
+                    if ( n != static_cast< ssize_t >( len ) ) {
+                        status = n < 0 ? UNIX_FILE_READ_ERR - errno : SYS_COPY_LEN_ERR;
+                        break;
+                    }
+
+                    openedDataObjInp_t writeInp;
+                    memset( &writeInp, 0, sizeof( writeInp ) );
+                    writeInp.l1descInx = l1descInx;
+                    writeInp.len       = static_cast< int >( len );
+                    bytesBuf_t writeBuf;
+                    writeBuf.len = writeInp.len;
+                    writeBuf.buf = &buf[ 0 ];
+                    status = rcDataObjWrite( _conn, &writeInp, &writeBuf );
+                    if ( status >= 0 && status != writeInp.len ) {
+                        status = SYS_COPY_LEN_ERR;
+                    }
+                    if ( status >= 0 ) {
+                        offset += len;
+                        stats_.add( len, 0 );
+                    }
+                }
+                if ( status >= 0 ) {
+                    status = journal_.chunk( _key, c );
+                }
+            }
+            close( fd );
+
+            int close_status = close_data_object( _conn, l1descInx );
+            return status < 0 ? status : close_status;
+
+        } // put_chunks
+
+        transfer_journal& journal_;
+
+    }; // class resumable_upload_engine
+
+    // =-=-=-=-=-=-=-
+    // settings for download_engine.  a queue_size of 0 holds 64 data
+    // objects per worker between the listing and the workers.
+    struct download_options {
+        download_options() :
+            workers( 4 ),
+            queue_size( 0 ),
+            force( false ),
+            verbose( false ),
+            progress( false ) {
+        }
+
+        size_t      workers;
+        size_t      queue_size;
+        bool        force;
+        bool        verbose;
+        bool        progress;
+        std::string resource;
+    };
+
+    // =-=-=-=-=-=-=-
+    // one data object for a worker to download
+    struct download_item {
+        std::string remote;
+        std::string local;
+        rodsLong_t  size;
+        time_t      mtime;
+    };
+
+    // =-=-=-=-=-=-=-
+    // downloads data objects and collections with a pool of workers, each
+    // on its own connection, recording its progress in a
+    // transfer_journal as resumable_upload_engine does.  collections are
+    // listed on the first connection while the other workers download
+    // what has been found so far, and the first connection joins them
+    // once the listing is done.  data objects smaller than the journal's
+    // chunk size are got whole; larger ones are read a chunk at a time
+    // into the local file, which is synced before each chunk is recorded.
+    class download_engine {
+    public:
+        download_engine(
+            rodsEnv&                _env,
+            const download_options& _opts,
+            transfer_journal&       _journal ) :
+            env_( _env ),
+            opts_( _opts ),
+            journal_( _journal ),
+            first_error_( 0 ) {
+        }
+
+        // download each of _sources, a data object or collection, to the
+        // matching local path in _targets, using _conn as the first
+        // connection.  returns the first error, after trying every object.
+        int run(
+            rcComm_t*                         _conn,
+            const std::vector< std::string >& _sources,
+            const std::vector< std::string >& _targets ) {
+            connection_pool pool( env_, _conn );
+            int status = pool.open( opts_.workers > 0 ? opts_.workers : 1 );
+            if ( status < 0 ) {
+                return status;
+            }
+            if ( static_cast< size_t >( status ) < opts_.workers ) {
+                rodsLog( LOG_NOTICE, "only %d of %d connections could be opened",
+                         status, static_cast< int >( opts_.workers ) );
+            }
+
+            // with a single connection everything is listed before the
+            // downloads start, so the queue must hold it all
+            bounded_queue< download_item > queue(
+                pool.size() == 1 ? std::numeric_limits< size_t >::max() :
+                opts_.queue_size > 0 ? opts_.queue_size : 64 * pool.size() );
+            std::unique_ptr< progress_reporter > reporter;
+            if ( opts_.progress ) {
+                reporter.reset( new progress_reporter( stats_, stdout, 1.0 ) );
+            }
+
+            std::vector< std::thread > workers;
+            for ( size_t i = 1; i < pool.size(); ++i ) {
+                workers.push_back( std::thread( &download_engine::work, this,
+                                                pool.at( i ), std::ref( queue ) ) );
+            }
+            for ( size_t i = 0; i < _sources.size(); ++i ) {
+                list( pool.at( 0 ), _sources[ i ], _targets[ i ], queue );
+            }
+            queue.close();
+            work( pool.at( 0 ), queue );
+
+            for ( size_t i = 0; i < workers.size(); ++i ) {
+                workers[ i ].join();
+            }
+            if ( reporter ) {
+                reporter->stop();
+            }
+            return first_error_;
+
+        } // run
+
+        const transfer_stats& stats() const {
+            return stats_;
+        }
+
+    private:
+        static const int SKIPPED = 1;
+
+        // queue _source, or every data object below it if it is a
+        // collection, creating the local directories as they are found
+        void list(
+            rcComm_t*                       _conn,
+            const std::string&              _source,
+            const std::string&              _target,
+            bounded_queue< download_item >& _queue ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _source.c_str(), MAX_NAME_LEN );
+            rodsObjStat_t* objStat = NULL;
+            int status = rcObjStat( _conn, &dataObjInp, &objStat );
+            if ( status < 0 ) {
+                failed( _source, status );
+                return;
+            }
+            objType_t type = objStat->objType;
+            download_item item;
+            item.remote = _source;
+            item.local  = _target;
+            item.size   = objStat->objSize;
+            item.mtime  = atol( objStat->modifyTime );
+            freeRodsObjStat( objStat );
+            if ( type == DATA_OBJ_T ) {
+                _queue.push( item );
+                return;
+            }
+
+            std::vector< std::pair< std::string, std::string > > colls;
+            colls.push_back( std::make_pair( _source, _target ) );
+            while ( !colls.empty() ) {
+                std::string coll = colls.back().first;
+                std::string dir = colls.back().second;
+                colls.pop_back();
+                if ( mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+                    failed( dir, UNIX_FILE_MKDIR_ERR - errno );
+                    continue;
+                }
+
+                collHandle_t collHandle;
+                status = rclOpenCollection( _conn, const_cast< char* >( coll.c_str() ),
+                                            LONG_METADATA_FG, &collHandle );
+                if ( status < 0 ) {
+                    failed( coll, status );
+                    continue;
+                }
+                collEnt_t collEnt;
+                while ( rclReadCollection( _conn, &collHandle, &collEnt ) >= 0 ) {
+                    if ( collEnt.objType == COLL_OBJ_T ) {
+                        std::string sub = collEnt.collName;
+                        size_t slash = sub.rfind( '/' );
+                        colls.push_back( std::make_pair( sub, dir + sub.substr( slash ) ) );
+                    }
+                    else if ( collEnt.objType == DATA_OBJ_T ) {
+                        item.remote = coll + "/" + collEnt.dataName;
+                        item.local  = dir + "/" + collEnt.dataName;
+                        item.size   = collEnt.dataSize;
+                        item.mtime  = collEnt.modifyTime ? atol( collEnt.modifyTime ) : 0;
+                        _queue.push( item );
+                    }
+                }
+                rclCloseCollection( &collHandle );
+            }
+
+        } // list
+
+        void work( rcComm_t* _conn, bounded_queue< download_item >& _queue ) {
+            download_item item;
+            while ( _queue.pop( item ) ) {
+                int status = get_file( _conn, item );
+                if ( status == 0 ) {
+                    stats_.add( 0 );
+                    if ( opts_.verbose ) {
+                        printf( "   %s  %lld bytes\n", item.local.c_str(),
+                                static_cast< long long >( item.size ) );
+                    }
+                }
+                else if ( status == SKIPPED ) {
+                    stats_.skip();
+                }
+                else if ( status < 0 ) {
+                    failed( item.remote, status );
+                }
+            }
+        }
+
+        // download one data object, counting its bytes in stats_
+        int get_file( rcComm_t* _conn, const download_item& _item ) {
+            uint64_t key = journal_key( _item.remote, _item.local, _item.size, _item.mtime );
+            if ( journal_.done( key ) ) {
+                return SKIPPED;
+            }
+            bool started = journal_.started( key );
+            if ( !started ) {
+                int status = journal_.start( key );
+                if ( status < 0 ) {
+                    return status;
+                }
+            }
+
+            int status = static_cast< uint64_t >( _item.size ) >= journal_.chunk_size() ?
+                         get_chunks( _conn, _item, key, started ) :
+                         get_whole( _conn, _item, started );
+            if ( status == OVERWRITE_WITHOUT_FORCE_FLAG ) {
+                journal_.abort( key );
+                return status;
+            }
+            return status < 0 ? status : journal_.finish( key );
+
+        } // get_file
+
+        int get_whole( rcComm_t* _conn, const download_item& _item, bool _started ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _item.remote.c_str(), MAX_NAME_LEN );
+            dataObjInp.dataSize  = _item.size;
+            dataObjInp.openFlags = O_RDONLY;
+            dataObjInp.oprType   = GET_OPR;
+            if ( opts_.force || _started ) {
+                addKeyVal( &dataObjInp.condInput, FORCE_FLAG_KW, "" );
+            }
+            if ( !opts_.resource.empty() ) {
+                addKeyVal( &dataObjInp.condInput, RESC_NAME_KW, opts_.resource.c_str() );
+            }
+
+            int status = rcDataObjGet( _conn, &dataObjInp, const_cast< char* >( _item.local.c_str() ) );
+            clearKeyVal( &dataObjInp.condInput );
+            if ( status >= 0 ) {
+                stats_.add( _item.size, 0 );
+            }
+            return status;
+        }
+
+        int get_chunks( rcComm_t* _conn, const download_item& _item, uint64_t _key, bool _started ) {
+            // a started download is continued in place if its file is
+            // still there; otherwise the local file is only replaced with -f
+            bool resumed = false;
+            int fd = -1;
+            if ( _started ) {
+                fd = open( _item.local.c_str(), O_WRONLY );
+                resumed = fd >= 0;
+            }
+            if ( !resumed ) {
+                int flags = O_WRONLY | O_CREAT;
+                if ( !_started && !opts_.force ) {
+                    flags |= O_EXCL;
+                }
+                fd = open( _item.local.c_str(), flags, 0644 );
+            }
+            if ( fd < 0 ) {
+                return errno == EEXIST ? OVERWRITE_WITHOUT_FORCE_FLAG : UNIX_FILE_OPEN_ERR - errno;
+            }
+
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _item.remote.c_str(), MAX_NAME_LEN );
+            dataObjInp.openFlags = O_RDONLY;
+            if ( !opts_.resource.empty() ) {
+                addKeyVal( &dataObjInp.condInput, RESC_NAME_KW, opts_.resource.c_str() );
+            }
+            int l1descInx = rcDataObjOpen( _conn, &dataObjInp );
+            clearKeyVal( &dataObjInp.condInput );
+            if ( l1descInx < 0 ) {
+                close( fd );
+                return l1descInx;
+            }
+
+            uint64_t size = _item.size;
+            uint64_t chunk_size = journal_.chunk_size();
+            uint32_t chunks = static_cast< uint32_t >( ( size + chunk_size - 1 ) / chunk_size );
+            std::vector< char > buf( RESUME_IO_SIZE );
+            int status = 0;
+            for ( uint32_t c = 0; c < chunks && status >= 0; ++c ) {
+                if ( resumed && journal_.chunk_done( _key, c ) ) {
+                    continue;
+                }
+                uint64_t offset = c * chunk_size;
+                uint64_t end = std::min( size, offset + chunk_size );
+                status = seek_data_object( _conn, l1descInx, offset );
+                while ( status >= 0 && offset < end ) {
+                    openedDataObjInp_t readInp;
+                    memset( &readInp, 0, sizeof( readInp ) );
+                    readInp.l1descInx = l1descInx;
+                    readInp.len       = static_cast< int >( std::min< uint64_t >( buf.size(), end - offset ) );
+                    bytesBuf_t readBuf;
+                    readBuf.len = readInp.len;
+                    readBuf.buf = &buf[ 0 ];
+                    int n = rcDataObjRead( _conn, &readInp, &readBuf );
+                    if ( n <= 0 ) {
+                        status = n < 0 ? n : SYS_COPY_LEN_ERR;
+                        break;
+                    }
+                    if ( pwrite( fd, &buf[ 0 ], n, offset ) != n ) {
+                        status = UNIX_FILE_WRITE_ERR - errno;
+                        break;
+                    }
+                    offset += n;
+                    stats_.add( n, 0 );
+                }
+                if ( status >= 0 && fdatasync( fd ) != 0 ) {
+                    status = UNIX_FILE_WRITE_ERR - errno;
+                }
+                if ( status >= 0 ) {
+                    status = journal_.chunk( _key, c );
+                }
+            }
+
+            // a file replaced with -f may have been longer
+            if ( status >= 0 && ftruncate( fd, size ) != 0 ) {
+                status = UNIX_FILE_WRITE_ERR - errno;
+            }
+            close( fd );
+            close_data_object( _conn, l1descInx );
+            return status;
+
+        } // get_chunks
+
+        void failed( const std::string& _path, int _status ) {
+            stats_.error();
+            rodsLogError( LOG_ERROR, _status, "%s failed", _path.c_str() );
+            int none = 0;
+            first_error_.compare_exchange_strong( none, _status );
+        }
+
+        rodsEnv&               env_;
+        const download_options opts_;
+        transfer_journal&      journal_;
+        transfer_stats         stats_;
+        std::atomic< int >     first_error_;
+
+    }; // class download_engine
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_RESUMABLE_TRANSFER_HPP
@@ -0,0 +1,473 @@
+#ifndef ICOMMANDS_TRANSFER_ENGINE_HPP
+#define ICOMMANDS_TRANSFER_ENGINE_HPP
+
+#include "rodsClient.h"
+#include "checksum.hpp"
+#include "irods_hasher_factory.hpp"
+#include "connection_pool.hpp"
+#include "tree_walker.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // checksum a local file with chksumLocFile in the scheme that _like,
+    // a checksum from the catalog, was computed in, so that the two can
+    // be compared as strings
+    inline int local_checksum( const std::string& _path, const std::string& _like, std::string& _checksum ) {
+        std::string scheme;
+        irods::error ret = irods::get_hash_scheme_from_checksum( _like, scheme );
+        if ( !ret.ok() ) {
+            return ret.code();
+        }
+        char chksum[ NAME_LEN ];
+        memset( chksum, 0, sizeof( chksum ) );
+        int status = chksumLocFile( _path.c_str(), chksum, scheme.c_str() );
+        if ( status < 0 ) {
+            return status;
+        }
+        _checksum = chksum;
+        return 0;
+    }
+
+    // the checksum of a data object, which the server computes and
+    // registers if it has none
+    inline int object_checksum( rcComm_t* _conn, const std::string& _path, std::string& _checksum ) {
+        dataObjInp_t dataObjInp;
+        memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+        rstrcpy( dataObjInp.objPath, _path.c_str(), MAX_NAME_LEN );
+        char* chksum = NULL;
+        int status = rcDataObjChksum( _conn, &dataObjInp, &chksum );
+        if ( status >= 0 && chksum != NULL ) {
+            _checksum = chksum;
+        }
+        free( chksum );
+        return status;
+    }
+
+    // =-=-=-=-=-=-=-
+    // running totals of a transfer, updated from the worker threads
+    class transfer_stats {
+    public:
+        transfer_stats() :
+            files_( 0 ),
+            bytes_( 0 ),
+            errors_( 0 ),
+            skipped_( 0 ),
+            start_( std::chrono::steady_clock::now() ) {
+        }
+
+        void add( off_t _bytes, size_t _files = 1 ) {
+            files_ += _files;
+            bytes_ += _bytes;
+        }
+
+        void error() {
+            ++errors_;
+        }
+
+        // a file that needed no transfer
+        void skip() {
+            ++skipped_;
+        }
+
+        size_t files() const {
+            return files_;
+        }
+
+        size_t errors() const {
+            return errors_;
+        }
+
+        double seconds() const {
+            return std::chrono::duration< double >(
+                       std::chrono::steady_clock::now() - start_ ).count();
+        }
+
+        // e.g. "1200 files, 61.3 MB in 4.1 s: 14.9 MB/s, 292.7 files/s"
+        std::string summary() const {
+            double secs = seconds();
+            double mb = static_cast< double >( bytes_ ) / ( 1024 * 1024 );
+            char line[ 256 ];
+            snprintf( line, sizeof( line ), "%lu files, %.1f MB in %.1f s: %.1f MB/s, %.1f files/s",
+                      static_cast< unsigned long >( files_ ), mb, secs,
+                      secs > 0 ? mb / secs : 0.0, secs > 0 ? files_ / secs : 0.0 );
+            std::string text = line;
+            if ( skipped_ > 0 ) {
+                snprintf( line, sizeof( line ), ", %lu skipped", static_cast< unsigned long >( skipped_ ) );
+                text += line;
+            }
+            if ( errors_ > 0 ) {
+                snprintf( line, sizeof( line ), ", %lu failed", static_cast< unsigned long >( errors_ ) );
+                text += line;
+            }
+            return text;
+        }
+
+    private:
+        std::atomic< size_t >                 files_;
+        std::atomic< unsigned long long >     bytes_;
+        std::atomic< size_t >                 errors_;
+        std::atomic< size_t >                 skipped_;
+        std::chrono::steady_clock::time_point start_;
+
+    }; // class transfer_stats
+
+    // =-=-=-=-=-=-=-
+    // prints a transfer's summary every _interval seconds from its own
+    // thread until stopped, overwriting the line on a terminal and
+    // writing a new line otherwise
+    class progress_reporter {
+    public:
+        progress_reporter( const transfer_stats& _stats, FILE* _out, double _interval ) :
+            stats_( _stats ),
+            out_( _out ),
+            tty_( isatty( fileno( _out ) ) != 0 ),
+            stopped_( false ) {
+            thread_ = std::thread( [this, _interval] {
+                std::unique_lock< std::mutex > lock( mutex_ );
+                while ( !cv_.wait_for( lock, std::chrono::duration< double >( _interval ),
+                                       [this] { return stopped_; } ) ) {
+                    fprintf( out_, tty_ ? "\r%s " : "%s\n", stats_.summary().c_str() );
+                    fflush( out_ );
+                }
+            } );
+        }
+
+        ~progress_reporter() {
+            stop();
+        }
+
+        void stop() {
+            {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                if ( stopped_ ) {
+                    return;
+                }
+                stopped_ = true;
+                cv_.notify_all();
+            }
+            thread_.join();
+            if ( tty_ ) {
+                fprintf( out_, "\r" );
+            }
+        }
+
+    private:
+        const transfer_stats&   stats_;
+        FILE*                   out_;
+        bool                    tty_;
+        bool                    stopped_;
+        std::mutex              mutex_;
+        std::condition_variable cv_;
+        std::thread             thread_;
+
+    }; // class progress_reporter
+
+    // =-=-=-=-=-=-=-
+    // settings for upload_engine.  a queue_size of 0 holds 64 files per
+    // worker between the scanners and the workers.
+    struct upload_options {
+        upload_options() :
+            scanners( 4 ),
+            workers( 4 ),
+            queue_size( 0 ),
+            num_threads( 0 ),
+            force( false ),
+            checksum( false ),
+            skip_links( false ),
+            verbose( false ),
+            progress( false ) {
+        }
+
+        size_t      scanners;
+        size_t      workers;
+        size_t      queue_size;
+        int         num_threads;
+        bool        force;
+        bool        checksum;
+        bool        skip_links;
+        bool        verbose;
+        bool        progress;
+        std::string resource;
+        std::string data_type;
+    };
+
+    // =-=-=-=-=-=-=-
+    // one file or collection for a worker to upload or create.  for an
+    // entry found under a source directory, base is the collection that
+    // directory is uploaded to and relative the entry's path below it;
+    // both are empty for a file given on its own.
+    struct upload_item {
+        std::string local;
+        std::string remote;
+        std::string base;
+        std::string relative;
+        bool        collection;
+        off_t       size;
+        mode_t      mode;
+        time_t      mtime;
+    };
+
+    // =-=-=-=-=-=-=-
+    // uploads local files and directory trees.  a tree_walker's scanners
+    // find the files and push them onto a bounded queue, which a pool of
+    // workers, each on its own connection, drains file by file with
+    // rcDataObjPut.  collections are created on first use, so a worker
+    // never waits for another to create a file's parent.  put_file may be
+    // overridden to transfer files differently, and wanted to leave out
+    // some of what the scanners find.
+    class upload_engine {
+    public:
+        upload_engine( rodsEnv& _env, const upload_options& _opts ) :
+            env_( _env ),
+            opts_( _opts ),
+            first_error_( 0 ) {
+        }
+
+        virtual ~upload_engine() {
+        }
+
+        // upload each of _sources, a local file or directory, to the
+        // matching path in _targets, using _conn as the first worker's
+        // connection.  returns the first error, after trying every file.
+        int run(
+            rcComm_t*                         _conn,
+            const std::vector< std::string >& _sources,
+            const std::vector< std::string >& _targets ) {
+            connection_pool pool( env_, _conn );
+            int status = pool.open( opts_.workers > 0 ? opts_.workers : 1 );
+            if ( status < 0 ) {
+                return status;
+            }
+            if ( static_cast< size_t >( status ) < opts_.workers ) {
+                rodsLog( LOG_NOTICE, "only %d of %d connections could be opened",
+                         status, static_cast< int >( opts_.workers ) );
+            }
+
+            bounded_queue< upload_item > queue(
+                opts_.queue_size > 0 ? opts_.queue_size : 64 * pool.size() );
+            std::unique_ptr< progress_reporter > reporter;
+            if ( opts_.progress ) {
+                reporter.reset( new progress_reporter( stats_, stdout, 1.0 ) );
+            }
+
+            std::vector< std::thread > workers;
+            for ( size_t i = 0; i < pool.size(); ++i ) {
+                workers.push_back( std::thread( &upload_engine::work, this,
+                                                pool.at( i ), std::ref( queue ) ) );
+            }
+
+            std::vector< std::string > roots;
+            std::vector< std::string > root_targets;
+            for ( size_t i = 0; i < _sources.size(); ++i ) {
+                struct stat st;
+                if ( stat( _sources[ i ].c_str(), &st ) != 0 ) {
+                    failed( _sources[ i ], UNIX_FILE_STAT_ERR - errno );
+                    continue;
+                }
+                if ( S_ISDIR( st.st_mode ) ) {
+                    roots.push_back( _sources[ i ] );
+                    root_targets.push_back( _targets[ i ] );
+                    continue;
+                }
+                upload_item item;
+                item.local      = _sources[ i ];
+                item.remote     = _targets[ i ];
+                item.collection = false;
+                item.size       = st.st_size;
+                item.mode       = st.st_mode;
+                item.mtime      = st.st_mtime;
+                if ( wanted( item ) ) {
+                    queue.push( item );
+                }
+            }
+
+            tree_walker walker( opts_.scanners, opts_.skip_links );
+            walker.walk( roots,
+                [&]( const walk_entry& _entry ) {
+                    upload_item item;
+                    item.local      = _entry.path;
+                    item.remote     = root_targets[ _entry.root ];
+                    if ( !_entry.relative.empty() ) {
+                        item.remote += "/" + _entry.relative;
+                    }
+                    item.base       = root_targets[ _entry.root ];
+                    item.relative   = _entry.relative;
+                    item.collection = _entry.directory;
+                    item.size       = _entry.size;
+                    item.mode       = _entry.mode;
+                    item.mtime      = _entry.mtime;
+                    if ( wanted( item ) ) {
+                        queue.push( item );
+                    }
+                },
+                [&]( const std::string& _path, int _errno ) {
+                    failed( _path, UNIX_FILE_OPENDIR_ERR - _errno );
+                } );
+
+            queue.close();
+            for ( size_t i = 0; i < workers.size(); ++i ) {
+                workers[ i ].join();
+            }
+            if ( reporter ) {
+                reporter->stop();
+            }
+            return first_error_;
+
+        } // run
+
+        const transfer_stats& stats() const {
+            return stats_;
+        }
+
+    protected:
+        // returned by put_file when it has taken the file to upload
+        // later, and will count it in stats_ then
+        static const int DEFERRED = 1;
+
+        // returned by put_file when the file needs no upload
+        static const int SKIPPED = 2;
+
+        // returned by put_file when it has uploaded the file and counted
+        // it in stats_ itself
+        static const int COUNTED = 3;
+
+        // upload one file on _conn
+        virtual int put_file( rcComm_t* _conn, const upload_item& _item ) {
+            dataObjInp_t dataObjInp;
+            memset( &dataObjInp, 0, sizeof( dataObjInp ) );
+            rstrcpy( dataObjInp.objPath, _item.remote.c_str(), MAX_NAME_LEN );
+            dataObjInp.dataSize   = _item.size;
+            dataObjInp.createMode = _item.mode;
+            dataObjInp.openFlags  = O_RDWR;
+            dataObjInp.oprType    = PUT_OPR;
+            dataObjInp.numThreads = opts_.num_threads;
+            add_keywords( dataObjInp.condInput );
+
+            int status = rcDataObjPut( _conn, &dataObjInp, const_cast< char* >( _item.local.c_str() ) );
+            clearKeyVal( &dataObjInp.condInput );
+            return status;
+        }
+
+        // called by the scanners, several at once, for each file and
+        // directory they find; one it returns false for is not queued
+        virtual bool wanted( const upload_item& _item ) {
+            return true;
+        }
+
+        // called by each worker once the queue is empty, to upload any
+        // files put_file deferred on _conn
+        virtual void finish( rcComm_t* _conn ) {
+        }
+
+        // the keywords from the options that apply to every new data object
+        void add_keywords( keyValPair_t& _cond ) const {
+            if ( opts_.force ) {
+                addKeyVal( &_cond, FORCE_FLAG_KW, "" );
+            }
+            if ( !opts_.resource.empty() ) {
+                addKeyVal( &_cond, DEST_RESC_NAME_KW, opts_.resource.c_str() );
+            }
+            if ( opts_.checksum ) {
+                addKeyVal( &_cond, REG_CHKSUM_KW, "" );
+            }
+            if ( !opts_.data_type.empty() ) {
+                addKeyVal( &_cond, DATA_TYPE_KW, opts_.data_type.c_str() );
+            }
+        }
+
+        // create a collection and its parents, once per run
+        int make_collection( rcComm_t* _conn, const std::string& _coll ) {
+            {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                if ( collections_.count( _coll ) ) {
+                    return 0;
+                }
+            }
+            collInp_t collInp;
+            memset( &collInp, 0, sizeof( collInp ) );
+            rstrcpy( collInp.collName, _coll.c_str(), MAX_NAME_LEN );
+            addKeyVal( &collInp.condInput, RECURSIVE_OPR__KW, "" );
+            int status = rcCollCreate( _conn, &collInp );
+            clearKeyVal( &collInp.condInput );
+            if ( status == CATALOG_ALREADY_HAS_ITEM_BY_THAT_NAME ) {
+                status = 0;
+            }
+            if ( status >= 0 ) {
+                std::lock_guard< std::mutex > lock( mutex_ );
+                collections_.insert( _coll );
+            }
+            return status;
+        }
+
+        // note a collection known to exist, so it is not created again
+        void collection_exists( const std::string& _coll ) {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            collections_.insert( _coll );
+        }
+
+        // count and report a failure, keeping the first error to return
+        void failed( const std::string& _path, int _status ) {
+            stats_.error();
+            rodsLogError( LOG_ERROR, _status, "%s failed", _path.c_str() );
+            int none = 0;
+            first_error_.compare_exchange_strong( none, _status );
+        }
+
+        static std::string parent_of( const std::string& _path ) {
+            size_t slash = _path.rfind( '/' );
+            return slash == std::string::npos || slash == 0 ? "/" : _path.substr( 0, slash );
+        }
+
+        rodsEnv&             env_;
+        const upload_options opts_;
+        transfer_stats       stats_;
+
+    private:
+        void work( rcComm_t* _conn, bounded_queue< upload_item >& _queue ) {
+            upload_item item;
+            while ( _queue.pop( item ) ) {
+                int status = make_collection( _conn, item.collection ? item.remote : parent_of( item.remote ) );
+                if ( status >= 0 && !item.collection ) {
+                    status = put_file( _conn, item );
+                    if ( status == 0 ) {
+                        stats_.add( item.size );
+                        if ( opts_.verbose ) {
+                            printf( "   %s  %lld bytes\n", item.local.c_str(),
+                                    static_cast< long long >( item.size ) );
+                        }
+                    }
+                    else if ( status == SKIPPED ) {
+                        stats_.skip();
+                    }
+                }
+                if ( status < 0 ) {
+                    failed( item.local, status );
+                }
+            }
+            finish( _conn );
+        }
+
+        std::mutex              mutex_;
+        std::set< std::string > collections_;
+        std::atomic< int >      first_error_;
+
+    }; // class upload_engine
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_TRANSFER_ENGINE_HPP
@@ -0,0 +1,299 @@
+#ifndef ICOMMANDS_TRANSFER_JOURNAL_HPP
+#define ICOMMANDS_TRANSFER_JOURNAL_HPP
+
+#include "rodsClient.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // 64 bit FNV-1a, chained through _seed to hash several values
+    inline uint64_t journal_hash( const void* _data, size_t _len,
+                                  uint64_t _seed = 14695981039346656037ULL ) {
+        const unsigned char* p = static_cast< const unsigned char* >( _data );
+        uint64_t hash = _seed;
+        for ( size_t i = 0; i < _len; ++i ) {
+            hash ^= p[ i ];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // the terminating nul is hashed too, so "ab" then "c" differs from
+    // "a" then "bc"
+    inline uint64_t journal_hash( const std::string& _text,
+                                  uint64_t _seed = 14695981039346656037ULL ) {
+        return journal_hash( _text.c_str(), _text.size() + 1, _seed );
+    }
+
+    // =-=-=-=-=-=-=-
+    // a local record of how far a transfer got, so that an interrupted
+    // one can be resumed without moving again what was already moved.
+    //
+    // the file is a 32 byte header naming the transfer it belongs to,
+    // followed by 16 byte records that are only ever appended: it is
+    // read in place through a mapping, and a record torn by a crash fails
+    // its check and is dropped along with anything after it.  a file is
+    // known only by a hash key of its paths, size and modification time,
+    // so a source changed since it was recorded is moved again from the
+    // start.  a file's start is recorded before its target is written,
+    // each chunk of a large file once it is stored, and its end once it
+    // is complete; a million small files take 32 MB.  opening the journal
+    // replays it into memory: the key of each finished file, and the key
+    // and stored chunks of each file started but not finished.
+    class transfer_journal {
+    public:
+        enum record_type {
+            START = 1,  // the target may have been written
+            CHUNK = 2,  // a chunk of the file is stored
+            DONE  = 3,  // the file is complete
+            ABORT = 4   // the target was not written after all
+        };
+
+        transfer_journal() :
+            fd_( -1 ),
+            chunk_size_( 0 ) {
+        }
+
+        ~transfer_journal() {
+            close();
+        }
+
+        // open the journal at _path for the transfer _job, reading what it
+        // recorded, or create it with _chunk_size if it does not exist or
+        // is empty.  a file that is not a journal is left as it is and
+        // refused.  a journal keeps the chunk size it was created with.
+        int open( const std::string& _path, uint64_t _job, uint64_t _chunk_size ) {
+            fd_ = ::open( _path.c_str(), O_RDWR | O_CREAT, 0600 );
+            if ( fd_ < 0 ) {
+                return UNIX_FILE_OPEN_ERR - errno;
+            }
+            path_ = _path;
+
+            struct stat st;
+            if ( fstat( fd_, &st ) != 0 ) {
+                return UNIX_FILE_STAT_ERR - errno;
+            }
+            if ( st.st_size < static_cast< off_t >( sizeof( header ) ) ) {
+                // a new file, or one whose header was torn while it was
+                // being written.  anything else is not ours to overwrite.
+                char start[ sizeof( header ) ];
+                size_t len = std::min( static_cast< size_t >( st.st_size ), strlen( magic() ) );
+                if ( pread( fd_, start, len, 0 ) != static_cast< ssize_t >( len ) ) {
+                    int status = UNIX_FILE_READ_ERR - errno;
+                    close();
+                    return status;
+                }
+                if ( memcmp( start, magic(), len ) != 0 ) {
+                    rodsLog( LOG_ERROR, "%s is not a transfer journal", _path.c_str() );
+                    close();
+                    return USER_INPUT_OPTION_ERR;
+                }
+
+                header head;
+                memset( &head, 0, sizeof( head ) );
+                memcpy( head.magic, magic(), sizeof( head.magic ) );
+                head.job        = _job;
+                head.chunk_size = _chunk_size;
+                head.version    = VERSION;
+                if ( ftruncate( fd_, 0 ) != 0 ||
+                        pwrite( fd_, &head, sizeof( head ), 0 ) != static_cast< ssize_t >( sizeof( head ) ) ) {
+                    return UNIX_FILE_WRITE_ERR - errno;
+                }
+                chunk_size_ = _chunk_size;
+                return lseek( fd_, 0, SEEK_END ) < 0 ? UNIX_FILE_WRITE_ERR - errno : 0;
+            }
+
+            void* map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd_, 0 );
+            if ( map == MAP_FAILED ) {
+                return UNIX_FILE_READ_ERR - errno;
+            }
+            const header* head = static_cast< const header* >( map );
+            int status = 0;
+            off_t end = st.st_size;
+            if ( memcmp( head->magic, magic(), sizeof( head->magic ) ) != 0 || head->version != VERSION ) {
+                rodsLog( LOG_ERROR, "%s is not a transfer journal", _path.c_str() );
+                status = USER_INPUT_OPTION_ERR;
+            }
+            else if ( head->job != _job ) {
+                rodsLog( LOG_ERROR, "%s was written for a different transfer; the source and target paths must be the ones it was started with",
+                         _path.c_str() );
+                status = USER_INPUT_OPTION_ERR;
+            }
+            else {
+                chunk_size_ = head->chunk_size;
+                size_t count = ( st.st_size - sizeof( header ) ) / sizeof( record );
+                end = sizeof( header ) + replay( reinterpret_cast< const record* >( head + 1 ), count ) * sizeof( record );
+            }
+            munmap( map, st.st_size );
+            if ( status < 0 ) {
+                close();
+                return status;
+            }
+
+            // drop a torn record, so that new ones are appended whole
+            if ( end != st.st_size && ftruncate( fd_, end ) != 0 ) {
+                return UNIX_FILE_WRITE_ERR - errno;
+            }
+            return lseek( fd_, 0, SEEK_END ) < 0 ? UNIX_FILE_WRITE_ERR - errno : 0;
+
+        } // open
+
+        uint64_t chunk_size() const {
+            return chunk_size_;
+        }
+
+        // the number of files the journal recorded as done when opened
+        size_t finished() const {
+            return done_.size();
+        }
+
+        // what the journal recorded when it was opened; records appended
+        // since are not reflected, as each file is only moved once a run
+        bool done( uint64_t _key ) const {
+            return std::binary_search( done_.begin(), done_.end(), _key );
+        }
+
+        bool started( uint64_t _key ) const {
+            return started_.count( _key ) > 0;
+        }
+
+        bool chunk_done( uint64_t _key, uint32_t _chunk ) const {
+            std::map< uint64_t, std::set< uint32_t > >::const_iterator it = started_.find( _key );
+            return it != started_.end() && it->second.count( _chunk ) > 0;
+        }
+
+        int start( uint64_t _key ) {
+            return append( START, _key, 0, false );
+        }
+
+        // a chunk is synced to disk, since it stands for data already stored
+        int chunk( uint64_t _key, uint32_t _chunk ) {
+            return append( CHUNK, _key, _chunk, true );
+        }
+
+        int finish( uint64_t _key ) {
+            return append( DONE, _key, 0, false );
+        }
+
+        int abort( uint64_t _key ) {
+            return append( ABORT, _key, 0, false );
+        }
+
+        int close() {
+            if ( fd_ < 0 ) {
+                return 0;
+            }
+            int status = fdatasync( fd_ ) == 0 ? 0 : UNIX_FILE_WRITE_ERR - errno;
+            ::close( fd_ );
+            fd_ = -1;
+            return status;
+        }
+
+        // close and delete the journal, once the transfer is complete
+        int remove() {
+            close();
+            return unlink( path_.c_str() ) == 0 ? 0 : UNIX_FILE_UNLINK_ERR - errno;
+        }
+
+    private:
+        static const uint32_t VERSION = 1;
+
+        static const char* magic() {
+            return "ICJOURNL";
+        }
+
+        struct header {
+            char     magic[ 8 ];
+            uint64_t job;
+            uint64_t chunk_size;
+            uint32_t version;
+            uint32_t reserved;
+        };
+
+        struct record {
+            uint64_t key;
+            uint32_t chunk;
+            uint16_t type;
+            uint16_t check;
+        };
+
+        static uint16_t check_of( const record& _rec ) {
+            return static_cast< uint16_t >( journal_hash( &_rec, offsetof( record, check ) ) >> 48 );
+        }
+
+        // apply _count records, returning how many of them were whole
+        size_t replay( const record* _recs, size_t _count ) {
+            size_t i = 0;
+            for ( ; i < _count; ++i ) {
+                const record& rec = _recs[ i ];
+                if ( rec.check != check_of( rec ) ) {
+                    break;
+                }
+                switch ( rec.type ) {
+                case START:
+                    started_[ rec.key ];
+                    break;
+                case CHUNK:
+                    started_[ rec.key ].insert( rec.chunk );
+                    break;
+                case DONE:
+                    started_.erase( rec.key );
+                    done_.push_back( rec.key );
+                    break;
+                case ABORT:
+                    started_.erase( rec.key );
+                    break;
+                }
+            }
+            std::sort( done_.begin(), done_.end() );
+            done_.erase( std::unique( done_.begin(), done_.end() ), done_.end() );
+            return i;
+        }
+
+        int append( record_type _type, uint64_t _key, uint32_t _chunk, bool _sync ) {
+            record rec;
+            memset( &rec, 0, sizeof( rec ) );
+            rec.key   = _key;
+            rec.chunk = _chunk;
+            rec.type  = static_cast< uint16_t >( _type );
+            rec.check = check_of( rec );
+
+            std::lock_guard< std::mutex > lock( mutex_ );
+            if ( write( fd_, &rec, sizeof( rec ) ) != static_cast< ssize_t >( sizeof( rec ) ) ) {
+                return UNIX_FILE_WRITE_ERR - errno;
+            }
+            if ( _sync && fdatasync( fd_ ) != 0 ) {
+                return UNIX_FILE_WRITE_ERR - errno;
+            }
+            return 0;
+        }
+
+        int                                         fd_;
+        std::string                                 path_;
+        uint64_t                                    chunk_size_;
+        std::vector< uint64_t >                     done_;
+        std::map< uint64_t, std::set< uint32_t > >  started_;
+        std::mutex                                  mutex_;
+
+    }; // class transfer_journal
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_TRANSFER_JOURNAL_HPP
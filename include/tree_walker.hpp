@@ -0,0 +1,318 @@
+#ifndef ICOMMANDS_TREE_WALKER_HPP
+#define ICOMMANDS_TREE_WALKER_HPP
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+
+#include <cstring>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // a fixed capacity queue between producer and consumer threads.
+    // push blocks while the queue is full, so a fast producer cannot run
+    // far ahead of its consumers; pop blocks while it is empty and
+    // returns false once the queue has been closed and drained.
+    template < typename T >
+    class bounded_queue {
+    public:
+        explicit bounded_queue( size_t _capacity ) :
+            capacity_( _capacity > 0 ? _capacity : 1 ),
+            closed_( false ) {
+        }
+
+        // returns false, dropping _item, if the queue has been closed
+        bool push( T _item ) {
+            std::unique_lock< std::mutex > lock( mutex_ );
+            not_full_.wait( lock, [&] {
+                return closed_ || items_.size() < capacity_;
+            } );
+            if ( closed_ ) {
+                return false;
+            }
+            items_.push_back( std::move( _item ) );
+            not_empty_.notify_one();
+            return true;
+        }
+
+        bool pop( T& _item ) {
+            std::unique_lock< std::mutex > lock( mutex_ );
+            not_empty_.wait( lock, [&] {
+                return closed_ || !items_.empty();
+            } );
+            if ( items_.empty() ) {
+                return false;
+            }
+            _item = std::move( items_.front() );
+            items_.pop_front();
+            not_full_.notify_one();
+            return true;
+        }
+
+        // no more items will be pushed; consumers drain what is left
+        void close() {
+            std::lock_guard< std::mutex > lock( mutex_ );
+            closed_ = true;
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+    private:
+        std::mutex              mutex_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+        std::deque< T >         items_;
+        size_t                  capacity_;
+        bool                    closed_;
+
+    }; // class bounded_queue
+
+    // =-=-=-=-=-=-=-
+    // an entry found by tree_walker.  relative is the path below the
+    // root the entry was found under, with / separators, and root is the
+    // index of that root in the list given to walk.
+    struct walk_entry {
+        std::string path;
+        std::string relative;
+        size_t      root;
+        bool        directory;
+        off_t       size;
+        time_t      mtime;
+        mode_t      mode;
+    };
+
+    // =-=-=-=-=-=-=-
+    // walks local directory trees with a pool of scanner threads.  each
+    // scanner keeps its own deque of directories still to be read,
+    // taking the most recently found one from the back of its own deque
+    // and, when that is empty, stealing the oldest one from the front of
+    // another scanner's, so a single deep or wide directory does not
+    // leave the other scanners idle.
+    //
+    // visit is called from the scanner threads, for every directory
+    // before any of its contents and for every regular file.  symbolic
+    // links to files are followed unless skip_links is set; symbolic
+    // links to directories are never followed, so the walk cannot loop.
+    // entries that cannot be read are passed to error with their errno.
+    class tree_walker {
+    public:
+        typedef std::function< void( const walk_entry& ) >       visit_t;
+        typedef std::function< void( const std::string&, int ) > error_t;
+
+        explicit tree_walker( size_t _scanners, bool _skip_links = false ) :
+            scanners_( _scanners > 0 ? _scanners : 1 ),
+            skip_links_( _skip_links ),
+            pending_( 0 ),
+            idle_( 0 ) {
+        }
+
+        void walk(
+            const std::vector< std::string >& _roots,
+            const visit_t&                    _visit,
+            const error_t&                    _error ) {
+            queues_.clear();
+            for ( size_t i = 0; i < scanners_; ++i ) {
+                queues_.push_back( std::unique_ptr< scan_queue >( new scan_queue ) );
+            }
+            pending_ = _roots.size();
+            for ( size_t i = 0; i < _roots.size(); ++i ) {
+                dir_task task;
+                task.path = _roots[ i ];
+                task.root = i;
+                queues_[ i % scanners_ ]->tasks.push_back( task );
+            }
+
+            std::vector< std::thread > threads;
+            for ( size_t i = 1; i < scanners_; ++i ) {
+                threads.push_back( std::thread( &tree_walker::scan, this, i,
+                                                std::cref( _visit ), std::cref( _error ) ) );
+            }
+            scan( 0, _visit, _error );
+            for ( size_t i = 0; i < threads.size(); ++i ) {
+                threads[ i ].join();
+            }
+
+        } // walk
+
+    private:
+        struct dir_task {
+            std::string path;
+            std::string relative;
+            size_t      root;
+        };
+
+        struct scan_queue {
+            std::mutex             mutex;
+            std::deque< dir_task > tasks;
+        };
+
+        bool take( size_t _self, dir_task& _task ) {
+            {
+                scan_queue& own = *queues_[ _self ];
+                std::lock_guard< std::mutex > lock( own.mutex );
+                if ( !own.tasks.empty() ) {
+                    _task = own.tasks.back();
+                    own.tasks.pop_back();
+                    return true;
+                }
+            }
+            for ( size_t i = 1; i < scanners_; ++i ) {
+                scan_queue& victim = *queues_[ ( _self + i ) % scanners_ ];
+                std::lock_guard< std::mutex > lock( victim.mutex );
+                if ( !victim.tasks.empty() ) {
+                    _task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void give( size_t _self, const dir_task& _task ) {
+            ++pending_;
+            {
+                scan_queue& own = *queues_[ _self ];
+                std::lock_guard< std::mutex > lock( own.mutex );
+                own.tasks.push_back( _task );
+            }
+            if ( idle_ > 0 ) {
+                std::lock_guard< std::mutex > lock( idle_mutex_ );
+                idle_cv_.notify_one();
+            }
+        }
+
+        void scan( size_t _self, const visit_t& _visit, const error_t& _error ) {
+            dir_task task;
+            for ( ;; ) {
+                if ( take( _self, task ) ) {
+                    read_dir( _self, task, _visit, _error );
+                    if ( --pending_ == 0 ) {
+                        std::lock_guard< std::mutex > lock( idle_mutex_ );
+                        idle_cv_.notify_all();
+                    }
+                    continue;
+                }
+                if ( pending_ == 0 ) {
+                    return;
+                }
+                // another scanner is reading a directory that may yield
+                // more work; wait to be told, or look again shortly
+                std::unique_lock< std::mutex > lock( idle_mutex_ );
+                ++idle_;
+                idle_cv_.wait_for( lock, std::chrono::milliseconds( 10 ) );
+                --idle_;
+            }
+        }
+
+        void read_dir(
+            size_t          _self,
+            const dir_task& _task,
+            const visit_t&  _visit,
+            const error_t&  _error ) {
+            struct stat st;
+            if ( stat( _task.path.c_str(), &st ) != 0 ) {
+                _error( _task.path, errno );
+                return;
+            }
+            walk_entry entry;
+            entry.path      = _task.path;
+            entry.relative  = _task.relative;
+            entry.root      = _task.root;
+            entry.directory = true;
+            entry.size      = 0;
+            entry.mtime     = st.st_mtime;
+            entry.mode      = st.st_mode;
+            _visit( entry );
+
+            DIR* dir = opendir( _task.path.c_str() );
+            if ( dir == NULL ) {
+                _error( _task.path, errno );
+                return;
+            }
+            struct dirent* ent;
+            while ( ( ent = readdir( dir ) ) != NULL ) {
+                if ( strcmp( ent->d_name, "." ) == 0 || strcmp( ent->d_name, ".." ) == 0 ) {
+                    continue;
+                }
+                std::string path = _task.path + "/" + ent->d_name;
+                std::string relative = _task.relative.empty() ?
+                                       std::string( ent->d_name ) :
+                                       _task.relative + "/" + ent->d_name;
+
+                if ( ent->d_type == DT_DIR ) {
+                    dir_task child;
+                    child.path     = path;
+                    child.relative = relative;
+                    child.root     = _task.root;
+                    give( _self, child );
+                    continue;
+                }
+                if ( ent->d_type == DT_LNK && skip_links_ ) {
+                    continue;
+                }
+
+                if ( lstat( path.c_str(), &st ) != 0 ) {
+                    _error( path, errno );
+                    continue;
+                }
+                if ( S_ISLNK( st.st_mode ) ) {
+                    if ( skip_links_ ) {
+                        continue;
+                    }
+                    if ( stat( path.c_str(), &st ) != 0 ) {
+                        _error( path, errno );
+                        continue;
+                    }
+                    if ( !S_ISREG( st.st_mode ) ) {
+                        continue;
+                    }
+                }
+                else if ( S_ISDIR( st.st_mode ) ) {
+                    dir_task child;
+                    child.path     = path;
+                    child.relative = relative;
+                    child.root     = _task.root;
+                    give( _self, child );
+                    continue;
+                }
+                else if ( !S_ISREG( st.st_mode ) ) {
+                    continue;
+                }
+
+                entry.path      = path;
+                entry.relative  = relative;
+                entry.directory = false;
+                entry.size      = st.st_size;
+                entry.mtime     = st.st_mtime;
+                entry.mode      = st.st_mode;
+                _visit( entry );
+            }
+            closedir( dir );
+        }
+
+        size_t                                     scanners_;
+        bool                                       skip_links_;
+        std::vector< std::unique_ptr< scan_queue > > queues_;
+        std::atomic< size_t >                      pending_;
+        std::atomic< size_t >                      idle_;
+        std::mutex                                 idle_mutex_;
+        std::condition_variable                    idle_cv_;
+
+    }; // class tree_walker
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_TREE_WALKER_HPP
@@ -0,0 +1,301 @@
+#ifndef ICOMMANDS_USTAR_HPP
+#define ICOMMANDS_USTAR_HPP
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace icommands {
+
+    // =-=-=-=-=-=-=-
+    // the POSIX ustar archive format: each member is a 512 byte header
+    // followed by its data padded to a multiple of 512 bytes, and the
+    // archive ends with two zero blocks.
+    namespace ustar {
+
+        static const size_t BLOCK = 512;
+
+        static const char REGULAR   = '0';
+        static const char DIRECTORY = '5';
+
+        // the number of zero bytes that pad _size bytes of data to a block
+        inline size_t padding( uint64_t _size ) {
+            return static_cast< size_t >( ( BLOCK - _size % BLOCK ) % BLOCK );
+        }
+
+        inline void put_octal( char* _field, size_t _width, uint64_t _value ) {
+            snprintf( _field, _width, "%0*llo", static_cast< int >( _width - 1 ),
+                      static_cast< unsigned long long >( _value ) );
+        }
+
+        // append the header of a member to _out.  a name longer than 100
+        // bytes is split at a / into the 155 byte prefix field and the
+        // name field; returns false, appending nothing, if it cannot be.
+        inline bool write_header(
+            const std::string& _name,
+            uint64_t           _size,
+            mode_t             _mode,
+            time_t             _mtime,
+            char               _type,
+            std::string&       _out ) {
+            std::string prefix;
+            std::string name = _name;
+            if ( name.size() > 100 ) {
+                size_t slash = name.find( '/', name.size() - 101 );
+                if ( slash == std::string::npos || slash > 155 || slash + 1 == name.size() ) {
+                    return false;
+                }
+                prefix = name.substr( 0, slash );
+                name = name.substr( slash + 1 );
+            }
+            if ( _size > 077777777777ULL ) {
+                return false;
+            }
+
+            char header[ BLOCK ];
+            memset( header, 0, sizeof( header ) );
+            memcpy( header, name.data(), name.size() );
+            put_octal( header + 100, 8, _mode & 07777 );
+            put_octal( header + 108, 8, 0 );
+            put_octal( header + 116, 8, 0 );
+            put_octal( header + 124, 12, _size );
+            put_octal( header + 136, 12, _mtime > 0 ? _mtime : 0 );
+            header[ 156 ] = _type;
+            memcpy( header + 257, "ustar", 6 );
+            memcpy( header + 263, "00", 2 );
+            memcpy( header + 345, prefix.data(), prefix.size() );
+
+            memset( header + 148, ' ', 8 );
+            unsigned int sum = 0;
+            for ( size_t i = 0; i < BLOCK; ++i ) {
+                sum += static_cast< unsigned char >( header[ i ] );
+            }
+            snprintf( header + 148, 8, "%06o", sum );
+            header[ 155 ] = ' ';
+
+            _out.append( header, BLOCK );
+            return true;
+        }
+
+        // append the end of archive marker
+        inline void write_end( std::string& _out ) {
+            _out.append( 2 * BLOCK, '\0' );
+        }
+
+        // =-=-=-=-=-=-=-
+        // a member as read from an archive
+        struct entry {
+            std::string name;
+            char        type;
+            uint64_t    size;
+            mode_t      mode;
+            time_t      mtime;
+        };
+
+        // =-=-=-=-=-=-=-
+        // reads an archive as it arrives, in pieces of any size.  begin is
+        // called with each member's header, data with its contents and
+        // end after the last of them; a nonzero return from any of them
+        // stops the reader and is returned from feed.  long names stored
+        // as GNU 'L' members or pax 'x' path records are applied to the
+        // member that follows them.
+        class reader {
+        public:
+            typedef std::function< int( const entry& ) >             begin_t;
+            typedef std::function< int( const char*, size_t ) >      data_t;
+            typedef std::function< int() >                           end_t;
+
+            reader( const begin_t& _begin, const data_t& _data, const end_t& _end ) :
+                begin_( _begin ),
+                data_( _data ),
+                end_( _end ),
+                state_( HEADER ),
+                remaining_( 0 ),
+                padding_( 0 ),
+                zero_blocks_( 0 ) {
+            }
+
+            // true once the end of archive marker has been read
+            bool done() const {
+                return state_ == DONE;
+            }
+
+            int feed( const char* _buf, size_t _len ) {
+                while ( _len > 0 && state_ != DONE ) {
+                    if ( state_ == HEADER ) {
+                        size_t n = std::min( _len, BLOCK - block_.size() );
+                        block_.append( _buf, n );
+                        _buf += n;
+                        _len -= n;
+                        if ( block_.size() == BLOCK ) {
+                            int status = header();
+                            block_.clear();
+                            if ( status != 0 ) {
+                                return status;
+                            }
+                        }
+                        continue;
+                    }
+
+                    if ( state_ == PAD ) {
+                        size_t n = static_cast< size_t >( std::min< uint64_t >( _len, padding_ ) );
+                        _buf += n;
+                        _len -= n;
+                        padding_ -= n;
+                        if ( padding_ == 0 ) {
+                            state_ = HEADER;
+                        }
+                        continue;
+                    }
+
+                    size_t n = static_cast< size_t >( std::min< uint64_t >( _len, remaining_ ) );
+                    if ( state_ == DATA ) {
+                        int status = data_( _buf, n );
+                        if ( status != 0 ) {
+                            return status;
+                        }
+                    }
+                    else if ( state_ == EXTENDED ) {
+                        extended_.append( _buf, n );
+                    }
+                    _buf += n;
+                    _len -= n;
+                    remaining_ -= n;
+                    if ( remaining_ == 0 ) {
+                        int status = finish_member();
+                        if ( status != 0 ) {
+                            return status;
+                        }
+                    }
+                }
+                return 0;
+            }
+
+        private:
+            enum state_t { HEADER, DATA, EXTENDED, SKIP, PAD, DONE };
+
+            static uint64_t get_number( const char* _field, size_t _width ) {
+                // base-256 for values too large for octal
+                if ( static_cast< unsigned char >( _field[ 0 ] ) & 0x80 ) {
+                    uint64_t value = static_cast< unsigned char >( _field[ 0 ] ) & 0x7f;
+                    for ( size_t i = 1; i < _width; ++i ) {
+                        value = ( value << 8 ) | static_cast< unsigned char >( _field[ i ] );
+                    }
+                    return value;
+                }
+                std::string text( _field, strnlen( _field, _width ) );
+                return strtoull( text.c_str(), NULL, 8 );
+            }
+
+            int header() {
+                const char* h = block_.data();
+                bool zero = true;
+                for ( size_t i = 0; i < BLOCK && zero; ++i ) {
+                    zero = h[ i ] == '\0';
+                }
+                if ( zero ) {
+                    if ( ++zero_blocks_ == 2 ) {
+                        state_ = DONE;
+                    }
+                    return 0;
+                }
+                zero_blocks_ = 0;
+
+                current_.type  = h[ 156 ] == '\0' ? REGULAR : h[ 156 ];
+                current_.size  = get_number( h + 124, 12 );
+                current_.mode  = static_cast< mode_t >( get_number( h + 100, 8 ) );
+                current_.mtime = static_cast< time_t >( get_number( h + 136, 12 ) );
+                current_.name.assign( h, strnlen( h, 100 ) );
+                if ( memcmp( h + 257, "ustar", 5 ) == 0 && h[ 345 ] != '\0' ) {
+                    current_.name = std::string( h + 345, strnlen( h + 345, 155 ) ) + "/" + current_.name;
+                }
+                remaining_ = current_.size;
+                padding_ = padding( current_.size );
+
+                if ( current_.type == 'L' || current_.type == 'x' ) {
+                    extended_.clear();
+                    state_ = EXTENDED;
+                }
+                else if ( current_.type == REGULAR || current_.type == '7' ||
+                          current_.type == DIRECTORY ) {
+                    if ( !long_name_.empty() ) {
+                        current_.name = long_name_;
+                        long_name_.clear();
+                    }
+                    int status = begin_( current_ );
+                    if ( status != 0 ) {
+                        return status;
+                    }
+                    state_ = current_.type == DIRECTORY ? SKIP : DATA;
+                }
+                else {
+                    long_name_.clear();
+                    state_ = SKIP;
+                }
+                return remaining_ == 0 ? finish_member() : 0;
+            }
+
+            int finish_member() {
+                if ( state_ == DATA ) {
+                    int status = end_();
+                    if ( status != 0 ) {
+                        return status;
+                    }
+                }
+                else if ( state_ == EXTENDED ) {
+                    if ( current_.type == 'L' ) {
+                        long_name_.assign( extended_.c_str() );
+                    }
+                    else {
+                        read_pax_path();
+                    }
+                }
+                state_ = padding_ > 0 ? PAD : HEADER;
+                return 0;
+            }
+
+            // pax records are "length key=value\n"
+            void read_pax_path() {
+                size_t pos = 0;
+                while ( pos < extended_.size() ) {
+                    size_t space = extended_.find( ' ', pos );
+                    if ( space == std::string::npos ) {
+                        return;
+                    }
+                    size_t len = strtoul( extended_.c_str() + pos, NULL, 10 );
+                    if ( len == 0 || pos + len > extended_.size() ) {
+                        return;
+                    }
+                    std::string record = extended_.substr( space + 1, pos + len - space - 2 );
+                    if ( record.compare( 0, 5, "path=" ) == 0 ) {
+                        long_name_ = record.substr( 5 );
+                    }
+                    pos += len;
+                }
+            }
+
+            begin_t     begin_;
+            data_t      data_;
+            end_t       end_;
+            state_t     state_;
+            std::string block_;
+            entry       current_;
+            std::string extended_;
+            std::string long_name_;
+            uint64_t    remaining_;
+            uint64_t    padding_;
+            int         zero_blocks_;
+
+        }; // class reader
+
+    }; // namespace ustar
+
+}; // namespace icommands
+
+#endif // ICOMMANDS_USTAR_HPP
@@ -0,0 +1,630 @@
+/*
+  iagent - a local agent that keeps logged in connections to the server
+  open, so that short lived icommands can borrow one over a Unix domain
+  socket instead of connecting and logging in themselves.  see
+  connection_broker.hpp for the protocol.
+*/
+
+#include "rodsClient.h"
+#include "irods_client_api_table.hpp"
+#include "irods_pack_table.hpp"
+#include "connection_broker.hpp"
+#include "query2.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+void usage();
+
+rodsEnv myEnv;
+
+/*
+  The connections the agent holds and the sessions they are lent to.
+*/
+struct agentState {
+    agentState() :
+        maxConnections( 4 ),
+        openConnections( 0 ),
+        sessions( 0 ),
+        lending( 0 ),
+        served( 0 ),
+        lastActive( time( NULL ) ),
+        stopping( false ),
+        listenFd( -1 ) {
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<rcComm_t *> idle;
+    size_t maxConnections;
+    size_t openConnections;
+    size_t sessions;
+    size_t lending;
+    size_t served;
+    time_t lastActive;
+    bool stopping;
+    int listenFd;
+    std::string identity;
+};
+
+rcComm_t *
+connectAndLogin( int *status ) {
+    rErrMsg_t errMsg;
+    rcComm_t *conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort,
+                                myEnv.rodsUserName, myEnv.rodsZone,
+                                0, &errMsg );
+    if ( conn == NULL ) {
+        *status = errMsg.status < 0 ? errMsg.status : USER_SOCK_CONNECT_ERR;
+        return NULL;
+    }
+    *status = clientLogin( conn );
+    if ( *status != 0 ) {
+        rcDisconnect( conn );
+        return NULL;
+    }
+    return conn;
+}
+
+/*
+  True unless the server has closed an idle connection: nothing is
+  outstanding on one, so its socket only becomes readable at end of file
+  or on an error.  A connection dropped without a word is not noticed
+  here, only when it is next used.
+*/
+bool
+connectionAlive( rcComm_t *conn ) {
+    struct pollfd pfd;
+    pfd.fd = conn->sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll( &pfd, 1, 0 ) == 0;
+}
+
+/*
+  Take an idle connection, or open another one.  Idle connections the
+  server has closed are dropped on the way.  With fresh set, a new
+  connection is always opened, closing an idle one first if the agent
+  already holds the maximum.  Sessions are only let in while there is a
+  connection for each of them, so this never waits for one to be
+  returned.
+*/
+rcComm_t *
+borrowConnection( agentState &state, int *status, bool fresh ) {
+    std::unique_lock<std::mutex> lock( state.mutex );
+    while ( !state.idle.empty() &&
+            ( !fresh || state.openConnections >= state.maxConnections ) ) {
+        rcComm_t *conn = state.idle.back();
+        state.idle.pop_back();
+        if ( !fresh && connectionAlive( conn ) ) {
+            return conn;
+        }
+        state.openConnections--;
+        lock.unlock();
+        rcDisconnect( conn );
+        lock.lock();
+    }
+    if ( state.openConnections >= state.maxConnections ) {
+        *status = SYS_MAX_CONNECT_COUNT_EXCEEDED;
+        return NULL;
+    }
+
+    state.openConnections++;
+    lock.unlock();
+    rcComm_t *conn = connectAndLogin( status );
+    if ( conn == NULL ) {
+        lock.lock();
+        state.openConnections--;
+    }
+    return conn;
+}
+
+/*
+  Give a connection back once its session has ended.  A connection that
+  failed, or that a session left with a query open on, is closed instead,
+  since the server would otherwise keep the query's statement for it.
+*/
+void
+returnConnection( agentState &state, rcComm_t *conn, bool reusable ) {
+    if ( !reusable ) {
+        rcDisconnect( conn );
+    }
+    std::lock_guard<std::mutex> lock( state.mutex );
+    if ( reusable ) {
+        state.idle.push_back( conn );
+    }
+    else {
+        state.openConnections--;
+    }
+}
+
+/*
+  True if a status means the connection to the server is no longer usable.
+*/
+bool
+connectionBroken( int status ) {
+    return status == SYS_HEADER_READ_LEN_ERR ||
+           status == SYS_HEADER_WRITE_LEN_ERR ||
+           status == SYS_SOCK_READ_ERR ||
+           status == SYS_SOCK_READ_TIMEDOUT;
+}
+
+std::string
+genQueryOutReply( int status, genQueryOut_t *genQueryOut ) {
+    std::string packed;
+    if ( genQueryOut != NULL ) {
+        int packStatus = icommands::broker::pack( genQueryOut, "GenQueryOut_PI", packed );
+        if ( packStatus < 0 ) {
+            return icommands::broker::make_reply( packStatus );
+        }
+        return icommands::broker::make_reply( status, packed.data(), packed.size() );
+    }
+    return icommands::broker::make_reply( status );
+}
+
+/*
+  Run one query request on conn, noting which queries it leaves open.
+*/
+int
+runRequest( rcComm_t *conn, uint32_t type, const std::string &body,
+            std::set<int> &openGenQueries, std::set<int> &openSpecificQueries,
+            std::string &reply ) {
+    int status = 0;
+    if ( type == icommands::broker::GEN_QUERY ) {
+        genQueryInp_t *genQueryInp = NULL;
+        genQueryOut_t *genQueryOut = NULL;
+        status = icommands::broker::unpack( body, "GenQueryInp_PI", ( void ** ) &genQueryInp );
+        if ( status >= 0 ) {
+            status = rcGenQuery( conn, genQueryInp, &genQueryOut );
+            openGenQueries.erase( genQueryInp->continueInx );
+            if ( status == 0 && genQueryOut != NULL && genQueryOut->continueInx > 0 ) {
+                openGenQueries.insert( genQueryOut->continueInx );
+            }
+            clearGenQueryInp( genQueryInp );
+            free( genQueryInp );
+        }
+        reply = genQueryOutReply( status, genQueryOut );
+        freeGenQueryOut( &genQueryOut );
+    }
+    else if ( type == icommands::broker::SPECIFIC_QUERY ) {
+        specificQueryInp_t *specificQueryInp = NULL;
+        genQueryOut_t *genQueryOut = NULL;
+        status = icommands::broker::unpack( body, "specificQueryInp_PI", ( void ** ) &specificQueryInp );
+        if ( status >= 0 ) {
+            status = rcSpecificQuery( conn, specificQueryInp, &genQueryOut );
+            openSpecificQueries.erase( specificQueryInp->continueInx );
+            if ( status == 0 && genQueryOut != NULL && genQueryOut->continueInx > 0 ) {
+                openSpecificQueries.insert( genQueryOut->continueInx );
+            }
+            free( specificQueryInp->sql );
+            for ( int i = 0; i < MAX_SQL_ARGS; i++ ) {
+                free( specificQueryInp->args[i] );
+            }
+            clearKeyVal( &specificQueryInp->condInput );
+            free( specificQueryInp );
+        }
+        reply = genQueryOutReply( status, genQueryOut );
+        freeGenQueryOut( &genQueryOut );
+    }
+    else if ( type == icommands::broker::QUERY2 ) {
+        const char *qu = body.c_str();
+        const char *hdr = qu + strlen( qu ) + 1;
+        if ( hdr >= body.c_str() + body.size() ) {
+            hdr = "";
+        }
+        char *res = NULL;
+        status = query( conn, qu, hdr, &res );
+        if ( res != NULL ) {
+            reply = icommands::broker::make_reply( status, res, strlen( res ) + 1 );
+        }
+        else {
+            reply = icommands::broker::make_reply( status );
+        }
+        free( res );
+    }
+    else {
+        reply = icommands::broker::make_reply( SYS_INVALID_INPUT_PARAM );
+    }
+
+    // the server's messages go back with a failed request, and are
+    // cleared either way so the connection's next session does not
+    // inherit them
+    if ( conn->rError != NULL && conn->rError->len > 0 ) {
+        if ( status < 0 && reply[sizeof( int )] == icommands::broker::NO_OUTPUT ) {
+            reply = icommands::broker::make_error_reply( status, conn->rError );
+        }
+        freeRErrorContent( conn->rError );
+    }
+    return status;
+}
+
+/*
+  Counts a session from when it is accepted until its thread is done
+  with it, however it ends, and the connection it was promised, if any.
+*/
+struct sessionGuard {
+    explicit sessionGuard( agentState &_state ) :
+        state( _state ),
+        lending( false ) {
+    }
+
+    ~sessionGuard() {
+        std::lock_guard<std::mutex> lock( state.mutex );
+        state.sessions--;
+        if ( lending ) {
+            state.lending--;
+        }
+        state.lastActive = time( NULL );
+        state.cv.notify_all();
+    }
+
+    agentState &state;
+    bool lending;
+};
+
+/*
+  Serve one client: check who it is, then run its requests on a borrowed
+  connection until it disconnects.  A client is refused at once when
+  every connection is promised to another session, so that it connects
+  directly instead of waiting for one.
+*/
+void
+serveSession( agentState &state, int fd ) {
+    sessionGuard guard( state );
+    uint32_t type;
+    std::string body;
+    if ( !icommands::broker::recv_message( fd, type, body ) ||
+            ( type != icommands::broker::HELLO && type != icommands::broker::CONTROL ) ||
+            body != state.identity ) {
+        icommands::broker::send_message( fd, 0, icommands::broker::make_reply( CAT_INVALID_USER ) );
+        close( fd );
+        return;
+    }
+    if ( type == icommands::broker::HELLO ) {
+        std::lock_guard<std::mutex> lock( state.mutex );
+        if ( state.lending >= state.maxConnections ) {
+            icommands::broker::send_message( fd, 0,
+                                             icommands::broker::make_reply( SYS_MAX_CONNECT_COUNT_EXCEEDED ) );
+            close( fd );
+            return;
+        }
+        state.lending++;
+        guard.lending = true;
+    }
+    icommands::broker::send_message( fd, 0, icommands::broker::make_reply( 0 ) );
+
+    rcComm_t *conn = NULL;
+    bool broken = false;
+    std::set<int> openGenQueries;
+    std::set<int> openSpecificQueries;
+
+    while ( !broken && icommands::broker::recv_message( fd, type, body ) ) {
+        std::string reply;
+        int status = 0;
+
+        if ( type == icommands::broker::STATUS ) {
+            char text[256];
+            std::lock_guard<std::mutex> lock( state.mutex );
+            snprintf( text, sizeof( text ),
+                      "iagent for %s: %d of %d connections (%d idle), %d sessions, %d served\n",
+                      state.identity.c_str(), ( int ) state.openConnections,
+                      ( int ) state.maxConnections, ( int ) state.idle.size(),
+                      ( int ) state.sessions, ( int ) state.served );
+            icommands::broker::send_message( fd, 0, icommands::broker::make_reply( 0, text, strlen( text ) ) );
+            continue;
+        }
+        if ( type == icommands::broker::STOP ) {
+            {
+                std::lock_guard<std::mutex> lock( state.mutex );
+                state.stopping = true;
+            }
+            icommands::broker::send_message( fd, 0, icommands::broker::make_reply( 0 ) );
+            continue;
+        }
+        if ( !guard.lending ) {
+            icommands::broker::send_message( fd, 0, icommands::broker::make_reply( SYS_INVALID_INPUT_PARAM ) );
+            continue;
+        }
+
+        bool borrowed = false;
+        if ( conn == NULL ) {
+            conn = borrowConnection( state, &status, false );
+            if ( conn == NULL ) {
+                icommands::broker::send_message( fd, 0, icommands::broker::make_reply( status ) );
+                break;
+            }
+            borrowed = true;
+        }
+
+        status = runRequest( conn, type, body, openGenQueries, openSpecificQueries, reply );
+
+        // an idle connection the server dropped silently only fails when
+        // used; the session's first request cannot depend on its state,
+        // so it is tried once more on a new connection
+        if ( borrowed && connectionBroken( status ) ) {
+            returnConnection( state, conn, false );
+            conn = borrowConnection( state, &status, true );
+            if ( conn == NULL ) {
+                icommands::broker::send_message( fd, 0, icommands::broker::make_reply( status ) );
+                break;
+            }
+            openGenQueries.clear();
+            openSpecificQueries.clear();
+            status = runRequest( conn, type, body, openGenQueries, openSpecificQueries, reply );
+        }
+
+        broken = connectionBroken( status );
+        if ( !icommands::broker::send_message( fd, 0, reply ) ) {
+            break;
+        }
+    }
+
+    if ( conn != NULL ) {
+        returnConnection( state, conn,
+                          !broken && openGenQueries.empty() && openSpecificQueries.empty() );
+    }
+    close( fd );
+
+    std::lock_guard<std::mutex> lock( state.mutex );
+    state.served++;
+}
+
+/*
+  Send a request to the running agent and print its reply.
+*/
+int
+sendToAgent( uint32_t type ) {
+    int fd = icommands::broker::open_session( icommands::broker::identity( myEnv ),
+                                              icommands::broker::CONTROL );
+    if ( fd == USER_SOCK_CONNECT_ERR ) {
+        printf( "No iagent is running for %s\n", icommands::broker::identity( myEnv ).c_str() );
+        return 1;
+    }
+    if ( fd < 0 ) {
+        rodsLogError( LOG_ERROR, fd, "iagent: the agent on %s refused the session",
+                      icommands::broker::socket_path().c_str() );
+        return 4;
+    }
+    std::string out;
+    bool hasOut = false;
+    int status = icommands::broker::call( fd, type, "", out, hasOut );
+    close( fd );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "iagent: request failed" );
+        return 4;
+    }
+    if ( hasOut ) {
+        printf( "%s", out.c_str() );
+    }
+    return 0;
+}
+
+/*
+  Listen on the agent socket and serve sessions until told to stop or
+  until there have been no sessions for idleTimeout seconds.
+*/
+int
+runAgent( agentState &state, int idleTimeout, bool foreground ) {
+    std::string path = icommands::broker::socket_path();
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof( addr ) );
+    if ( path.size() >= sizeof( addr.sun_path ) ) {
+        rodsLog( LOG_ERROR, "iagent: socket path %s is too long", path.c_str() );
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    strncpy( addr.sun_path, path.c_str(), sizeof( addr.sun_path ) - 1 );
+
+    // check that the credentials work before going into the background
+    int status = 0;
+    rcComm_t *first = connectAndLogin( &status );
+    if ( first == NULL ) {
+        rodsLogError( LOG_ERROR, status, "iagent: connect failed" );
+        return status == USER_SOCK_CONNECT_ERR ? 2 : 3;
+    }
+    state.idle.push_back( first );
+    state.openConnections = 1;
+
+    // a socket left behind by an agent that has gone away is replaced
+    unlink( path.c_str() );
+    state.listenFd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    mode_t mask = umask( 077 );
+    status = state.listenFd < 0 ? -1 :
+             bind( state.listenFd, reinterpret_cast<struct sockaddr *>( &addr ), sizeof( addr ) );
+    umask( mask );
+    if ( status != 0 || listen( state.listenFd, 64 ) != 0 ) {
+        rodsLog( LOG_ERROR, "iagent: cannot listen on %s, errno %d", path.c_str(), errno );
+        rcDisconnect( first );
+        return 1;
+    }
+
+    if ( !foreground && daemon( 0, 0 ) != 0 ) {
+        rodsLog( LOG_ERROR, "iagent: cannot run in the background, errno %d", errno );
+        return 1;
+    }
+
+    for ( ;; ) {
+        {
+            std::lock_guard<std::mutex> lock( state.mutex );
+            if ( state.stopping ||
+                    ( state.sessions == 0 && time( NULL ) - state.lastActive > idleTimeout ) ) {
+                break;
+            }
+        }
+
+        struct pollfd pfd;
+        pfd.fd = state.listenFd;
+        pfd.events = POLLIN;
+        if ( poll( &pfd, 1, 1000 ) <= 0 ) {
+            continue;
+        }
+        int fd = accept( state.listenFd, NULL, NULL );
+        if ( fd < 0 ) {
+            continue;
+        }
+
+        // only the user who started the agent may borrow its connections
+        struct ucred cred;
+        socklen_t len = sizeof( cred );
+        if ( getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) != 0 || cred.uid != getuid() ) {
+            close( fd );
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( state.mutex );
+            state.sessions++;
+        }
+        std::thread( serveSession, std::ref( state ), fd ).detach();
+    }
+
+    close( state.listenFd );
+    unlink( path.c_str() );
+
+    // let the sessions in progress finish before closing the connections
+    std::unique_lock<std::mutex> lock( state.mutex );
+    state.cv.wait( lock, [&] {
+        return state.sessions == 0;
+    } );
+    for ( size_t i = 0; i < state.idle.size(); i++ ) {
+        rcDisconnect( state.idle[i] );
+    }
+    return 0;
+}
+
+int
+main( int argc, char **argv ) {
+
+    signal( SIGPIPE, SIG_IGN );
+
+    int status;
+    std::string command;
+    size_t connections = 4;
+    int idleTimeout = 1800;
+
+    namespace po = boost::program_options;
+    po::options_description opt_desc( "options" );
+    opt_desc.add_options()
+    ( "help,h", "show command usage" )
+    ( "connections,n", po::value<size_t>( &connections ), "most connections to keep open" )
+    ( "idle-timeout,t", po::value<int>( &idleTimeout ), "seconds without sessions before exiting" )
+    ( "foreground,f", "do not run in the background" )
+    ( "command", po::value<std::string>( &command ), "start, stop or status" );
+
+    po::positional_options_description pos_desc;
+    pos_desc.add( "command", 1 );
+
+    po::variables_map vm;
+    try {
+        po::store(
+            po::command_line_parser(
+                argc, argv ).options(
+                opt_desc ).positional(
+                pos_desc ).run(), vm );
+        po::notify( vm );
+    }
+    catch ( po::error& _e ) {
+        printf( "%s\n", _e.what() );
+        printf( "Use -h for help\n" );
+        exit( 1 );
+    }
+
+    if ( vm.count( "help" ) || command.empty() ) {
+        usage();
+        exit( 0 );
+    }
+
+    status = getRodsEnv( &myEnv );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "main: getRodsEnv error. " );
+        exit( 1 );
+    }
+
+    // =-=-=-=-=-=-=-
+    // initialize pluggable api table
+    irods::api_entry_table&  api_tbl = irods::get_client_api_table();
+    irods::pack_entry_table& pk_tbl  = irods::get_pack_table();
+    init_api_table( api_tbl, pk_tbl );
+
+    if ( command == "status" ) {
+        exit( sendToAgent( icommands::broker::STATUS ) );
+    }
+    if ( command == "stop" ) {
+        exit( sendToAgent( icommands::broker::STOP ) );
+    }
+    if ( command != "start" ) {
+        usage();
+        exit( 1 );
+    }
+
+    int fd = icommands::broker::open_session( icommands::broker::identity( myEnv ),
+                                              icommands::broker::CONTROL );
+    if ( fd >= 0 ) {
+        close( fd );
+        printf( "An iagent is already running for %s\n", icommands::broker::identity( myEnv ).c_str() );
+        exit( 0 );
+    }
+
+    // only a socket nothing answers on is taken over; one whose agent
+    // serves another user or server is left to it
+    if ( fd != USER_SOCK_CONNECT_ERR ) {
+        rodsLogError( LOG_ERROR, fd, "iagent: another agent is listening on %s",
+                      icommands::broker::socket_path().c_str() );
+        exit( 1 );
+    }
+
+    agentState state;
+    state.identity = icommands::broker::identity( myEnv );
+    state.maxConnections = connections > 0 ? connections : 1;
+    exit( runAgent( state, idleTimeout, vm.count( "foreground" ) > 0 ) );
+}
+
+void
+usage() {
+    char *msgs[] = {
+        "Usage: iagent [-hf] [-n connections] [-t seconds] start|stop|status",
+        " ",
+        "Keep logged in connections to the server open for other icommands.",
+        " ",
+        "While an agent is running, iquest, iquest2 and imeta2 borrow one of its",
+        "connections over a Unix domain socket instead of connecting and logging",
+        "in themselves, and connect directly as before when no agent is running",
+        "or when all of its connections are lent out.",
+        "The agent only serves the user and server of the environment it was",
+        "started in, and only to the same local account.",
+        " ",
+        "The socket is ~/.irods/agent.sock, or $IRODS_AGENT_SOCKET if it is set.",
+        " ",
+        "Options are:",
+        " -n connections  the most connections to keep open (default 4)",
+        " -t seconds      exit after this long without sessions (default 1800)",
+        " -f              stay in the foreground",
+        " -h              this help",
+        " ",
+        "Commands are:",
+        " start   start an agent, unless one is already running",
+        " stop    stop the running agent once its sessions have finished",
+        " status  show the running agent's connections and sessions",
+        ""
+    };
+    int i;
+    for ( i = 0;; i++ ) {
+        if ( strlen( msgs[i] ) == 0 ) {
+            break;
+        }
+        printf( "%s\n", msgs[i] );
+    }
+    printReleaseInfo( "iagent" );
+}
@@ -12,9 +12,120 @@
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
 #include "irods_parse_command_line_options.hpp"
+#include "miscUtil.h"
+#include "bundle_transfer.hpp"
+#include "resumable_transfer.hpp"
 
 void usage( FILE* );
 
+/*
+  Get each source collection by having the server bundle it into a
+  temporary tar data object in the home collection, which is streamed
+  down and unpacked locally.
+*/
+int
+bundleGet( rcComm_t *conn, rodsEnv *myEnv, rodsArguments_t *myRodsArgs,
+           rodsPathInp_t *rodsPathInp ) {
+    int status = resolveRodsTarget( conn, rodsPathInp, GET_OPR );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "bundleGet: resolveRodsTarget error" );
+        return status;
+    }
+
+    std::string resource;
+    if ( myRodsArgs->resource == True ) {
+        resource = myRodsArgs->resourceString;
+    }
+    else {
+        resource = myEnv->rodsDefResource;
+    }
+
+    icommands::transfer_stats stats;
+    icommands::progress_reporter reporter( stats, stdout, 1.0 );
+    int firstError = 0;
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        if ( rodsPathInp->srcPath[i].objType != COLL_OBJ_T ) {
+            rodsLog( LOG_ERROR, "bundleGet: --bundle only gets collections, not %s",
+                     rodsPathInp->srcPath[i].outPath );
+            status = USER_INPUT_PATH_ERR;
+        }
+        else {
+            status = icommands::bundle_download( conn, rodsPathInp->srcPath[i].outPath,
+                                                 rodsPathInp->targPath[i].outPath,
+                                                 myEnv->rodsHome, resource,
+                                                 myRodsArgs->force == True,
+                                                 myRodsArgs->verbose == True, stats );
+        }
+        if ( status < 0 ) {
+            stats.error();
+            if ( firstError == 0 ) {
+                firstError = status;
+            }
+        }
+    }
+    reporter.stop();
+    printf( "%s\n", stats.summary().c_str() );
+    return firstError;
+}
+
+/*
+  Get the sources with the parallel download engine, recording the
+  progress in the journal at resume and skipping what it already records
+  as downloaded.  The journal is removed once everything has been got.
+*/
+int
+resumeGet( rcComm_t *conn, rodsEnv *myEnv, rodsArguments_t *myRodsArgs,
+           rodsPathInp_t *rodsPathInp, const char *resume ) {
+    int status = resolveRodsTarget( conn, rodsPathInp, GET_OPR );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "resumeGet: resolveRodsTarget error" );
+        return status;
+    }
+
+    std::vector<std::string> sources;
+    std::vector<std::string> targets;
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        if ( rodsPathInp->srcPath[i].objType == COLL_OBJ_T && myRodsArgs->recursive != True ) {
+            rodsLog( LOG_ERROR, "resumeGet: %s is a collection, use -r",
+                     rodsPathInp->srcPath[i].outPath );
+            return USER_INPUT_OPTION_ERR;
+        }
+        sources.push_back( rodsPathInp->srcPath[i].outPath );
+        targets.push_back( rodsPathInp->targPath[i].outPath );
+    }
+
+    icommands::transfer_journal journal;
+    status = journal.open( resume, icommands::journal_job( "iget", sources, targets ),
+                           icommands::RESUME_CHUNK_SIZE );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "resumeGet: cannot use journal %s", resume );
+        return status;
+    }
+    if ( journal.finished() > 0 ) {
+        printf( "resuming from %s: %lu files already downloaded\n", resume,
+                static_cast<unsigned long>( journal.finished() ) );
+    }
+
+    icommands::download_options opts;
+    opts.force = myRodsArgs->force == True;
+    opts.verbose = myRodsArgs->verbose == True;
+    opts.progress = true;
+    if ( myRodsArgs->resource == True ) {
+        opts.resource = myRodsArgs->resourceString;
+    }
+
+    icommands::download_engine engine( *myEnv, opts, journal );
+    status = engine.run( conn, sources, targets );
+    printf( "%s\n", engine.stats().summary().c_str() );
+
+    // the journal is kept until a run completes without errors
+    int journal_status = status < 0 ? journal.close() : journal.remove();
+    if ( journal_status < 0 ) {
+        rodsLogError( LOG_ERROR, journal_status, "resumeGet: journal %s", resume );
+    }
+    return status;
+}
+
 int
 main( int argc, char **argv ) {
 
@@ -28,6 +139,35 @@ main( int argc, char **argv ) {
     int reconnFlag;
 
 
+    // --bundle and --resume are not known to parse_opts_and_paths, so
+    // take them out of the arguments first
+    bool bundle = false;
+    const char *resume = NULL;
+    int nargs = 0;
+    for ( int i = 0; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--bundle" ) == 0 ) {
+            bundle = true;
+        }
+        else if ( strncmp( argv[i], "--resume", 8 ) == 0 && ( argv[i][8] == '\0' || argv[i][8] == '=' ) ) {
+            if ( argv[i][8] == '=' ) {
+                resume = argv[i] + 9;
+            }
+            else if ( i + 1 < argc ) {
+                resume = argv[++i];
+            }
+            if ( resume == NULL || *resume == '\0' ) {
+                fprintf( stderr, "--resume needs a journal file\n" );
+                usage( stderr );
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            argv[nargs++] = argv[i];
+        }
+    }
+    argc = nargs;
+    argv[argc] = NULL;
+
     rodsEnv myEnv;
     status = getRodsEnv( &myEnv );
     if ( status < 0 ) {
@@ -53,6 +193,23 @@ main( int argc, char **argv ) {
         return EXIT_SUCCESS;
     }
 
+    if ( bundle || resume != NULL ) {
+        if ( bundle && myRodsArgs.recursive != True ) {
+            fprintf( stderr, "--bundle needs -r\n" );
+            return EXIT_FAILURE;
+        }
+        if ( bundle && resume != NULL ) {
+            fprintf( stderr, "--bundle cannot be used with --resume\n" );
+            return EXIT_FAILURE;
+        }
+        if ( myRodsArgs.restart == True || myRodsArgs.lfrestart == True ||
+                myRodsArgs.rbudp == True || myRodsArgs.redirectConn == True ||
+                myRodsArgs.verifyChecksum == True ) {
+            fprintf( stderr, "--bundle and --resume cannot be used with -I, -K, -Q, -X or --lfrestart\n" );
+            return EXIT_FAILURE;
+        }
+    }
+
     if ( myRodsArgs.reconnect == True ) {
         reconnFlag = RECONN_TIMEOUT;
     }
@@ -85,7 +242,15 @@ main( int argc, char **argv ) {
         gGuiProgressCB = ( guiProgressCallback ) iCommandProgStat;
     }
 
-    status = getUtil( &conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    if ( bundle ) {
+        status = bundleGet( conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    }
+    else if ( resume != NULL ) {
+        status = resumeGet( conn, &myEnv, &myRodsArgs, &rodsPathInp, resume );
+    }
+    else {
+        status = getUtil( &conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    }
 
     printErrorStack( conn->rError );
     rcDisconnect( conn );
@@ -119,6 +284,11 @@ usage( FILE* _fout ) {
         "[-R resource] [--lfrestart lfRestartFile] [--retries count] [--purgec]",
         "[--rlock] srcDataObj ... -",
         " ",
+        "Usage: iget -r --bundle [-fvV] [-R resource] srcCollection ... destLocalDir",
+        " ",
+        "Usage: iget [-frvV] [-R resource] --resume journalFile",
+        "srcDataObj|srcCollection ... destLocalFile|destLocalDir",
+        " ",
         "Get data-objects or collections from iRODS space, either to the specified",
         "local area or to the current working directory.",
         " ",
@@ -198,6 +368,20 @@ usage( FILE* _fout ) {
         "      the restart info.",
         " -t  ticket - ticket (string) to use for ticket-based access.",
         " --rlock - use advisory read lock for the download",
+        " --bundle - with -r, have the server pack each collection into a",
+        "      temporary tar data object in your home collection (on the -R or",
+        "      default resource), then stream it down as one transfer and",
+        "      unpack it locally as it arrives.  Suited to collections of many",
+        "      small files.  The bundle is removed afterwards.  Existing local",
+        "      files are only replaced with -f.",
+        " --resume journalFile - record the progress of the download in the local",
+        "      journalFile, and if it already exists, skip what it records as",
+        "      downloaded.  Data objects of 64 MB or more are read in 64 MB",
+        "      chunks, each recorded once synced to disk, so an interrupted",
+        "      download of one continues from its first missing chunk.  Four",
+        "      connections download side by side.  The sources and destination",
+        "      must be the ones the journal was started with.  The journal is",
+        "      removed once a run completes without errors.",
         " --kv_pass - pass quoted key-value strings through to the resource hierarchy,",
         "             of the form key1=value1;key2=value2",
         " -h  this help",
@@ -7,13 +7,18 @@
 
 #include "rods.h"
 #include "rodsClient.h"
-#include "irods_children_parser.hpp"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
 #include "irods_resource_constants.hpp"
 #include "irods_exception.hpp"
+#include "genquery_pager.hpp"
+#include "query_cache.hpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #define BIG_STR 200
@@ -25,15 +30,54 @@ enum DrawingStyle {
     DrawingStyle_unicode
 };
 
+// tree output formats
+enum OutputFormat {
+    OutputFormat_tree = 0,
+    OutputFormat_json,
+    OutputFormat_ndjson
+};
+
 
 const std::string middle_child_connector[2] = {"|-- ", "\u251C\u2500\u2500 "};
 const std::string last_child_connector[2] = {"`-- ", "\u2514\u2500\u2500 "};
 const std::string vertical_pipe[2] = {"|   ", "\u2502   "};
 const std::string indent = "    ";
 
+rcComm_t *Conn = NULL;
+rodsEnv myEnv;
 
 void usage();
 
+/*
+ Connect to the server the first time a query is not answered from the
+ cache; exits as ilsresc always has if that fails.
+ */
+rcComm_t *
+connectToServer() {
+    if ( Conn != NULL ) {
+        return Conn;
+    }
+
+    rErrMsg_t errMsg;
+    Conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
+                      myEnv.rodsZone, 0, &errMsg );
+    if ( Conn == NULL ) {
+        char *mySubName;
+        const char *myName = rodsErrorName( errMsg.status, &mySubName );
+        rodsLog( LOG_ERROR, "rcConnect failure %s (%s) (%d) %s",
+                 myName,
+                 mySubName,
+                 errMsg.status,
+                 errMsg.msg );
+        exit( 2 );
+    }
+
+    if ( clientLogin( Conn ) != 0 ) {
+        exit( 3 );
+    }
+    return Conn;
+}
+
 int
 printGenQueryResults( rcComm_t *Conn, int status, genQueryOut_t *genQueryOut,
                       char *descriptions[], int doDashes ) {
@@ -80,7 +124,8 @@ printGenQueryResults( rcComm_t *Conn, int status, genQueryOut_t *genQueryOut,
 Via a general query, show a resource
 */
 int
-showResc( char *name, int longOption, const char* zoneArgument, rcComm_t *Conn ) {
+showResc( char *name, int longOption, const char* zoneArgument,
+          const icommands::query_cache& cache ) {
     genQueryInp_t genQueryInp;
     genQueryOut_t *genQueryOut;
     int i1a[20];
@@ -158,13 +203,12 @@ showResc( char *name, int longOption, const char* zoneArgument, rcComm_t *Conn )
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::cached_pager<> pager( cache, connectToServer, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_R_RESC_INFO;
         genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             printf( "None\n" );
             return 0;
@@ -182,10 +226,9 @@ showResc( char *name, int longOption, const char* zoneArgument, rcComm_t *Conn )
 
     printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames,
                                         longOption );
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 && longOption ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 && longOption ) {
             printf( "----\n" );
         }
         printCount += printGenQueryResults( Conn, status, genQueryOut,
@@ -195,6 +238,33 @@ showResc( char *name, int longOption, const char* zoneArgument, rcComm_t *Conn )
     return 1;
 }
 
+// a resource in the hierarchy, with its children as indices into
+// rescTree::nodes
+struct rescNode {
+    rescNode() :
+        objects( 0 ),
+        bytes( 0 ) {
+    }
+
+    std::string         name;
+    std::string         type;
+    std::string         id;
+    std::string         parent_id;
+    std::vector<size_t> children;
+
+    // replicas and bytes stored in this resource and its descendants
+    rodsLong_t          objects;
+    rodsLong_t          bytes;
+};
+
+// the resource hierarchy, with nodes looked up by id and by name
+struct rescTree {
+    std::vector<rescNode>                   nodes;
+    std::unordered_map<std::string, size_t> by_id;
+    std::unordered_map<std::string, size_t> by_name;
+    std::vector<size_t>                     roots;
+};
+
 // depth is a binary string of open nodes
 void printDepth( const std::string& depth, DrawingStyle drawing_style ) {
     for ( std::string::const_iterator it=depth.begin(); it!=depth.end(); ++it ) {
@@ -208,62 +278,36 @@ void printDepth( const std::string& depth, DrawingStyle drawing_style ) {
 
 // recursive function to print resource tree
 void printRescTree(
-     const std::string&                node_name,
-     const std::string&                depth,
-     const std::vector<std::string>&   resc_types,
-     const std::vector<std::string>&   resc_children,
-     const std::map<std::string, int>& resc_map,
-     DrawingStyle                      drawing_style ) {
+     const rescTree& tree,
+     size_t          node_index,
+     std::string&    depth,
+     DrawingStyle    drawing_style ) {
 
-    // get children string
-    const std::map<std::string, int>::const_iterator it_resc_map = resc_map.find(node_name);
-    if (it_resc_map == resc_map.end()) {
-        THROW( SYS_INTERNAL_NULL_INPUT_ERR, std::string("Missing node in resc_map: [") + node_name + "]" );
-    }
-
-    const int resc_index = it_resc_map->second;
-    const std::string& children_str = resc_children[resc_index];
+    const rescNode& node = tree.nodes[node_index];
 
     // print node name, and type if not UFS
-    if ( resc_types[resc_index] != irods::RESOURCE_TYPE_NATIVE ) {
-        std::cout << node_name << ":" << resc_types[resc_index] << std::endl;
+    if ( node.type != irods::RESOURCE_TYPE_NATIVE ) {
+        std::cout << node.name << ":" << node.type << "\n";
     } else {
-        std::cout << node_name << std::endl;
-    }
-
-    if ( children_str.empty() ) {
-        return;
+        std::cout << node.name << "\n";
     }
 
     // print children
-    irods::children_parser parser;
-    parser.set_string( children_str );
-    irods::children_parser::const_iterator it;
-    const irods::children_parser::const_iterator final_it = --parser.end();
-    for ( it=parser.begin(); it!=parser.end(); ++it ) {
-        if ( it != final_it ) {
-            printDepth( depth, drawing_style);
-            std::cout << middle_child_connector[drawing_style];
-            printRescTree( it->first, depth + "1", resc_types, resc_children, resc_map, drawing_style );
-        } else {
-            printDepth( depth, drawing_style );
-            std::cout << last_child_connector[drawing_style];
-            printRescTree( it->first, depth + "0", resc_types, resc_children, resc_map, drawing_style );
-        }
+    for ( size_t i = 0; i < node.children.size(); ++i ) {
+        const bool last = i + 1 == node.children.size();
+        printDepth( depth, drawing_style );
+        std::cout << ( last ? last_child_connector[drawing_style] : middle_child_connector[drawing_style] );
+        depth.push_back( last ? '0' : '1' );
+        printRescTree( tree, node.children[i], depth, drawing_style );
+        depth.pop_back();
     }
     return;
 }
 
 int
 parseGenQueryOut(
-    int                         offset,
-    genQueryOut_t*              genQueryOut,
-    std::vector<std::string>&   resc_names,
-    std::vector<std::string>&   resc_indices,
-    std::vector<std::string>&   resc_types,
-    std::vector<std::string>&   resc_parents,
-    std::map<std::string, int>& resc_map,
-    std::vector<std::string>&   roots ) {
+    genQueryOut_t* genQueryOut,
+    rescTree&      tree ) {
 
     // loop over rows (i.e. for each resource)
     for ( int i=0; i<genQueryOut->rowCnt; ++i ) {
@@ -273,74 +317,178 @@ parseGenQueryOut(
             // parsing error
             return SYS_INTERNAL_NULL_INPUT_ERR;
         }
-        resc_names.push_back( std::string( t_res ) );
-
-        // map resource name to row index
-        resc_map[resc_names.back()] = i + offset;
 
-        // get resource type
-        t_res = genQueryOut->sqlResult[1].value + i * genQueryOut->sqlResult[1].len;
-        resc_types.push_back( std::string( t_res ) );
+        tree.nodes.push_back( rescNode() );
+        rescNode& node = tree.nodes.back();
+        node.name = t_res;
 
-        // get resource indicies
-        t_res = genQueryOut->sqlResult[2].value + i * genQueryOut->sqlResult[2].len;
-        if (t_res) {
-            resc_indices.push_back( std::string( t_res ) );
-        } else {
-            resc_indices.push_back( "" );
-        }
+        // get resource type, id and parent id
+        node.type = genQueryOut->sqlResult[1].value + i * genQueryOut->sqlResult[1].len;
+        node.id = genQueryOut->sqlResult[2].value + i * genQueryOut->sqlResult[2].len;
+        node.parent_id = genQueryOut->sqlResult[3].value + i * genQueryOut->sqlResult[3].len;
 
-        // check if has parent
-        t_res = genQueryOut->sqlResult[3].value + i * genQueryOut->sqlResult[3].len;
-        if ( !t_res || !strlen( t_res ) ) {
-            // another root node
-            roots.push_back( resc_names.back() );
-            resc_parents.push_back( "" ); // parents must line up with resources
-        } else {
-            resc_parents.push_back( std::string( t_res ) );
-        }
+        tree.by_id[node.id] = tree.nodes.size() - 1;
+        tree.by_name[node.name] = tree.nodes.size() - 1;
     }
 
     return 0;
 }
 
-int build_child_list(
-    const std::vector<std::string>&   _resc_names,
-    const std::vector<std::string>&   _resc_parents,
-    const std::vector<std::string>&   _resc_indicies,
-    std::vector<std::string>&         _resc_children ) {
-
-    for( size_t idx = 0;
-         idx < _resc_names.size();
-         ++idx ) {
-        if(idx >= _resc_parents.size() ||
-           _resc_parents[idx].empty()) {
+// link every node to its parent, in one pass over the nodes.  roots are
+// kept in query order and children are sorted by name.
+void build_child_lists( rescTree& tree ) {
+    for ( size_t idx = 0; idx < tree.nodes.size(); ++idx ) {
+        const rescNode& node = tree.nodes[idx];
+        if ( node.parent_id.empty() ) {
+            // another root node
+            tree.roots.push_back( idx );
             continue;
         }
 
-        size_t parent_pos = std::find(
-                                _resc_indicies.begin(),
-                                _resc_indicies.end(),
-                                _resc_parents[idx] ) - _resc_indicies.begin();
-        if( parent_pos > _resc_indicies.size() ) {
-            // parent_idx not found
+        std::unordered_map<std::string, size_t>::const_iterator parent = tree.by_id.find( node.parent_id );
+        if ( parent == tree.by_id.end() ) {
+            // parent not found
             continue;
         }
+        tree.nodes[parent->second].children.push_back( idx );
+    }
+
+    for ( size_t idx = 0; idx < tree.nodes.size(); ++idx ) {
+        std::vector<size_t>& children = tree.nodes[idx].children;
+        std::sort( children.begin(), children.end(),
+            [&tree]( size_t _lhs, size_t _rhs ) {
+                return tree.nodes[_lhs].name < tree.nodes[_rhs].name;
+            } );
+    }
+
+} // build_child_lists
 
-        if(!_resc_children[parent_pos].empty()) {
-            _resc_children[parent_pos] += ";";
+
+/*
+ Get the number of replicas and bytes stored on each resource with one
+ grouped query, and roll the totals up the tree so that every node
+ carries the totals of its subtree.
+ */
+int
+getRescUsage( const icommands::query_cache& cache, const char *zoneArgument, rescTree& tree ) {
+    genQueryInp_t genQueryInp;
+    genQueryOut_t *genQueryOut = NULL;
+    memset( &genQueryInp, 0, sizeof( genQueryInp ) );
+
+    addInxIval( &genQueryInp.selectInp, COL_D_RESC_ID, 1 );
+    addInxIval( &genQueryInp.selectInp, COL_DATA_SIZE, SELECT_SUM );
+    addInxIval( &genQueryInp.selectInp, COL_D_DATA_ID, SELECT_COUNT );
+
+    if ( zoneArgument && *zoneArgument ) {
+        addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
+    }
+
+    int status;
+    {
+        icommands::cached_pager<> pager( cache, connectToServer, &genQueryInp, &genQueryOut, MAX_SQL_ROWS );
+        status = pager.first();
+        while ( status == 0 ) {
+            for ( int i = 0; i < genQueryOut->rowCnt; ++i ) {
+                const char *id = genQueryOut->sqlResult[0].value + i * genQueryOut->sqlResult[0].len;
+                std::unordered_map<std::string, size_t>::const_iterator it = tree.by_id.find( id );
+                if ( it == tree.by_id.end() ) {
+                    continue;
+                }
+                rescNode& node = tree.nodes[it->second];
+                node.bytes += strtoll( genQueryOut->sqlResult[1].value + i * genQueryOut->sqlResult[1].len, NULL, 10 );
+                node.objects += strtoll( genQueryOut->sqlResult[2].value + i * genQueryOut->sqlResult[2].len, NULL, 10 );
+            }
+            if ( !pager.more() ) {
+                break;
+            }
+            status = pager.next();
         }
-        _resc_children[parent_pos] += _resc_names[idx];
-        _resc_children[parent_pos] += "{}";
+    }
+    clearGenQueryInp( &genQueryInp );
+    if ( status < 0 && status != CAT_NO_ROWS_FOUND ) {
+        return status;
+    }
 
-    } // for idx
+    // list the nodes so that every node comes before its parent, then add
+    // each node's totals to its parent in a single pass
+    std::vector<size_t> order;
+    std::vector<size_t> stack( tree.roots.rbegin(), tree.roots.rend() );
+    while ( !stack.empty() ) {
+        size_t idx = stack.back();
+        stack.pop_back();
+        order.push_back( idx );
+        const std::vector<size_t>& children = tree.nodes[idx].children;
+        stack.insert( stack.end(), children.begin(), children.end() );
+    }
+    for ( std::vector<size_t>::reverse_iterator it = order.rbegin(); it != order.rend(); ++it ) {
+        const rescNode& node = tree.nodes[*it];
+        std::unordered_map<std::string, size_t>::const_iterator parent = tree.by_id.find( node.parent_id );
+        if ( node.parent_id.empty() || parent == tree.by_id.end() ) {
+            continue;
+        }
+        tree.nodes[parent->second].objects += node.objects;
+        tree.nodes[parent->second].bytes += node.bytes;
+    }
 
     return 0;
+}
 
-} // build_child_list
+void printJsonString( std::ostream& out, const std::string& str ) {
+    out << '"';
+    for ( std::string::const_iterator it = str.begin(); it != str.end(); ++it ) {
+        const unsigned char c = *it;
+        if ( c == '"' || c == '\\' ) {
+            out << '\\' << c;
+        } else if ( c < 0x20 ) {
+            char esc[8];
+            snprintf( esc, sizeof( esc ), "\\u%04x", c );
+            out << esc;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
 
+void printJsonFields( std::ostream& out, const rescNode& node ) {
+    out << "\"name\":";
+    printJsonString( out, node.name );
+    out << ",\"type\":";
+    printJsonString( out, node.type );
+    out << ",\"id\":";
+    printJsonString( out, node.id );
+    out << ",\"objects\":" << node.objects << ",\"bytes\":" << node.bytes;
+}
 
-int showRescTree( const char *name, const char *zoneArgument, rcComm_t *Conn , DrawingStyle drawing_style) {
+// print a subtree as one JSON object with nested children
+void printRescTreeJson( const rescTree& tree, size_t node_index ) {
+    const rescNode& node = tree.nodes[node_index];
+    std::cout << '{';
+    printJsonFields( std::cout, node );
+    std::cout << ",\"children\":[";
+    for ( size_t i = 0; i < node.children.size(); ++i ) {
+        if ( i > 0 ) {
+            std::cout << ',';
+        }
+        printRescTreeJson( tree, node.children[i] );
+    }
+    std::cout << "]}";
+}
+
+// print a subtree as one JSON object per line, parents before children
+void printRescTreeNdjson( const rescTree& tree, size_t node_index, const std::string& parent, int depth ) {
+    const rescNode& node = tree.nodes[node_index];
+    std::cout << '{';
+    printJsonFields( std::cout, node );
+    std::cout << ",\"parent\":";
+    printJsonString( std::cout, parent );
+    std::cout << ",\"depth\":" << depth << "}\n";
+    for ( size_t i = 0; i < node.children.size(); ++i ) {
+        printRescTreeNdjson( tree, node.children[i], node.name, depth + 1 );
+    }
+}
+
+int showRescTree( const char *name, const char *zoneArgument, const icommands::query_cache& cache, DrawingStyle drawing_style, OutputFormat output_format ) {
     genQueryInp_t genQueryInp;
     memset( &genQueryInp, 0, sizeof( genQueryInp ) );
     genQueryOut_t *genQueryOut = NULL;
@@ -360,9 +508,10 @@ int showRescTree( const char *name, const char *zoneArgument, rcComm_t *Conn , D
     snprintf( collQCond, MAX_NAME_LEN, "!='%s'", BUNDLE_RESC );
     addInxVal( &genQueryInp.sqlCondInp, COL_R_RESC_NAME, collQCond );
 
-    // query for resources
-    genQueryInp.maxRows = MAX_SQL_ROWS;
-    int status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    // query for resources, parsing each page while the next one is fetched
+    icommands::cached_pager< icommands::prefetch_pager > pager(
+        cache, connectToServer, &genQueryInp, &genQueryOut, MAX_SQL_ROWS );
+    int status = pager.first();
 
     // query fail?
     if ( status < 0 ) {
@@ -370,55 +519,62 @@ int showRescTree( const char *name, const char *zoneArgument, rcComm_t *Conn , D
         return status;
     }
 
-    // containers for storing query results
-    // one vector per attribute
-    std::vector<std::string> resc_names;
-    std::vector<std::string> resc_indices;
-    std::vector<std::string> resc_types;
-    std::vector<std::string> resc_children;
-    std::vector<std::string> resc_parents;
-
-    // mapping of resource names and row indexes for looking up children
-    std::map<std::string, int> resc_map;
-
-    // list of root resources
-    std::vector<std::string> roots;
-
     // parse results
-    int offset = 0;
-    status = parseGenQueryOut( offset, genQueryOut, resc_names, resc_indices, resc_types, resc_parents, resc_map, roots );
-    while ( !status && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        offset += genQueryOut->rowCnt;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        status = parseGenQueryOut( offset, genQueryOut, resc_names, resc_indices, resc_types, resc_parents, resc_map, roots );
+    rescTree tree;
+    status = parseGenQueryOut( genQueryOut, tree );
+    while ( !status && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 ) {
+            status = parseGenQueryOut( genQueryOut, tree );
+        }
     }
 
-    // child strings assumed to be initialized by printRescTree
-    resc_children.resize( resc_names.size() );
-
-    status =  build_child_list( resc_names, resc_parents, resc_indices, resc_children );
-    if( status < 0 ) {
-        printError( Conn, status, "build_child_list failed" );
-        return status;
-    }
+    build_child_lists( tree );
 
-    // If target resource was specified print tree for that resource
+    // If target resource was specified print tree for that resource,
+    // otherwise print tree for each root node
+    std::vector<size_t> tops = tree.roots;
     if ( name && *name ) {
         // check for invalid resource name
-        if ( std::find( resc_names.begin(), resc_names.end(), name ) == resc_names.end() ) {
+        std::unordered_map<std::string, size_t>::const_iterator it = tree.by_name.find( name );
+        if ( it == tree.by_name.end() ) {
             std::cout << "Resource " << name << " does not exist." << std::endl;
             return USER_INVALID_RESC_INPUT;
         }
+        tops.assign( 1, it->second );
+    }
 
-        // print tree
-        printRescTree( name, "", resc_types, resc_children, resc_map, drawing_style );
-    } else {
-        // Otherwise print tree for each root node
-        for ( std::vector<std::string>::const_iterator it = roots.begin(); it != roots.end(); ++it ) {
-            printRescTree( *it, "", resc_types, resc_children, resc_map, drawing_style );
+    if ( output_format != OutputFormat_tree ) {
+        status = getRescUsage( cache, zoneArgument, tree );
+        if ( status < 0 ) {
+            printError( Conn, status, "rcGenQuery" );
+            return status;
+        }
+    }
+
+    std::string depth;
+    for ( size_t i = 0; i < tops.size(); ++i ) {
+        const rescNode& top = tree.nodes[tops[i]];
+        switch ( output_format ) {
+        case OutputFormat_json:
+            std::cout << ( i == 0 ? "[" : "," );
+            printRescTreeJson( tree, tops[i] );
+            break;
+        case OutputFormat_ndjson: {
+            std::unordered_map<std::string, size_t>::const_iterator parent = tree.by_id.find( top.parent_id );
+            printRescTreeNdjson( tree, tops[i],
+                                 parent == tree.by_id.end() ? "" : tree.nodes[parent->second].name, 0 );
+            break;
+        }
+        default:
+            printRescTree( tree, tops[i], depth, drawing_style );
+            break;
         }
     }
+    if ( output_format == OutputFormat_json ) {
+        std::cout << ( tops.empty() ? "[]\n" : "]\n" );
+    }
+    std::cout.flush();
 
     return status;
 }
@@ -428,6 +584,30 @@ main( int argc, char **argv ) {
     signal( SIGPIPE, SIG_IGN );
     rodsLogLevel( LOG_ERROR );
 
+    // --json, --ndjson and --no-cache are not known to parseCmdLineOpt, so
+    // take them out of the arguments first
+    OutputFormat output_format = OutputFormat_tree;
+    bool use_cache = true;
+    int nargs = 0;
+    for ( int i = 0; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--json" ) == 0 || strcmp( argv[i], "--ndjson" ) == 0 ) {
+            OutputFormat format = argv[i][2] == 'j' ? OutputFormat_json : OutputFormat_ndjson;
+            if ( output_format != OutputFormat_tree && output_format != format ) {
+                printf( "--json and --ndjson cannot be used together\n" );
+                return 1;
+            }
+            output_format = format;
+        }
+        else if ( strcmp( argv[i], "--no-cache" ) == 0 ) {
+            use_cache = false;
+        }
+        else {
+            argv[nargs++] = argv[i];
+        }
+    }
+    argc = nargs;
+    argv[argc] = NULL;
+
     rodsArguments_t myRodsArgs;
     int status = parseCmdLineOpt( argc, argv, "hvVlz:Z", 1, &myRodsArgs );
     if ( status ) {
@@ -440,12 +620,16 @@ main( int argc, char **argv ) {
         return 0;
     }
 
+    if ( output_format != OutputFormat_tree && myRodsArgs.longOption == True ) {
+        printf( "--json and --ndjson print the tree view and cannot be used with -l\n" );
+        return 1;
+    }
+
     char zoneArgument[MAX_NAME_LEN + 2] = "";
     if ( myRodsArgs.zone == True ) {
         strncpy( zoneArgument, myRodsArgs.zoneName, MAX_NAME_LEN );
     }
 
-    rodsEnv myEnv;
     status = getRodsEnv( &myEnv );
     if ( status < 0 ) {
         rodsLog( LOG_ERROR, "main: getRodsEnv error. status = %d", status );
@@ -458,45 +642,30 @@ main( int argc, char **argv ) {
     irods::api_entry_table&  api_tbl = irods::get_client_api_table();
     init_api_table( api_tbl, pk_tbl );
 
-    rErrMsg_t errMsg;
-    rcComm_t *Conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
-                      myEnv.rodsZone, 0, &errMsg );
+    // the connection is made by the first query that is not answered
+    // from the cache
+    icommands::query_cache cache( myEnv, use_cache );
 
     try {
-        if ( Conn == NULL ) {
-            char *mySubName;
-            const char *myName = rodsErrorName( errMsg.status, &mySubName );
-            rodsLog( LOG_ERROR, "rcConnect failure %s (%s) (%d) %s",
-                     myName,
-                     mySubName,
-                     errMsg.status,
-                     errMsg.msg );
-
-            return 2;
-        }
-
-        status = clientLogin( Conn );
-        if ( status != 0 ) {
-            return 3;
-        }
-
         // tree view
         DrawingStyle drawing_style = DrawingStyle_unicode;
         if ( myRodsArgs.longOption != True ) {
             if ( myRodsArgs.ascii == True ) { // character set for printing tree
                 drawing_style = DrawingStyle_ascii;
             }
-            status = showRescTree( argv[myRodsArgs.optind], zoneArgument, Conn, drawing_style);
+            status = showRescTree( argv[myRodsArgs.optind], zoneArgument, cache, drawing_style, output_format );
         } else { // regular view
-            status = showResc( argv[myRodsArgs.optind], myRodsArgs.longOption, zoneArgument, Conn );
+            status = showResc( argv[myRodsArgs.optind], myRodsArgs.longOption, zoneArgument, cache );
         }
     } catch ( const irods::exception& e_ ) {
         rodsLog( LOG_ERROR, "Caught irods::exception\n%s", e_.what() );
         status = e_.code();
     }
 
-    printErrorStack( Conn->rError );
-    rcDisconnect( Conn );
+    if ( Conn != NULL ) {
+        printErrorStack( Conn->rError );
+        rcDisconnect( Conn );
+    }
 
     /* Exit 0 if one or more items were displayed */
     if ( status >= 0 ) {
@@ -512,7 +681,7 @@ Print the main usage/help information.
 void usage() {
     char *msgs[] = {
         "ilsresc lists iRODS resources",
-        "Usage: ilsresc [-lvVh] [--tree] [--ascii] [Name]",
+        "Usage: ilsresc [-lvVh] [--tree] [--ascii] [--json|--ndjson] [--no-cache] [Name]",
         "If Name is present, list only that resource, ",
         "otherwise list them all ",
         "Options are:",
@@ -522,7 +691,18 @@ void usage() {
         " -z Zonename  list resources of specified Zone",
         " --tree - tree view",
         " --ascii - use ascii character set to build tree view (ignored without --tree)",
+        " --json - print the tree as JSON, each resource with its name, type, id,",
+        "          the replicas and bytes stored in it and below it, and its children",
+        " --ndjson - as --json, but one resource per line, parents before children,",
+        "          with the parent's name and the depth in place of the children.",
+        "          Neither is streamed: the whole tree and its usage are read before",
+        "          the first resource is printed, as a resource's totals include",
+        "          every resource below it.  --json and --ndjson cannot be used with -l",
+        " --no-cache - query the server even if the results are in the query cache",
         " -h This help",
+        " ",
+        "If IRODS_QUERY_CACHE_TTL is set to a number of seconds, query results are",
+        "kept in ~/.irods/query_cache and reused for that long by later invocations.",
         ""
     };
     for ( int i = 0;; i++ ) {
@@ -9,6 +9,7 @@
 #include "rodsClient.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
+#include "genquery_pager.hpp"
 
 #include <sstream>
 #include <string>
@@ -191,20 +192,19 @@ showDataObj( char *name, char *attrName, int wild ) {
     condVal[0] = const_cast<char*>( v1.c_str() );
     condVal[1] = const_cast<char*>( v2.c_str() );
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_D_DATA_PATH;
         genQueryInp.selectInp.len = 1;
         genQueryInp.sqlCondInp.len = 2;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             printf( "None\n" );
             return 0;
@@ -221,10 +221,9 @@ showDataObj( char *name, char *attrName, int wild ) {
         printGenQueryResults( Conn, status, genQueryOut, columnNames );
     }
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -316,20 +315,19 @@ showColl( char *name, char *attrName, int wild ) {
         genQueryInp.sqlCondInp.len++;
     }
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_COLL_COMMENTS;
         genQueryInp.selectInp.len = 1;
         genQueryInp.sqlCondInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             printf( "None\n" );
             return 0;
@@ -343,10 +341,9 @@ showColl( char *name, char *attrName, int wild ) {
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -416,20 +413,19 @@ showResc( char *name, char *attrName, int wild ) {
         genQueryInp.sqlCondInp.len++;
     }
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_R_RESC_INFO;
         genQueryInp.selectInp.len = 1;
         genQueryInp.sqlCondInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             printf( "None\n" );
             return 0;
@@ -443,10 +439,9 @@ showResc( char *name, char *attrName, int wild ) {
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -535,20 +530,19 @@ showUser( char *name, char *attrName, int wild ) {
     condVal[0] = const_cast<char*>( v1.c_str() );
     condVal[1] = const_cast<char*>( v2.c_str() );
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_USER_COMMENT;
         genQueryInp.selectInp.len = 1;
         genQueryInp.sqlCondInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             printf( "None\n" );
             return 0;
@@ -562,10 +556,9 @@ showUser( char *name, char *attrName, int wild ) {
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -659,22 +652,20 @@ int queryDataObj( char *cmdToken[] ) {
         return -2;
     }
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -765,22 +756,20 @@ int queryCollection( char *cmdToken[] ) {
         return -2;
     }
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -837,22 +826,20 @@ int queryResc( char *attribute, char *op, char *value ) {
     genQueryInp.sqlCondInp.value = condVal;
     genQueryInp.sqlCondInp.len = 2;
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -909,22 +896,20 @@ int queryUser( char *attribute, char *op, char *value ) {
     genQueryInp.sqlCondInp.value = condVal;
     genQueryInp.sqlCondInp.len = 2;
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
     genQueryInp.condInput.len = 0;
 
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
 
     printGenQueryResults( Conn, status, genQueryOut, columnNames );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printGenQueryResults( Conn, status, genQueryOut,
@@ -10,11 +10,21 @@
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
 
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "connection_broker.hpp"
 #include "query2.hpp"
+#include "query2_result_view.hpp"
+#include "query2_statement.hpp"
 
 #define MAX_SQL 300
 #define BIG_STR 3000
@@ -23,29 +33,37 @@ char cwd[BIG_STR];
 
 int debug = 0;
 int testMode = 0; /* some particular internal tests */
-int longMode = 0; /* more detailed listing */
+thread_local int longMode = 0; /* more detailed listing */
 int upperCaseFlag = 0;
 
 char zoneArgument[MAX_NAME_LEN + 2] = "";
 
-rcComm_t *Conn;
+/* per-command state is thread local so that pipeline workers (see
+   runPipeline) can each run commands on their own connection */
+thread_local rcComm_t *Conn;
 rodsEnv myEnv;
 
-int lastCommandStatus = 0;
-int printCount = 0;
+thread_local int lastCommandStatus = 0;
+thread_local int printCount = 0;
+
+/* where command results are written; a memory stream in pipeline mode */
+thread_local FILE *cmdOut = stdout;
 
 int usage( char *subOpt );
+int runPipeline( int depth );
+int batchAVUMetadata( char *objType, char *fileName, int depth );
 
 /*
- print the results of a general query.
+ print the results of a general query.  only the first descriptionCount
+ columns have descriptions, and any further columns are not printed.
  */
 void
-printGenQueryResults( rcComm_t *Conn, int status, char *json,
-                      char *descriptions[] ) {
-
-  std::vector< std::vector<std::string> > results = parseQuery2Results(json);
+printGenQueryResults( rcComm_t *Conn, int status,
+                      const query2::result_view& results,
+                      char *descriptions[], size_t descriptionCount ) {
 
   char localTime[TIME_LEN];
+  char rodsTime[TIME_LEN];
   lastCommandStatus = status;
   if ( status == CAT_NO_ROWS_FOUND ) {
     lastCommandStatus = 0;
@@ -56,26 +74,27 @@ printGenQueryResults( rcComm_t *Conn, int status, char *json,
   else {
     if ( status == CAT_NO_ROWS_FOUND ) {
       if ( printCount == 0 ) {
-	printf( "None\n" );
+	fprintf( cmdOut, "None\n" );
       }
     }
     else {
-      for ( size_t i = 0; i < results.size(); i++ ) {
+      for ( size_t i = 0; i < results.rows(); i++ ) {
 	if ( i > 0 ) {
-	  printf( "----\n" );
+	  fprintf( cmdOut, "----\n" );
 	}
-	auto row = results[i];
-	for ( size_t j = 0; j < row.size(); j++ ) {
-	  std::string tResult;
-	  tResult = row[j];
+	for ( size_t j = 0; j < results.columns() && j < descriptionCount; j++ ) {
+	  query2::cell_t tResult = results.at( i, j );
 	  if ( *descriptions[j] != '\0' ) {
 	    if ( strstr( descriptions[j], "time" ) != 0 ) {
-	      getLocalTimeFromRodsTime( tResult.c_str(), localTime );
-	      printf( "%s: %s\n", descriptions[j],
-		      localTime );
+	      snprintf( rodsTime, sizeof( rodsTime ), "%.*s",
+			static_cast<int>( tResult.size() ), tResult.data() );
+	      getLocalTimeFromRodsTime( rodsTime, localTime );
+	      fprintf( cmdOut, "%s: %s\n", descriptions[j],
+		       localTime );
 	    }
 	    else {
-	      printf( "%s: %s\n", descriptions[j], tResult.c_str() );
+	      fprintf( cmdOut, "%s: %.*s\n", descriptions[j],
+		       static_cast<int>( tResult.size() ), tResult.data() );
 	      printCount++;
 	    }
 	  }
@@ -85,6 +104,18 @@ printGenQueryResults( rcComm_t *Conn, int status, char *json,
   }
 }
 
+/*
+ Add the optional attribute name condition of ls and lsw to a query.
+ */
+void
+addAttrCondition( std::string& qu, std::vector<std::string>& args,
+                  char *attrName, int wild ) {
+    if ( attrName != NULL && *attrName != '\0' ) {
+        qu += wild ? " like(a, ?)" : " eq(a, ?)";
+        args.push_back( attrName );
+    }
+}
+
 /*
  Via a general query and show the AVUs for a dataobject.
  */
@@ -97,10 +128,10 @@ showDataObj( char *name, char *attrName, int wild ) {
     /* "id" only used in testMode, in longMode id is reset to be 'time set' :*/
     char *columnNames[] = {"attribute", "value", "units", "id"};
 
-    std::string qu;
-    char *res;
+    std::vector<std::string> args;
+    query2::result_view res;
 
-    printf( "AVUs defined for dataObj %s:\n", name );
+    fprintf( cmdOut, "AVUs defined for dataObj %s:\n", name );
     printCount = 0;
 
 
@@ -116,30 +147,15 @@ showDataObj( char *name, char *attrName, int wild ) {
       rodsLog( LOG_ERROR, "splitPathByKey failed in showDataObj with status %d", status );
     }
 
-    qu = "COLL_NAME(cid,\"";
-    qu += myDirName;
-    qu += "\")";
-    
-    qu = "DATA_NAME_2(oid,\"";
-    qu += myFileName;
-    qu += "\") DATA_COLL_ID(oid, cid) META_2(oid, a, v, u)";
-
-    if ( attrName != NULL && *attrName != '\0' ) {
-        if ( wild ) {
-            qu  = "like(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-        else {
-            qu  = "eq(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-    }
+    std::string qu = "COLL_NAME(cid, ?) DATA_NAME_2(oid, ?) DATA_COLL_ID(oid, cid) META_2(oid, a, v, u)";
+    args.push_back( myDirName );
+    args.push_back( myFileName );
+    addAttrCondition( qu, args, attrName, wild );
 
-    status = query(Conn, qu.c_str(), "a v u", &res);
+    status = query2::query( Conn, query2::statement( qu ), args, "a v u", res );
 
-    printGenQueryResults( Conn, status, res, columnNames );
+    printGenQueryResults( Conn, status, res, columnNames,
+                          sizeof( columnNames ) / sizeof( columnNames[0] ) );
     
     return 0;
 }
@@ -154,10 +170,10 @@ showColl( char *name, char *attrName, int wild ) {
     /* "id" only used in testMode, in longMode id is reset to be 'time set' :*/
     char *columnNames[] = {"attribute", "value", "units", "id"};
 
-    std::string qu;
-    char *res;
+    std::vector<std::string> args;
+    query2::result_view res;
 
-    printf( "AVUs defined for collection %s:\n", name );
+    fprintf( cmdOut, "AVUs defined for collection %s:\n", name );
     printCount = 0;
 
 
@@ -168,27 +184,14 @@ showColl( char *name, char *attrName, int wild ) {
         snprintf( fullName, sizeof( fullName ), "%s/%s", cwd, name );
     }
 
-    qu = "COLL_NAME(cid,\"";
-    qu += fullName;
-    qu += "\") META2(cid, a, v, u)";
-
-    if ( attrName != NULL && *attrName != '\0' ) {
-        if ( wild ) {
-            qu  = "like(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-        else {
-            qu  = "eq(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-    }
-    
+    std::string qu = "COLL_NAME(cid, ?) META_2(cid, a, v, u)";
+    args.push_back( fullName );
+    addAttrCondition( qu, args, attrName, wild );
 
-    status = query(Conn, qu.c_str(), "a v u", &res);
+    status = query2::query( Conn, query2::statement( qu ), args, "a v u", res );
 
-    printGenQueryResults( Conn, status, res, columnNames );
+    printGenQueryResults( Conn, status, res, columnNames,
+                          sizeof( columnNames ) / sizeof( columnNames[0] ) );
     
     return 0;
 }
@@ -202,34 +205,21 @@ showResc( char *name, char *attrName, int wild ) {
     /* "id" only used in testMode, in longMode id is reset to be 'time set' :*/
     char *columnNames[] = {"attribute", "value", "units", "id"};
 
-    std::string qu;
-    char *res;
+    std::vector<std::string> args;
+    query2::result_view res;
 
-    printf( "AVUs defined for resource %s:\n", name );
+    fprintf( cmdOut, "AVUs defined for resource %s:\n", name );
     printCount = 0;
 
 
-    qu = "RESC_NAME(rid,\"";
-    qu += name;
-    qu += "\") META2(rid, a, v, u)";
-
-    if ( attrName != NULL && *attrName != '\0' ) {
-        if ( wild ) {
-            qu  = "like(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-        else {
-            qu  = "eq(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-    }
-    
+    std::string qu = "RESC_NAME(rid, ?) META_2(rid, a, v, u)";
+    args.push_back( name );
+    addAttrCondition( qu, args, attrName, wild );
 
-    status = query(Conn, qu.c_str(), "a v u", &res);
+    status = query2::query( Conn, query2::statement( qu ), args, "a v u", res );
 
-    printGenQueryResults( Conn, status, res, columnNames );
+    printGenQueryResults( Conn, status, res, columnNames,
+                          sizeof( columnNames ) / sizeof( columnNames[0] ) );
     
     return 0;
 }
@@ -243,34 +233,21 @@ showUser( char *name, char *attrName, int wild ) {
     /* "id" only used in testMode, in longMode id is reset to be 'time set' :*/
     char *columnNames[] = {"attribute", "value", "units", "id"};
 
-    std::string qu;
-    char *res;
+    std::vector<std::string> args;
+    query2::result_view res;
 
-    printf( "AVUs defined for collection %s:\n", name );
+    fprintf( cmdOut, "AVUs defined for collection %s:\n", name );
     printCount = 0;
 
 
-    qu = "USER_NAME(uid,\"";
-    qu += name;
-    qu += "\") META2(uid, a, v, u)";
+    std::string qu = "USER_NAME(uid, ?) META_2(uid, a, v, u)";
+    args.push_back( name );
+    addAttrCondition( qu, args, attrName, wild );
 
-    if ( attrName != NULL && *attrName != '\0' ) {
-        if ( wild ) {
-            qu  = "like(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-        else {
-            qu  = "eq(a,\"";
-            qu += attrName;
-            qu += "\"";
-        }
-    }
-    
+    status = query2::query( Conn, query2::statement( qu ), args, "a v u", res );
 
-    status = query(Conn, qu.c_str(), "a v u", &res);
-
-    printGenQueryResults( Conn, status, res, columnNames );
+    printGenQueryResults( Conn, status, res, columnNames,
+                          sizeof( columnNames ) / sizeof( columnNames[0] ) );
     
     return 0;
 }
@@ -287,6 +264,7 @@ modAVUMetadata( char *arg0, char *arg1, char *arg2, char *arg3,
     char myDirName[MAX_NAME_LEN];
 
     std::string qu;
+    std::vector<std::string> args;
     if ( strcmp( arg1, "-R" ) == 0 || strcmp( arg1, "-r" ) == 0 ||
             strcmp( arg1, "-u" ) == 0 ) {
         snprintf( fullName, sizeof( fullName ), "%s", arg2 );
@@ -303,117 +281,40 @@ modAVUMetadata( char *arg0, char *arg1, char *arg2, char *arg3,
         snprintf( fullName, sizeof( fullName ), "%s", cwd );
     }
 
-    if(strcmp(arg0, "add") == 0) {
-      if ( strcmp( arg1, "-R" ) == 0 || strcmp( arg1, "-r" ) == 0) {
-        snprintf( fullName, sizeof( fullName ), "%s", arg2 );
-	qu += "RESC_NAME(id, \"" ;
-	qu += fullName ;
-	qu += "\") insert META_2(id, \"";
-	qu +=  arg3 ;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      } else if (strcmp( arg1, "-u" ) == 0 ) {
-        snprintf( fullName, sizeof( fullName ), "%s", arg2 );
-	qu += "USER_NAME(id, \"";
-	qu += fullName;
-	qu += "\") insert META_2(id, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      }
-      else if ( strcmp( arg1, "-C" ) == 0 ) {
-	qu += "COLL_NAME(id, \"" ;
-	qu += fullName;
-	qu += "\") insert META_2(id, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      }
-      else {
-	if ( int status = splitPathByKey( fullName, myDirName,
-					  MAX_NAME_LEN, myFileName, MAX_NAME_LEN, '/' ) ) {
-	  rodsLog( LOG_ERROR, "splitPathByKey failed in showDataObj with status %d", status );
-	}
-	qu += "DATA_NAME_2(oid, \"";
-	qu += myFileName;
-	qu += "\") COLL_NAME(cid, \"";
-	qu += myDirName;
-	qu += "\") DATA_COLL_ID(oid, cid) insert META_2(oid, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      }
-    } else {
-      if ( strcmp( arg1, "-R" ) == 0 || strcmp( arg1, "-r" ) == 0) {
-        snprintf( fullName, sizeof( fullName ), "%s", arg2 );
-	qu += "RESC_NAME(id, \"";
-	qu += fullName;
-	qu += "\") delete META_2(id, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-	
-      } else if (
-		 strcmp( arg1, "-u" ) == 0 ) {
-        snprintf( fullName, sizeof( fullName ), "%s", arg2 );
-	qu += "USER_NAME(id, \"";
-	qu += fullName;
-	qu += "\") delete META_2(id, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      }
-      else if ( strcmp( arg1, "-C" ) == 0 ) {
-	qu += "COLL_NAME(id, \"";
-	qu += fullName;
-	qu += "\") delete META_2(id, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      }
-      else {
-	if ( int status = splitPathByKey( fullName, myDirName,
-					  MAX_NAME_LEN, myFileName, MAX_NAME_LEN, '/' ) ) {
-	  rodsLog( LOG_ERROR, "splitPathByKey failed in showDataObj with status %d", status );
-	}
-	qu += "DATA_NAME_2(oid, \"";
-	qu += myFileName;
-	qu += "\") COLL_NAME(cid, \"";
-	qu += myDirName;
-	qu += "\") DATA_COLL_ID(oid, cid) delete META_2(oid, \"";
-	qu += arg3;
-	qu += "\",\"";
-	qu += arg4;
-	qu += "\", \"";
-	qu += arg5;
-	qu += "\")";
-      }
+    /* doCommand has already lower-cased -C and -R */
+    if ( strcmp( arg1, "-R" ) == 0 || strcmp( arg1, "-r" ) == 0 ) {
+        qu = "RESC_NAME(id, ?)";
+        args.push_back( fullName );
+    }
+    else if ( strcmp( arg1, "-u" ) == 0 ) {
+        qu = "USER_NAME(id, ?)";
+        args.push_back( fullName );
+    }
+    else if ( strcmp( arg1, "-C" ) == 0 || strcmp( arg1, "-c" ) == 0 ) {
+        qu = "COLL_NAME(id, ?)";
+        args.push_back( fullName );
+    }
+    else {
+        if ( int status = splitPathByKey( fullName, myDirName,
+                                          MAX_NAME_LEN, myFileName, MAX_NAME_LEN, '/' ) ) {
+            rodsLog( LOG_ERROR, "splitPathByKey failed in showDataObj with status %d", status );
+        }
+        qu = "DATA_NAME_2(id, ?) COLL_NAME(cid, ?) DATA_COLL_ID(id, cid)";
+        args.push_back( myFileName );
+        args.push_back( myDirName );
     }
 
+    if ( strcmp( arg0, "add" ) == 0 ) {
+        qu += " insert META_2(id, ?, ?, ?)";
+    }
+    else {
+        qu += " delete META_2(id, ?, ?, ?)";
+    }
+    args.push_back( arg3 );
+    args.push_back( arg4 );
+    args.push_back( arg5 );
 
-    char *res;
-    status = query(Conn, qu.c_str(), "", &res);
+    status = query2::execute( Conn, query2::statement( qu ), args );
     lastCommandStatus = status;
 
     if ( status < 0 ) {
@@ -438,28 +339,15 @@ modAVUMetadata( char *arg0, char *arg1, char *arg2, char *arg3,
 }
 
 /*
- Prompt for input and parse into tokens
+ Parse a line of input into tokens (in place)
 */
 int
-getInput( char *cmdToken[], int maxTokens ) {
+parseInput( char *ttybuf, char *cmdToken[], int maxTokens ) {
     int lenstr, i;
-    static char ttybuf[BIG_STR];
     int nTokens;
     int tokenFlag; /* 1: start reg, 2: start ", 3: start ' */
     char *cpTokenStart;
-    char *stat;
 
-    memset( ttybuf, 0, BIG_STR );
-    fputs( "imeta>", stdout );
-    stat = fgets( ttybuf, BIG_STR, stdin );
-    if ( stat == 0 ) {
-        printf( "\n" );
-        rcDisconnect( Conn );
-        if ( lastCommandStatus != 0 ) {
-            exit( 4 );
-        }
-        exit( 0 );
-    }
     lenstr = strlen( ttybuf );
     for ( i = 0; i < maxTokens; i++ ) {
         cmdToken[i] = "";
@@ -521,6 +409,28 @@ getInput( char *cmdToken[], int maxTokens ) {
     return 0;
 }
 
+/*
+ Prompt for input and parse into tokens
+*/
+int
+getInput( char *cmdToken[], int maxTokens ) {
+    static char ttybuf[BIG_STR];
+    char *stat;
+
+    memset( ttybuf, 0, BIG_STR );
+    fputs( "imeta>", stdout );
+    stat = fgets( ttybuf, BIG_STR, stdin );
+    if ( stat == 0 ) {
+        printf( "\n" );
+        icommands::broker_disconnect( Conn );
+        if ( lastCommandStatus != 0 ) {
+            exit( 4 );
+        }
+        exit( 0 );
+    }
+    return parseInput( ttybuf, cmdToken, maxTokens );
+}
+
 /*
  Detect a 'l' in a '-' option and if present, set a mode flag and
  remove it from the string (to simplify other processing).
@@ -606,7 +516,7 @@ doCommand( char *cmdToken[] ) {
                                  cmdToken[3], cmdToken[4], cmdToken[5],
                                  cmdToken[6], cmdToken[7], "" );
         if ( myStat > 0 ) {
-            printf( "AVU added to %d data-objects\n", myStat );
+            fprintf( cmdOut, "AVU added to %d data-objects\n", myStat );
             lastCommandStatus = 0;
         }
         return 0;
@@ -644,6 +554,15 @@ doCommand( char *cmdToken[] ) {
         return 0;
     }
 
+    if ( strcmp( cmdToken[0], "pipeline" ) == 0 ) {
+        runPipeline( atoi( cmdToken[1] ) );
+        return 0;
+    }
+    if ( strcmp( cmdToken[0], "batch" ) == 0 ) {
+        batchAVUMetadata( cmdToken[1], cmdToken[2], atoi( cmdToken[3] ) );
+        return 0;
+    }
+
     doLs = 0;
     if ( strcmp( cmdToken[0], "lsw" ) == 0 ) {
         doLs = 1;
@@ -674,12 +593,437 @@ doCommand( char *cmdToken[] ) {
 
 
     if ( *cmdToken[0] != '\0' ) {
-        printf( "unrecognized subcommand '%s', try 'imeta help'\n", cmdToken[0] );
+        fprintf( cmdOut, "unrecognized subcommand '%s', try 'imeta help'\n", cmdToken[0] );
         return -2;
     }
     return -3;
 }
 
+/*
+ A command read ahead in pipeline mode, with its own copy of the input
+ line and the output it produced.  lineNumber is the line of a batch
+ file the command was made from.
+ */
+struct pipelineJob {
+    char line[BIG_STR];
+    char *cmdToken[40];
+    char *output;
+    size_t outputLen;
+    int status;
+    int lineNumber;
+    bool done;
+};
+
+/*
+ A pipeline worker runs the jobs routed to it, in order, on its own
+ connection.
+ */
+struct pipelineWorker {
+    rcComm_t *conn;
+    std::deque<pipelineJob *> queue;
+    std::thread thread;
+};
+
+/*
+ The workers of a pipeline and the jobs in flight, oldest first.  finish
+ is called with each job, in the order the jobs were submitted, once it
+ has run; it owns the job from then on.
+ */
+struct pipelineState {
+    std::mutex mutex;
+    std::condition_variable workCv;
+    std::condition_variable doneCv;
+    bool shutdown;
+    std::vector<pipelineWorker *> workers;
+    std::deque<pipelineJob *> inflight;
+    size_t depth;
+    std::function<void( pipelineJob * )> finish;
+};
+
+void
+pipelineWorkerLoop( pipelineState *state, pipelineWorker *worker ) {
+    Conn = worker->conn;
+    for ( ;; ) {
+        pipelineJob *job;
+        {
+            std::unique_lock<std::mutex> lock( state->mutex );
+            state->workCv.wait( lock, [&] {
+                return !worker->queue.empty() || state->shutdown;
+            } );
+            if ( worker->queue.empty() ) {
+                return;
+            }
+            job = worker->queue.front();
+            worker->queue.pop_front();
+        }
+
+        lastCommandStatus = 0;
+        cmdOut = open_memstream( &job->output, &job->outputLen );
+        if ( cmdOut == NULL ) {
+            cmdOut = stdout;
+            lastCommandStatus = SYS_MALLOC_ERR;
+        }
+        else {
+            doCommand( job->cmdToken );
+            fclose( cmdOut );
+            cmdOut = stdout;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( state->mutex );
+            job->status = lastCommandStatus;
+            job->done = true;
+        }
+        state->doneCv.notify_all();
+    }
+}
+
+/*
+ Return true for the commands that only touch the item they name and so
+ can run in a pipeline worker.  addw adds to every data object its
+ wildcard matches, so it is not one of them.
+ */
+bool
+isPipelineCommand( char *cmd ) {
+    const char *cmds[] = { "add", "adda", "rm", "rmw", "rmi",
+                           "mod", "set", "ls", "lsw"
+                         };
+    for ( size_t i = 0; i < sizeof( cmds ) / sizeof( cmds[0] ); i++ ) {
+        if ( strcmp( cmd, cmds[i] ) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ The item a pipeline command names, as its type letter (d, c, r or u)
+ and its name, with data object and collection names made absolute as
+ modAVUMetadata does, so that every spelling of an item gives the same
+ key.
+ */
+std::string
+pipelineKey( char *cmdToken[] ) {
+    char type = '\0';
+    for ( const char *cp = cmdToken[1]; *cp != '\0'; cp++ ) {
+        if ( *cp != '-' && *cp != 'l' ) {
+            type = tolower( *cp );
+            break;
+        }
+    }
+    std::string name = cmdToken[2];
+    if ( type == 'd' || type == 'c' ) {
+        if ( name.empty() ) {
+            name = cwd;
+        }
+        else if ( name[0] != '/' ) {
+            name = std::string( cwd ) + "/" + name;
+        }
+    }
+    return std::string( 1, type ) + ":" + name;
+}
+
+/*
+ Open depth connections (4 if depth is not positive) and start a worker
+ on each.  Returns the number of workers, or -1 if no connection could
+ be opened.
+ */
+int
+openPipeline( pipelineState& state, int depth ) {
+    if ( depth <= 0 ) {
+        depth = 4;
+    }
+
+    state.shutdown = false;
+    for ( int i = 0; i < depth; i++ ) {
+        rErrMsg_t errMsg;
+        rcComm_t *conn = icommands::broker_connect( myEnv, &errMsg );
+        if ( conn == NULL ) {
+            rodsLog( LOG_ERROR, "rcConnect failure for pipeline connection %d (%d) %s",
+                     i, errMsg.status, errMsg.msg );
+            break;
+        }
+        if ( icommands::broker_login( conn ) != 0 ) {
+            icommands::broker_disconnect( conn );
+            break;
+        }
+        pipelineWorker *worker = new pipelineWorker();
+        worker->conn = conn;
+        state.workers.push_back( worker );
+    }
+    if ( state.workers.empty() ) {
+        return -1;
+    }
+
+    state.depth = depth;
+    for ( size_t i = 0; i < state.workers.size(); i++ ) {
+        state.workers[i]->thread = std::thread( pipelineWorkerLoop, &state, state.workers[i] );
+    }
+    return state.workers.size();
+}
+
+/*
+ Wait for the oldest job in flight and hand it to state.finish.
+ */
+void
+finishPipelineJob( pipelineState& state ) {
+    pipelineJob *job = state.inflight.front();
+    {
+        std::unique_lock<std::mutex> lock( state.mutex );
+        state.doneCv.wait( lock, [&] { return job->done; } );
+    }
+    state.inflight.pop_front();
+    state.finish( job );
+}
+
+/*
+ Wait for every job in flight.
+ */
+void
+drainPipeline( pipelineState& state ) {
+    while ( !state.inflight.empty() ) {
+        finishPipelineJob( state );
+    }
+}
+
+/*
+ Queue a job on the worker for the item it names, once fewer than
+ state.depth jobs are in flight.
+ */
+void
+submitPipelineJob( pipelineState& state, pipelineJob *job ) {
+    while ( state.inflight.size() >= state.depth ) {
+        finishPipelineJob( state );
+    }
+    std::string key = pipelineKey( job->cmdToken );
+    pipelineWorker *worker = state.workers[std::hash<std::string>()( key ) % state.workers.size()];
+    {
+        std::lock_guard<std::mutex> lock( state.mutex );
+        worker->queue.push_back( job );
+    }
+    state.workCv.notify_all();
+    state.inflight.push_back( job );
+}
+
+/*
+ Wait for every job in flight, then stop the workers and close their
+ connections.
+ */
+void
+closePipeline( pipelineState& state ) {
+    drainPipeline( state );
+    {
+        std::lock_guard<std::mutex> lock( state.mutex );
+        state.shutdown = true;
+    }
+    state.workCv.notify_all();
+    for ( size_t i = 0; i < state.workers.size(); i++ ) {
+        state.workers[i]->thread.join();
+        icommands::broker_disconnect( state.workers[i]->conn );
+        delete state.workers[i];
+    }
+    state.workers.clear();
+}
+
+/*
+ Read the remaining commands from stdin and run them on depth
+ connections at once, keeping up to depth commands in flight.  Commands
+ naming the same item are routed to the same connection so they run in
+ input order, and all output is printed in input order.  Other commands
+ (help, batch, ...) wait for the commands in flight and then run here.
+ */
+int
+runPipeline( int depth ) {
+    pipelineState state;
+    if ( openPipeline( state, depth ) < 0 ) {
+        lastCommandStatus = -1;
+        return -1;
+    }
+
+    int finalStatus = 0;
+    state.finish = [&]( pipelineJob *job ) {
+        if ( job->output != NULL ) {
+            fwrite( job->output, 1, job->outputLen, stdout );
+            free( job->output );
+        }
+        if ( job->status != 0 ) {
+            finalStatus = job->status;
+        }
+        delete job;
+    };
+
+    for ( ;; ) {
+        pipelineJob *job = new pipelineJob();
+        if ( fgets( job->line, BIG_STR, stdin ) == NULL ) {
+            delete job;
+            break;
+        }
+        if ( parseInput( job->line, job->cmdToken, 40 ) < 0 ) {
+            finalStatus = -1;
+            delete job;
+            continue;
+        }
+        if ( strcmp( job->cmdToken[0], "quit" ) == 0 ||
+                strcmp( job->cmdToken[0], "q" ) == 0 ) {
+            delete job;
+            break;
+        }
+
+        if ( !isPipelineCommand( job->cmdToken[0] ) ) {
+            drainPipeline( state );
+            if ( strcmp( job->cmdToken[0], "pipeline" ) == 0 ) {
+                printf( "pipeline cannot be run in pipeline mode\n" );
+                finalStatus = -1;
+                delete job;
+                continue;
+            }
+            lastCommandStatus = 0;
+            if ( doCommand( job->cmdToken ) == -2 || lastCommandStatus != 0 ) {
+                finalStatus = lastCommandStatus != 0 ? lastCommandStatus : -1;
+            }
+            delete job;
+            continue;
+        }
+
+        submitPipelineJob( state, job );
+    }
+
+    closePipeline( state );
+
+    lastCommandStatus = finalStatus;
+    return finalStatus;
+}
+
+/*
+ Remove leading and trailing blanks from a field of a batch line.
+ */
+std::string
+trimField( const std::string& field ) {
+    size_t start = field.find_first_not_of( " \t\r\n" );
+    if ( start == std::string::npos ) {
+        return "";
+    }
+    size_t end = field.find_last_not_of( " \t\r\n" );
+    return field.substr( start, end - start + 1 );
+}
+
+/*
+ Add or remove the AVUs listed in a file (or stdin), one per line as
+ [add|rm |]Name |AttName |AttValue [|AttUnits], and report the number
+ of operations, failures and the rate.  The operations run as pipeline
+ jobs on depth connections, routed as in runPipeline, so the operations
+ on one item are applied in file order.
+ */
+int
+batchAVUMetadata( char *objType, char *fileName, int depth ) {
+    FILE *fp = stdin;
+    if ( *fileName != '\0' && strcmp( fileName, "-" ) != 0 ) {
+        fp = fopen( fileName, "r" );
+        if ( fp == NULL ) {
+            fprintf( cmdOut, "Unable to open file %s\n", fileName );
+            lastCommandStatus = UNIX_FILE_OPEN_ERR;
+            return UNIX_FILE_OPEN_ERR;
+        }
+    }
+
+    pipelineState state;
+    if ( openPipeline( state, depth ) < 0 ) {
+        if ( fp != stdin ) {
+            fclose( fp );
+        }
+        lastCommandStatus = -1;
+        return -1;
+    }
+
+    char line[BIG_STR];
+    int lineNumber = 0;
+    int totalCount = 0;
+    int totalFailures = 0;
+    state.finish = [&]( pipelineJob *job ) {
+        if ( job->output != NULL ) {
+            fwrite( job->output, 1, job->outputLen, cmdOut );
+            free( job->output );
+        }
+        if ( job->status < 0 ) {
+            fprintf( cmdOut, "line %d: %s failed for %s\n", job->lineNumber,
+                     job->cmdToken[0], job->cmdToken[2] );
+            totalFailures++;
+        }
+        delete job;
+    };
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    while ( fgets( line, sizeof( line ), fp ) != NULL ) {
+        lineNumber++;
+        std::vector<std::string> fields;
+        std::stringstream ss( line );
+        std::string field;
+        while ( std::getline( ss, field, '|' ) ) {
+            fields.push_back( trimField( field ) );
+        }
+        if ( fields.empty() || ( fields.size() == 1 && fields[0].empty() ) ||
+                fields[0][0] == '#' ) {
+            continue;
+        }
+
+        const char *op = "add";
+        if ( fields[0] == "add" || fields[0] == "rm" ) {
+            if ( fields[0] == "rm" ) {
+                op = "rm";
+            }
+            fields.erase( fields.begin() );
+        }
+        if ( fields.size() < 3 || fields.size() > 4 ) {
+            fprintf( cmdOut, "line %d: expected Name |AttName |AttValue [|AttUnits]\n",
+                     lineNumber );
+            totalFailures++;
+            totalCount++;
+            continue;
+        }
+        fields.resize( 4 );
+        totalCount++;
+
+        /* the job's tokens are op, objType and the fields, each copied
+           into the job's line and terminated there */
+        std::vector<std::string> tokens = { op, objType };
+        tokens.insert( tokens.end(), fields.begin(), fields.end() );
+        size_t lineLen = 0;
+        for ( size_t i = 0; i < tokens.size(); i++ ) {
+            lineLen += tokens[i].size() + 1;
+        }
+        if ( lineLen > BIG_STR ) {
+            fprintf( cmdOut, "line %d: line too long\n", lineNumber );
+            totalFailures++;
+            continue;
+        }
+        pipelineJob *job = new pipelineJob();
+        job->lineNumber = lineNumber;
+        for ( int i = 0; i < 40; i++ ) {
+            job->cmdToken[i] = "";
+        }
+        char *cp = job->line;
+        for ( size_t i = 0; i < tokens.size(); i++ ) {
+            job->cmdToken[i] = cp;
+            memcpy( cp, tokens[i].c_str(), tokens[i].size() + 1 );
+            cp += tokens[i].size() + 1;
+        }
+        submitPipelineJob( state, job );
+    }
+
+    closePipeline( state );
+    if ( fp != stdin ) {
+        fclose( fp );
+    }
+
+    double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start ).count();
+    fprintf( cmdOut, "total: %d operations, %d failed, %.1f operations/sec\n",
+             totalCount, totalFailures, secs > 0 ? totalCount / secs : 0.0 );
+
+    lastCommandStatus = totalFailures > 0 ? -1 : 0;
+    return lastCommandStatus;
+}
+
 int
 main( int argc, char **argv ) {
 
@@ -821,8 +1165,7 @@ main( int argc, char **argv ) {
     irods::pack_entry_table& pk_tbl  = irods::get_pack_table();
     init_api_table( api_tbl, pk_tbl );
 
-    Conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
-                      myEnv.rodsZone, 0, &errMsg );
+    Conn = icommands::broker_connect( myEnv, &errMsg );
 
     if ( Conn == NULL ) {
         char *mySubName = NULL;
@@ -837,7 +1180,7 @@ main( int argc, char **argv ) {
         exit( 2 );
     }
 
-    status = clientLogin( Conn );
+    status = icommands::broker_login( Conn );
     if ( status != 0 ) {
         if ( !debug ) {
             exit( 3 );
@@ -873,7 +1216,7 @@ main( int argc, char **argv ) {
 
     printErrorStack( Conn->rError );
 
-    rcDisconnect( Conn );
+    icommands::broker_disconnect( Conn );
 
     if ( lastCommandStatus != 0 ) {
         exit( 4 );
@@ -908,6 +1251,8 @@ void usageMain() {
         " qu -d|C|R|u AttName Op AttVal [...] (Query objects with matching AVUs)",
         " cp -d|C|R|u -d|C|R|u Name1 Name2 (Copy AVUs from item Name1 to Name2)",
         " upper (Toggle between upper case mode for queries (qu))",
+        " batch -d|C|R|u [FileName [N]] (Add/remove AVUs listed in a file)",
+        " pipeline [N] (Run the commands from stdin with N requests in flight)",
         " ",
         "Metadata attribute-value-units triples (AVUs) consist of an Attribute-Name,",
         "Attribute-Value, and an optional Attribute-Units.  They can be added",
@@ -1215,6 +1560,54 @@ usage( char *subOpt ) {
                 printf( "%s\n", msgs[i] );
             }
         }
+        if ( strcmp( subOpt, "batch" ) == 0 ) {
+            char *msgs[] = {
+                " batch -d|C|R|u [FileName [N]] (Add/remove AVUs listed in a file)",
+                "Read AVU operations from FileName (or stdin if omitted or '-'), one per",
+                "line, in the form:",
+                "  [add|rm |]Name |AttName |AttValue [|AttUnits]",
+                "and apply them to dataobjs (-d), collections(-C), resources(-R)",
+                "or users(-u).  Lines without add or rm are added; blank lines and",
+                "lines starting with # are skipped.",
+                "Each operation is still its own request, but up to N (default 4)",
+                "of them run at once, each on its own connection, as in pipeline",
+                "mode.  The operations on one item run in file order.  A line that",
+                "fails is reported and skipped, and the number of operations,",
+                "failures and the rate is reported at the end.",
+                "Example: batch -d metadata.txt 8",
+                "with metadata.txt containing lines like:",
+                "  /tempZone/home/rods/file1 |distance |12 |miles",
+                "  rm |/tempZone/home/rods/file2 |distance |14 |miles",
+                ""
+            };
+            for ( i = 0;; i++ ) {
+                if ( strlen( msgs[i] ) == 0 ) {
+                    return 0;
+                }
+                printf( "%s\n", msgs[i] );
+            }
+        }
+        if ( strcmp( subOpt, "pipeline" ) == 0 ) {
+            char *msgs[] = {
+                " pipeline [N] (Run the commands from stdin with N requests in flight)",
+                "Read the remaining commands from stdin and run up to N (default 4)",
+                "of them at once, each on its own connection, so scripted jobs are",
+                "not limited by the round trip time of one connection.",
+                "Commands naming the same item always run in input order, and the",
+                "output of all commands is printed in input order.  The add, adda,",
+                "rm, rmw, rmi, mod, set, ls and lsw commands are pipelined; other",
+                "commands, including addw, wait for the commands in flight to",
+                "finish first.  pipeline itself is refused.",
+                "Example: cat commands.txt | imeta pipeline 8",
+                ""
+            };
+            for ( i = 0;; i++ ) {
+                if ( strlen( msgs[i] ) == 0 ) {
+                    return 0;
+                }
+                printf( "%s\n", msgs[i] );
+            }
+        }
         if ( strcmp( subOpt, "upper" ) == 0 ) {
             char *msgs[] = {
                 " upper (Toggle between upper case mode for queries (qu)",
@@ -8,13 +8,104 @@
 #include "parseCommandLine.h"
 #include "rodsPath.h"
 #include "putUtil.h"
+#include "miscUtil.h"
 #include "rcGlobalExtern.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
 #include "irods_parse_command_line_options.hpp"
+#include "bundle_transfer.hpp"
+#include "resumable_transfer.hpp"
+#include "transfer_engine.hpp"
 
 void usage( FILE* );
 
+/*
+  Upload the sources with the parallel engine: scanners walk the local
+  directories and workers, each on its own connection, upload the files
+  they find, packing the small ones into bundles if bundle is set.  With
+  a resume journal, the files it records as uploaded are skipped and the
+  rest are uploaded in chunks it records as they are stored; the journal
+  is removed once everything has been uploaded.
+*/
+int
+parallelPut( rcComm_t *conn, rodsEnv *myEnv, rodsArguments_t *myRodsArgs,
+             rodsPathInp_t *rodsPathInp, int workers, int scanners, bool bundle,
+             const char *resume ) {
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        if ( rodsPathInp->srcPath[i].objType == LOCAL_DIR_T && myRodsArgs->recursive != True ) {
+            rodsLog( LOG_ERROR, "parallelPut: %s is a directory, use -r",
+                     rodsPathInp->srcPath[i].outPath );
+            return USER_INPUT_OPTION_ERR;
+        }
+    }
+
+    int status = resolveRodsTarget( conn, rodsPathInp, PUT_OPR );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "parallelPut: resolveRodsTarget error" );
+        return status;
+    }
+
+    icommands::upload_options opts;
+    opts.workers = workers;
+    opts.scanners = scanners;
+    opts.force = myRodsArgs->force == True;
+    opts.checksum = myRodsArgs->checksum == True;
+    opts.skip_links = myRodsArgs->link == True;
+    opts.verbose = myRodsArgs->verbose == True;
+    opts.progress = isatty( STDOUT_FILENO ) != 0;
+    if ( myRodsArgs->number == True ) {
+        opts.num_threads = myRodsArgs->numberValue;
+    }
+    if ( myRodsArgs->resource == True ) {
+        opts.resource = myRodsArgs->resourceString;
+    }
+    else if ( strlen( myEnv->rodsDefResource ) > 0 ) {
+        opts.resource = myEnv->rodsDefResource;
+    }
+    if ( myRodsArgs->dataType == True ) {
+        opts.data_type = myRodsArgs->dataTypeString;
+    }
+
+    std::vector<std::string> sources;
+    std::vector<std::string> targets;
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        sources.push_back( rodsPathInp->srcPath[i].outPath );
+        targets.push_back( rodsPathInp->targPath[i].outPath );
+    }
+
+    icommands::transfer_journal journal;
+    std::unique_ptr<icommands::upload_engine> engine;
+    if ( resume != NULL ) {
+        status = journal.open( resume, icommands::journal_job( "iput", sources, targets ),
+                               icommands::RESUME_CHUNK_SIZE );
+        if ( status < 0 ) {
+            rodsLogError( LOG_ERROR, status, "parallelPut: cannot use journal %s", resume );
+            return status;
+        }
+        if ( journal.finished() > 0 ) {
+            printf( "resuming from %s: %lu files already uploaded\n", resume,
+                    static_cast<unsigned long>( journal.finished() ) );
+        }
+        engine.reset( new icommands::resumable_upload_engine( *myEnv, opts, journal ) );
+    }
+    else if ( bundle ) {
+        engine.reset( new icommands::bundle_upload_engine( *myEnv, opts, icommands::bundle_options() ) );
+    }
+    else {
+        engine.reset( new icommands::upload_engine( *myEnv, opts ) );
+    }
+    status = engine->run( conn, sources, targets );
+    printf( "%s\n", engine->stats().summary().c_str() );
+    if ( resume != NULL ) {
+        // the journal is kept until a run completes without errors
+        int journal_status = status < 0 ? journal.close() : journal.remove();
+        if ( journal_status < 0 ) {
+            rodsLogError( LOG_ERROR, journal_status, "parallelPut: journal %s", resume );
+        }
+    }
+    return status;
+}
+
 int
 main( int argc, char **argv ) {
 
@@ -26,6 +117,63 @@ main( int argc, char **argv ) {
     rodsPathInp_t rodsPathInp;
     int reconnFlag;
 
+    // --parallel, --scanners, --bundle and --resume are not known to
+    // parse_opts_and_paths, so take them out of the arguments first
+    int parallel = 0;
+    int scanners = 0;
+    bool bundle = false;
+    const char *resume = NULL;
+    int nargs = 0;
+    for ( int i = 0; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--bundle" ) == 0 ) {
+            bundle = true;
+            continue;
+        }
+        if ( strncmp( argv[i], "--resume", 8 ) == 0 && ( argv[i][8] == '\0' || argv[i][8] == '=' ) ) {
+            if ( argv[i][8] == '=' ) {
+                resume = argv[i] + 9;
+            }
+            else if ( i + 1 < argc ) {
+                resume = argv[++i];
+            }
+            if ( resume == NULL || *resume == '\0' ) {
+                fprintf( stderr, "--resume needs a journal file\n" );
+                usage( stderr );
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+        int *value = NULL;
+        const char *name = argv[i];
+        const char *arg = argv[i];
+        if ( strncmp( arg, "--parallel", 10 ) == 0 && ( arg[10] == '\0' || arg[10] == '=' ) ) {
+            value = &parallel;
+            arg += 10;
+        }
+        else if ( strncmp( arg, "--scanners", 10 ) == 0 && ( arg[10] == '\0' || arg[10] == '=' ) ) {
+            value = &scanners;
+            arg += 10;
+        }
+        if ( value == NULL ) {
+            argv[nargs++] = argv[i];
+            continue;
+        }
+        if ( *arg == '\0' && i + 1 < argc ) {
+            arg = argv[++i];
+        }
+        else if ( *arg == '=' ) {
+            arg++;
+        }
+        *value = atoi( arg );
+        if ( *value < 1 ) {
+            fprintf( stderr, "%.10s needs a number of at least 1\n", name );
+            usage( stderr );
+            return EXIT_FAILURE;
+        }
+    }
+    argc = nargs;
+    argv[argc] = NULL;
+
     rodsEnv myEnv;
     int status = getRodsEnv( &myEnv );
     if ( status < 0 ) {
@@ -51,6 +199,38 @@ main( int argc, char **argv ) {
         return EXIT_SUCCESS;
     }
 
+    if ( parallel > 0 || scanners > 0 || bundle || resume != NULL ) {
+        if ( ( parallel > 0 || scanners > 0 || bundle ) && myRodsArgs.recursive != True ) {
+            fprintf( stderr, "--parallel, --scanners and --bundle need -r\n" );
+            return EXIT_FAILURE;
+        }
+        if ( bundle && resume != NULL ) {
+            fprintf( stderr, "--bundle cannot be used with --resume\n" );
+            return EXIT_FAILURE;
+        }
+        if ( bundle && ( myRodsArgs.checksum == True || myRodsArgs.dataType == True ) ) {
+            fprintf( stderr, "--bundle cannot be used with -k or -D\n" );
+            return EXIT_FAILURE;
+        }
+        if ( myRodsArgs.bulk == True || myRodsArgs.restart == True ||
+                myRodsArgs.lfrestart == True || myRodsArgs.rbudp == True ||
+                myRodsArgs.redirectConn == True || myRodsArgs.physicalPath == True ||
+                myRodsArgs.verifyChecksum == True ) {
+            fprintf( stderr, "--parallel, --bundle and --resume cannot be used with -b, -I, -K, -p, -Q, -X or --lfrestart\n" );
+            return EXIT_FAILURE;
+        }
+        // these are applied by putUtil to each data object it writes,
+        // which the transfer engines do not go through
+        if ( myRodsArgs.all == True || myRodsArgs.replNum == True ||
+                myRodsArgs.ticket == True || myRodsArgs.wlock == True ||
+                myRodsArgs.purgeCache == True || myRodsArgs.kv_pass == True ||
+                ( myRodsArgs.metadata_string != NULL && *myRodsArgs.metadata_string != '\0' ) ||
+                ( myRodsArgs.acl_string != NULL && *myRodsArgs.acl_string != '\0' ) ) {
+            fprintf( stderr, "--parallel, --bundle and --resume cannot be used with -a, -n, -t, --wlock, --purgec, --kv_pass, --metadata or --acl\n" );
+            return EXIT_FAILURE;
+        }
+    }
+
     if ( myRodsArgs.reconnect == True ) {
         reconnFlag = RECONN_TIMEOUT;
     }
@@ -81,7 +261,14 @@ main( int argc, char **argv ) {
         gGuiProgressCB = ( guiProgressCallback ) iCommandProgStat;
     }
 
-    status = putUtil( &conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    if ( parallel > 0 || scanners > 0 || bundle || resume != NULL ) {
+        status = parallelPut( conn, &myEnv, &myRodsArgs, &rodsPathInp,
+                              parallel > 0 ? parallel : 4, scanners > 0 ? scanners : 4,
+                              bundle, resume );
+    }
+    else {
+        status = putUtil( &conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    }
 
     printErrorStack( conn->rError );
     rcDisconnect( conn );
@@ -108,6 +295,11 @@ usage( FILE* _fout ) {
         "             [--lfrestart lfRestartFile] [--retries count] [--wlock]",
         "             [--purgec] [--kv_pass=key-value-string] [--metadata=avu-string]",
         "             [--acl=acl-string]  localSrcFile|localSrcDir ...  destDataObj|destColl",
+        "Usage: iput -r [-fkPvV] [-D dataType] [-N numThreads] [-R resource] [--link]",
+        "             --parallel N [--scanners N] [--bundle]  localSrcDir ...  destColl",
+        "Usage: iput [-frkPvV] [-D dataType] [-N numThreads] [-R resource] [--link]",
+        "             [--parallel N] [--scanners N] --resume journalFile",
+        "             localSrcFile|localSrcDir ...  destDataObj|destColl",
         "Usage: iput [-abfIkKPQtTUvV] [-D dataType] [-N numThreads] [-n replNum] ",
         "             [-p physicalPath] [-R resource] [-X restartFile] [--link]",
         "             [--lfrestart lfRestartFile] [--retries count] [--wlock]",
@@ -215,6 +407,32 @@ usage( FILE* _fout ) {
         " --metadata - atomically assign metadata after a data object is registered in",
         "              the catalog. Metadata is encoded into a quoted string of the",
         "              form attr1;val1;unit1;attr2;val2;unit2;",
+        " --parallel N - upload a recursive -r transfer with N workers, each on",
+        "       its own connection, taking files from a queue that directory",
+        "       scanners fill as they walk the local tree.  Suited to trees of",
+        "       many small files.  The progress (files and MB per second) is",
+        "       shown as it goes when the output is a terminal.  It cannot be",
+        "       combined with -a, -b, -I, -K, -n, -p, -Q, -t, -X, --lfrestart,",
+        "       --wlock, --purgec, --kv_pass, --metadata or --acl, and --bundle",
+        "       and --resume cannot either.",
+        " --scanners N - the number of threads walking the local directories",
+        "       for --parallel (default 4); scanners that run out of",
+        "       directories take unread ones from the others.",
+        " --bundle - with -r, pack files of up to 1 MB into tar bundles of up",
+        "       to 512 files or 64 MB, streamed to a temporary data object in",
+        "       the target collection, which the server extracts and registers",
+        "       in one bulk operation before the bundle is removed.  Larger",
+        "       files are uploaded as usual.  Uses --parallel's engine (4",
+        "       workers unless --parallel is given), and cannot be combined",
+        "       with -k or -D.",
+        " --resume journalFile - record the progress of the upload in the local",
+        "       journalFile, and if it already exists, skip what it records as",
+        "       uploaded.  Files of 64 MB or more are written in 64 MB chunks,",
+        "       each recorded once stored, so an interrupted upload of one",
+        "       continues from its first missing chunk.  The sources and",
+        "       destination must be the ones the journal was started with.  The",
+        "       journal is removed once a run completes without errors.  Uses",
+        "       --parallel's engine, and cannot be combined with --bundle.",
         " --acl - atomically apply ACLs of the form",
         "          'perm user_or_group;perm user_or_group;'",
         "          where 'perm' is defined as null|read|write|own",
@@ -9,6 +9,7 @@
 #include "rodsClient.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
+#include "genquery_pager.hpp"
 
 #define MAX_SQL 300
 #define BIG_STR 200
@@ -141,9 +142,8 @@ showRuleExec( char *name, char *ruleName, int allFlag ) {
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         if ( ruleName != NULL && *ruleName != '\0' ) {
             printf( "User %s or rule '%s' does not exist.\n", name, ruleName );
@@ -152,7 +152,7 @@ showRuleExec( char *name, char *ruleName, int allFlag ) {
             i1a[0] = COL_USER_COMMENT;
             i2a[0] = COL_USER_NAME;
             genQueryInp.selectInp.len = 1;
-            status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+            status = pager.first();
             if ( status == 0 ) {
                 if ( allFlag ) {
                     printf( "No delayed rules pending\n" );
@@ -175,10 +175,9 @@ showRuleExec( char *name, char *ruleName, int allFlag ) {
     }
     printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames, 0 );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printCount += printGenQueryResults( Conn, status, genQueryOut,
@@ -226,14 +225,13 @@ showRuleExecBrief( char *name, int allFlag ) {
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_USER_COMMENT;
         i2a[0] = COL_USER_NAME;
         genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             if ( allFlag ) {
                 printf( "No delayed rules pending\n" );
@@ -251,9 +249,8 @@ showRuleExecBrief( char *name, int allFlag ) {
     printf( "id     name\n" );
     printCount += printGenQueryResults( Conn, status, genQueryOut, NULL, 1 );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
         printCount += printGenQueryResults( Conn, status, genQueryOut,
                                             NULL, 1 );
     }
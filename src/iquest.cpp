@@ -7,12 +7,15 @@
 #include "rodsPath.h"
 #include "rcMisc.h"
 #include "lsUtil.h"
+#include "connection_broker.hpp"
+#include "format_program.hpp"
+#include "genquery_pager.hpp"
 #include <iostream>
 #include <string>
+#include <vector>
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
 
-#include <boost/format.hpp>
 
 void usage();
 
@@ -85,38 +88,35 @@ usage() {
 }
 
 void
-printFormatted( char *format, char *args[], int nargs ) {
-    try {
-        boost::format formatter( format );
-        for ( int i = 0; i < nargs; i++ ) {
-            formatter % args[i];
-        }
-        std::cout << formatter;
-    }
-    catch ( const boost::io::format_error& _e ) {
-        std::cout << _e.what() << std::endl;
-    }
+printFormatted( const icommands::format_program& program, const char *args[], int nargs,
+                icommands::output_buffer& out ) {
+    program.render( args, nargs, out.str() );
+    out.commit();
 }
 
 void
-printBasicGenQueryOut( genQueryOut_t *genQueryOut, char *format ) {
+printBasicGenQueryOut( genQueryOut_t *genQueryOut,
+                       const icommands::format_program& program ) {
     int i, j;
-    if ( format == NULL || strlen( format ) == 0 ) {
+    icommands::output_buffer out( stdout );
+    if ( !program.compiled() ) {
         for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
             if ( i > 0 ) {
-                printf( "----\n" );
+                out.str() += "----\n";
             }
             for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
                 char *tResult;
                 tResult = genQueryOut->sqlResult[j].value;
                 tResult += i * genQueryOut->sqlResult[j].len;
-                printf( "%s\n", tResult );
+                out.str() += tResult;
+                out.str() += '\n';
             }
+            out.commit();
         }
     }
     else {
+        std::vector<const char *> results( genQueryOut->attriCnt );
         for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-            char *results[20];
             for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
                 char *tResult;
                 tResult = genQueryOut->sqlResult[j].value;
@@ -124,9 +124,10 @@ printBasicGenQueryOut( genQueryOut_t *genQueryOut, char *format ) {
                 results[j] = tResult;
             }
 
-            printFormatted( format, results, j );
+            printFormatted( program, results.data(), j, out );
         }
     }
+    out.flush();
 }
 
 int
@@ -159,9 +160,8 @@ queryAndShowStrCond( rcComm_t *conn, char *hint, char *format,
         printf( "Zone is %s\n", zoneArgument );
     }
 
-    genQueryInp.maxRows = MAX_SQL_ROWS;
-    genQueryInp.continueInx = 0;
-    i = rcGenQuery( conn, &genQueryInp, &genQueryOut );
+    icommands::prefetch_pager pager( conn, &genQueryInp, &genQueryOut, MAX_SQL_ROWS );
+    i = pager.first();
     if ( i < 0 ) {
         return i;
     }
@@ -172,7 +172,7 @@ queryAndShowStrCond( rcComm_t *conn, char *hint, char *format,
     }
 
 
-    while ( i == 0 && genQueryOut->continueInx > 0 ) {
+    while ( i == 0 && pager.more() ) {
         if ( noPageFlag == 0 ) {
             char inbuf[100];
             printf( "Continue? [Y/n]" );
@@ -183,8 +183,7 @@ queryAndShowStrCond( rcComm_t *conn, char *hint, char *format,
                 break;
             }
         }
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        i = rcGenQuery( conn, &genQueryInp, &genQueryOut );
+        i = pager.next();
         if ( i < 0 ) {
             return i;
         }
@@ -208,6 +207,7 @@ execAndShowSpecificQuery( rcComm_t *conn, char *sql,
     int nQuestionMarks, nArgs;
     char *format = "";
     char myFormat[300] = "";
+    icommands::format_program program;
 
     memset( &specificQueryInp, 0, sizeof( specificQueryInp_t ) );
     specificQueryInp.maxRows = MAX_SQL_ROWS;
@@ -238,6 +238,10 @@ execAndShowSpecificQuery( rcComm_t *conn, char *sql,
         strncpy( myFormat, format, 300 - 10 );
         strcat( myFormat, "\n" ); /* since \n is difficult to pass in
 				on the command line, add one by default */
+        if ( !program.compile( myFormat ) ) {
+            printf( "%s\n", program.error().c_str() );
+            return USER_INPUT_FORMAT_ERR;
+        }
     }
 
     i = 0;
@@ -245,7 +249,7 @@ execAndShowSpecificQuery( rcComm_t *conn, char *sql,
         specificQueryInp.args[i++] = args[argsOffset];
         argsOffset++;
     }
-    status = rcSpecificQuery( conn, &specificQueryInp, &genQueryOut );
+    status = icommands::specific_query( conn, &specificQueryInp, &genQueryOut );
     if ( status == CAT_NO_ROWS_FOUND ) {
         printf( "No rows found\n" );
         return 0;
@@ -255,7 +259,7 @@ execAndShowSpecificQuery( rcComm_t *conn, char *sql,
         return status;
     }
 
-    printBasicGenQueryOut( genQueryOut, myFormat );
+    printBasicGenQueryOut( genQueryOut, program );
 
     while ( status == 0 && genQueryOut->continueInx > 0 ) {
         if ( noPageFlag == 0 ) {
@@ -269,12 +273,12 @@ execAndShowSpecificQuery( rcComm_t *conn, char *sql,
             }
         }
         specificQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcSpecificQuery( conn, &specificQueryInp, &genQueryOut );
+        status = icommands::specific_query( conn, &specificQueryInp, &genQueryOut );
         if ( status < 0 ) {
             printError( conn, status, "rcSpecificQuery" );
             return status;
         }
-        printBasicGenQueryOut( genQueryOut, myFormat );
+        printBasicGenQueryOut( genQueryOut, program );
     }
 
     return 0;
@@ -349,14 +353,13 @@ main( int argc, char **argv ) {
     irods::pack_entry_table& pk_tbl  = irods::get_pack_table();
     init_api_table( api_tbl, pk_tbl );
 
-    conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
-                      myEnv.rodsZone, 0, &errMsg );
+    conn = icommands::broker_connect( myEnv, &errMsg );
 
     if ( conn == NULL ) {
         exit( 2 );
     }
 
-    status = clientLogin( conn );
+    status = icommands::broker_login( conn );
     if ( status != 0 ) {
         exit( 3 );
     }
@@ -366,7 +369,7 @@ main( int argc, char **argv ) {
                                            argv,
                                            myRodsArgs.optind + 1,
                                            myRodsArgs.noPage );
-        rcDisconnect( conn );
+        icommands::broker_disconnect( conn );
         if ( status < 0 ) {
             rodsLogError( LOG_ERROR, status, "iquest Error: specificQuery (sql-query) failed" );
             exit( 4 );
@@ -395,7 +398,7 @@ main( int argc, char **argv ) {
                                       myRodsArgs.zoneName,
                                       myRodsArgs.noPage );
     }
-    rcDisconnect( conn );
+    icommands::broker_disconnect( conn );
 
     if ( status < 0 ) {
         if ( status == CAT_NO_ROWS_FOUND ) {
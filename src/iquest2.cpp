@@ -7,11 +7,28 @@
 #include "rodsPath.h"
 #include "rcMisc.h"
 #include "lsUtil.h"
+#include "connection_broker.hpp"
+#include "connection_pool.hpp"
+#include "genquery_pager.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "query2.hpp"
+#include "query2_cursor.hpp"
+#include "query2_explain.hpp"
+#include "query2_formatter.hpp"
+#include "query2_pager.hpp"
+#include "query2_parallel.hpp"
+#include "query2_script.hpp"
 
-#include <boost/format.hpp>
+#include <boost/program_options.hpp>
 
 void usage();
 
@@ -19,58 +36,87 @@ void usage();
 void
 usage() {
     char *msgs[] = {
-        "Usage: iquest [-hz] [--no-page] [ [hint] format]  selectConditionString ",
-        "Usage: iquest --sql 'pre-defined SQL string' [format] [arguments] ",
-        "Usage: iquest attrs",
+        "Usage: iquest2 [-hz] [--no-page] [--page-size N] [--limit N]",
+        "               [--parallel N --partition-by collection:Root|id [--unordered]]",
+        "               [--format text|csv|tsv|ndjson|arrow|FMT]",
+        "               [no-distinct] [upper] query [header]",
+        "       iquest2 [-h] [--limit N] [--parallel N]",
+        "               [--format text|csv|tsv|ndjson|arrow|FMT]",
+        "               -f script",
+        "       iquest2 [-h] --explain [--analyze] query [header]",
+        "Usage: iquest2 attrs",
         "Options are:",
-        " -h  this help",
-        " -z Zonename  the zone to query (default or invalid uses the local zone)",
-        " --no-page    do not prompt asking whether to continue or not",
-        "              (by default, prompt after a large number of results (500)",
-        "format is C format restricted to character strings.",
-        "selectConditionString is of the form: SELECT <attribute> [, <attribute>]* [WHERE <condition> [ AND <condition>]*]",
-        "attribute can be found using 'iquest attrs' command",
-        "condition is of the form: <attribute> <rel-op> <value>",
-        "rel-op is a relational operator: eg. =, <>, >,<, like, not like, between, etc.,",
-        "value is either a constant or a wild-carded expression.",
-        "One can also use a few aggregation operators such as sum,count,min,max and avg,",
-        "or order and order_desc (descending) to specify an order (if needed).",
-        "Use % and _ as wild-cards, and use \\ to escape them.",
-        "If 'no-distinct' appears before the selectConditionString, the normal",
-        "distinct option on the SQL will bypassed (this is useful in rare cases).",
-        "If uppercase (or upper) appears before the selectConditionString, the",
-        "database value in the 'where' condition will be made upper case so one can do",
-        "case-insensitive tests (using upper-case literals).",
+        " -h            this help",
+        " -z Zonename   the zone to query, accepted as with iquest",
+        " --no-page     do not prompt asking whether to continue or not",
+        " --page-size N prompt whether to continue after every N rows of text",
+        "               output (by default, all rows are printed without asking)",
+        " --limit N     stop after N rows",
+        " --parallel N  run a partitioned query over N connections at once, or",
+        "               with -f, run up to N statements of the script at once",
+        " --partition-by collection:Root|id",
+        "               how to partition the query: once per collection in the",
+        "               tree under Root (Root itself and every collection below",
+        "               it), binding the collection name to the ? in the",
+        "               query, or once per range of data object IDs, binding the",
+        "               first ID and the ID past the end of the range to two ?s",
+        " --unordered   print each partition as soon as it completes instead of",
+        "               in partition order",
+        " --format text|csv|tsv|ndjson|arrow|FMT",
+        "               the output format: text (the default) as described below,",
+        "               csv or tsv with a header line of the variable names,",
+        "               ndjson with one JSON object per row, an Arrow IPC",
+        "               stream with one utf8 column per variable, or a format",
+        "               FMT containing %s fields, as with iquest, such as",
+        "               '%-12.12s size is %s', printed once per row with a",
+        "               newline added.  Only text and FMT output prompt between",
+        "               pages.",
+        " -f script     run the query2 statements in the file script (- for",
+        "               standard input) on one login instead of a single query",
+        " --explain     instead of printing the rows, show how the query's",
+        "               predicates join (the variables each one shares with the",
+        "               predicates before it, the ones it introduces and the",
+        "               literals it filters on), warn about cross products, and",
+        "               time the query and count its rows",
+        " --analyze     with --explain, also run each prefix of the predicates",
+        "               (the first one, the first two and so on) to show where",
+        "               the row count and the time grow.  This runs the query",
+        "               once per predicate, and early prefixes can match many",
+        "               rows.  The SQL the server generates is not available",
+        "               to the client, so it is not shown.",
+        "query is a query2 query and header lists the variables to return,",
+        "separated by blanks.  Each row is printed as 'variable = value' lines,",
+        "with rows separated by '----'.",
+        "Paging is done by iquest2, not by the server: query2 returns the whole",
+        "result in one reply, which iquest2 cuts into pages as it prints it.",
+        "So --page-size and --limit only pace and cut short the output; they",
+        "do not make the query return fewer rows.  Without --page-size the",
+        "output is not paged at all.",
+        "no-distinct and upper (or uppercase) before the query, and -z, are",
+        "accepted as with iquest, but the query2 query is sent as written.",
+        "'iquest2 attrs' lists the GenQuery attribute names, as 'iquest attrs' does.",
         " ",
-        "The --sql option executes a pre-defined SQL query.  The specified query must",
-        "match one defined by the admin (see 'iadmin h asq' (add specific query)).",
-        "A few of these may be defined at your site.  A special alias 'ls' ('--sql ls')",
-        "is normally defined to display these. You can specify these via the full",
-        "SQL or the alias, if defined.  Generally, it is better to use the",
-        "general-query (non --sql forms herein) since that generates the proper SQL",
-        "(knows how to link the ICAT tables) and handles access control and other",
-        "aspects of security.  If the SQL includes arguments, you enter them following",
-        "the SQL. As without --sql, you can enter a printf format statement to use in",
-        "formatting the results (except when using aliases).",
+        "A script is a list of statements separated by blank lines, each made",
+        "of 'key: value' lines.  query is required; header, format (which",
+        "overrides --format) and output (a file to write the result to instead",
+        "of standard output) are optional.  An indented line continues the line",
+        "before it and lines starting with # are comments.  Statements that",
+        "write to the same file or to standard output appear in script order,",
+        "even when run at once, and no statement prompts between pages.",
+        "For example:",
+        "   # the AVUs on the home collection",
+        "   query:  COLL_NAME(cid, \"/tempZone/home/rods\")",
+        "           META_2(cid, a, v, u)",
+        "   header: a v u",
+        "   format: csv",
+        "   output: avus.csv",
         " ",
         "Examples:",
-        " iquest \"SELECT DATA_NAME, DATA_CHECKSUM WHERE DATA_RESC_NAME like 'demo%'\"",
-        " iquest \"For %-12.12s size is %s\" \"SELECT DATA_NAME ,  DATA_SIZE  WHERE COLL_NAME = '/tempZone/home/rods'\"",
-        " iquest \"SELECT COLL_NAME WHERE COLL_NAME like '/tempZone/home/%'\"",
-        " iquest \"User %-6.6s has %-5.5s access to file %s\" \"SELECT USER_NAME,  DATA_ACCESS_NAME, DATA_NAME WHERE COLL_NAME = '/tempZone/home/rods'\"",
-        " iquest \" %-5.5s access has been given to user %-6.6s for the file %s\" \"SELECT DATA_ACCESS_NAME, USER_NAME, DATA_NAME WHERE COLL_NAME = '/tempZone/home/rods'\"",
-        " iquest no-distinct \"select META_DATA_ATTR_NAME\"",
-        " iquest uppercase \"select COLL_NAME, DATA_NAME WHERE DATA_NAME like 'F1'\"",
-
-        " iquest \"SELECT RESC_NAME, RESC_LOC, RESC_VAULT_PATH, DATA_PATH WHERE DATA_NAME = 't2' AND COLL_NAME = '/tempZone/home/rods'\"",
-        " iquest \"User %-9.9s uses %14.14s bytes in %8.8s files in '%s'\" \"SELECT USER_NAME, sum(DATA_SIZE),count(DATA_NAME),RESC_NAME\"",
-        " iquest \"select sum(DATA_SIZE) where COLL_NAME = '/tempZone/home/rods'\"",
-        " iquest \"select sum(DATA_SIZE) where COLL_NAME like '/tempZone/home/rods%'\"",
-        " iquest \"select sum(DATA_SIZE), RESC_NAME where COLL_NAME like '/tempZone/home/rods%'\"",
-        " iquest \"select order_desc(DATA_ID) where COLL_NAME like '/tempZone/home/rods%'\"",
-        " iquest \"select count(DATA_ID) where COLL_NAME like '/tempZone/home/rods%'\"",
-        " iquest \"select RESC_NAME where RESC_CLASS_NAME IN ('bundle','archive')\"",
-        " iquest \"select DATA_NAME,DATA_SIZE where DATA_SIZE BETWEEN '100000' '100200'\"",
+        " iquest2 'COLL_NAME(cid, \"/tempZone/home/rods\") META_2(cid, a, v, u)' 'a v u'",
+        " iquest2 --limit 10 'DATA_NAME_2(oid, n) DATA_COLL_ID(oid, cid) COLL_NAME(cid, \"/tempZone/home/rods\")' 'n'",
+        " iquest2 --no-page --format csv 'COLL_NAME(cid, \"/tempZone/home/rods\") META_2(cid, a, v, u)' 'a v u' > avus.csv",
+        " iquest2 --parallel 8 --partition-by collection:/tempZone/home 'COLL_NAME(cid, ?) META_2(cid, a, v, u)' 'a v u'",
+        " iquest2 --parallel 4 -f report.q",
         ""
     };
     int i;
@@ -80,204 +126,508 @@ usage() {
         }
         printf( "%s\n", msgs[i] );
     }
-    printReleaseInfo( "iquest" );
+    printReleaseInfo( "iquest2" );
 }
 
+/*
+  Split the query2 header into the names of the returned variables.
+ */
 void
-printFormatted( char *format, char *args[], int nargs ) {
-    try {
-        boost::format formatter( format );
-        for ( int i = 0; i < nargs; i++ ) {
-            formatter % args[i];
+splitHeader( const char *hdr, std::vector<std::string>& names ) {
+    std::string name;
+    for ( const char *cp = hdr; cp != NULL && *cp != '\0'; cp++ ) {
+        if ( *cp == ' ' || *cp == '\t' ) {
+            if ( !name.empty() ) {
+                names.push_back( name );
+                name.clear();
+            }
+        }
+        else {
+            name += *cp;
         }
-        std::cout << formatter;
     }
-    catch ( const boost::io::format_error& _e ) {
-        std::cout << _e.what() << std::endl;
+    if ( !name.empty() ) {
+        names.push_back( name );
     }
 }
 
-void
-printBasicGenQueryOut( genQueryOut_t *genQueryOut, char *format ) {
-    int i, j;
-    if ( format == NULL || strlen( format ) == 0 ) {
-        for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-            if ( i > 0 ) {
-                printf( "----\n" );
+/*
+  Run a query2 query and write each row to fmt as soon as it is read
+  from the reply.  If pageFlag is set and the output format is
+  interactive, prompt after every pageOpts.page_size rows; at most
+  pageOpts.limit rows are shown.
+ */
+int
+queryAndShowQuery2( rcComm_t *conn, const char *qu, const char *hdr,
+                    const query2::page_options& pageOpts, int pageFlag,
+                    query2::formatter& fmt ) {
+    fmt.begin();
+    int status = query2::for_each_page_row( conn, qu, hdr, pageOpts,
+        [&]( const query2::row_t& _row ) {
+            fmt.row( _row );
+            return 0;
+        },
+        [&]( size_t ) {
+            if ( !pageFlag || !fmt.interactive() ) {
+                return true;
+            }
+            fmt.flush();
+            printf( "Continue? [Y/n]" );
+            fflush( stdout );
+            std::string response = "";
+            getline( std::cin, response );
+            return strncmp( response.c_str(), "n", 1 ) != 0;
+        } );
+    fmt.end();
+    return status;
+}
+
+/*
+  Partition a query by the collections in the tree under root: each
+  partition binds the full name of root itself or of one collection below
+  it, at any depth, so that together they cover the whole tree.  The
+  names are sorted so the partitions print in a stable order.
+ */
+int
+getCollectionPartitions( rcComm_t *conn, const char *root,
+                         std::vector<query2::partition_t>& parts ) {
+    genQueryInp_t genQueryInp;
+    genQueryOut_t *genQueryOut = NULL;
+    char condStr[MAX_NAME_LEN * 2 + 32];
+
+    std::string rootName = root;
+    while ( rootName.size() > 1 && rootName[rootName.size() - 1] == '/' ) {
+        rootName.erase( rootName.size() - 1 );
+    }
+    memset( &genQueryInp, 0, sizeof( genQueryInp ) );
+    addInxIval( &genQueryInp.selectInp, COL_COLL_NAME, 1 );
+    snprintf( condStr, sizeof( condStr ), "= '%s' || like '%s/%%'", rootName.c_str(),
+              rootName == "/" ? "" : rootName.c_str() );
+    addInxVal( &genQueryInp.sqlCondInp, COL_COLL_NAME, condStr );
+
+    /* the next page is fetched while this one is copied out */
+    int status;
+    {
+        icommands::prefetch_pager pager( conn, &genQueryInp, &genQueryOut, MAX_SQL_ROWS );
+        status = pager.first();
+        while ( status >= 0 ) {
+            sqlResult_t *colls = getSqlResultByInx( genQueryOut, COL_COLL_NAME );
+            if ( colls == NULL ) {
+                status = UNMATCHED_KEY_OR_INDEX;
+                break;
             }
-            for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
-                char *tResult;
-                tResult = genQueryOut->sqlResult[j].value;
-                tResult += i * genQueryOut->sqlResult[j].len;
-                printf( "%s\n", tResult );
+            for ( int i = 0; i < genQueryOut->rowCnt; i++ ) {
+                parts.push_back( query2::partition_t( 1, &colls->value[colls->len * i] ) );
             }
+            if ( !pager.more() ) {
+                break;
+            }
+            status = pager.next();
         }
     }
-    else {
-        for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-            char *results[20];
-            for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
-                char *tResult;
-                tResult = genQueryOut->sqlResult[j].value;
-                tResult += i * genQueryOut->sqlResult[j].len;
-                results[j] = tResult;
-            }
+    clearGenQueryInp( &genQueryInp );
 
-            printFormatted( format, results, j );
-        }
+    std::sort( parts.begin(), parts.end() );
+    if ( status == CAT_NO_ROWS_FOUND ) {
+        status = 0;
     }
+    return status;
 }
 
+/*
+  Partition a query into count ranges of data object IDs: each partition
+  binds the first ID of its range and the first ID past it.
+ */
 int
-queryAndShowStrCond( rcComm_t *conn, char *hint, char *format,
-                     char *selectConditionString, int noDistinctFlag,
-                     int upperCaseFlag, char *zoneArgument, int noPageFlag ) {
-    /*
-      NoDistinctFlag is 1 if the user is requesting 'distinct' to be skipped.
-     */
-
+getDataIdPartitions( rcComm_t *conn, size_t count,
+                     std::vector<query2::partition_t>& parts ) {
     genQueryInp_t genQueryInp;
-    int i;
     genQueryOut_t *genQueryOut = NULL;
 
-    memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
-    i = fillGenQueryInpFromStrCond( selectConditionString, &genQueryInp );
-    if ( i < 0 ) {
-        return i;
+    memset( &genQueryInp, 0, sizeof( genQueryInp ) );
+    addInxIval( &genQueryInp.selectInp, COL_D_DATA_ID, SELECT_MIN );
+    addInxIval( &genQueryInp.selectInp, COL_D_DATA_ID, SELECT_MAX );
+    genQueryInp.maxRows = 1;
+
+    int status = icommands::gen_query( conn, &genQueryInp, &genQueryOut );
+    if ( status >= 0 && genQueryOut->rowCnt > 0 && genQueryOut->attriCnt == 2 ) {
+        long long lo = atoll( genQueryOut->sqlResult[0].value );
+        long long hi = atoll( genQueryOut->sqlResult[1].value ) + 1;
+        long long step = ( hi - lo + count - 1 ) / count;
+        if ( step < 1 ) {
+            step = 1;
+        }
+        for ( long long start = lo; start < hi; start += step ) {
+            query2::partition_t part;
+            part.push_back( std::to_string( start ) );
+            part.push_back( std::to_string( std::min( start + step, hi ) ) );
+            parts.push_back( part );
+        }
     }
+    freeGenQueryOut( &genQueryOut );
+    clearGenQueryInp( &genQueryInp );
 
-    if ( noDistinctFlag ) {
-        genQueryInp.options = NO_DISTINCT;
+    if ( status == CAT_NO_ROWS_FOUND ) {
+        status = 0;
     }
-    if ( upperCaseFlag ) {
-        genQueryInp.options = UPPER_CASE_WHERE;
+    return status;
+}
+
+/*
+  Run a query once per partition over all of the connections at once and
+  write the merged rows to fmt, either in partition order or, if
+  unordered is set, a partition at a time as each one completes.
+ */
+int
+parallelQueryAndShowQuery2( const std::vector<rcComm_t *>& conns,
+                            const char *qu, const char *hdr,
+                            const std::vector<query2::partition_t>& parts,
+                            size_t limit, int unordered,
+                            query2::formatter& fmt ) {
+    query2::statement stmt( qu );
+    if ( !parts.empty() && stmt.parameter_count() != parts[0].size() ) {
+        printf( "The query needs %d ? placeholders for this partitioning\n",
+                static_cast<int>( parts[0].size() ) );
+        return USER_INPUT_FORMAT_ERR;
     }
 
-    if ( zoneArgument != 0 && zoneArgument[0] != '\0' ) {
-        addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
-        printf( "Zone is %s\n", zoneArgument );
+    std::vector<query2::row_buffer> rows( parts.size() );
+    std::vector<bool> done( parts.size(), false );
+    std::mutex mutex;
+    size_t nextToPrint = 0;
+    std::atomic<size_t> printed( 0 );
+
+    auto printPartition = [&]( size_t part ) {
+        if ( limit == 0 ) {
+            printed += rows[part].replay( fmt, 0 );
+        }
+        else if ( printed < limit ) {
+            printed += rows[part].replay( fmt, limit - printed );
+        }
+        rows[part].clear();
+    };
+
+    fmt.begin();
+    int status = query2::for_each_partition_row( conns, stmt, parts, hdr,
+        [&]( size_t _part, const query2::row_t& _row ) {
+            if ( limit > 0 && printed >= limit ) {
+                return query2::STOP_ITERATION;
+            }
+            rows[_part].append( _row );
+            return 0;
+        },
+        [&]( size_t _part, int ) {
+            std::lock_guard<std::mutex> lock( mutex );
+            done[_part] = true;
+            if ( unordered ) {
+                printPartition( _part );
+                return;
+            }
+            while ( nextToPrint < parts.size() && done[nextToPrint] ) {
+                printPartition( nextToPrint++ );
+            }
+        } );
+    fmt.end();
+    return status;
+}
+
+/*
+  Run one statement of a script on conn, writing its result to out.
+ */
+int
+runStatement( rcComm_t *conn, const query2::script_statement& stmt,
+              const query2::page_options& pageOpts, const std::string& format,
+              FILE *out ) {
+    std::vector<std::string> names;
+    splitHeader( stmt.header.c_str(), names );
+    std::unique_ptr<query2::formatter> fmt =
+        query2::make_formatter( stmt.format.empty() ? format : stmt.format, out, names );
+    int status = queryAndShowQuery2( conn, stmt.query.c_str(), stmt.header.c_str(),
+                                     pageOpts, 0, *fmt );
+    if ( status == CAT_NO_ROWS_FOUND ) {
+        if ( fmt->interactive() ) {
+            fprintf( out, "CAT_NO_ROWS_FOUND: Nothing was found matching your query\n" );
+        }
+        status = 0;
     }
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "iquest2: statement at line %d failed", stmt.line );
+    }
+    return status;
+}
 
-    genQueryInp.maxRows = MAX_SQL_ROWS;
-    genQueryInp.continueInx = 0;
-    i = rcGenQuery( conn, &genQueryInp, &genQueryOut );
-    if ( i < 0 ) {
-        return i;
+/*
+  Copy the whole of a temporary file to out and close it.
+ */
+void
+copyHeldOutput( FILE *held, FILE *out ) {
+    char buf[65536];
+    size_t n;
+    rewind( held );
+    while ( ( n = fread( buf, 1, sizeof( buf ), held ) ) > 0 ) {
+        fwrite( buf, 1, n, out );
     }
+    fclose( held );
+}
 
-    i = printGenQueryOut( stdout, format, hint,  genQueryOut );
-    if ( i < 0 ) {
-        return i;
+/*
+  Run the statements of a script, as many at once as there are
+  connections.  Each output file is opened once; when statements run at
+  once, those sharing an output (standard output included) write to
+  temporary files that are copied to it in script order as they finish.
+  Returns the status of the first statement that failed.
+ */
+int
+runScript( const std::vector<rcComm_t *>& conns,
+           const std::vector<query2::script_statement>& stmts,
+           const query2::page_options& pageOpts, const std::string& format ) {
+    std::map<std::string, FILE *> outputs;
+    std::map<std::string, size_t> writers;
+    outputs["-"] = stdout;
+    for ( size_t i = 0; i < stmts.size(); i++ ) {
+        writers[stmts[i].output]++;
+        if ( outputs.count( stmts[i].output ) == 0 ) {
+            FILE *out = fopen( stmts[i].output.c_str(), "w" );
+            if ( out == NULL ) {
+                int status = UNIX_FILE_OPEN_ERR - errno;
+                rodsLogError( LOG_ERROR, status, "iquest2: cannot open %s",
+                              stmts[i].output.c_str() );
+                for ( std::map<std::string, FILE *>::iterator it = outputs.begin();
+                        it != outputs.end(); ++it ) {
+                    if ( it->second != stdout ) {
+                        fclose( it->second );
+                    }
+                }
+                return status;
+            }
+            outputs[stmts[i].output] = out;
+        }
     }
 
+    bool concurrent = conns.size() > 1 && stmts.size() > 1;
+    std::vector<FILE *> held( stmts.size(), static_cast<FILE *>( NULL ) );
+    std::vector<int> statuses( stmts.size(), 0 );
+    std::vector<bool> done( stmts.size(), false );
+    std::mutex mutex;
+    size_t nextToCopy = 0;
+
+    icommands::run_on_connections( conns, stmts.size(),
+        [&]( rcComm_t *_conn, size_t _idx ) {
+            const query2::script_statement& stmt = stmts[_idx];
+            FILE *out = outputs.at( stmt.output );
+            if ( concurrent && writers.at( stmt.output ) > 1 ) {
+                held[_idx] = tmpfile();
+                if ( held[_idx] == NULL ) {
+                    statuses[_idx] = UNIX_FILE_OPEN_ERR - errno;
+                    rodsLogError( LOG_ERROR, statuses[_idx],
+                                  "iquest2: cannot hold the output of the statement at line %d",
+                                  stmt.line );
+                }
+                out = held[_idx];
+            }
+            if ( out != NULL ) {
+                statuses[_idx] = runStatement( _conn, stmt, pageOpts, format, out );
+            }
 
-    while ( i == 0 && genQueryOut->continueInx > 0 ) {
-        if ( noPageFlag == 0 ) {
-            char inbuf[100];
-            printf( "Continue? [Y/n]" );
-            std::string response = "";
-            getline( std::cin, response );
-            strncpy( inbuf, response.c_str(), 90 );
-            if ( strncmp( inbuf, "n", 1 ) == 0 ) {
-                break;
+            std::lock_guard<std::mutex> lock( mutex );
+            done[_idx] = true;
+            while ( nextToCopy < stmts.size() && done[nextToCopy] ) {
+                if ( held[nextToCopy] != NULL ) {
+                    copyHeldOutput( held[nextToCopy], outputs.at( stmts[nextToCopy].output ) );
+                }
+                nextToCopy++;
             }
+        } );
+
+    for ( std::map<std::string, FILE *>::iterator it = outputs.begin(); it != outputs.end(); ++it ) {
+        if ( it->second == stdout ) {
+            fflush( stdout );
         }
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        i = rcGenQuery( conn, &genQueryInp, &genQueryOut );
-        if ( i < 0 ) {
-            return i;
-        }
-        i = printGenQueryOut( stdout, format, hint,  genQueryOut );
-        if ( i < 0 ) {
-            return i;
+        else {
+            fclose( it->second );
         }
     }
 
+    for ( size_t i = 0; i < statuses.size(); i++ ) {
+        if ( statuses[i] < 0 ) {
+            return statuses[i];
+        }
+    }
     return 0;
-
 }
 
+/*
+  Run a query and count its rows without printing them.  reply is the
+  time until the whole reply had arrived, which is close to the time the
+  server took to answer, and total also includes decoding every row.
+ */
 int
-execAndShowSpecificQuery( rcComm_t *conn, char *sql,
-                          char *args[], int argsOffset, int noPageFlag ) {
-    specificQueryInp_t specificQueryInp;
-    int status, i;
-    genQueryOut_t *genQueryOut = NULL;
-    char *cp;
-    int nQuestionMarks, nArgs;
-    char *format = "";
-    char myFormat[300] = "";
-
-    memset( &specificQueryInp, 0, sizeof( specificQueryInp_t ) );
-    specificQueryInp.maxRows = MAX_SQL_ROWS;
-    specificQueryInp.continueInx = 0;
-    specificQueryInp.sql = sql;
-    /* To differentiate format from args, count the ? in the SQL and the
-       arguments */
-    cp = specificQueryInp.sql;
-    nQuestionMarks = 0;
-    while ( *cp != '\0' ) {
-        if ( *cp++ == '?' ) {
-            nQuestionMarks++;
-        }
-    }
-    i = argsOffset;
-    nArgs = 0;
-    while ( args[i] != NULL && strlen( args[i] ) > 0 ) {
-        nArgs++;
-        i++;
-    }
-    /* If the SQL is an alias, counting the ?'s won't be accurate so now
-       the following is only done if nQuestionMarks is > 0.  But this means
-       iquest won't be able to notice a Format statement when using aliases,
-       but will instead assume all are parameters to the SQL. */
-    if ( nQuestionMarks > 0 && nArgs > nQuestionMarks ) {
-        format = args[argsOffset];  /* this must be the format */
-        argsOffset++;
-        strncpy( myFormat, format, 300 - 10 );
-        strcat( myFormat, "\n" ); /* since \n is difficult to pass in
-				on the command line, add one by default */
-    }
-
-    i = 0;
-    while ( args[argsOffset] != NULL && strlen( args[argsOffset] ) > 0 ) {
-        specificQueryInp.args[i++] = args[argsOffset];
-        argsOffset++;
-    }
-    status = rcSpecificQuery( conn, &specificQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-        printf( "No rows found\n" );
-        return 0;
-    }
+timeQuery2( rcComm_t *conn, const std::string& qu, const std::string& hdr,
+            size_t& rows, double& reply, double& total ) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    rows = 0;
+    char *res = NULL;
+    int status = query2::send_query( conn, qu.c_str(), hdr.c_str(), &res );
+    reply = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
     if ( status < 0 ) {
-        printError( conn, status, "rcSpecificQuery" );
+        free( res );
+        total = reply;
         return status;
     }
 
-    printBasicGenQueryOut( genQueryOut, myFormat );
+    query2::cursor cur( res );
+    query2::row_t row;
+    while ( ( status = cur.next( row ) ) > 0 ) {
+        ++rows;
+    }
+    free( res );
+    total = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    return status < 0 ? status : 0;
+}
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        if ( noPageFlag == 0 ) {
-            char inbuf[100];
-            printf( "Continue? [Y/n]" );
-            std::string response = "";
-            getline( std::cin, response );
-            strncpy( inbuf, response.c_str(), 90 );
-            if ( strncmp( inbuf, "n", 1 ) == 0 ) {
-                break;
+/*
+  Join a list of names with blanks between them.
+ */
+std::string
+joinNames( const std::vector<std::string>& names ) {
+    std::string joined;
+    for ( size_t i = 0; i < names.size(); i++ ) {
+        if ( i > 0 ) {
+            joined += ' ';
+        }
+        joined += names[i];
+    }
+    return joined;
+}
+
+/*
+  Describe how a query's predicates join and measure it.  With analyze,
+  each prefix of the predicates is also run with every variable it binds
+  in the header, to show which predicate makes the row count or the time
+  grow.
+ */
+int
+explainQuery2( rcComm_t *conn, const std::string& qu, const std::string& hdr, bool analyze ) {
+    printf( "Query: %s\n", qu.c_str() );
+    printf( "Generated SQL: not available; the server translates query2 queries\n" );
+    printf( "               and does not return the SQL to the client\n" );
+
+    std::vector<query2::predicate> preds;
+    std::vector<query2::predicate_plan> plans;
+    std::map<std::string, std::vector<size_t> > uses;
+    std::string error;
+    bool parsed = query2::parse_predicates( qu, preds, error );
+    if ( !parsed ) {
+        printf( "Predicates: the query could not be split into predicates: %s\n", error.c_str() );
+    }
+    else {
+        query2::plan_predicates( preds, plans, uses );
+
+        size_t width = 0;
+        for ( size_t p = 0; p < preds.size(); p++ ) {
+            width = std::max( width, preds[p].text.size() );
+        }
+        printf( "\nPredicates, in query order:\n" );
+        for ( size_t p = 0; p < preds.size(); p++ ) {
+            std::string how;
+            if ( !plans[p].joins.empty() ) {
+                how += "joins on " + joinNames( plans[p].joins );
+            }
+            if ( !plans[p].binds.empty() ) {
+                how += std::string( how.empty() ? "" : "; " ) + "binds " + joinNames( plans[p].binds );
             }
+            if ( !plans[p].filters.empty() ) {
+                how += std::string( how.empty() ? "" : "; " ) + "filters on " + joinNames( plans[p].filters );
+            }
+            printf( "  %2d  %-*s  %s\n", static_cast<int>( p + 1 ), static_cast<int>( width ),
+                    preds[p].text.c_str(), how.c_str() );
+        }
+
+        printf( "\nJoin graph, the predicates using each variable:\n" );
+        for ( std::map<std::string, std::vector<size_t> >::const_iterator it = uses.begin();
+                it != uses.end(); ++it ) {
+            printf( "  %-12s", it->first.c_str() );
+            for ( size_t i = 0; i < it->second.size(); i++ ) {
+                printf( " %d", static_cast<int>( it->second[i] + 1 ) );
+            }
+            printf( "%s\n", it->second.size() == 1 ? "  (not joined)" : "" );
         }
-        specificQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcSpecificQuery( conn, &specificQueryInp, &genQueryOut );
-        if ( status < 0 ) {
-            printError( conn, status, "rcSpecificQuery" );
-            return status;
+
+        for ( size_t p = 0; p < preds.size(); p++ ) {
+            if ( plans[p].cross ) {
+                printf( "\nWarning: predicate %d shares no variable with the predicates before it,\n"
+                        "         so it is a cross product with them unless a later predicate joins them\n",
+                        static_cast<int>( p + 1 ) );
+            }
         }
-        printBasicGenQueryOut( genQueryOut, myFormat );
     }
 
+    if ( query2::statement( qu ).parameter_count() > 0 ) {
+        printf( "\nThe query has ? placeholders; bind them to measure it.\n" );
+        return 0;
+    }
+
+    int status = 0;
+    size_t rows;
+    double reply, total;
+    printf( "\n%-10s %12s %10s %10s %9s\n", "predicates", "rows", "reply", "total", "growth" );
+    if ( analyze && parsed ) {
+        std::string prefix;
+        std::vector<std::string> bound;
+        size_t lastRows = 0;
+        for ( size_t p = 0; p + 1 < preds.size(); p++ ) {
+            prefix += ( p > 0 ? " " : "" ) + preds[p].text;
+            bound.insert( bound.end(), plans[p].binds.begin(), plans[p].binds.end() );
+            status = timeQuery2( conn, prefix, joinNames( bound ), rows, reply, total );
+            if ( status < 0 ) {
+                rodsLogError( LOG_ERROR, status, "iquest2: predicates 1 to %d failed",
+                              static_cast<int>( p + 1 ) );
+                return status;
+            }
+            char growth[32] = "";
+            if ( p > 0 && lastRows > 0 ) {
+                snprintf( growth, sizeof( growth ), " %8.2fx", static_cast<double>( rows ) / lastRows );
+            }
+            printf( "1-%-8d %12lu %9.3fs %9.3fs%s\n", static_cast<int>( p + 1 ),
+                    static_cast<unsigned long>( rows ), reply, total, growth );
+            lastRows = rows;
+        }
+    }
+
+    std::string fullHdr = hdr;
+    if ( fullHdr.empty() && parsed ) {
+        std::vector<std::string> vars;
+        for ( std::map<std::string, std::vector<size_t> >::const_iterator it = uses.begin();
+                it != uses.end(); ++it ) {
+            vars.push_back( it->first );
+        }
+        fullHdr = joinNames( vars );
+    }
+    status = timeQuery2( conn, qu, fullHdr, rows, reply, total );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "iquest2: the query failed" );
+        return status;
+    }
+    printf( "%-10s %12lu %9.3fs %9.3fs\n", "all", static_cast<unsigned long>( rows ), reply, total );
     return 0;
+}
 
+/*
+  Connect, through the agent if one is running, and log in, returning
+  NULL on failure.
+ */
+rcComm_t *
+connectAndLogin( rodsEnv *myEnv ) {
+    rErrMsg_t errMsg;
+    rcComm_t *conn = icommands::broker_connect( *myEnv, &errMsg );
+    if ( conn == NULL ) {
+        return NULL;
+    }
+    if ( icommands::broker_login( conn ) != 0 ) {
+        icommands::broker_disconnect( conn );
+        return NULL;
+    }
+    return conn;
 }
 
 int
@@ -289,44 +639,144 @@ main( int argc, char **argv ) {
     rodsEnv myEnv;
     rErrMsg_t errMsg;
     rcComm_t *conn;
-    rodsArguments_t myRodsArgs;
-    char *optStr;
+    query2::page_options pageOpts;
+    std::string qu;
+    std::string hdr;
+    size_t parallel = 1;
+    std::string partitionBy;
+    std::string format = "text";
+    std::string scriptFile;
+    std::string zoneName;
+    std::vector<std::string> args;
     int noDistinctFlag = 0;
     int upperCaseFlag = 0;
 
-    optStr = "hz:Z";
+    namespace po = boost::program_options;
+    po::options_description opt_desc( "options" );
+    opt_desc.add_options()
+    ( "help,h", "show command usage" )
+    ( "zone,z", po::value<std::string>( &zoneName ), "the zone to query" )
+    ( "no-page", "do not prompt asking whether to continue or not" )
+    ( "page-size", po::value<size_t>( &pageOpts.page_size ), "number of rows per page" )
+    ( "limit", po::value<size_t>( &pageOpts.limit ), "stop after this many rows" )
+    ( "parallel", po::value<size_t>( &parallel ), "number of connections for a partitioned query" )
+    ( "partition-by", po::value<std::string>( &partitionBy ), "collection:Root or id" )
+    ( "unordered", "print partitions as they complete" )
+    ( "format", po::value<std::string>( &format ), "text, csv, tsv, ndjson, arrow or a format" )
+    ( "file,f", po::value<std::string>( &scriptFile ), "script of query2 statements" )
+    ( "explain", "describe and time the query instead of printing its rows" )
+    ( "analyze", "with --explain, also time each prefix of the predicates" )
+    ( "args", po::value<std::vector<std::string>>( &args ), "[no-distinct] [upper] query [header]" );
+
+    po::positional_options_description pos_desc;
+    pos_desc.add( "args", -1 );
+
+    po::variables_map vm;
+    try {
+        po::store(
+            po::command_line_parser(
+                argc, argv ).options(
+                opt_desc ).positional(
+                pos_desc ).run(), vm );
+        po::notify( vm );
+    }
+    catch ( po::error& _e ) {
+        printf( "%s\n", _e.what() );
+        printf( "Use -h for help\n" );
+        exit( 1 );
+    }
 
-    status = parseCmdLineOpt( argc, argv, optStr, 1, &myRodsArgs );
+    if ( vm.count( "help" ) ) {
+        usage();
+        exit( 0 );
+    }
 
-    if ( myRodsArgs.optind < argc ) {
-        if ( !strcmp( argv[myRodsArgs.optind], "no-distinct" ) ) {
-            noDistinctFlag = 1;
-            myRodsArgs.optind++;
-        }
+    size_t argInx = 0;
+    if ( argInx < args.size() && args[argInx] == "no-distinct" ) {
+        noDistinctFlag = 1;
+        argInx++;
     }
-    if ( myRodsArgs.optind < argc ) {
-        if ( strncmp( argv[myRodsArgs.optind], "upper", 5 ) == 0 ) {
-            upperCaseFlag = 1;
-            myRodsArgs.optind++;
-        }
+    if ( argInx < args.size() && args[argInx].compare( 0, 5, "upper" ) == 0 ) {
+        upperCaseFlag = 1;
+        argInx++;
+    }
+    if ( args.size() - argInx > 2 ) {
+        printf( "Too many arguments\n" );
+        printf( "Use -h for help\n" );
+        exit( 1 );
+    }
+    if ( argInx < args.size() ) {
+        qu = args[argInx++];
+    }
+    if ( argInx < args.size() ) {
+        hdr = args[argInx++];
     }
 
+    if ( !scriptFile.empty() && ( !qu.empty() || !partitionBy.empty() ) ) {
+        printf( "-f cannot be used with a query or --partition-by\n" );
+        exit( 1 );
+    }
 
-    if ( status < 0 ) {
-        printf( "Use -h for help\n" );
+    if ( vm.count( "explain" ) && ( !scriptFile.empty() || !partitionBy.empty() ) ) {
+        printf( "--explain cannot be used with -f or --partition-by\n" );
         exit( 1 );
     }
-    if ( myRodsArgs.help == True ) {
-        usage();
-        exit( 0 );
+    if ( vm.count( "analyze" ) && !vm.count( "explain" ) ) {
+        printf( "--analyze needs --explain\n" );
+        exit( 1 );
     }
 
-    if ( myRodsArgs.optind == argc ) {
-        printf( "StringCondition needed\n" );
+    if ( qu.empty() && scriptFile.empty() ) {
+        printf( "Query needed\n" );
         usage();
         exit( 0 );
     }
 
+    std::vector<std::string> names;
+    splitHeader( hdr.c_str(), names );
+    std::unique_ptr<query2::formatter> fmt = query2::make_formatter( format, stdout, names );
+    if ( !fmt ) {
+        printf( "--format must be text, csv, tsv, ndjson, arrow or a valid format\n" );
+        exit( 1 );
+    }
+
+    if ( parallel < 1 ) {
+        parallel = 1;
+    }
+    if ( parallel > 1 && partitionBy.empty() && scriptFile.empty() ) {
+        printf( "--parallel needs --partition-by\n" );
+        exit( 1 );
+    }
+    if ( !partitionBy.empty() && partitionBy != "id" &&
+            partitionBy.compare( 0, 11, "collection:" ) != 0 ) {
+        printf( "--partition-by must be collection:Root or id\n" );
+        exit( 1 );
+    }
+
+    std::vector<query2::script_statement> stmts;
+    if ( !scriptFile.empty() ) {
+        std::ifstream file;
+        if ( scriptFile != "-" ) {
+            file.open( scriptFile.c_str() );
+            if ( !file ) {
+                printf( "Cannot open %s\n", scriptFile.c_str() );
+                exit( 1 );
+            }
+        }
+        std::string error;
+        if ( !query2::parse_script( scriptFile == "-" ? std::cin : file, stmts, error ) ) {
+            printf( "%s: %s\n", scriptFile.c_str(), error.c_str() );
+            exit( 1 );
+        }
+        for ( size_t i = 0; i < stmts.size(); i++ ) {
+            if ( !stmts[i].format.empty() &&
+                    !query2::make_formatter( stmts[i].format, stdout, names ) ) {
+                printf( "%s: line %d: format must be text, csv, tsv, ndjson, arrow "
+                        "or a valid format\n", scriptFile.c_str(), stmts[i].line );
+                exit( 1 );
+            }
+        }
+    }
 
     status = getRodsEnv( &myEnv );
 
@@ -335,41 +785,89 @@ main( int argc, char **argv ) {
         exit( 1 );
     }
 
-    if ( myRodsArgs.optind == 1 ) {
-        if ( !strncmp( argv[argc - 1], "attrs", 5 ) ) {
-            showAttrNames();
-            exit( 0 );
-        }
+    if ( args.size() == 1 && qu == "attrs" && !noDistinctFlag && !upperCaseFlag ) {
+        showAttrNames();
+        exit( 0 );
     }
 
-    conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
-                      myEnv.rodsZone, 0, &errMsg );
+    conn = icommands::broker_connect( myEnv, &errMsg );
 
     if ( conn == NULL ) {
         exit( 2 );
     }
 
-    status = clientLogin( conn );
+    status = icommands::broker_login( conn );
     if ( status != 0 ) {
         exit( 3 );
     }
 
-    char *qu = argv[1];
-    char *hdr = argv[2];
-    char *res = NULL;
+    if ( vm.count( "explain" ) ) {
+        status = explainQuery2( conn, qu, hdr, vm.count( "analyze" ) > 0 );
+    }
+    else if ( !scriptFile.empty() ) {
+        std::vector<rcComm_t *> conns( 1, conn );
+        while ( conns.size() < parallel && conns.size() < stmts.size() ) {
+            rcComm_t *extra = connectAndLogin( &myEnv );
+            if ( extra == NULL ) {
+                rodsLog( LOG_ERROR, "only %d of %d connections could be opened",
+                         static_cast<int>( conns.size() ), static_cast<int>( parallel ) );
+                break;
+            }
+            conns.push_back( extra );
+        }
 
-    query(conn, qu, hdr, &res);
-    printf("%s", res);
+        status = runScript( conns, stmts, pageOpts, format );
+        for ( size_t i = 1; i < conns.size(); i++ ) {
+            icommands::broker_disconnect( conns[i] );
+        }
+    }
+    else if ( partitionBy.empty() ) {
+        status = queryAndShowQuery2( conn, qu.c_str(), hdr.c_str(), pageOpts,
+                                     vm.count( "page-size" ) > 0 && !vm.count( "no-page" ),
+                                     *fmt );
+    }
+    else {
+        std::vector<query2::partition_t> parts;
+        if ( partitionBy == "id" ) {
+            status = getDataIdPartitions( conn, parallel * 4, parts );
+        }
+        else {
+            status = getCollectionPartitions( conn, partitionBy.c_str() + 11, parts );
+        }
 
-    rcDisconnect( conn );
+        std::vector<rcComm_t *> conns( 1, conn );
+        while ( status >= 0 && conns.size() < parallel ) {
+            rcComm_t *extra = connectAndLogin( &myEnv );
+            if ( extra == NULL ) {
+                rodsLog( LOG_ERROR, "only %d of %d connections could be opened",
+                         static_cast<int>( conns.size() ), static_cast<int>( parallel ) );
+                break;
+            }
+            conns.push_back( extra );
+        }
+
+        if ( status >= 0 ) {
+            status = parallelQueryAndShowQuery2( conns, qu.c_str(), hdr.c_str(), parts,
+                                                 pageOpts.limit, vm.count( "unordered" ) > 0,
+                                                 *fmt );
+        }
+        for ( size_t i = 1; i < conns.size(); i++ ) {
+            icommands::broker_disconnect( conns[i] );
+        }
+    }
+
+    icommands::broker_disconnect( conn );
 
     if ( status < 0 ) {
         if ( status == CAT_NO_ROWS_FOUND ) {
+            if ( !fmt->interactive() ) {
+                exit( 0 );
+            }
             printf( "CAT_NO_ROWS_FOUND: Nothing was found matching your query\n" );
             exit( 0 );
         }
         else {
-            rodsLogError( LOG_ERROR, status, "iquest Error: queryAndShowStrCond failed" );
+            rodsLogError( LOG_ERROR, status, "iquest Error: queryAndShowQuery2 failed" );
             exit( 4 );
         }
     }
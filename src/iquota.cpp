@@ -9,152 +9,173 @@
 #include "rodsClient.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
+#include "connection_pool.hpp"
+#include "genquery_pager.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
-#define BIG_STR 200
 #define QUOTA_APPROACH_WARNING_SIZE -10000000000LL
 
+/* at most this many connections are used to run the queries side by side */
+#define QUOTA_CONNECTIONS 4
+
 int debug = 0;
 char quotaTime[TIME_LEN] = "";
-int printedFlag[3] = {0, 0, 0};
 rcComm_t *Conn;
 rodsEnv myEnv;
 
 void usage();
 
+/*
+  The rows of one query, as strings, kept so that the queries can run
+  side by side and their results be printed afterwards, in order.
+*/
+typedef std::vector< std::string > tableRow;
+
+struct queryTable {
+    queryTable() : status( 0 ), latestTime( 0 ) {
+    }
+
+    int status;
+    std::vector< tableRow > rows;
+    long long latestTime;         /* latest of the rows' modify times */
+    std::string latestTimeValue;  /* and as it came from the catalog */
+};
 
 /*
- print a number nicely, that is with commas and summary magnitude
+ format a number nicely, that is with commas, and return the summary
+ magnitude (like "(12 million)") in summary, or an empty string if the
+ number is less than a thousand
  */
-int
-printNice( char *inArg, int minLen, char *Units ) {
-    int i, n, k, len;
-    int nextComma, firstComma, commaCount;
-    char niceString[40];
-    char firstPart[10];
-    char *numberName;
-    char blanks[] = "                                        ";
-    len = strlen( inArg );
-    nextComma = len % 3;
+std::string
+withCommas( const char *inArg, std::string &summary ) {
+    static const char *numberNames[] = {
+        "", "thousand", "million", "billion", "trillion",
+        "quadrillion", "quintillion", "sextillion", "septillion"
+    };
+    std::string niceString;
+    std::string firstPart;
+    int len = strlen( inArg );
+    int nextComma = len % 3;
     if ( inArg[0] == '-' ) {
         nextComma = ( len - 1 ) % 3;
     }
     if ( nextComma == 0 ) {
         nextComma = 3;
     }
-    n = 0;
-    k = 0;
-    firstComma = 0;
-    commaCount = 0;
-    for ( i = 0; i < len; i++ ) {
-        niceString[n++] = inArg[i];
+    int firstComma = 0;
+    int commaCount = 0;
+    for ( int i = 0; i < len; i++ ) {
+        niceString += inArg[i];
         if ( firstComma == 0 ) {
-            firstPart[k++] = inArg[i];
+            firstPart += inArg[i];
         }
         if ( inArg[i] != '-' ) {
             nextComma--;
         }
         if ( nextComma == 0 && i < len - 1 ) {
-            niceString[n++] = ',';
+            niceString += ',';
             nextComma = 3;
             firstComma = 1;
             commaCount++;
         }
     }
-    niceString[n] = '\0';
-    firstPart[k] = '\0';
-    numberName = "";
-    if ( commaCount == 1 ) {
-        numberName = "thousand";
-    }
-    if ( commaCount == 2 ) {
-        numberName = "million";
-    }
-    if ( commaCount == 3 ) {
-        numberName = "billion";
-    }
-    if ( commaCount == 4 ) {
-        numberName = "trillion";
-    }
-    if ( commaCount == 5 ) {
-        numberName = "quadrillion";
-    }
-    if ( commaCount == 6 ) {
-        numberName = "quintillion";
-    }
-    if ( commaCount == 7 ) {
-        numberName = "sextillion";
-    }
-    if ( commaCount == 8 ) {
-        numberName = "septillion";
-    }
-    if ( commaCount > 8 ) {
-        numberName = "very many";
-    }
-    len = strlen( niceString );
-    if ( len < minLen ) {
-        i = minLen - len;
-        blanks[i] = '\0';
-        printf( "%s", blanks );
-        blanks[i] = ' ';
-    }
-    if ( commaCount == 0 ) {
-        printf( "%s %s", niceString, Units );
-    }
-    else {
-        printf( "%s (%s %s) %s", niceString,
-                firstPart, numberName, Units );
+
+    summary.clear();
+    if ( commaCount > 0 ) {
+        summary = "(" + firstPart + " " +
+                  ( commaCount > 8 ? "very many" : numberNames[commaCount] ) + ")";
     }
-    return 0;
+    return niceString;
 }
 
+/*
+ format a number nicely, that is with commas and summary magnitude
+ */
+std::string
+niceNumber( const char *inArg, const char *Units ) {
+    std::string summary;
+    std::string niceString = withCommas( inArg, summary );
+    if ( !summary.empty() ) {
+        niceString += " " + summary;
+    }
+    if ( Units[0] != '\0' ) {
+        niceString += " ";
+        niceString += Units;
+    }
+    return niceString;
+}
 
+/*
+  Run a general query to the end, a page at a time, collecting its rows
+  into table.  timeColumn is the index of a modify time column whose
+  latest value is kept, or -1.
+*/
+int
+queryToTable( rcComm_t *conn, genQueryInp_t *genQueryInp, int timeColumn,
+              queryTable &table ) {
+    genQueryOut_t *genQueryOut = NULL;
+    icommands::genquery_pager pager( conn, genQueryInp, &genQueryOut );
+
+    int status = pager.first();
+    while ( status == 0 ) {
+        for ( int i = 0; i < genQueryOut->rowCnt; i++ ) {
+            tableRow row;
+            for ( int j = 0; j < genQueryOut->attriCnt; j++ ) {
+                const char *tResult = genQueryOut->sqlResult[j].value +
+                                      i * genQueryOut->sqlResult[j].len;
+                row.push_back( tResult );
+            }
+            if ( timeColumn >= 0 ) {
+                long long itime = atoll( row[timeColumn].c_str() );
+                if ( itime > table.latestTime ) {
+                    table.latestTime = itime;
+                    table.latestTimeValue = row[timeColumn];
+                }
+            }
+            table.rows.push_back( row );
+        }
+        if ( !pager.more() ) {
+            break;
+        }
+        status = pager.next();
+    }
+    if ( status == CAT_NO_ROWS_FOUND ) {
+        status = 0;
+    }
+    table.status = status;
+    return status;
+}
 
 /*
-  Show user quota information
+  Get user or group quota information, on the resource rescName only if
+  it is not empty
 */
 int
-showQuotas( char *userName, int userOrGroup, int rescOrGlobal ) {
+getQuotas( rcComm_t *conn, const char *userName, int userOrGroup, int rescOrGlobal,
+           const char *rescName, queryTable &table ) {
     genQueryInp_t genQueryInp;
-    genQueryOut_t *genQueryOut;
-    int inputInx[20];
-    int inputVal[20] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    int inputCond[20];
-    char *condVal[10];
-    char v1[BIG_STR];
-    char v1b[BIG_STR];
-    char v2[BIG_STR];
-    char v3[BIG_STR];
-    int i, j, status;
-    int  localiTime = 0;
-    int printCount;
-    static int printedTime = 0;
-    char *colName[10];
+    int inputInx[6];
+    int inputVal[6] = {0, 0, 0, 0, 0, 0};
+    int inputCond[5];
+    char *condVal[5];
+    std::string condStr[5];
+    int i, status;
 
     memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
-    printCount = 0;
     i = 0;
     if ( rescOrGlobal == 0 ) {
-        colName[i] = "Resource: ";
         inputInx[i++] = COL_QUOTA_RESC_NAME;
     }
     else {
-        colName[i] = "Resource: ";
         inputInx[i++] = COL_QUOTA_RESC_ID;
     }
-    if ( userOrGroup == 0 ) {
-        colName[i] = "User:  ";
-    }
-    else {
-        colName[i] = "Group:  ";
-    }
     inputInx[i++] = COL_QUOTA_USER_NAME;
-    colName[i] = "Zone:  ";
     inputInx[i++] = COL_QUOTA_USER_ZONE;
-    colName[i] = "Quota: ";
     inputInx[i++] = COL_QUOTA_LIMIT;
-    colName[i] = "Over:  ";
     inputInx[i++] = COL_QUOTA_OVER;
-    colName[i] = "Time";
     inputInx[i++] = COL_QUOTA_MODIFY_TIME;
 
     genQueryInp.selectInp.inx = inputInx;
@@ -163,168 +184,100 @@ showQuotas( char *userName, int userOrGroup, int rescOrGlobal ) {
 
     char userName2[NAME_LEN];
     char userZone[NAME_LEN];
-    genQueryInp.sqlCondInp.len = 0;
+    i = 0;
     if ( userName[0] != '\0' ) {
         status = parseUserName( userName, userName2, userZone );
         if ( status < 0 ) {
-            rodsLog( LOG_ERROR, "parseUserName error in showQuotas with status %d", status );
+            rodsLog( LOG_ERROR, "parseUserName error in getQuotas with status %d", status );
+            table.status = status;
             return status;
         }
-        if ( userZone[0] == '\0' ) {
-            inputCond[0] = COL_QUOTA_USER_NAME;
-            sprintf( v1, "='%s'", userName );
-            condVal[0] = v1;
-            genQueryInp.sqlCondInp.len++;
-        }
-        else {
-            inputCond[0] = COL_QUOTA_USER_NAME;
-            sprintf( v1, "='%s'", userName2 );
-            condVal[0] = v1;
-            genQueryInp.sqlCondInp.len++;
-            inputCond[1] = COL_QUOTA_USER_ZONE;
-            sprintf( v1b, "='%s'", userZone );
-            condVal[1] = v1b;
-            genQueryInp.sqlCondInp.len++;
+        inputCond[i] = COL_QUOTA_USER_NAME;
+        condStr[i++] = std::string( "='" ) + userName2 + "'";
+        if ( userZone[0] != '\0' ) {
+            inputCond[i] = COL_QUOTA_USER_ZONE;
+            condStr[i++] = std::string( "='" ) + userZone + "'";
         }
     }
-    inputCond[genQueryInp.sqlCondInp.len] = COL_QUOTA_USER_TYPE;
-    if ( userOrGroup == 0 ) {
-        sprintf( v2, "!='%s'", "rodsgroup" );
-    }
-    else {
-        sprintf( v2, "='%s'", "rodsgroup" );
-    }
-    condVal[genQueryInp.sqlCondInp.len] = v2;
-    genQueryInp.sqlCondInp.len++;
+    inputCond[i] = COL_QUOTA_USER_TYPE;
+    condStr[i++] = userOrGroup == 0 ? "!='rodsgroup'" : "='rodsgroup'";
 
     if ( rescOrGlobal == 1 ) {
-        inputCond[genQueryInp.sqlCondInp.len] = COL_QUOTA_RESC_ID;
-        sprintf( v3, "='%s'", "0" );
-        condVal[genQueryInp.sqlCondInp.len] = v3;
-        genQueryInp.sqlCondInp.len++;
+        inputCond[i] = COL_QUOTA_RESC_ID;
+        condStr[i++] = "='0'";
+    }
+    else if ( rescName[0] != '\0' ) {
+        inputCond[i] = COL_QUOTA_RESC_NAME;
+        condStr[i++] = std::string( "='" ) + rescName + "'";
     }
 
-
+    for ( int k = 0; k < i; k++ ) {
+        condVal[k] = const_cast< char * >( condStr[k].c_str() );
+    }
     genQueryInp.sqlCondInp.inx = inputCond;
     genQueryInp.sqlCondInp.value = condVal;
+    genQueryInp.sqlCondInp.len = i;
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = MAX_SQL_ROWS;
+    status = queryToTable( conn, &genQueryInp, 5, table );
+    std::sort( table.rows.begin(), table.rows.end() );
+    return status;
+}
 
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
+/*
+  Show user or group quota information
+*/
+int
+showQuotas( const queryTable &table, int userOrGroup, int rescOrGlobal ) {
+    if ( table.status != 0 ) {
+        printError( Conn, table.status, "rcGenQuery" );
+        return table.status;
+    }
+    if ( table.rows.empty() ) {
         printf( "None\n\n" );
         return 0;
     }
-    if ( status != 0 ) {
-        printError( Conn, status, "rcGenQuery" );
-        return status;
-    }
-
-    if ( genQueryOut->rowCnt > 0 && printedTime == 0 ) {
-        for ( i = 0; i < 1; i++ ) {
-            for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
-                char *tResult;
-                long itime;
-
-                tResult = genQueryOut->sqlResult[j].value;
-                tResult += i * genQueryOut->sqlResult[j].len;
-                if ( j == 5 ) {
-                    itime = atoll( tResult );
-                    if ( itime > localiTime ) {
-                        localiTime = itime;
-                        getLocalTimeFromRodsTime( tResult, quotaTime );
-                    }
-                }
-            }
+
+    for ( size_t i = 0; i < table.rows.size(); i++ ) {
+        const tableRow &row = table.rows[i];
+        printf( "  Resource: %s\n", rescOrGlobal == 1 ? "All" : row[0].c_str() );
+        printf( "  %s%s\n", userOrGroup == 0 ? "User:  " : "Group:  ", row[1].c_str() );
+        printf( "  Zone:  %s\n", row[2].c_str() );
+        printf( "  Quota: %s\n", niceNumber( row[3].c_str(), "bytes" ).c_str() );
+
+        rodsLong_t ival = atoll( row[4].c_str() );
+        const char *state;
+        if ( ival > 0 ) {
+            state = "OVER QUOTA";
         }
-    }
-    printCount = 0;
-    for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-        for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
-            char *tResult;
-            long itime;
-            tResult = genQueryOut->sqlResult[j].value;
-            tResult += i * genQueryOut->sqlResult[j].len;
-            if ( j == 5 ) {
-                itime = atoll( tResult );
-                if ( itime > localiTime ) {
-                    localiTime = itime;
-                    getLocalTimeFromRodsTime( tResult, quotaTime );
-                }
-            }
-            else {
-                printf( "  %s", colName[j] );
-                if ( rescOrGlobal == 1 && j == 0 ) {
-                    tResult = "All";
-                }
-                if ( j == 4 || j == 3 ) {
-                    printNice( tResult, 0, "bytes" );
-                    if ( strncmp( colName[j], "Over:", 5 ) == 0 ) {
-                        rodsLong_t ival;
-                        ival = atoll( tResult );
-                        if ( ival > 0 ) {
-                            printf( " OVER QUOTA" );
-                        }
-                        else {
-                            if ( ival > QUOTA_APPROACH_WARNING_SIZE ) {
-                                printf( " (Nearing quota)" );
-                            }
-                            else {
-                                printf( " (under quota)" );
-                            }
-                        }
-
-                    }
-                    printf( "\n" );
-                }
-                else {
-                    printf( "%s\n", tResult );
-                }
-                printCount++;
-            }
+        else if ( ival > QUOTA_APPROACH_WARNING_SIZE ) {
+            state = "(Nearing quota)";
         }
+        else {
+            state = "(under quota)";
+        }
+        printf( "  Over:  %s %s\n", niceNumber( row[4].c_str(), "bytes" ).c_str(), state );
         printf( "\n" );
     }
     return 0;
 }
 
 /*
-  Show user quota information
+  Get user quota usage information, on the resource rescName only if it
+  is not empty
 */
 int
-showUserUsage( char *userName, char *usersZone ) {
+getUserUsage( rcComm_t *conn, const char *userName, const char *rescName,
+              queryTable &table ) {
     genQueryInp_t genQueryInp;
-    genQueryOut_t *genQueryOut;
-    int inputInx[20];
-    int inputVal[20] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    int inputCond[20];
-    char *condVal[10];
-    char v1[BIG_STR];
-    int i, j, k, status;
-    int printCount;
-    char header[] =
-        "Resource      User            Data-stored (bytes)";
-    char *pad[14] = {"             ",
-                     "            ",
-                     "           ",
-                     "          ",
-                     "         ",
-                     "        ",
-                     "       ",
-                     "      ",
-                     "     ",
-                     "    ",
-                     "   ",
-                     "  ",
-                     " ",
-                     ""
-                    };
+    int inputInx[5];
+    int inputVal[5] = {0, 0, 0, 0, 0};
+    int inputCond[2];
+    char *condVal[2];
+    int i;
 
     memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
-    printCount = 0;
     i = 0;
     inputInx[i++] = COL_QUOTA_USAGE_MODIFY_TIME;
     inputInx[i++] = COL_QUOTA_RESC_NAME;
@@ -336,113 +289,91 @@ showUserUsage( char *userName, char *usersZone ) {
     genQueryInp.selectInp.value = inputVal;
     genQueryInp.selectInp.len = i;
 
-    genQueryInp.sqlCondInp.len = 0;
+    std::string cond = std::string( "='" ) + userName + "'";
+    std::string rescCond = std::string( "='" ) + rescName + "'";
+    i = 0;
     if ( userName[0] != '\0' ) {
-        inputCond[0] = COL_QUOTA_USER_NAME;
-        sprintf( v1, "='%s'", userName );
-        condVal[0] = v1;
-
-        genQueryInp.sqlCondInp.inx = inputCond;
-        genQueryInp.sqlCondInp.value = condVal;
-        genQueryInp.sqlCondInp.len++;
+        inputCond[i] = COL_QUOTA_USER_NAME;
+        condVal[i++] = const_cast< char * >( cond.c_str() );
     }
+    if ( rescName[0] != '\0' ) {
+        inputCond[i] = COL_QUOTA_RESC_NAME;
+        condVal[i++] = const_cast< char * >( rescCond.c_str() );
+    }
+    genQueryInp.sqlCondInp.inx = inputCond;
+    genQueryInp.sqlCondInp.value = condVal;
+    genQueryInp.sqlCondInp.len = i;
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = MAX_SQL_ROWS;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
+    return queryToTable( conn, &genQueryInp, 0, table );
+}
+
+/*
+  Show user quota usage information as a table sorted by resource and
+  user, with each column as wide as its widest value
+*/
+int
+showUserUsage( queryTable &table, const char *usersZone ) {
+    if ( table.status != 0 ) {
+        printError( Conn, table.status, "rcGenQuery" );
+        return table.status;
+    }
+    if ( table.rows.empty() ) {
         printf( "No records found, run 'iadmin cu' to calculate usage\n" );
         return 0;
     }
-    if ( status != 0 ) {
-        printError( Conn, status, "rcGenQuery" );
-        return status;
-    }
-
-    printf( "%s\n", header );
-    printCount = 0;
-    k = 0;
-    for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-        for ( j = 1; j < genQueryOut->attriCnt; j++ ) {
-            char *tResult;
-            char *tResult2;
-            tResult = genQueryOut->sqlResult[j].value;
-            tResult += i * genQueryOut->sqlResult[j].len;
-            if ( j == 1 ) {
-                printf( "%s ", tResult );
-                k = strlen( tResult );
-            }
-            if ( j == 2 ) {
-                j++;
-                tResult2 = genQueryOut->sqlResult[j].value;
-                tResult2 += i * genQueryOut->sqlResult[j].len;
-                if ( strncmp( tResult2, usersZone, NAME_LEN ) == 0 ) {
-                    printf( "%s", tResult );
-                    k = strlen( tResult );
-                }
-                else {
-                    printf( "%s#%s", tResult, tResult2 );
-                    k = strlen( tResult ) + 1 + strlen( tResult2 );
-                }
-            }
-            if ( j == 4 ) {
-                printNice( tResult, 14, "" );
-                k = strlen( tResult );
-            }
-            if ( k < 14 ) {
-                printf( "%s", pad[k] );
-            }
-            printCount++;
+
+    /* resource, user, usage with commas, usage summary */
+    std::vector< tableRow > cells;
+    for ( size_t i = 0; i < table.rows.size(); i++ ) {
+        const tableRow &row = table.rows[i];
+        tableRow cell( 4 );
+        cell[0] = row[1];
+        cell[1] = row[2];
+        if ( row[3] != usersZone ) {
+            cell[1] += "#" + row[3];
         }
-        printf( "\n" );
+        cell[2] = withCommas( row[4].c_str(), cell[3] );
+        cells.push_back( cell );
     }
+    std::sort( cells.begin(), cells.end() );
 
-    const sqlResult_t *quota_usage_modify_time_result = getSqlResultByInx( genQueryOut, COL_QUOTA_USAGE_MODIFY_TIME );
-    if ( quota_usage_modify_time_result == NULL ) {
-        printf( "Error getting quota usage modify times.\n" );
-        return SYS_NULL_INPUT;
+    const char *header[] = { "Resource", "User", "Data-stored (bytes)" };
+    size_t width[3];
+    for ( int j = 0; j < 3; j++ ) {
+        width[j] = j < 2 ? strlen( header[j] ) : 0;
+        for ( size_t i = 0; i < cells.size(); i++ ) {
+            width[j] = std::max( width[j], cells[i][j].size() );
+        }
     }
-    long long localiTime = 0;
-    for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-        const char *tResult = quota_usage_modify_time_result->value + i * quota_usage_modify_time_result->len;
-        const long long itime = atoll( tResult );
-        if ( itime > localiTime ) {
-            localiTime = itime;
-            getLocalTimeFromRodsTime( tResult, quotaTime );
+
+    printf( "%-*s  %-*s  %s\n", ( int ) width[0], header[0],
+            ( int ) width[1], header[1], header[2] );
+    for ( size_t i = 0; i < cells.size(); i++ ) {
+        const tableRow &cell = cells[i];
+        printf( "%-*s  %-*s  %*s", ( int ) width[0], cell[0].c_str(),
+                ( int ) width[1], cell[1].c_str(),
+                ( int ) width[2], cell[2].c_str() );
+        if ( !cell[3].empty() ) {
+            printf( " %s", cell[3].c_str() );
         }
+        printf( "\n" );
     }
     return 0;
 }
 
 /*
-  Via a general query, show user group membership
+  Via a general query, get user group membership
 */
 int
-showUserGroupMembership( char *userNameIn, char *usersZone ) {
+getUserGroupMembership( rcComm_t *conn, const char *userName, const char *zoneName,
+                        queryTable &table ) {
     genQueryInp_t genQueryInp;
-    genQueryOut_t *genQueryOut;
-    int i1a[20];
-    int i1b[20] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-    int i2a[20];
-    char *condVal[10];
-    char v1[BIG_STR];
-    char v2[BIG_STR];
-    int i, j, status;
-    int printCount;
-    char userName[NAME_LEN];
-    char zoneName[NAME_LEN];
-    int showUserZone = 1;
-
-    status = parseUserName( userNameIn, userName, zoneName );
-    if ( status ) {
-        return status;
-    }
-    if ( zoneName[0] == '\0' ) {
-        snprintf( zoneName, sizeof( zoneName ), "%s", usersZone );
-        showUserZone = 0;
-    }
+    int i1a[1];
+    int i1b[1] = {0};
+    int i2a[2];
+    char *condVal[2];
 
     memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
 
@@ -451,13 +382,13 @@ showUserGroupMembership( char *userNameIn, char *usersZone ) {
     genQueryInp.selectInp.value = i1b;
     genQueryInp.selectInp.len = 1;
 
+    std::string v1 = std::string( "='" ) + userName + "'";
     i2a[0] = COL_USER_NAME;
-    snprintf( v1, sizeof v1, "='%s'", userName );
-    condVal[0] = v1;
+    condVal[0] = const_cast< char * >( v1.c_str() );
 
+    std::string v2 = std::string( "='" ) + zoneName + "'";
     i2a[1] = COL_USER_ZONE;
-    snprintf( v2, sizeof v2, "='%s'", zoneName );
-    condVal[1] = v2;
+    condVal[1] = const_cast< char * >( v2.c_str() );
 
     genQueryInp.sqlCondInp.inx = i2a;
     genQueryInp.sqlCondInp.value = condVal;
@@ -465,43 +396,96 @@ showUserGroupMembership( char *userNameIn, char *usersZone ) {
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = MAX_SQL_ROWS;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
+    int status = queryToTable( conn, &genQueryInp, -1, table );
+    std::sort( table.rows.begin(), table.rows.end() );
+    return status;
+}
+
+/*
+  Show user group membership
+*/
+int
+showUserGroupMembership( const queryTable &table, const char *userName,
+                         const char *zoneName, int showUserZone ) {
+    if ( table.status != 0 ) {
+        printError( Conn, table.status, "rcGenQuery" );
+        return table.status;
+    }
+    if ( table.rows.empty() ) {
         printf( "Not a member of any group\n" );
         return 0;
     }
-    if ( status != 0 ) {
-        printError( Conn, status, "rcGenQuery" );
-        return status;
-    }
 
-    printCount = 0;
     if ( showUserZone ) {
         printf( "User %s#%s is a member of groups: ", userName, zoneName );
     }
     else {
         printf( "User %s is a member of groups: ", userName );
     }
-    for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
-        for ( j = 0; j < genQueryOut->attriCnt; j++ ) {
-            char *tResult;
-            tResult = genQueryOut->sqlResult[j].value;
-            tResult += i * genQueryOut->sqlResult[j].len;
-            if ( printCount > 0 ) {
-                printf( ", %s", tResult );
-            }
-            else {
-                printf( "%s", tResult );
-            }
-            printCount++;
-        }
+    for ( size_t i = 0; i < table.rows.size(); i++ ) {
+        printf( i > 0 ? ", %s" : "%s", table.rows[i][0].c_str() );
     }
     printf( "\n" );
     return 0;
 }
 
+/*
+  Get the names of the resources, to split the per resource queries by
+*/
+int
+getResourceNames( rcComm_t *conn, std::vector< std::string > &rescNames ) {
+    genQueryInp_t genQueryInp;
+    int inputInx[1] = {COL_R_RESC_NAME};
+    int inputVal[1] = {0};
+
+    memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
+    genQueryInp.selectInp.inx = inputInx;
+    genQueryInp.selectInp.value = inputVal;
+    genQueryInp.selectInp.len = 1;
+    genQueryInp.condInput.len = 0;
+
+    queryTable table;
+    int status = queryToTable( conn, &genQueryInp, -1, table );
+    for ( size_t i = 0; i < table.rows.size(); i++ ) {
+        rescNames.push_back( table.rows[i][0] );
+    }
+    return status;
+}
+
+/*
+  Join the tables of the queries a query was split into, keeping the
+  first error and the latest modify time
+*/
+void
+mergeTables( const std::vector< queryTable > &parts, queryTable &table ) {
+    for ( size_t i = 0; i < parts.size(); i++ ) {
+        if ( table.status == 0 ) {
+            table.status = parts[i].status;
+        }
+        table.rows.insert( table.rows.end(), parts[i].rows.begin(), parts[i].rows.end() );
+        if ( parts[i].latestTime > table.latestTime ) {
+            table.latestTime = parts[i].latestTime;
+            table.latestTimeValue = parts[i].latestTimeValue;
+        }
+    }
+    std::sort( table.rows.begin(), table.rows.end() );
+}
+
+/*
+  Keep the latest of the tables' modify times as the time the quota
+  information was set
+*/
+void
+setQuotaTime( const std::vector< queryTable > &tables ) {
+    long long localiTime = 0;
+    for ( size_t i = 0; i < tables.size(); i++ ) {
+        if ( tables[i].latestTime > localiTime ) {
+            localiTime = tables[i].latestTime;
+            getLocalTimeFromRodsTime( tables[i].latestTimeValue.c_str(), quotaTime );
+        }
+    }
+}
+
 
 int
 main( int argc, char **argv ) {
@@ -564,24 +548,92 @@ main( int argc, char **argv ) {
         userName[0] = '\0';
     }
 
+    /* with every user listed, the per resource queries are split into
+       one query per resource, so that the pool can run them side by
+       side; an empty name stands for all the resources */
+    std::vector< std::string > rescNames;
+    if ( userName[0] == '\0' ) {
+        getResourceNames( Conn, rescNames );
+    }
+    if ( rescNames.empty() ) {
+        rescNames.push_back( "" );
+    }
+    size_t rescCount = rescNames.size();
+
     nArgs = argc - myRodsArgs.optind;
 
     if ( nArgs > 0 ) {
         if ( strncmp( argv[myRodsArgs.optind], "usage", 5 ) == 0 ) {
-            status = showUserUsage( userName, myEnv.rodsZone );
+            std::vector< queryTable > parts( rescCount );
+            icommands::connection_pool pool( myEnv, Conn );
+            pool.open( std::min< size_t >( rescCount, QUOTA_CONNECTIONS ) );
+            icommands::run_on_pool( pool, rescCount, [&]( rcComm_t * conn, size_t task ) {
+                getUserUsage( conn, userName, rescNames[task].c_str(), parts[task] );
+            } );
+            std::vector< queryTable > tables( 1 );
+            mergeTables( parts, tables[0] );
+            setQuotaTime( tables );
+            status = showUserUsage( tables[0], myEnv.rodsZone );
         }
         else {
             usage();
         }
     }
     else {
+        char memberName[NAME_LEN] = "";
+        char memberZone[NAME_LEN] = "";
+        int showMemberZone = 1;
+        int memberStatus = 0;
+        if ( userName[0] != '\0' ) {
+            memberStatus = parseUserName( userName, memberName, memberZone );
+            if ( memberZone[0] == '\0' ) {
+                snprintf( memberZone, sizeof( memberZone ), "%s", myEnv.rodsZone );
+                showMemberZone = 0;
+            }
+        }
+
+        /* the quota queries, and the group membership one, are independent
+           of each other, so they are run side by side, each on its own
+           connection, and printed once they have all finished.  the
+           first 2 * rescCount tasks are the per resource queries of
+           users and then of groups; the global queries and the
+           membership query are not split */
+        std::vector< queryTable > userParts( rescCount );
+        std::vector< queryTable > groupParts( rescCount );
+        std::vector< queryTable > tables( 5 );
+        int hasMembership = userName[0] != '\0' && memberStatus == 0;
+        size_t taskCount = 2 * rescCount + ( hasMembership ? 3 : 2 );
+        icommands::connection_pool pool( myEnv, Conn );
+        pool.open( std::min< size_t >( taskCount, QUOTA_CONNECTIONS ) );
+        icommands::run_on_pool( pool, taskCount, [&]( rcComm_t * conn, size_t task ) {
+            if ( task < rescCount ) {                       /* users, resc */
+                getQuotas( conn, userName, 0, 0, rescNames[task].c_str(), userParts[task] );
+            }
+            else if ( task < 2 * rescCount ) {              /* all groups, resc */
+                size_t resc = task - rescCount;
+                getQuotas( conn, "", 1, 0, rescNames[resc].c_str(), groupParts[resc] );
+            }
+            else if ( task == 2 * rescCount ) {             /* users, global */
+                getQuotas( conn, userName, 0, 1, "", tables[1] );
+            }
+            else if ( task == 2 * rescCount + 1 ) {         /* all groups, global */
+                getQuotas( conn, "", 1, 1, "", tables[3] );
+            }
+            else {
+                getUserGroupMembership( conn, memberName, memberZone, tables[4] );
+            }
+        } );
+        mergeTables( userParts, tables[0] );
+        mergeTables( groupParts, tables[2] );
+        setQuotaTime( tables );
+
         if ( userName[0] == '\0' ) {
             printf( "Resource quotas for users:\n" );
         }
         else {
             printf( "Resource quotas for user %s:\n", userName );
         }
-        status = showQuotas( userName, 0, 0 ); /* users, resc */
+        status = showQuotas( tables[0], 0, 0 );
 
         if ( userName[0] == '\0' ) {
             printf( "Global (total) quotas for users:\n" );
@@ -589,16 +641,17 @@ main( int argc, char **argv ) {
         else {
             printf( "Global (total) quotas for user %s:\n", userName );
         }
-        status = showQuotas( userName, 0, 1 ); /* users, global */
+        status = showQuotas( tables[1], 0, 1 );
 
         printf( "Group quotas on resources:\n" );
-        status = showQuotas( "", 1, 0 );     /* all groups, resc */
+        status = showQuotas( tables[2], 1, 0 );
 
         printf( "Group global (total) quotas:\n" );
-        status = showQuotas( "", 1, 1 );     /* all groups, global */
+        status = showQuotas( tables[3], 1, 1 );
 
-        if ( userName[0] != '\0' ) {
-            status = showUserGroupMembership( userName, myEnv.rodsZone );
+        if ( hasMembership ) {
+            status = showUserGroupMembership( tables[4], memberName, memberZone,
+                                              showMemberZone );
         }
     }
     if ( quotaTime[0] != '\0' ) {
@@ -8,11 +8,127 @@
 #include "parseCommandLine.h"
 #include "rodsPath.h"
 #include "rsyncUtil.h"
+#include "miscUtil.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
+#include "delta_sync.hpp"
+#include "catalog_sync.hpp"
 
 void usage();
 
+/*
+  Sync local files to iRODS sending only the blocks that changed since
+  the last --delta sync, with the parallel upload engine.
+*/
+int
+deltaSync( rcComm_t *conn, rodsEnv *myEnv, rodsArguments_t *myRodsArgs,
+           rodsPathInp_t *rodsPathInp, int workers, int scanners ) {
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        if ( rodsPathInp->srcPath[i].objType == LOCAL_DIR_T && myRodsArgs->recursive != True ) {
+            rodsLog( LOG_ERROR, "deltaSync: %s is a directory, use -r",
+                     rodsPathInp->srcPath[i].outPath );
+            return USER_INPUT_OPTION_ERR;
+        }
+    }
+
+    int status = resolveRodsTarget( conn, rodsPathInp, RSYNC_OPR );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "deltaSync: resolveRodsTarget error" );
+        return status;
+    }
+
+    icommands::upload_options opts;
+    opts.workers = workers;
+    opts.scanners = scanners;
+    opts.skip_links = myRodsArgs->link == True;
+    opts.verbose = myRodsArgs->verbose == True;
+    opts.progress = isatty( STDOUT_FILENO ) != 0;
+    if ( myRodsArgs->resource == True ) {
+        opts.resource = myRodsArgs->resourceString;
+    }
+    else if ( strlen( myEnv->rodsDefResource ) > 0 ) {
+        opts.resource = myEnv->rodsDefResource;
+    }
+
+    std::vector<std::string> sources;
+    std::vector<std::string> targets;
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        sources.push_back( rodsPathInp->srcPath[i].outPath );
+        targets.push_back( rodsPathInp->targPath[i].outPath );
+    }
+
+    icommands::delta_upload_engine engine( *myEnv, opts );
+    status = engine.run( conn, sources, targets );
+    printf( "%s; %.1f MB compared\n", engine.stats().summary().c_str(),
+            static_cast<double>( engine.scanned() ) / ( 1024 * 1024 ) );
+    return status;
+}
+
+/*
+  Sync local files to iRODS with the parallel upload engine, comparing
+  them against a listing of the target collections fetched up front
+  instead of asking the server about each file, and uploading those
+  that differ while the rest are still being compared.
+*/
+int
+parallelSync( rcComm_t *conn, rodsEnv *myEnv, rodsArguments_t *myRodsArgs,
+              rodsPathInp_t *rodsPathInp, int workers, int scanners ) {
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        if ( rodsPathInp->srcPath[i].objType == LOCAL_DIR_T && myRodsArgs->recursive != True ) {
+            rodsLog( LOG_ERROR, "parallelSync: %s is a directory, use -r",
+                     rodsPathInp->srcPath[i].outPath );
+            return USER_INPUT_OPTION_ERR;
+        }
+    }
+
+    int status = resolveRodsTarget( conn, rodsPathInp, RSYNC_OPR );
+    if ( status < 0 ) {
+        rodsLogError( LOG_ERROR, status, "parallelSync: resolveRodsTarget error" );
+        return status;
+    }
+
+    icommands::upload_options opts;
+    opts.workers = workers;
+    opts.scanners = scanners;
+    opts.skip_links = myRodsArgs->link == True;
+    opts.verbose = myRodsArgs->verbose == True;
+    opts.progress = myRodsArgs->longOption != True;
+    if ( myRodsArgs->number == True ) {
+        opts.num_threads = myRodsArgs->numberValue;
+    }
+    if ( myRodsArgs->resource == True ) {
+        opts.resource = myRodsArgs->resourceString;
+    }
+    else if ( strlen( myEnv->rodsDefResource ) > 0 ) {
+        opts.resource = myEnv->rodsDefResource;
+    }
+
+    icommands::sync_options sync;
+    sync.size_only = myRodsArgs->sizeFlag == True;
+    sync.list_only = myRodsArgs->longOption == True;
+    if ( myRodsArgs->age == True ) {
+        sync.max_age = static_cast<time_t>( myRodsArgs->agevalue ) * 60;
+    }
+
+    std::vector<std::string> sources;
+    std::vector<std::string> targets;
+    for ( int i = 0; i < rodsPathInp->numSrc; i++ ) {
+        sources.push_back( rodsPathInp->srcPath[i].outPath );
+        targets.push_back( rodsPathInp->targPath[i].outPath );
+    }
+
+    icommands::sync_upload_engine engine( *myEnv, opts, sync );
+    status = engine.run( conn, sources, targets );
+    if ( sync.list_only ) {
+        printf( "%lu files need synchronizing\n", static_cast<unsigned long>( engine.listed() ) );
+    }
+    else {
+        printf( "%s; %lu data objects in the catalog listing\n", engine.stats().summary().c_str(),
+                static_cast<unsigned long>( engine.index().objects() ) );
+    }
+    return status;
+}
+
 int
 main( int argc, char **argv ) {
 
@@ -29,6 +145,47 @@ main( int argc, char **argv ) {
     int nArgv;
     int i;
 
+    // --delta, --parallel and --scanners are not known to
+    // parseCmdLineOpt, so take them out of the arguments first
+    bool delta = false;
+    int parallel = 0;
+    int scanners = 0;
+    int nargs = 0;
+    for ( i = 0; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--delta" ) == 0 ) {
+            delta = true;
+            continue;
+        }
+        int *value = NULL;
+        const char *name = argv[i];
+        const char *arg = argv[i];
+        if ( strncmp( arg, "--parallel", 10 ) == 0 && ( arg[10] == '\0' || arg[10] == '=' ) ) {
+            value = &parallel;
+            arg += 10;
+        }
+        else if ( strncmp( arg, "--scanners", 10 ) == 0 && ( arg[10] == '\0' || arg[10] == '=' ) ) {
+            value = &scanners;
+            arg += 10;
+        }
+        if ( value == NULL ) {
+            argv[nargs++] = argv[i];
+            continue;
+        }
+        if ( *arg == '\0' && i + 1 < argc ) {
+            arg = argv[++i];
+        }
+        else if ( *arg == '=' ) {
+            arg++;
+        }
+        *value = atoi( arg );
+        if ( *value < 1 ) {
+            fprintf( stderr, "%.10s needs a number of at least 1\n", name );
+            printf( "use -h for help.\n" );
+            exit( 1 );
+        }
+    }
+    argc = nargs;
+    argv[argc] = NULL;
 
     optStr = "ahKlN:rR:svVZ";
 
@@ -100,6 +257,29 @@ main( int argc, char **argv ) {
         exit( 1 );
     }
 
+    if ( delta ) {
+        if ( srcType != UNKNOWN_FILE_T || destType != UNKNOWN_OBJ_T ) {
+            rodsLog( LOG_ERROR, "--delta only synchronizes local files to iRODS" );
+            exit( 1 );
+        }
+        if ( myRodsArgs.all == True || myRodsArgs.verifyChecksum == True ||
+                myRodsArgs.longOption == True || myRodsArgs.sizeFlag == True ||
+                myRodsArgs.age == True ) {
+            rodsLog( LOG_ERROR, "--delta cannot be used with -a, -K, -l, -s or --age" );
+            exit( 1 );
+        }
+    }
+    else if ( parallel > 0 || scanners > 0 ) {
+        if ( srcType != UNKNOWN_FILE_T || destType != UNKNOWN_OBJ_T ) {
+            rodsLog( LOG_ERROR, "--parallel only synchronizes local files to iRODS" );
+            exit( 1 );
+        }
+        if ( myRodsArgs.all == True || myRodsArgs.verifyChecksum == True ) {
+            rodsLog( LOG_ERROR, "--parallel cannot be used with -a or -K" );
+            exit( 1 );
+        }
+    }
+
     // =-=-=-=-=-=-=-
     // initialize pluggable api table
     irods::api_entry_table&  api_tbl = irods::get_client_api_table();
@@ -119,7 +299,17 @@ main( int argc, char **argv ) {
         exit( 7 );
     }
 
-    status = rsyncUtil( conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    if ( delta ) {
+        status = deltaSync( conn, &myEnv, &myRodsArgs, &rodsPathInp,
+                            parallel > 0 ? parallel : 4, scanners > 0 ? scanners : 4 );
+    }
+    else if ( parallel > 0 || scanners > 0 ) {
+        status = parallelSync( conn, &myEnv, &myRodsArgs, &rodsPathInp,
+                               parallel > 0 ? parallel : 4, scanners > 0 ? scanners : 4 );
+    }
+    else {
+        status = rsyncUtil( conn, &myEnv, &myRodsArgs, &rodsPathInp );
+    }
 
     printErrorStack( conn->rError );
     rcDisconnect( conn );
@@ -138,6 +328,11 @@ usage() {
     char *msgs[] = {
         "Usage: irsync [-rahKsvV] [-N numThreads] [-R resource] [--link] [--age age_in_minutes]",
         "          sourceFile|sourceDirectory [....] targetFile|targetDirectory",
+        "Usage: irsync --parallel N [--scanners N] [-rlsvV] [-N numThreads] [-R resource]",
+        "          [--link] [--age age_in_minutes]",
+        "          localFile|localDirectory [....] i:targetFile|i:targetCollection",
+        "Usage: irsync --delta [--parallel N] [--scanners N] [-rvV] [-R resource] [--link]",
+        "          localFile|localDirectory [....] i:targetFile|i:targetCollection",
         " ",
         "Synchronize the data between a local copy (local file system) and",
         "the copy stored in iRODS or between two iRODS copies. The command can be ",
@@ -214,6 +409,32 @@ usage() {
         "      synchronization.",
         " --age age_in_minutes - The maximum age of the source copy in minutes for sync.",
         "      i.e., age larger than age_in_minutes will not be synced.",
+        " --delta - synchronize local files to iRODS sending only the blocks that",
+        "      changed since the last --delta run.  The MD5 digests of each",
+        "      block of every file sent are kept in ~/.irods/delta_signatures",
+        "      and trusted only while the data object's size, modify time and",
+        "      checksum are those recorded after that run.  Otherwise the",
+        "      file is compared by size and checksum as without --delta, and",
+        "      sent whole only if it differs.  Files whose size and time have",
+        "      not changed since the last run are not read.  Changed blocks",
+        "      are written into the data object in place, so it suits large",
+        "      files modified in place, such as disk images and HDF5 files.",
+        "      Other replicas of a data object become stale.  Cannot be used",
+        "      with -a, -K, -l, -s or --age.",
+        " --parallel N - synchronize local files to iRODS with N connections",
+        "      (default 4) uploading at once.  The sizes, modify times and",
+        "      checksums of every data object under the targets are listed with",
+        "      a few paged queries before the local directories are read, and",
+        "      each file is compared against that listing as it is found;",
+        "      files that differ are uploaded while the rest are still being",
+        "      compared.  Sizes and checksums are compared as without",
+        "      --parallel, with the local checksum computed in the scheme of",
+        "      the data object's.  Only a data object that has no checksum",
+        "      yet needs a request to the server, which computes one.",
+        "      Uploads register a checksum.  Cannot be used with -a or -K.",
+        "      With --delta, the number of connections used.",
+        " --scanners N - the number of threads reading the local directories",
+        "      and comparing files (default 4).  Implies --parallel.",
         " ",
         "Also see 'irepl' for the replication and synchronization of physical",
         "copies (replica).",
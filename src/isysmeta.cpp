@@ -4,6 +4,7 @@
 #include "rodsClient.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
+#include "genquery_pager.hpp"
 
 void usage();
 
@@ -135,13 +136,12 @@ doLs( rcComm_t *Conn, char *objPath, int longOption ) {
     condVal[1] = v2;
     genQueryInp.sqlCondInp.len = 2;
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_R_RESC_INFO;
         genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             printf( "None\n" );
             return 0;
@@ -154,10 +154,9 @@ doLs( rcComm_t *Conn, char *objPath, int longOption ) {
 
     printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames,
                                         longOption );
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 && longOption ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 && longOption ) {
             printf( "----\n" );
         }
         printCount += printGenQueryResults( Conn, status, genQueryOut,
@@ -199,9 +198,8 @@ doListDataTypes( rcComm_t *Conn ) {
     condition_value[0] = value1;
     genQueryInp.sqlCondInp.len = 1;
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         printf( "None exist.\n" );
         return 0;
@@ -209,9 +207,8 @@ doListDataTypes( rcComm_t *Conn ) {
 
     printCount += printGenQueryResults( Conn, status, genQueryOut, 0,
                                         0 );
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
         printCount += printGenQueryResults( Conn, status, genQueryOut,
                                             0, 0 );
     }
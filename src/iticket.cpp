@@ -10,6 +10,11 @@
 #include "rods.h"
 #include "rodsClient.h"
 #include "irods_random.hpp"
+#include "genquery_pager.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
 
 #define MAX_SQL 300
 #define BIG_STR 3000
@@ -32,7 +37,16 @@ int printedRows = 0;
 
 int usage( char *subOpt );
 
-void showRestrictions( char *inColumn );
+struct ticketRestrictions {
+    std::map<std::string, std::vector<std::string> > hosts;
+    std::map<std::string, std::vector<std::string> > users;
+    std::map<std::string, std::vector<std::string> > groups;
+};
+
+int getRestrictions( genQueryOut_t *genQueryOut, int idIndex,
+                     ticketRestrictions& restrictions );
+void showRestrictions( const ticketRestrictions& restrictions,
+                       const std::string& ticketId );
 
 
 /*
@@ -56,6 +70,13 @@ printResultsAndSubQuery( rcComm_t *Conn, int status, genQueryOut_t *genQueryOut,
             }
         }
         else {
+            ticketRestrictions restrictions;
+            if ( subColumn >= 0 ) {
+                int rStatus = getRestrictions( genQueryOut, subColumn, restrictions );
+                if ( rStatus < 0 ) {
+                    printError( Conn, rStatus, "rcGenQuery" );
+                }
+            }
             for ( i = 0; i < genQueryOut->rowCnt; i++ ) {
                 printedRows++;
                 char *subCol = "";
@@ -86,207 +107,136 @@ printResultsAndSubQuery( rcComm_t *Conn, int status, genQueryOut_t *genQueryOut,
                     }
                 }
                 if ( subColumn >= 0 ) {
-                    showRestrictions( subCol );
+                    showRestrictions( restrictions, subCol );
                 }
             }
         }
     }
 }
 
-void
-showRestrictionsByHost( char *inColumn ) {
+/*
+ Query one kind of restriction (allowed hosts, users or groups) for the
+ tickets in ticketIds, adding the values to restrictions keyed by ticket
+ id.  The ids are sent in "in" lists of at most MAX_NAME_LEN characters,
+ one query each, so that the condition stays within what the server
+ accepts however many tickets are in the page.
+ */
+int
+queryRestrictions( int valueColumn, int idColumn,
+                   const std::vector<std::string>& ticketIds,
+                   std::map<std::string, std::vector<std::string> >& restrictions ) {
     genQueryInp_t genQueryInp;
     genQueryOut_t *genQueryOut;
-    int i1a[10];
-    int i1b[10];
-    int i2a[10];
-    int i;
-    char v1[MAX_NAME_LEN];
-    char *condVal[10];
-    int status;
-    char *columnNames[] = {"restricted-to host"};
-
-
-    memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
-
-    printCount = 0;
-
-    i = 0;
-    i1a[i] = COL_TICKET_ALLOWED_HOST;
-    i1b[i++] = 0;
-
-    genQueryInp.selectInp.inx = i1a;
-    genQueryInp.selectInp.value = i1b;
-    genQueryInp.selectInp.len = i;
-
-    i2a[0] = COL_TICKET_ALLOWED_HOST_TICKET_ID;
-    snprintf( v1, sizeof( v1 ), "='%s'", inColumn );
-    condVal[0] = v1;
-    genQueryInp.sqlCondInp.inx = i2a;
-    genQueryInp.sqlCondInp.value = condVal;
-    genQueryInp.sqlCondInp.len = 1;
-
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
-    genQueryInp.condInput.len = 0;
-
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-        i1a[0] = COL_USER_COMMENT;
-        genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( status == 0 ) {
-            printf( "No host restrictions (1)\n" );
-            return;
+    int status = 0;
+
+    for ( size_t next = 0; next < ticketIds.size() && status >= 0; ) {
+        std::string condition = "in (";
+        size_t first = next;
+        while ( next < ticketIds.size() &&
+                ( next == first ||
+                  condition.size() + ticketIds[next].size() + 5 < MAX_NAME_LEN ) ) {
+            if ( next > first ) {
+                condition += ", ";
+            }
+            condition += "'" + ticketIds[next++] + "'";
+        }
+        condition += ")";
+
+        memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
+        addInxIval( &genQueryInp.selectInp, idColumn, 1 );
+        addInxIval( &genQueryInp.selectInp, valueColumn, 1 );
+        addInxVal( &genQueryInp.sqlCondInp, idColumn, condition.c_str() );
+
+        {
+            icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut,
+                                             MAX_SQL_ROWS );
+            status = pager.first();
+            while ( status == 0 ) {
+                sqlResult_t *ids = getSqlResultByInx( genQueryOut, idColumn );
+                sqlResult_t *values = getSqlResultByInx( genQueryOut, valueColumn );
+                if ( ids == NULL || values == NULL ) {
+                    status = UNMATCHED_KEY_OR_INDEX;
+                    break;
+                }
+                for ( int i = 0; i < genQueryOut->rowCnt; i++ ) {
+                    restrictions[&ids->value[ids->len * i]].push_back(
+                        &values->value[values->len * i] );
+                }
+                if ( !pager.more() ) {
+                    break;
+                }
+                status = pager.next();
+            }
         }
+        clearGenQueryInp( &genQueryInp );
+
         if ( status == CAT_NO_ROWS_FOUND ) {
-            printf( "No host restrictions\n" );
-            return;
+            status = 0;
         }
     }
-
-    printResultsAndSubQuery( Conn, status, genQueryOut, columnNames, -1, 0 );
-
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        printResultsAndSubQuery( Conn, status, genQueryOut,
-                                 columnNames, 0, 0 );
-    }
-    return;
+    return status;
 }
 
-void
-showRestrictionsByUser( char *inColumn ) {
-    genQueryInp_t genQueryInp;
-    genQueryOut_t *genQueryOut;
-    int i1a[10];
-    int i1b[10];
-    int i2a[10];
-    int i;
-    char v1[MAX_NAME_LEN];
-    char *condVal[10];
-    int status;
-    char *columnNames[] = {"restricted-to user"};
-
-
-    memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
-
-    printCount = 0;
-
-    i = 0;
-    i1a[i] = COL_TICKET_ALLOWED_USER_NAME;
-    i1b[i++] = 0;
-
-    genQueryInp.selectInp.inx = i1a;
-    genQueryInp.selectInp.value = i1b;
-    genQueryInp.selectInp.len = i;
-
-    i2a[0] = COL_TICKET_ALLOWED_USER_TICKET_ID;
-    snprintf( v1, sizeof( v1 ), "='%s'", inColumn );
-    condVal[0] = v1;
-    genQueryInp.sqlCondInp.inx = i2a;
-    genQueryInp.sqlCondInp.value = condVal;
-    genQueryInp.sqlCondInp.len = 1;
-
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
-    genQueryInp.condInput.len = 0;
-
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-        i1a[0] = COL_USER_COMMENT;
-        genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( status == 0 ) {
-            printf( "No user restrictions (1)\n" );
-            return;
-        }
-        if ( status == CAT_NO_ROWS_FOUND ) {
-            printf( "No user restrictions\n" );
-            return;
-        }
+/*
+ Get the restrictions for every ticket in a page of tickets, whose ids
+ are in column idIndex, with one query per kind of restriction rather
+ than three per ticket.
+ */
+int
+getRestrictions( genQueryOut_t *genQueryOut, int idIndex,
+                 ticketRestrictions& restrictions ) {
+    std::vector<std::string> ticketIds;
+    for ( int i = 0; i < genQueryOut->rowCnt; i++ ) {
+        ticketIds.push_back( genQueryOut->sqlResult[idIndex].value +
+                             i * genQueryOut->sqlResult[idIndex].len );
+    }
+    if ( ticketIds.empty() ) {
+        return 0;
     }
 
-    printResultsAndSubQuery( Conn, status, genQueryOut, columnNames, -1, 0 );
-
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        printResultsAndSubQuery( Conn, status, genQueryOut,
-                                 columnNames, 0, 0 );
+    int status = queryRestrictions( COL_TICKET_ALLOWED_HOST,
+                                    COL_TICKET_ALLOWED_HOST_TICKET_ID,
+                                    ticketIds, restrictions.hosts );
+    if ( status < 0 ) {
+        return status;
     }
-    return;
+    status = queryRestrictions( COL_TICKET_ALLOWED_USER_NAME,
+                                COL_TICKET_ALLOWED_USER_TICKET_ID,
+                                ticketIds, restrictions.users );
+    if ( status < 0 ) {
+        return status;
+    }
+    return queryRestrictions( COL_TICKET_ALLOWED_GROUP_NAME,
+                              COL_TICKET_ALLOWED_GROUP_TICKET_ID,
+                              ticketIds, restrictions.groups );
 }
 
 void
-showRestrictionsByGroup( char *inColumn ) {
-    genQueryInp_t genQueryInp;
-    genQueryOut_t *genQueryOut;
-    int i1a[10];
-    int i1b[10];
-    int i2a[10];
-    int i;
-    char v1[MAX_NAME_LEN];
-    char *condVal[10];
-    int status;
-    char *columnNames[] = {"restricted-to group"};
-
-
-    memset( &genQueryInp, 0, sizeof( genQueryInp_t ) );
-
-    printCount = 0;
-
-    i = 0;
-    i1a[i] = COL_TICKET_ALLOWED_GROUP_NAME;
-    i1b[i++] = 0;
-
-    genQueryInp.selectInp.inx = i1a;
-    genQueryInp.selectInp.value = i1b;
-    genQueryInp.selectInp.len = i;
-
-    i2a[0] = COL_TICKET_ALLOWED_GROUP_TICKET_ID;
-    snprintf( v1, sizeof( v1 ), "='%s'", inColumn );
-    condVal[0] = v1;
-    genQueryInp.sqlCondInp.inx = i2a;
-    genQueryInp.sqlCondInp.value = condVal;
-    genQueryInp.sqlCondInp.len = 1;
-
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
-    genQueryInp.condInput.len = 0;
-
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-        i1a[0] = COL_USER_COMMENT;
-        genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( status == 0 ) {
-            printf( "No group restrictions (1)\n" );
-            return;
-        }
-        if ( status == CAT_NO_ROWS_FOUND ) {
-            printf( "No group restrictions\n" );
-            return;
-        }
+showRestrictionList( const std::map<std::string, std::vector<std::string> >& restrictions,
+                     const std::string& ticketId, const char *description,
+                     const char *noneMessage ) {
+    std::map<std::string, std::vector<std::string> >::const_iterator itr =
+        restrictions.find( ticketId );
+    if ( itr == restrictions.end() ) {
+        printf( "%s\n", noneMessage );
+        return;
+    }
+    for ( size_t i = 0; i < itr->second.size(); i++ ) {
+        printedRows++;
+        printf( "%s: %s\n", description, itr->second[i].c_str() );
+        printCount++;
     }
-
-    printResultsAndSubQuery( Conn, status, genQueryOut, columnNames, -1, 0 );
-
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        printResultsAndSubQuery( Conn, status, genQueryOut,
-                                 columnNames, 0, 0 );
-    }
-    return;
 }
 
 void
-showRestrictions( char *inColumn ) {
-    showRestrictionsByHost( inColumn );
-    showRestrictionsByUser( inColumn );
-    showRestrictionsByGroup( inColumn );
+showRestrictions( const ticketRestrictions& restrictions,
+                  const std::string& ticketId ) {
+    showRestrictionList( restrictions.hosts, ticketId,
+                         "restricted-to host", "No host restrictions" );
+    showRestrictionList( restrictions.users, ticketId,
+                         "restricted-to user", "No user restrictions" );
+    showRestrictionList( restrictions.groups, ticketId,
+                         "restricted-to group", "No group restrictions" );
     return;
 }
 
@@ -376,18 +326,16 @@ showTickets1( char *inOption, char *inName ) {
         genQueryInp.sqlCondInp.len = 1;
     }
 
-    genQueryInp.maxRows = 10;
-    genQueryInp.continueInx = 0;
-
     if ( zoneArgument[0] != '\0' ) {
         addKeyVal( &genQueryInp.condInput, ZONE_KW, zoneArgument );
     }
 
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    icommands::genquery_pager pager( Conn, &genQueryInp, &genQueryOut );
+    status = pager.first();
     if ( status == CAT_NO_ROWS_FOUND ) {
         i1a[0] = COL_USER_COMMENT;
         genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+        status = pager.first();
         if ( status == 0 ) {
             return 0;
         }
@@ -398,10 +346,9 @@ showTickets1( char *inOption, char *inName ) {
 
     printResultsAndSubQuery( Conn, status, genQueryOut, columnNames, 0, 1 );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( genQueryOut->rowCnt > 0 ) {
+    while ( status == 0 && pager.more() ) {
+        status = pager.next();
+        if ( status == 0 && genQueryOut->rowCnt > 0 ) {
             printf( "----\n" );
         }
         printResultsAndSubQuery( Conn, status, genQueryOut,
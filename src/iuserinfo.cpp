@@ -9,6 +9,7 @@
 #include "rodsClient.h"
 #include "irods_client_api_table.hpp"
 #include "irods_pack_table.hpp"
+#include "query_cache.hpp"
 
 #define MAX_SQL 300
 #define BIG_STR 200
@@ -17,11 +18,40 @@ char cwd[BIG_STR];
 
 int debug = 0;
 
-rcComm_t *Conn;
+rcComm_t *Conn = NULL;
 rodsEnv myEnv;
 
 void usage();
 
+/*
+ Connect to the server the first time a query is not answered from the
+ cache; exits as iuserinfo always has if that fails.
+ */
+rcComm_t *
+connectToServer() {
+    rErrMsg_t errMsg;
+    int status;
+
+    if ( Conn != NULL ) {
+        return Conn;
+    }
+
+    Conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
+                      myEnv.rodsZone, 0, &errMsg );
+
+    if ( Conn == NULL ) {
+        exit( 2 );
+    }
+
+    status = clientLogin( Conn );
+    if ( status != 0 ) {
+        if ( !debug ) {
+            exit( 3 );
+        }
+    }
+    return Conn;
+}
+
 /*
  print the results of a general query.
  */
@@ -62,7 +92,7 @@ printGenQueryResults( rcComm_t *Conn, int status, genQueryOut_t *genQueryOut,
 Via a general query, show user information
 */
 int
-showUser( char *name ) {
+showUser( char *name, const icommands::query_cache& cache ) {
     genQueryInp_t genQueryInp;
     genQueryOut_t *genQueryOut;
     int i1a[20];
@@ -104,24 +134,25 @@ showUser( char *name ) {
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = 2;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-        i1a[0] = COL_USER_COMMENT;
-        genQueryInp.selectInp.len = 1;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        if ( status == 0 ) {
-            printf( "None\n" );
-            return 0;
-        }
+    {
+        icommands::cached_pager<> pager( cache, connectToServer, &genQueryInp, &genQueryOut, 2 );
+        status = pager.first();
         if ( status == CAT_NO_ROWS_FOUND ) {
-            printf( "User %s does not exist.\n", name );
-            return 0;
+            i1a[0] = COL_USER_COMMENT;
+            genQueryInp.selectInp.len = 1;
+            status = pager.first();
+            if ( status == 0 ) {
+                printf( "None\n" );
+                return 0;
+            }
+            if ( status == CAT_NO_ROWS_FOUND ) {
+                printf( "User %s does not exist.\n", name );
+                return 0;
+            }
         }
-    }
 
-    printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames );
+        printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames );
+    }
 
 
     printCount = 0;
@@ -140,20 +171,20 @@ showUser( char *name ) {
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-    }
-    else {
-        printCount += printGenQueryResults( Conn, status, genQueryOut,
-                                            columnNames3 );
-
-        while ( status == 0 && genQueryOut->continueInx > 0 ) {
-            genQueryInp.continueInx = genQueryOut->continueInx;
-            status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
+    {
+        icommands::cached_pager<> pager( cache, connectToServer, &genQueryInp, &genQueryOut, 50 );
+        status = pager.first();
+        if ( status == CAT_NO_ROWS_FOUND ) {
+        }
+        else {
             printCount += printGenQueryResults( Conn, status, genQueryOut,
                                                 columnNames3 );
+
+            while ( status == 0 && pager.more() ) {
+                status = pager.next();
+                printCount += printGenQueryResults( Conn, status, genQueryOut,
+                                                    columnNames3 );
+            }
         }
     }
 
@@ -173,20 +204,20 @@ showUser( char *name ) {
 
     genQueryInp.condInput.len = 0;
 
-    genQueryInp.maxRows = 50;
-    genQueryInp.continueInx = 0;
-    status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-    if ( status == CAT_NO_ROWS_FOUND ) {
-        printf( "Not a member of any group\n" );
-        return 0;
-    }
-    printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames2 );
+    {
+        icommands::cached_pager<> pager( cache, connectToServer, &genQueryInp, &genQueryOut, 50 );
+        status = pager.first();
+        if ( status == CAT_NO_ROWS_FOUND ) {
+            printf( "Not a member of any group\n" );
+            return 0;
+        }
+        printCount += printGenQueryResults( Conn, status, genQueryOut, columnNames2 );
 
-    while ( status == 0 && genQueryOut->continueInx > 0 ) {
-        genQueryInp.continueInx = genQueryOut->continueInx;
-        status = rcGenQuery( Conn, &genQueryInp, &genQueryOut );
-        printCount += printGenQueryResults( Conn, status, genQueryOut,
-                                            columnNames2 );
+        while ( status == 0 && pager.more() ) {
+            status = pager.next();
+            printCount += printGenQueryResults( Conn, status, genQueryOut,
+                                                columnNames2 );
+        }
     }
 
     return 0;
@@ -198,12 +229,26 @@ main( int argc, char **argv ) {
     signal( SIGPIPE, SIG_IGN );
 
     int status, nArgs;
-    rErrMsg_t errMsg;
 
     rodsArguments_t myRodsArgs;
 
     rodsLogLevel( LOG_ERROR );
 
+    /* --no-cache is not known to parseCmdLineOpt, so take it out of the
+       arguments first */
+    bool useCache = true;
+    int n = 0;
+    for ( int i = 0; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--no-cache" ) == 0 ) {
+            useCache = false;
+        }
+        else {
+            argv[n++] = argv[i];
+        }
+    }
+    argc = n;
+    argv[argc] = NULL;
+
     status = parseCmdLineOpt( argc, argv, "vVh", 0, &myRodsArgs );
     if ( status ) {
         printf( "Use -h for help.\n" );
@@ -227,31 +272,23 @@ main( int argc, char **argv ) {
     irods::pack_entry_table& pk_tbl  = irods::get_pack_table();
     init_api_table( api_tbl, pk_tbl );
 
-    Conn = rcConnect( myEnv.rodsHost, myEnv.rodsPort, myEnv.rodsUserName,
-                      myEnv.rodsZone, 0, &errMsg );
-
-    if ( Conn == NULL ) {
-        exit( 2 );
-    }
-
-    status = clientLogin( Conn );
-    if ( status != 0 ) {
-        if ( !debug ) {
-            exit( 3 );
-        }
-    }
+    /* the connection is made by the first query that is not answered
+       from the cache */
+    icommands::query_cache cache( myEnv, useCache );
 
     nArgs = argc - myRodsArgs.optind;
 
     if ( nArgs == 1 ) {
-        status = showUser( argv[myRodsArgs.optind] );
+        status = showUser( argv[myRodsArgs.optind], cache );
     }
     else {
-        status = showUser( myEnv.rodsUserName );
+        status = showUser( myEnv.rodsUserName, cache );
     }
 
-    printErrorStack( Conn->rError );
-    rcDisconnect( Conn );
+    if ( Conn != NULL ) {
+        printErrorStack( Conn->rError );
+        rcDisconnect( Conn );
+    }
 
     exit( 0 );
 }
@@ -261,9 +298,13 @@ Print the main usage/help information.
  */
 void usage() {
     char *msgs[] = {
-        "Usage: iuserinfo [-vVh] [user]",
+        "Usage: iuserinfo [-vVh] [--no-cache] [user]",
         " ",
         "Show information about your iRODS user account or the entered user",
+        " ",
+        "If IRODS_QUERY_CACHE_TTL is set to a number of seconds, query results are",
+        "kept in ~/.irods/query_cache and reused for that long by later invocations;",
+        "--no-cache queries the server regardless.",
         ""
     };
     int i;
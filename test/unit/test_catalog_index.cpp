@@ -0,0 +1,139 @@
+#include "catalog_sync.hpp"
+#include "unit_test.hpp"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace icommands;
+
+namespace {
+
+    // =-=-=-=-=-=-=-
+    // a page of general query results built in memory, with each
+    // column's values in fixed width cells as the server returns them
+    class query_page {
+    public:
+        explicit query_page( int _rows ) {
+            memset( &out_, 0, sizeof( out_ ) );
+            out_.rowCnt = _rows;
+        }
+
+        void add_column( int _inx, const std::vector< std::string >& _values ) {
+            size_t width = 1;
+            for ( size_t i = 0; i < _values.size(); ++i ) {
+                width = std::max( width, _values[ i ].size() + 1 );
+            }
+            cells_.push_back( std::string( width * _values.size(), '\0' ) );
+            std::string& cells = cells_.back();
+            for ( size_t i = 0; i < _values.size(); ++i ) {
+                cells.replace( i * width, _values[ i ].size(), _values[ i ] );
+            }
+
+            sqlResult_t& result = out_.sqlResult[ out_.attriCnt++ ];
+            result.attriInx = _inx;
+            result.len      = static_cast< int >( width );
+            result.value    = &cells[ 0 ];
+        }
+
+        genQueryOut_t* get() {
+            return &out_;
+        }
+
+    private:
+        genQueryOut_t             out_;
+        std::deque< std::string > cells_;  // a deque, as the cells must not move
+
+    }; // class query_page
+
+    void add_columns( query_page& _page ) {
+        _page.add_column( COL_COLL_NAME, { "/tempZone/home/rods", "/", "/tempZone/home/rods", "/tempZone/home/rods" } );
+        _page.add_column( COL_DATA_NAME, { "a.txt", "top", "b.txt", "a.txt" } );
+        _page.add_column( COL_DATA_SIZE, { "1234", "0", "9876543210", "99" } );
+        _page.add_column( COL_D_MODIFY_TIME, { "01500000000", "1", "1600000000", "2" } );
+        _page.add_column( COL_D_DATA_CHECKSUM, { "sha2:abc=", "", "0123456789abcdef", "other" } );
+    }
+
+    void test_rows() {
+        query_page page( 4 );
+        page.add_column( COL_D_DATA_CHECKSUM, { "sha2:abc=", "", "0123456789abcdef", "other" } );
+        page.add_column( COL_DATA_SIZE, { "1234", "0", "9876543210", "99" } );
+        page.add_column( COL_COLL_NAME, { "/tempZone/home/rods", "/", "/tempZone/home/rods", "/tempZone/home/rods" } );
+        page.add_column( COL_D_MODIFY_TIME, { "01500000000", "1", "1600000000", "2" } );
+        page.add_column( COL_DATA_NAME, { "a.txt", "top", "b.txt", "a.txt" } );
+
+        catalog_index index;
+        CHECK( index.add_rows( page.get() ) == 0 );
+        CHECK( index.objects() == 3 );
+
+        const catalog_entry* a = index.find( "/tempZone/home/rods/a.txt" );
+        CHECK( a != NULL );
+        if ( a != NULL ) {
+            // the first of several replicas is kept
+            CHECK( a->size == 1234 );
+            CHECK( a->modify_time == 1500000000 );
+            CHECK( a->checksum == "sha2:abc=" );
+        }
+
+        const catalog_entry* b = index.find( "/tempZone/home/rods/b.txt" );
+        CHECK( b != NULL );
+        if ( b != NULL ) {
+            CHECK( b->size == 9876543210LL );
+            CHECK( b->checksum == "0123456789abcdef" );
+        }
+
+        // no doubled slash under the root collection
+        const catalog_entry* top = index.find( "/top" );
+        CHECK( top != NULL );
+        if ( top != NULL ) {
+            CHECK( top->size == 0 );
+            CHECK( top->checksum.empty() );
+        }
+
+        CHECK( index.find( "/tempZone/home/rods" ) == NULL );
+        CHECK( index.find( "/tempZone/home/rods/c.txt" ) == NULL );
+        CHECK( !index.has_collection( "/tempZone/home/rods" ) );
+    }
+
+    void test_pages() {
+        catalog_index index;
+        query_page first( 4 );
+        add_columns( first );
+        CHECK( index.add_rows( first.get() ) == 0 );
+
+        query_page second( 1 );
+        second.add_column( COL_COLL_NAME, { "/tempZone/home/rods/sub" } );
+        second.add_column( COL_DATA_NAME, { "c.txt" } );
+        second.add_column( COL_DATA_SIZE, { "5" } );
+        second.add_column( COL_D_MODIFY_TIME, { "3" } );
+        second.add_column( COL_D_DATA_CHECKSUM, { "" } );
+        CHECK( index.add_rows( second.get() ) == 0 );
+        CHECK( index.objects() == 4 );
+        CHECK( index.find( "/tempZone/home/rods/sub/c.txt" ) != NULL );
+
+        query_page empty( 0 );
+        add_columns( empty );
+        CHECK( index.add_rows( empty.get() ) == 0 );
+        CHECK( index.objects() == 4 );
+    }
+
+    void test_missing_column() {
+        query_page page( 1 );
+        page.add_column( COL_COLL_NAME, { "/tempZone" } );
+        page.add_column( COL_DATA_NAME, { "x" } );
+        page.add_column( COL_DATA_SIZE, { "1" } );
+        page.add_column( COL_D_MODIFY_TIME, { "1" } );
+
+        catalog_index index;
+        CHECK( index.add_rows( page.get() ) == UNMATCHED_KEY_OR_INDEX );
+        CHECK( index.objects() == 0 );
+    }
+
+}
+
+int main() {
+    test_rows();
+    test_pages();
+    test_missing_column();
+    return unit_test::result();
+}
@@ -0,0 +1,101 @@
+#include "format_program.hpp"
+#include "unit_test.hpp"
+
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
+
+using namespace icommands;
+
+namespace {
+
+    // compile _format and render it with _args, or return the error
+    std::string render( const char* _format, const char* const* _args, size_t _nargs ) {
+        format_program program;
+        if ( !program.compile( _format ) ) {
+            return program.error();
+        }
+        std::string out;
+        program.render( _args, _nargs, out );
+        return out;
+    }
+
+    void test_literals() {
+        CHECK( render( "plain text", NULL, 0 ) == "plain text" );
+        CHECK( render( "100%% done", NULL, 0 ) == "100% done" );
+        CHECK( render( "", NULL, 0 ) == "" );
+    }
+
+    void test_fields() {
+        const char* args[] = { "rods", "tempZone", "12345" };
+        CHECK( render( "%s#%s %s", args, 3 ) == "rods#tempZone 12345" );
+        CHECK( render( "[%8s]", args, 1 ) == "[    rods]" );
+        CHECK( render( "[%-8s]", args, 1 ) == "[rods    ]" );
+        CHECK( render( "[%.2s]", args, 1 ) == "[ro]" );
+        CHECK( render( "[%-6.3s]", args, 1 ) == "[rod   ]" );
+        CHECK( render( "[%08d]", args + 2, 1 ) == "[00012345]" );
+        CHECK( render( "[%3s]", args + 2, 1 ) == "[12345]" );
+    }
+
+    void test_positional() {
+        const char* args[] = { "a", "b" };
+        CHECK( render( "%2$s %1$s", args, 2 ) == "b a" );
+        CHECK( render( "%2% %1% %2%", args, 2 ) == "b a b" );
+        CHECK( render( "%|4s|%|-3|", args, 2 ) == "   ab  " );
+    }
+
+    void test_errors() {
+        const char* args[] = { "a", "b" };
+        CHECK( render( "%", NULL, 0 ).find( "bad_format_string" ) != std::string::npos );
+        CHECK( render( "%5", NULL, 0 ).find( "bad_format_string" ) != std::string::npos );
+        CHECK( render( "%y", NULL, 0 ).find( "bad_format_string" ) != std::string::npos );
+        CHECK( render( "%s %s", args, 1 ).find( "too_few_args" ) != std::string::npos );
+        CHECK( render( "%s", args, 2 ).find( "too_many_args" ) != std::string::npos );
+
+        format_program program;
+        CHECK( !program.compiled() );
+        CHECK( !program.compile( "%q" ) );
+        CHECK( !program.compiled() );
+        CHECK( program.compile( "%s" ) );
+        CHECK( program.compiled() );
+        CHECK( program.error().empty() );
+    }
+
+    void test_reuse() {
+        format_program program;
+        CHECK( program.compile( "%s=%s;" ) );
+        std::string out;
+        const char* first[] = { "x", "1" };
+        const char* second[] = { "y", "2" };
+        CHECK( program.render( first, 2, out ) );
+        CHECK( program.render( second, 2, out ) );
+        CHECK( out == "x=1;y=2;" );
+    }
+
+    void test_views() {
+        // views are rendered by their size, not up to a terminating NUL
+        const char text[] = "alphabetagamma";
+        std::vector< boost::string_ref > args;
+        args.push_back( boost::string_ref( text, 5 ) );
+        args.push_back( boost::string_ref( text + 5, 4 ) );
+        args.push_back( boost::string_ref( text + 9, 0 ) );
+
+        format_program program;
+        CHECK( program.compile( "[%-6s|%.2s|%3s]" ) );
+        std::string out;
+        CHECK( program.render( args.data(), args.size(), out ) );
+        CHECK( out == "[alpha |be|   ]" );
+    }
+
+}
+
+int main() {
+    test_literals();
+    test_fields();
+    test_positional();
+    test_errors();
+    test_reuse();
+    test_views();
+    return unit_test::result();
+}
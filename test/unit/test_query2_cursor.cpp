@@ -0,0 +1,195 @@
+#include "query2_cursor.hpp"
+#include "unit_test.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace query2;
+
+// =-=-=-=-=-=-=-
+// stands in for the server's query2 api: the reply handed to
+// for_each_row is whatever the test last put in fake_reply.  this
+// definition is used ahead of the one in the client library.
+namespace {
+    const char* fake_reply = "";
+    int         fake_status = 0;
+}
+
+int query( rcComm_t*, const char*, const char*, char** _res ) {
+    *_res = strdup( fake_reply );
+    return fake_status;
+}
+
+namespace {
+
+    // read every row of _json, returning the status of the last next()
+    int read_all( const std::string& _json, std::vector< std::vector< std::string > >& _rows ) {
+        std::vector< char > buffer( _json.begin(), _json.end() );
+        buffer.push_back( '\0' );
+        cursor cur( &buffer[ 0 ] );
+        row_t  row;
+        int    status;
+        _rows.clear();
+        while ( ( status = cur.next( row ) ) > 0 ) {
+            std::vector< std::string > cells;
+            for ( size_t i = 0; i < row.size(); ++i ) {
+                cells.push_back( row[ i ].to_string() );
+            }
+            _rows.push_back( cells );
+        }
+        return status;
+    }
+
+    void test_rows() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( " [ [\"a\", \"b\"],\n[\"c\",\"d\"] ] ", rows ) == 0 );
+        CHECK( rows.size() == 2 );
+        if ( rows.size() != 2 ) {
+            return;
+        }
+        CHECK( rows[ 0 ] == std::vector< std::string >( { "a", "b" } ) );
+        CHECK( rows[ 1 ] == std::vector< std::string >( { "c", "d" } ) );
+
+        CHECK( read_all( "[[]]", rows ) == 0 );
+        CHECK( rows.size() == 1 && rows[ 0 ].empty() );
+    }
+
+    void test_escapes() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( "[[\"q\\\"b\\\\s\\/f\", \"\\b\\f\\n\\r\\t\"]]", rows ) == 0 );
+        CHECK( rows.size() == 1 );
+        if ( rows.size() != 1 ) {
+            return;
+        }
+        CHECK( rows[ 0 ][ 0 ] == "q\"b\\s/f" );
+        CHECK( rows[ 0 ][ 1 ] == "\b\f\n\r\t" );
+    }
+
+    void test_unicode() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( "[[\"\\u0041\", \"\\u00e9\", \"\\u20AC\", \"\\ud83d\\ude00\"]]", rows ) == 0 );
+        CHECK( rows.size() == 1 );
+        if ( rows.size() != 1 ) {
+            return;
+        }
+        CHECK( rows[ 0 ][ 0 ] == "A" );
+        CHECK( rows[ 0 ][ 1 ] == "\xC3\xA9" );
+        CHECK( rows[ 0 ][ 2 ] == "\xE2\x82\xAC" );
+        CHECK( rows[ 0 ][ 3 ] == "\xF0\x9F\x98\x80" );
+
+        // a high surrogate that is not followed by a low one is kept alone
+        CHECK( read_all( "[[\"\\ud83dx\"]]", rows ) == 0 );
+        CHECK( rows.size() == 1 && rows[ 0 ][ 0 ] == "\xED\xA0\xBDx" );
+    }
+
+    void test_literals() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( "[[null, 12, -1.5, true, \"null\"]]", rows ) == 0 );
+        CHECK( rows.size() == 1 );
+        if ( rows.size() != 1 ) {
+            return;
+        }
+        CHECK( rows[ 0 ] == std::vector< std::string >( { "", "12", "-1.5", "true", "null" } ) );
+    }
+
+    void test_objects() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( "[{\"a\": \"x\", \"v\": null}, {\"a\":\"y\",\"v\":\"z\"}]", rows ) == 0 );
+        CHECK( rows.size() == 2 );
+        if ( rows.size() != 2 ) {
+            return;
+        }
+        CHECK( rows[ 0 ] == std::vector< std::string >( { "x", "" } ) );
+        CHECK( rows[ 1 ] == std::vector< std::string >( { "y", "z" } ) );
+    }
+
+    void test_malformed() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( "{}", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[\"a\"]", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[[\"a\" \"b\"]]", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[[\"unterminated]]", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[[\"\\q\"]]", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[[\"\\u12g4\"]]", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[[,]]", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( read_all( "[{\"a\" \"x\"}]", rows ) == SYS_INVALID_INPUT_PARAM );
+
+        // rows read before the error are still handed out
+        CHECK( read_all( "[[\"a\"], [\"b\"", rows ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( rows.size() == 1 );
+
+        // the error is sticky
+        char json[] = "[x";
+        cursor cur( json );
+        row_t  row;
+        CHECK( cur.next( row ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( cur.next( row ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( cur.status() == SYS_INVALID_INPUT_PARAM );
+    }
+
+    void test_empty() {
+        std::vector< std::vector< std::string > > rows;
+        CHECK( read_all( "", rows ) == 0 );
+        CHECK( read_all( "  []  ", rows ) == 0 );
+        CHECK( rows.empty() );
+
+        cursor none( NULL );
+        row_t  row;
+        CHECK( none.next( row ) == 0 );
+    }
+
+    void test_for_each_row() {
+        rcComm_t conn;
+        memset( &conn, 0, sizeof( conn ) );
+        int count = 0;
+        auto counter = [&count]( const row_t& ) {
+            ++count;
+            return 0;
+        };
+
+        fake_reply = "[[\"a\"],[\"b\"],[\"c\"]]";
+        CHECK( for_each_row( &conn, "q", "h", counter ) == 0 );
+        CHECK( count == 3 );
+
+        count = 0;
+        CHECK( for_each_row( &conn, "q", "h", [&count]( const row_t& ) {
+            return ++count == 2 ? STOP_ITERATION : 0;
+        } ) == 0 );
+        CHECK( count == 2 );
+
+        CHECK( for_each_row( &conn, "q", "h", []( const row_t& ) {
+            return SYS_INTERNAL_ERR;
+        } ) == SYS_INTERNAL_ERR );
+
+        // an empty reply, or an empty array, is reported as no rows
+        count = 0;
+        fake_reply = "";
+        CHECK( for_each_row( &conn, "q", "h", counter ) == CAT_NO_ROWS_FOUND );
+        fake_reply = "[]";
+        CHECK( for_each_row( &conn, "q", "h", counter ) == CAT_NO_ROWS_FOUND );
+        CHECK( count == 0 );
+
+        fake_reply = "[[\"a\"";
+        CHECK( for_each_row( &conn, "q", "h", counter ) == SYS_INVALID_INPUT_PARAM );
+
+        fake_reply = "";
+        fake_status = SYS_NO_API_PRIV;
+        CHECK( for_each_row( &conn, "q", "h", counter ) == SYS_NO_API_PRIV );
+        fake_status = 0;
+    }
+
+}
+
+int main() {
+    test_rows();
+    test_escapes();
+    test_unicode();
+    test_literals();
+    test_objects();
+    test_malformed();
+    test_empty();
+    test_for_each_row();
+    return unit_test::result();
+}
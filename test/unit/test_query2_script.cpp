@@ -0,0 +1,84 @@
+#include "query2_script.hpp"
+#include "unit_test.hpp"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace query2;
+
+namespace {
+
+    bool parse( const std::string& _text, std::vector< script_statement >& _stmts, std::string& _error ) {
+        std::istringstream in( _text );
+        return parse_script( in, _stmts, _error );
+    }
+
+    void test_statements() {
+        std::vector< script_statement > stmts;
+        std::string error;
+        CHECK( parse( "# the AVUs on the home collection\n"
+                      "query:  COLL_NAME(cid, \"/tempZone/home/rods\")\n"
+                      "        META_2(cid, a, v, u)\n"
+                      "header: a v u\n"
+                      "format: csv\n"
+                      "output: avus.csv\n"
+                      "\n"
+                      "query: DATA_NAME(d, n)\r\n"
+                      "header: n\r\n"
+                      "query: USER_NAME(u, name)\n",
+                      stmts, error ) );
+        CHECK( error.empty() );
+        CHECK( stmts.size() == 3 );
+        if ( stmts.size() != 3 ) {
+            return;
+        }
+
+        CHECK( stmts[ 0 ].line == 2 );
+        CHECK( stmts[ 0 ].query == "COLL_NAME(cid, \"/tempZone/home/rods\") META_2(cid, a, v, u)" );
+        CHECK( stmts[ 0 ].header == "a v u" );
+        CHECK( stmts[ 0 ].format == "csv" );
+        CHECK( stmts[ 0 ].output == "avus.csv" );
+
+        CHECK( stmts[ 1 ].line == 8 );
+        CHECK( stmts[ 1 ].query == "DATA_NAME(d, n)" );
+        CHECK( stmts[ 1 ].header == "n" );
+        CHECK( stmts[ 1 ].format.empty() );
+        CHECK( stmts[ 1 ].output == "-" );
+
+        CHECK( stmts[ 2 ].line == 10 );
+        CHECK( stmts[ 2 ].query == "USER_NAME(u, name)" );
+        CHECK( stmts[ 2 ].header.empty() );
+    }
+
+    void test_empty() {
+        std::vector< script_statement > stmts;
+        std::string error;
+        CHECK( parse( "", stmts, error ) );
+        CHECK( parse( "# nothing but comments\n\n   \n", stmts, error ) );
+        CHECK( stmts.empty() );
+    }
+
+    void test_errors() {
+        std::vector< script_statement > stmts;
+        std::string error;
+        CHECK( !parse( "header: a\n", stmts, error ) );
+        CHECK( error == "line 1: statement has no query" );
+        CHECK( !parse( "  continued\n", stmts, error ) );
+        CHECK( error == "line 1: continuation line with nothing to continue" );
+        CHECK( !parse( "query: X(a)\nno colon here\n", stmts, error ) );
+        CHECK( error == "line 2: expected key: value" );
+        CHECK( !parse( "query: X(a)\nsort: a\n", stmts, error ) );
+        CHECK( error == "line 2: unknown key sort" );
+        CHECK( !parse( "query: X(a)\n\nformat: csv\n", stmts, error ) );
+        CHECK( error == "line 3: statement has no query" );
+    }
+
+}
+
+int main() {
+    test_statements();
+    test_empty();
+    test_errors();
+    return unit_test::result();
+}
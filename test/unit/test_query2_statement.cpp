@@ -0,0 +1,75 @@
+#include "query2_statement.hpp"
+#include "unit_test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace query2;
+
+namespace {
+
+    std::string bound( const std::string& _text, const std::vector< std::string >& _args ) {
+        std::string out = "unchanged";
+        if ( statement( _text ).bind( _args, out ) < 0 ) {
+            return "error";
+        }
+        return out;
+    }
+
+    void test_placeholders() {
+        CHECK( statement( "USER_NAME(u, n)" ).parameter_count() == 0 );
+        CHECK( statement( "COLL_NAME(cid, ?) DATA_NAME_2(oid, ?)" ).parameter_count() == 2 );
+        CHECK( statement( "?" ).parameter_count() == 1 );
+
+        CHECK( bound( "USER_NAME(u, n)", {} ) == "USER_NAME(u, n)" );
+        CHECK( bound( "COLL_NAME(cid, ?) DATA_NAME_2(oid, ?)", { "/z/home", "f" } ) ==
+               "COLL_NAME(cid, \"/z/home\") DATA_NAME_2(oid, \"f\")" );
+        CHECK( bound( "?", { "" } ) == "\"\"" );
+        CHECK( bound( "??", { "a", "b" } ) == "\"a\"\"b\"" );
+    }
+
+    void test_quoting() {
+        // quotes and backslashes in arguments are escaped, nothing else is
+        CHECK( bound( "X(a, ?)", { "say \"hi\"" } ) == "X(a, \"say \\\"hi\\\"\")" );
+        CHECK( bound( "X(a, ?)", { "C:\\dir\\" } ) == "X(a, \"C:\\\\dir\\\\\")" );
+        CHECK( bound( "X(a, ?)", { "\\\"" } ) == "X(a, \"\\\\\\\"\")" );
+        CHECK( bound( "X(a, ?)", { "it's ? % _\n" } ) == "X(a, \"it's ? % _\n\")" );
+
+        // an argument cannot close the literal it is bound into
+        CHECK( bound( "X(a, ?) Y(b, ?)", { "\") Z(c, \"", "y" } ) ==
+               "X(a, \"\\\") Z(c, \\\"\") Y(b, \"y\")" );
+    }
+
+    void test_literals() {
+        // a ? inside a quoted literal of the template is kept as text
+        CHECK( statement( "X(a, \"?\") Y(b, ?)" ).parameter_count() == 1 );
+        CHECK( bound( "X(a, \"?\") Y(b, ?)", { "v" } ) == "X(a, \"?\") Y(b, \"v\")" );
+
+        // as is one after an escaped quote inside the literal
+        CHECK( statement( "X(a, \"\\\"?\") Y(b, ?)" ).parameter_count() == 1 );
+        CHECK( bound( "X(a, \"\\\"?\") Y(b, ?)", { "v" } ) == "X(a, \"\\\"?\") Y(b, \"v\")" );
+        CHECK( statement( "X(a, \"\\\\\") Y(b, ?)" ).parameter_count() == 1 );
+    }
+
+    void test_errors() {
+        statement stmt( "X(a, ?) Y(b, ?)" );
+        std::string out;
+        CHECK( stmt.bind( { "one" }, out ) == SYS_INVALID_INPUT_PARAM );
+        CHECK( stmt.bind( { "one", "two", "three" }, out ) == SYS_INVALID_INPUT_PARAM );
+
+        // a statement can be bound again, and the output is replaced
+        out = "stale";
+        CHECK( stmt.bind( { "1", "2" }, out ) == 0 );
+        CHECK( stmt.bind( { "3", "4" }, out ) == 0 );
+        CHECK( out == "X(a, \"3\") Y(b, \"4\")" );
+    }
+
+}
+
+int main() {
+    test_placeholders();
+    test_quoting();
+    test_literals();
+    test_errors();
+    return unit_test::result();
+}
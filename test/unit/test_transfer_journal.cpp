@@ -0,0 +1,182 @@
+#include "transfer_journal.hpp"
+#include "unit_test.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace icommands;
+
+namespace {
+
+    std::string journal_path;
+
+    off_t file_size() {
+        struct stat st;
+        return stat( journal_path.c_str(), &st ) == 0 ? st.st_size : -1;
+    }
+
+    void write_file( const std::string& _text ) {
+        FILE* f = fopen( journal_path.c_str(), "wb" );
+        fwrite( _text.data(), 1, _text.size(), f );
+        fclose( f );
+    }
+
+    std::string read_file() {
+        std::string text;
+        FILE* f = fopen( journal_path.c_str(), "rb" );
+        char buf[ 256 ];
+        size_t n;
+        while ( ( n = fread( buf, 1, sizeof( buf ), f ) ) > 0 ) {
+            text.append( buf, n );
+        }
+        fclose( f );
+        return text;
+    }
+
+    void test_hash() {
+        std::string a( "a" ), ab( "ab" ), ba( "ba" ), bc( "bc" ), c( "c" );
+        CHECK( journal_hash( ab ) != journal_hash( ba ) );
+        CHECK( journal_hash( c, journal_hash( ab ) ) != journal_hash( bc, journal_hash( a ) ) );
+        CHECK( journal_hash( ab ) == journal_hash( ab.c_str(), ab.size() + 1 ) );
+    }
+
+    void test_replay() {
+        unlink( journal_path.c_str() );
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == 0 );
+            CHECK( journal.chunk_size() == 4096 );
+            CHECK( journal.finished() == 0 );
+            CHECK( journal.start( 1 ) == 0 );
+            CHECK( journal.finish( 1 ) == 0 );
+            CHECK( journal.start( 2 ) == 0 );
+            CHECK( journal.chunk( 2, 0 ) == 0 );
+            CHECK( journal.chunk( 2, 3 ) == 0 );
+            CHECK( journal.start( 3 ) == 0 );
+            CHECK( journal.abort( 3 ) == 0 );
+            CHECK( journal.start( 4 ) == 0 );
+            CHECK( journal.close() == 0 );
+        }
+        CHECK( file_size() == 32 + 8 * 16 );
+
+        // the chunk size is the one the journal was created with
+        transfer_journal journal;
+        CHECK( journal.open( journal_path, 7, 8192 ) == 0 );
+        CHECK( journal.chunk_size() == 4096 );
+        CHECK( journal.finished() == 1 );
+        CHECK( journal.done( 1 ) );
+        CHECK( !journal.started( 1 ) );
+        CHECK( !journal.done( 2 ) );
+        CHECK( journal.started( 2 ) );
+        CHECK( journal.chunk_done( 2, 0 ) );
+        CHECK( !journal.chunk_done( 2, 1 ) );
+        CHECK( journal.chunk_done( 2, 3 ) );
+        CHECK( !journal.started( 3 ) && !journal.done( 3 ) );
+        CHECK( journal.started( 4 ) );
+        CHECK( !journal.chunk_done( 4, 0 ) );
+
+        // records appended after opening are not reflected
+        CHECK( journal.finish( 2 ) == 0 );
+        CHECK( !journal.done( 2 ) );
+    }
+
+    void test_torn_record() {
+        unlink( journal_path.c_str() );
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == 0 );
+            CHECK( journal.start( 1 ) == 0 );
+            CHECK( journal.finish( 1 ) == 0 );
+            CHECK( journal.start( 2 ) == 0 );
+            CHECK( journal.finish( 2 ) == 0 );
+        }
+
+        // a partly written last record, and a damaged one before it
+        std::string text = read_file();
+        text[ 32 + 3 * 16 + 1 ] ^= 0x40;
+        write_file( text + std::string( 7, '\x11' ) );
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == 0 );
+            CHECK( journal.done( 1 ) );
+            CHECK( journal.started( 2 ) );
+            CHECK( !journal.done( 2 ) );
+        }
+        CHECK( file_size() == 32 + 3 * 16 );
+    }
+
+    void test_wrong_file() {
+        unlink( journal_path.c_str() );
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == 0 );
+        }
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 8, 4096 ) == USER_INPUT_OPTION_ERR );
+        }
+
+        // files that are not journals are left alone, whatever their size
+        std::string text( 100, 'x' );
+        write_file( text );
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == USER_INPUT_OPTION_ERR );
+        }
+        CHECK( read_file() == text );
+
+        write_file( "short" );
+        {
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == USER_INPUT_OPTION_ERR );
+        }
+        CHECK( read_file() == "short" );
+    }
+
+    void test_new_file() {
+        // an empty file, or one with a header torn while it was written
+        const char* starts[] = { "", "ICJ", "ICJOURNL\x07" };
+        for ( size_t i = 0; i < sizeof( starts ) / sizeof( starts[ 0 ] ); ++i ) {
+            write_file( starts[ i ] );
+            transfer_journal journal;
+            CHECK( journal.open( journal_path, 7, 4096 ) == 0 );
+            CHECK( journal.finished() == 0 );
+            CHECK( journal.start( 1 ) == 0 );
+            CHECK( journal.close() == 0 );
+            CHECK( file_size() == 32 + 16 );
+        }
+    }
+
+    void test_remove() {
+        unlink( journal_path.c_str() );
+        transfer_journal journal;
+        CHECK( journal.open( journal_path, 7, 4096 ) == 0 );
+        CHECK( journal.remove() == 0 );
+        CHECK( file_size() == -1 );
+    }
+
+}
+
+int main() {
+    const char* tmp = getenv( "TMPDIR" );
+    char path[ 4096 ];
+    snprintf( path, sizeof( path ), "%s/test_transfer_journal.XXXXXX", tmp != NULL ? tmp : "/tmp" );
+    int fd = mkstemp( path );
+    if ( fd < 0 ) {
+        perror( path );
+        return 1;
+    }
+    close( fd );
+    journal_path = path;
+
+    test_hash();
+    test_replay();
+    test_torn_record();
+    test_wrong_file();
+    test_new_file();
+    test_remove();
+
+    unlink( journal_path.c_str() );
+    return unit_test::result();
+}
@@ -0,0 +1,192 @@
+#include "ustar.hpp"
+#include "unit_test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace icommands;
+
+namespace {
+
+    struct member {
+        ustar::entry entry;
+        std::string  data;
+        bool         ended;
+    };
+
+    // read _archive, fed in pieces of _piece bytes
+    int read_archive( const std::string& _archive, size_t _piece,
+                      std::vector< member >& _members, bool& _done ) {
+        ustar::reader reader(
+            [&]( const ustar::entry& _entry ) {
+                member m;
+                m.entry = _entry;
+                m.ended = false;
+                _members.push_back( m );
+                return 0;
+            },
+            [&]( const char* _buf, size_t _len ) {
+                _members.back().data.append( _buf, _len );
+                return 0;
+            },
+            [&]() {
+                _members.back().ended = true;
+                return 0;
+            } );
+        for ( size_t pos = 0; pos < _archive.size(); pos += _piece ) {
+            int status = reader.feed( _archive.data() + pos, std::min( _piece, _archive.size() - pos ) );
+            if ( status != 0 ) {
+                return status;
+            }
+        }
+        _done = reader.done();
+        return 0;
+    }
+
+    void append_file( const std::string& _name, const std::string& _data, std::string& _out ) {
+        CHECK( ustar::write_header( _name, _data.size(), 0644, 1500000000, ustar::REGULAR, _out ) );
+        _out += _data;
+        _out.append( ustar::padding( _data.size() ), '\0' );
+    }
+
+    void test_padding() {
+        CHECK( ustar::padding( 0 ) == 0 );
+        CHECK( ustar::padding( 1 ) == 511 );
+        CHECK( ustar::padding( 512 ) == 0 );
+        CHECK( ustar::padding( 513 ) == 511 );
+    }
+
+    void test_header() {
+        std::string out;
+        CHECK( ustar::write_header( "dir/file", 1234, 0100644, 1500000000, ustar::REGULAR, out ) );
+        CHECK( out.size() == ustar::BLOCK );
+        CHECK( out.compare( 0, 9, std::string( "dir/file\0", 9 ) ) == 0 );
+        CHECK( out.compare( 100, 8, std::string( "0000644\0", 8 ) ) == 0 );
+        CHECK( out.compare( 124, 12, std::string( "00000002322\0", 12 ) ) == 0 );
+        CHECK( out[ 156 ] == ustar::REGULAR );
+        CHECK( out.compare( 257, 6, std::string( "ustar\0", 6 ) ) == 0 );
+
+        // the checksum is the sum of the header bytes with its own field
+        // taken as blanks
+        unsigned int sum = 0;
+        for ( size_t i = 0; i < ustar::BLOCK; ++i ) {
+            sum += i >= 148 && i < 156 ? ' ' : static_cast< unsigned char >( out[ i ] );
+        }
+        CHECK( strtoul( out.substr( 148, 6 ).c_str(), NULL, 8 ) == sum );
+    }
+
+    void test_long_names() {
+        std::string out;
+        std::string dir( 120, 'd' );
+        CHECK( ustar::write_header( dir + "/name", 0, 0644, 0, ustar::REGULAR, out ) );
+        CHECK( out.compare( 0, 5, std::string( "name\0", 5 ) ) == 0 );
+        CHECK( out.compare( 345, dir.size(), dir ) == 0 );
+
+        // no / to split at, or a prefix too long for its field
+        out.clear();
+        CHECK( !ustar::write_header( std::string( 101, 'n' ), 0, 0644, 0, ustar::REGULAR, out ) );
+        CHECK( !ustar::write_header( std::string( 156, 'd' ) + "/name", 0, 0644, 0, ustar::REGULAR, out ) );
+        CHECK( out.empty() );
+    }
+
+    void test_round_trip() {
+        std::string archive;
+        CHECK( ustar::write_header( "dir", 0, 0755, 1500000000, ustar::DIRECTORY, archive ) );
+        append_file( "dir/empty", "", archive );
+        append_file( "dir/small", "hello", archive );
+        append_file( "dir/" + std::string( 150, 'x' ) + "/long", std::string( 1000, 'a' ), archive );
+        ustar::write_end( archive );
+
+        size_t pieces[] = { 1, 7, 512, 100000 };
+        for ( size_t p = 0; p < sizeof( pieces ) / sizeof( pieces[ 0 ] ); ++p ) {
+            std::vector< member > members;
+            bool done = false;
+            CHECK( read_archive( archive, pieces[ p ], members, done ) == 0 );
+            CHECK( done );
+            CHECK( members.size() == 4 );
+            if ( members.size() != 4 ) {
+                continue;
+            }
+            CHECK( members[ 0 ].entry.name == "dir" );
+            CHECK( members[ 0 ].entry.type == ustar::DIRECTORY );
+            CHECK( members[ 1 ].entry.name == "dir/empty" );
+            CHECK( members[ 1 ].data.empty() && members[ 1 ].ended );
+            CHECK( members[ 2 ].entry.name == "dir/small" );
+            CHECK( members[ 2 ].entry.size == 5 );
+            CHECK( members[ 2 ].entry.mode == 0644 );
+            CHECK( members[ 2 ].entry.mtime == 1500000000 );
+            CHECK( members[ 2 ].data == "hello" && members[ 2 ].ended );
+            CHECK( members[ 3 ].entry.name == "dir/" + std::string( 150, 'x' ) + "/long" );
+            CHECK( members[ 3 ].data == std::string( 1000, 'a' ) );
+        }
+    }
+
+    void test_gnu_long_name() {
+        std::string name( 300, 'g' );
+        std::string archive;
+        CHECK( ustar::write_header( "././@LongLink", name.size() + 1, 0, 0, 'L', archive ) );
+        archive += name;
+        archive += '\0';
+        archive.append( ustar::padding( name.size() + 1 ), '\0' );
+        append_file( "truncated", "x", archive );
+        ustar::write_end( archive );
+
+        std::vector< member > members;
+        bool done = false;
+        CHECK( read_archive( archive, 512, members, done ) == 0 );
+        CHECK( members.size() == 1 );
+        CHECK( !members.empty() && members[ 0 ].entry.name == name );
+    }
+
+    void test_pax_path() {
+        std::string record = "path=pax/named/file\n";
+        // the length counts itself
+        std::string pax = std::to_string( record.size() + 3 ) + " " + record;
+        std::string archive;
+        CHECK( ustar::write_header( "PaxHeader", pax.size(), 0, 0, 'x', archive ) );
+        archive += pax;
+        archive.append( ustar::padding( pax.size() ), '\0' );
+        append_file( "short", "y", archive );
+        ustar::write_end( archive );
+
+        std::vector< member > members;
+        bool done = false;
+        CHECK( read_archive( archive, 64, members, done ) == 0 );
+        CHECK( members.size() == 1 );
+        CHECK( !members.empty() && members[ 0 ].entry.name == "pax/named/file" );
+    }
+
+    void test_stop() {
+        std::string archive;
+        append_file( "a", "1", archive );
+        append_file( "b", "2", archive );
+        ustar::write_end( archive );
+
+        int begun = 0;
+        ustar::reader reader(
+            [&]( const ustar::entry& ) {
+                return ++begun == 2 ? -1 : 0;
+            },
+            []( const char*, size_t ) {
+                return 0;
+            },
+            []() {
+                return 0;
+            } );
+        CHECK( reader.feed( archive.data(), archive.size() ) == -1 );
+        CHECK( begun == 2 );
+        CHECK( !reader.done() );
+    }
+
+}
+
+int main() {
+    test_padding();
+    test_header();
+    test_long_names();
+    test_round_trip();
+    test_gnu_long_name();
+    test_pax_path();
+    test_stop();
+    return unit_test::result();
+}
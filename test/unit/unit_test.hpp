@@ -0,0 +1,35 @@
+#ifndef ICOMMANDS_UNIT_TEST_HPP
+#define ICOMMANDS_UNIT_TEST_HPP
+
+#include <cstdio>
+
+namespace unit_test {
+
+    // =-=-=-=-=-=-=-
+    // the number of checks that have failed so far
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    inline void check( bool _ok, const char* _text, const char* _file, int _line ) {
+        if ( !_ok ) {
+            fprintf( stderr, "%s:%d: check failed: %s\n", _file, _line, _text );
+            ++failures();
+        }
+    }
+
+    // the exit status of a test program
+    inline int result() {
+        if ( failures() > 0 ) {
+            fprintf( stderr, "%d check(s) failed\n", failures() );
+            return 1;
+        }
+        return 0;
+    }
+
+}; // namespace unit_test
+
+#define CHECK( _cond ) unit_test::check( ( _cond ), #_cond, __FILE__, __LINE__ )
+
+#endif // ICOMMANDS_UNIT_TEST_HPP